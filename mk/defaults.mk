@@ -143,6 +143,7 @@ RT_REDUCE_NATIVE ?= 0
 KEEP_INLINE ?= 0
 NO_EVENTFD ?= 0
 NO_EPOLL ?= 0
+NO_IO_URING ?= 0
 UNIT_TEST_FILTER ?= *
 PACKAGE_FOR_SUSE_10 ?= 0
 NO_COMPILE_JS ?= 0
@@ -18,6 +18,7 @@
 #include "arch/runtime/runtime.hpp"
 #include "arch/io/disk/filestat.hpp"
 #include "arch/io/disk/pool.hpp"
+#include "arch/io/disk/uring.hpp"
 #include "arch/io/disk/conflict_resolving.hpp"
 #include "arch/io/disk/stats.hpp"
 #include "arch/io/disk/accounting.hpp"
@@ -46,12 +47,12 @@ public:
     linux_disk_manager_t(linux_event_queue_t *queue,
                          int batch_factor,
                          int max_concurrent_io_requests,
+                         io_backend_t io_backend,
                          perfmon_collection_t *stats) :
         stack_stats(stats, "stack"),
         conflict_resolver(stats),
         accounter(batch_factor),
         backend_stats(stats, "backend", accounter.producer),
-        backend(queue, backend_stats.producer, max_concurrent_io_requests),
         outstanding_txn(0)
     {
         /* Hook up the `submit_fun`s of the parts of the IO stack that are above the
@@ -63,12 +64,39 @@ public:
                                                  &accounter, ph::_1);
 
         /* Hook up everything's `done_fun`. */
-        backend.done_fun = std::bind(&stats_diskmgr_2_t::done, &backend_stats, ph::_1);
         backend_stats.done_fun = std::bind(&accounting_diskmgr_t::done, &accounter, ph::_1);
         accounter.done_fun = std::bind(&conflict_resolving_diskmgr_t::done,
                                        &conflict_resolver, ph::_1);
         conflict_resolver.done_fun = std::bind(&stats_diskmgr_t::done, &stack_stats, ph::_1);
         stack_stats.done_fun = std::bind(&linux_disk_manager_t::done, this, ph::_1);
+
+        /* Set up the backend last, since it might start popping actions right away. */
+        if (io_backend != io_backend_t::pool) {
+#if USE_IO_URING
+            if (uring_diskmgr_t::is_supported()) {
+                uring_backend.init(new uring_diskmgr_t(
+                    queue, backend_stats.producer, max_concurrent_io_requests,
+                    io_backend == io_backend_t::uring_registered));
+                uring_backend->done_fun = std::bind(&stats_diskmgr_2_t::done,
+                                                    &backend_stats, ph::_1);
+            } else {
+                logWRN("The kernel doesn't support io_uring. Falling back to the "
+                       "thread pool I/O backend.");
+            }
+#else
+            logWRN("This build doesn't support io_uring. Falling back to the "
+                   "thread pool I/O backend.");
+#endif  // USE_IO_URING
+        }
+#if USE_IO_URING
+        if (!uring_backend.has())
+#endif
+        {
+            pool_backend.init(new pool_diskmgr_t(queue, backend_stats.producer,
+                                                 max_concurrent_io_requests));
+            pool_backend->done_fun = std::bind(&stats_diskmgr_2_t::done,
+                                               &backend_stats, ph::_1);
+        }
     }
 
     ~linux_disk_manager_t() {
@@ -88,6 +116,17 @@ public:
         }, home_thread());
     }
 
+    /* May be called on any thread. */
+    void forget_fd(fd_t fd) {
+#if USE_IO_URING
+        if (uring_backend.has()) {
+            uring_backend->forget_fd(fd);
+        }
+#else
+        (void)fd;
+#endif
+    }
+
     void submit_action_to_stack_stats(action_t *a) {
         assert_thread();
         outstanding_txn++;
@@ -176,7 +215,8 @@ private:
     holding back operations that must be run after other, currently-running, operations.
     Then it goes to the account manager, which queues up running IO operations according
     to which account they are part of. Finally the "backend" pops the IO operations
-    from the queue.
+    from the queue. The backend is either a `pool_diskmgr_t` or, if selected and
+    supported by the kernel, a `uring_diskmgr_t`.
 
     At two points in the process--once as soon as it is submitted, and again right
     as the backend pops it off the queue--its statistics are recorded. The "stack stats"
@@ -189,7 +229,10 @@ private:
     conflict_resolving_diskmgr_t conflict_resolver;
     accounting_diskmgr_t accounter;
     stats_diskmgr_2_t backend_stats;
-    pool_diskmgr_t backend;
+    scoped_ptr_t<pool_diskmgr_t> pool_backend;
+#if USE_IO_URING
+    scoped_ptr_t<uring_diskmgr_t> uring_backend;
+#endif
 
 
     intptr_t outstanding_txn;
@@ -198,11 +241,13 @@ private:
 };
 
 io_backender_t::io_backender_t(file_direct_io_mode_t _direct_io_mode,
-                               int max_concurrent_io_requests)
+                               int max_concurrent_io_requests,
+                               io_backend_t io_backend)
     : direct_io_mode(_direct_io_mode),
       diskmgr(new linux_disk_manager_t(&linux_thread_pool_t::get_thread()->queue,
                                        DEFAULT_IO_BATCH_FACTOR,
                                        max_concurrent_io_requests,
+                                       io_backend,
                                        &stats)) { }
 
 io_backender_t::~io_backender_t() { }
@@ -366,6 +411,11 @@ void linux_file_t::destroy_account(void *account) {
 
 
 linux_file_t::~linux_file_t() {
+    // The disk manager might have registered the descriptor (see `uring_diskmgr_t`),
+    // and must forget about it before it can get reused.
+    if (diskmgr != NULL) {
+        diskmgr->forget_fd(fd.get());
+    }
     // scoped_fd_t's destructor takes care of close()ing the file
 }
 
@@ -28,8 +28,11 @@ public:
     // This takes what is effectively a global flag whether to use O_DIRECT here.  Nothing technical
     // stops us from specifying this on a file-by-file basis, but right now there's no desire for
     // that.  See https://github.com/rethinkdb/rethinkdb/issues/97#issuecomment-19778177 .
+    // `io_backend` selects how the I/O gets done. If the io_uring backend is requested
+    // but not available, it falls back to `io_backend_t::pool`.
     io_backender_t(file_direct_io_mode_t direct_io_mode,
-                   int max_concurrent_io_requests = DEFAULT_MAX_CONCURRENT_IO_REQUESTS);
+                   int max_concurrent_io_requests = DEFAULT_MAX_CONCURRENT_IO_REQUESTS,
+                   io_backend_t io_backend = io_backend_t::pool);
     ~io_backender_t();
     linux_disk_manager_t *get_diskmgr_ptr() { return diskmgr.get(); }
     file_direct_io_mode_t get_direct_io_mode() const;
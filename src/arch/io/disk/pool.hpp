@@ -97,6 +97,7 @@ struct pool_diskmgr_action_t
 
 private:
     friend class pool_diskmgr_t;
+    friend class uring_diskmgr_t;
     pool_diskmgr_t *parent;
 
     enum action_type_t {ACTION_READ, ACTION_WRITE, ACTION_RESIZE};
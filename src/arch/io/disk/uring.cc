@@ -0,0 +1,483 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "arch/io/disk/uring.hpp"
+
+#if USE_IO_URING
+
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "arch/io/disk.hpp"
+#include "config/args.hpp"
+#include "logger.hpp"
+
+/* glibc doesn't provide wrappers for the io_uring system calls. */
+
+int sys_io_uring_setup(unsigned entries, io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int sys_io_uring_enter(fd_t ring_fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+int sys_io_uring_register(fd_t ring_fd, unsigned opcode, const void *arg,
+                          unsigned nr_args) {
+    return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+/* The head and tail indices of the rings are shared with the kernel. We use full
+barriers rather than the C++11 atomics because these are plain `unsigned`s in memory
+that the kernel mapped for us. */
+
+unsigned uring_load_acquire(const unsigned *p) {
+    const unsigned value = *static_cast<const volatile unsigned *>(p);
+    __sync_synchronize();
+    return value;
+}
+
+void uring_store_release(unsigned *p, unsigned value) {
+    __sync_synchronize();
+    *static_cast<volatile unsigned *>(p) = value;
+}
+
+unsigned uring_ring_entries(int max_concurrent_io_requests) {
+    guarantee(max_concurrent_io_requests > 0);
+    guarantee(max_concurrent_io_requests < MAXIMUM_MAX_CONCURRENT_IO_REQUESTS);
+    // The kernel requires a power of two, and refuses rings with more than 32768
+    // entries. We don't need anywhere near that many.
+    unsigned entries = 8;
+    while (entries < static_cast<unsigned>(max_concurrent_io_requests)
+           && entries < 4096) {
+        entries *= 2;
+    }
+    return entries;
+}
+
+bool uring_diskmgr_t::is_supported() {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int res = sys_io_uring_setup(2, &params);
+    if (res == -1) {
+        return false;
+    }
+    scoped_fd_t closer(res);
+    return true;
+}
+
+uring_diskmgr_t::uring_diskmgr_t(linux_event_queue_t *_queue,
+                                 passive_producer_t<action_t *> *_source,
+                                 int max_concurrent_io_requests,
+                                 bool use_registered_resources)
+    : use_fixed_files(use_registered_resources),
+      use_registered_buffers(use_registered_resources),
+      enter_fun(&sys_io_uring_enter),
+      source(_source),
+      queue(_queue),
+      sq_ring_ptr(MAP_FAILED),
+      sq_ring_size(0),
+      cq_ring_ptr(MAP_FAILED),
+      cq_ring_size(0),
+      sqes(NULL),
+      sqes_size(0),
+      unsubmitted_sqes(0),
+      submit_retry_timer(NULL),
+      fallback(_queue, &fallback_queue, URING_FALLBACK_IO_THREADS) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int res = sys_io_uring_setup(uring_ring_entries(max_concurrent_io_requests),
+                                 &params);
+    guarantee_err(res != -1, "Could not set up an io_uring");
+    ring_fd.reset(res);
+
+    // Map the submission and completion rings, and the array of SQEs.
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    sq_ring_ptr = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd.get(), IORING_OFF_SQ_RING);
+    guarantee_err(sq_ring_ptr != MAP_FAILED, "Could not map io_uring submission ring");
+    if (single_mmap) {
+        cq_ring_ptr = sq_ring_ptr;
+    } else {
+        cq_ring_ptr = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring_fd.get(),
+                           IORING_OFF_CQ_RING);
+        guarantee_err(cq_ring_ptr != MAP_FAILED,
+                      "Could not map io_uring completion ring");
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes_ptr = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd.get(), IORING_OFF_SQES);
+    guarantee_err(sqes_ptr != MAP_FAILED, "Could not map io_uring SQEs");
+    sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+
+    char *sq = static_cast<char *>(sq_ring_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_ring_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ring_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_ring_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    // Every request has at most one SQE in the ring at any time, so limiting the
+    // number of requests to the size of the submission ring makes sure that neither
+    // ring can overflow (the completion ring is twice as large).
+    requests.init(params.sq_entries);
+    for (size_t i = 0; i < requests.size(); ++i) {
+        requests[i].action = NULL;
+        requests[i].registered_buffer = -1;
+        free_requests.push_back(requests.size() - 1 - i);
+    }
+
+    // Have the kernel ping our eventfd whenever a completion is posted.
+    fd_t event_fd = completion_event.get_notify_fd();
+    res = sys_io_uring_register(ring_fd.get(), IORING_REGISTER_EVENTFD, &event_fd, 1);
+    guarantee_err(res == 0, "Could not register eventfd with io_uring");
+
+    if (use_fixed_files) {
+        // Register a sparse file table. Files get put into it on first use.
+        std::vector<fd_t> fds(URING_FIXED_FILE_SLOTS, INVALID_FD);
+        res = sys_io_uring_register(ring_fd.get(), IORING_REGISTER_FILES,
+                                    fds.data(), fds.size());
+        if (res == 0) {
+            for (int i = URING_FIXED_FILE_SLOTS - 1; i >= 0; --i) {
+                free_fixed_file_slots.push_back(i);
+            }
+        } else {
+            logWRN("Could not register a file table with io_uring (%s). "
+                   "Continuing without fixed files.",
+                   errno_string(get_errno()).c_str());
+            use_fixed_files = false;
+        }
+    }
+
+    if (use_registered_buffers) {
+        registered_buffer_arena.init(
+            malloc_aligned(URING_REGISTERED_BUFFER_SIZE * URING_REGISTERED_BUFFER_COUNT,
+                           DEVICE_BLOCK_SIZE));
+        std::vector<iovec> buffers(URING_REGISTERED_BUFFER_COUNT);
+        for (int i = 0; i < URING_REGISTERED_BUFFER_COUNT; ++i) {
+            buffers[i].iov_base = get_registered_buffer(i);
+            buffers[i].iov_len = URING_REGISTERED_BUFFER_SIZE;
+        }
+        res = sys_io_uring_register(ring_fd.get(), IORING_REGISTER_BUFFERS,
+                                    buffers.data(), buffers.size());
+        if (res == 0) {
+            for (int i = URING_REGISTERED_BUFFER_COUNT - 1; i >= 0; --i) {
+                free_registered_buffers.push_back(i);
+            }
+        } else {
+            // This usually means that RLIMIT_MEMLOCK is too low.
+            logWRN("Could not register buffers with io_uring (%s). "
+                   "Continuing without registered buffers.",
+                   errno_string(get_errno()).c_str());
+            use_registered_buffers = false;
+            registered_buffer_arena.reset();
+        }
+    }
+
+    fallback.done_fun = [this](action_t *a) { done_fun(a); };
+
+    queue->watch_resource(completion_event.get_notify_fd(), poll_event_in, this);
+
+    if (source->available->get()) { pump(); }
+    source->available->set_callback(this);
+}
+
+uring_diskmgr_t::~uring_diskmgr_t() {
+    assert_thread();
+    source->available->unset_callback();
+    queue->forget_resource(completion_event.get_notify_fd(), this);
+    if (submit_retry_timer != NULL) {
+        cancel_timer(submit_retry_timer);
+    }
+
+    rassert(free_requests.size() == requests.size(),
+            "Destroying the io_uring disk manager with outstanding requests");
+
+    munmap(sqes, sqes_size);
+    if (cq_ring_ptr != sq_ring_ptr) {
+        munmap(cq_ring_ptr, cq_ring_size);
+    }
+    munmap(sq_ring_ptr, sq_ring_size);
+    // `ring_fd`'s destructor closes the ring.
+}
+
+void uring_diskmgr_t::forget_fd(fd_t fd) {
+    if (!use_fixed_files) {
+        return;
+    }
+    system_mutex_t::lock_t lock(&fixed_files_mutex);
+    auto it = fixed_file_slots.find(fd);
+    if (it == fixed_file_slots.end()) {
+        return;
+    }
+    fd_t invalid_fd = INVALID_FD;
+    io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = it->second;
+    update.fds = reinterpret_cast<uint64_t>(&invalid_fd);
+    int res = sys_io_uring_register(ring_fd.get(), IORING_REGISTER_FILES_UPDATE,
+                                    &update, 1);
+    // If we can't drop the registration, a new file with the same descriptor
+    // number could end up reading or writing the old file. We can't allow that.
+    guarantee_err(res == 1, "Could not unregister a file from io_uring");
+    free_fixed_file_slots.push_back(it->second);
+    fixed_file_slots.erase(it);
+}
+
+int uring_diskmgr_t::get_fixed_file_slot(fd_t fd) {
+    if (!use_fixed_files) {
+        return -1;
+    }
+    system_mutex_t::lock_t lock(&fixed_files_mutex);
+    auto it = fixed_file_slots.find(fd);
+    if (it != fixed_file_slots.end()) {
+        return it->second;
+    }
+    if (free_fixed_file_slots.empty()) {
+        return -1;
+    }
+    const int slot = free_fixed_file_slots.back();
+    io_uring_files_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.fds = reinterpret_cast<uint64_t>(&fd);
+    int res = sys_io_uring_register(ring_fd.get(), IORING_REGISTER_FILES_UPDATE,
+                                    &update, 1);
+    if (res != 1) {
+        // Older kernels can't update the file table. Just use the descriptor.
+        return -1;
+    }
+    free_fixed_file_slots.pop_back();
+    fixed_file_slots.insert(std::make_pair(fd, slot));
+    return slot;
+}
+
+char *uring_diskmgr_t::get_registered_buffer(int index) {
+    rassert(index >= 0 && index < URING_REGISTERED_BUFFER_COUNT);
+    return registered_buffer_arena.get() + index * URING_REGISTERED_BUFFER_SIZE;
+}
+
+int uring_diskmgr_t::acquire_registered_buffer(size_t count) {
+    if (!use_registered_buffers
+        || count > static_cast<size_t>(URING_REGISTERED_BUFFER_SIZE)
+        || free_registered_buffers.empty()) {
+        return -1;
+    }
+    const int index = free_registered_buffers.back();
+    free_registered_buffers.pop_back();
+    return index;
+}
+
+void uring_diskmgr_t::on_source_availability_changed() {
+    assert_thread();
+    if (source->available->get()) pump();
+}
+
+void uring_diskmgr_t::on_event(DEBUG_VAR int events) {
+    assert_thread();
+    rassert(events == poll_event_in);
+    completion_event.consume_wakey_wakeys();
+    reap_completions();
+    // Requests that were only partially done have been put back into the
+    // submission ring by `reap_completions()`, and we might have room for new
+    // requests now.
+    pump();
+}
+
+void uring_diskmgr_t::on_timer() {
+    assert_thread();
+    submit_retry_timer = NULL;
+    submit_pending_sqes();
+}
+
+void uring_diskmgr_t::pump() {
+    assert_thread();
+    while (source->available->get() && !free_requests.empty()) {
+        action_t *a = source->pop();
+        if (a->get_is_resize() || a->wrap_in_datasyncs) {
+            fallback_queue.push(a);
+            continue;
+        }
+
+        const size_t index = free_requests.back();
+        free_requests.pop_back();
+        request_t *r = &requests[index];
+        r->action = a;
+        a->copy_vectors(&r->vecs);
+        r->remaining_vecs = r->vecs.data();
+        r->remaining_vecs_len = r->vecs.size();
+        r->bytes_done = 0;
+        r->total_bytes = a->get_count();
+        r->registered_buffer = -1;
+        if (r->vecs.size() == 1) {
+            r->registered_buffer = acquire_registered_buffer(r->total_bytes);
+            if (r->registered_buffer != -1 && a->get_is_write()) {
+                memcpy(get_registered_buffer(r->registered_buffer),
+                       r->vecs[0].iov_base, r->total_bytes);
+            }
+        }
+        prepare_sqe(index);
+    }
+    submit_pending_sqes();
+}
+
+void uring_diskmgr_t::prepare_sqe(size_t index) {
+    request_t *r = &requests[index];
+    action_t *a = r->action;
+    rassert(a != NULL);
+
+    // We are the only producer, so nobody else modifies the tail.
+    const unsigned tail = *sq_tail;
+    rassert(tail - uring_load_acquire(sq_head) <= sq_ring_mask);
+    const unsigned sqe_index = tail & sq_ring_mask;
+    io_uring_sqe *sqe = &sqes[sqe_index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    const int slot = get_fixed_file_slot(a->fd);
+    if (slot != -1) {
+        sqe->fd = slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = a->fd;
+    }
+    sqe->off = a->offset + r->bytes_done;
+    sqe->user_data = index;
+
+    if (r->registered_buffer != -1) {
+        sqe->opcode = a->get_is_read() ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->addr = reinterpret_cast<uint64_t>(
+            get_registered_buffer(r->registered_buffer) + r->bytes_done);
+        sqe->len = r->total_bytes - r->bytes_done;
+        sqe->buf_index = r->registered_buffer;
+    } else {
+        sqe->opcode = a->get_is_read() ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->addr = reinterpret_cast<uint64_t>(r->remaining_vecs);
+        sqe->len = std::min<size_t>(r->remaining_vecs_len, IOV_MAX);
+    }
+
+    sq_array[sqe_index] = sqe_index;
+    uring_store_release(sq_tail, tail + 1);
+    ++unsubmitted_sqes;
+}
+
+void uring_diskmgr_t::submit_pending_sqes() {
+    while (unsubmitted_sqes > 0) {
+        int res = enter_fun(ring_fd.get(), unsubmitted_sqes, 0, 0);
+        if (res == -1) {
+            const int errsv = get_errno();
+            if (errsv == EINTR) {
+                continue;
+            }
+            if (errsv == EAGAIN || errsv == EBUSY) {
+                // The kernel is temporarily short on resources. The SQEs stay in
+                // the ring and we try again when the next completion comes in. If
+                // nothing is in flight, no completion is going to come in, so we
+                // retry from a timer instead.
+                const size_t in_flight =
+                    requests.size() - free_requests.size() - unsubmitted_sqes;
+                if (in_flight == 0 && submit_retry_timer == NULL) {
+                    submit_retry_timer = fire_timer_once(URING_SUBMIT_RETRY_MS, this);
+                }
+                return;
+            }
+            crash("io_uring_enter failed: %s", errno_string(errsv).c_str());
+        }
+        unsubmitted_sqes -= res;
+    }
+}
+
+void uring_diskmgr_t::reap_completions() {
+    // Copy the completions out first and release their ring slots. Handling a
+    // completion can call back into `pump()` through `done_fun`.
+    std::vector<std::pair<size_t, int32_t> > completions;
+    unsigned head = *cq_head;
+    const unsigned tail = uring_load_acquire(cq_tail);
+    while (head != tail) {
+        const io_uring_cqe *cqe = &cqes[head & cq_ring_mask];
+        completions.push_back(std::make_pair(static_cast<size_t>(cqe->user_data),
+                                             cqe->res));
+        ++head;
+    }
+    uring_store_release(cq_head, head);
+
+    for (auto it = completions.begin(); it != completions.end(); ++it) {
+        handle_completion(it->first, it->second);
+    }
+}
+
+void uring_diskmgr_t::handle_completion(size_t index, int32_t res) {
+    request_t *r = &requests[index];
+    action_t *a = r->action;
+    rassert(a != NULL);
+
+    if (res == -EINTR || res == -EAGAIN) {
+        prepare_sqe(index);
+        return;
+    }
+    if (res < 0) {
+        finish_request(index, res);
+        return;
+    }
+    if (res == 0) {
+        if (a->get_is_write()) {
+            // See the comment in `pool_diskmgr_t::action_t::perform_read_write()`.
+            logERR("Failed I/O: vectored write of %" PRIi64 " bytes stopped after "
+                   "%" PRIi64 " bytes. Assuming we ran out of disk space.",
+                   r->total_bytes, r->bytes_done);
+            finish_request(index, -ENOSPC);
+        } else {
+            // We never read past the end of the file, so this shouldn't happen.
+            finish_request(index, -EIO);
+        }
+        return;
+    }
+
+    r->bytes_done += res;
+    if (r->bytes_done < r->total_bytes) {
+        // A short transfer. Submit the rest of the request.
+        if (r->registered_buffer == -1) {
+            action_t::advance_vector(&r->remaining_vecs, &r->remaining_vecs_len, res);
+        }
+        prepare_sqe(index);
+        return;
+    }
+
+    if (r->registered_buffer != -1 && a->get_is_read()) {
+        memcpy(r->vecs[0].iov_base, get_registered_buffer(r->registered_buffer),
+               r->total_bytes);
+    }
+    finish_request(index, r->total_bytes);
+}
+
+void uring_diskmgr_t::finish_request(size_t index, int64_t io_result) {
+    request_t *r = &requests[index];
+    action_t *a = r->action;
+    if (r->registered_buffer != -1) {
+        free_registered_buffers.push_back(r->registered_buffer);
+        r->registered_buffer = -1;
+    }
+    r->action = NULL;
+    r->vecs.reset();
+    free_requests.push_back(index);
+
+    a->io_result = io_result;
+    done_fun(a);
+}
+
+#endif  // USE_IO_URING
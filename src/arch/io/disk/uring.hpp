@@ -0,0 +1,175 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef ARCH_IO_DISK_URING_HPP_
+#define ARCH_IO_DISK_URING_HPP_
+
+#if defined(__linux) && !defined(NO_EVENTFD) && !defined(NO_IO_URING) \
+    && !defined(LEGACY_LINUX)
+#define USE_IO_URING 1
+#else
+#define USE_IO_URING 0
+#endif
+
+#if USE_IO_URING
+
+#include <sys/uio.h>
+
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "arch/io/disk/pool.hpp"
+#include "arch/io/concurrency.hpp"
+#include "arch/io/io_utils.hpp"
+#include "arch/timer.hpp"
+#include "arch/runtime/event_queue.hpp"
+#include "arch/runtime/system_event.hpp"
+#include "concurrency/queue/passive_producer.hpp"
+#include "concurrency/queue/unlimited_fifo.hpp"
+#include "containers/scoped.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace unittest { void run_uring_submit_retry_test(); }
+
+/* The io_uring disk manager submits reads and writes to the kernel through an
+io_uring submission queue, directly from the event loop thread. The kernel signals
+completions through an eventfd which is watched by the thread's
+`linux_event_queue_t`, so no helper threads and no extra context switches are involved
+in the common case.
+
+It consumes the same `pool_diskmgr_t::action_t` objects as `pool_diskmgr_t`, so it
+can be plugged in below `stats_diskmgr_2_t` without any change to the rest of the IO
+stack. Operations that io_uring cannot express well (resizes, and writes that have
+to be wrapped in datasyncs) are handed to a small internal `pool_diskmgr_t`.
+
+If `use_registered_resources` is set, files are registered with the ring on first
+use ("fixed files"), and a small arena of registered bounce buffers is used for
+single-buffer requests up to `URING_REGISTERED_BUFFER_SIZE` bytes. That saves the
+kernel from pinning user pages and looking up the file on every request, at the
+price of a memcpy per block. */
+
+class uring_diskmgr_t : private availability_callback_t,
+                        private linux_event_callback_t,
+                        private timer_callback_t,
+                        public home_thread_mixin_debug_only_t {
+public:
+    typedef pool_diskmgr_t::action_t action_t;
+
+    /* The `uring_diskmgr_t` will draw actions to run from `source`. It will call
+    `done_fun` on each one when it's done. Crashes if the io_uring could not be set
+    up, so check `is_supported()` first. */
+    uring_diskmgr_t(linux_event_queue_t *queue, passive_producer_t<action_t *> *source,
+                    int max_concurrent_io_requests, bool use_registered_resources);
+    std::function<void(action_t *)> done_fun;
+    ~uring_diskmgr_t();
+
+    /* Returns true if the running kernel lets us create an io_uring. */
+    static bool is_supported();
+
+    /* Must be called (from any thread) before `fd` is closed if it has ever been
+    used with this disk manager. Drops the fixed-file registration of `fd`, so that
+    a different file that later gets the same descriptor number is not confused with
+    the old one. */
+    void forget_fd(fd_t fd);
+
+private:
+    friend void unittest::run_uring_submit_retry_test();
+
+    struct request_t {
+        action_t *action;
+        // A working copy of the action's buffers that gets advanced on short
+        // transfers.
+        scoped_array_t<iovec> vecs;
+        iovec *remaining_vecs;
+        size_t remaining_vecs_len;
+        int64_t bytes_done;
+        int64_t total_bytes;
+        // Index of the registered bounce buffer that is used for this request, or
+        // -1 if the request goes directly to the action's own buffers.
+        int registered_buffer;
+    };
+
+    void on_source_availability_changed();
+    void on_event(int events);
+    void on_timer();
+
+    void pump();
+    // Fills in an SQE for the remaining part of `requests[index]`.
+    void prepare_sqe(size_t index);
+    void submit_pending_sqes();
+    void reap_completions();
+    void handle_completion(size_t index, int32_t res);
+    void finish_request(size_t index, int64_t io_result);
+
+    // Returns the fixed-file slot for `fd`, or -1 if it should be used as a normal
+    // file descriptor.
+    int get_fixed_file_slot(fd_t fd);
+    // Returns the index of a free registered buffer that can hold `count` bytes, or
+    // -1 if there is none.
+    int acquire_registered_buffer(size_t count);
+    char *get_registered_buffer(int index);
+
+    // These start out as the `use_registered_resources` constructor argument, but
+    // get cleared if the kernel refuses to register the files or buffers.
+    bool use_fixed_files;
+    bool use_registered_buffers;
+    // Calls `io_uring_enter`. The unit tests replace it to simulate a kernel that
+    // refuses submissions.
+    int (*enter_fun)(fd_t ring_fd, unsigned to_submit, unsigned min_complete,
+                     unsigned flags);
+    passive_producer_t<action_t *> *source;
+    linux_event_queue_t *queue;
+
+    /* The ring itself. */
+    scoped_fd_t ring_fd;
+    void *sq_ring_ptr;
+    size_t sq_ring_size;
+    void *cq_ring_ptr;
+    size_t cq_ring_size;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_ring_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_ring_mask;
+    io_uring_cqe *cqes;
+
+    // The number of SQEs that have been written to the ring but not yet handed to
+    // the kernel with `io_uring_enter`.
+    unsigned unsubmitted_sqes;
+    // Set while we wait to retry a submission that failed with `EAGAIN` or `EBUSY`
+    // at a time when no completion was going to come in and retry it for us.
+    timer_token_t *submit_retry_timer;
+
+    system_event_t completion_event;
+
+    /* Bookkeeping for in-flight requests. The `user_data` of every SQE is an index
+    into `requests`. */
+    scoped_array_t<request_t> requests;
+    std::vector<size_t> free_requests;
+
+    /* Fixed files. Protected by `fixed_files_mutex` because `forget_fd()` may be
+    called from any thread. */
+    system_mutex_t fixed_files_mutex;
+    std::map<fd_t, int> fixed_file_slots;
+    std::vector<int> free_fixed_file_slots;
+
+    /* Registered bounce buffers. */
+    scoped_malloc_t<char> registered_buffer_arena;
+    std::vector<int> free_registered_buffers;
+
+    /* Actions that we pass on to the blocker pool. */
+    unlimited_fifo_queue_t<action_t *> fallback_queue;
+    pool_diskmgr_t fallback;
+
+    DISABLE_COPYING(uring_diskmgr_t);
+};
+
+#endif  // USE_IO_URING
+
+#endif  // ARCH_IO_DISK_URING_HPP_
@@ -20,7 +20,8 @@ linux_message_hub_t::linux_message_hub_t(linux_event_queue_t *queue,
                                          threadnum_t current_thread)
     : queue_(queue),
       thread_pool_(thread_pool),
-      is_woken_up_(false),
+      incoming_messages_(NULL),
+      is_woken_up_(0),
       current_thread_(current_thread) {
 
 #ifndef NDEBUG
@@ -44,7 +45,7 @@ linux_message_hub_t::~linux_message_hub_t() {
         guarantee(get_priority_msg_list(p).empty());
     }
 
-    guarantee(incoming_messages_.empty());
+    guarantee(incoming_messages_ == NULL);
 }
 
 void linux_message_hub_t::do_store_message(threadnum_t nthread, linux_thread_message_t *msg) {
@@ -91,15 +92,33 @@ void linux_message_hub_t::store_message_sometime(threadnum_t nthread, linux_thre
 
 
 void linux_message_hub_t::insert_external_message(linux_thread_message_t *msg) {
-    bool do_wake_up;
-    {
-        spinlock_acq_t acq(&incoming_messages_lock_);
-        do_wake_up = !check_and_set_is_woken_up();
-        incoming_messages_.push_back(msg);
+    msg->hub_next = NULL;
+    push_incoming_messages(msg, msg);
+    wake_up();
+}
+
+void linux_message_hub_t::push_incoming_messages(linux_thread_message_t *head,
+                                                 linux_thread_message_t *tail) {
+    // Nothing ever gets popped off the stack except by taking all of it, so there's
+    // no ABA problem here.
+    linux_thread_message_t *top = incoming_messages_;
+    for (;;) {
+        tail->hub_next = top;
+        linux_thread_message_t *prev =
+            __sync_val_compare_and_swap(&incoming_messages_, top, head);
+        if (prev == top) {
+            break;
+        }
+        top = prev;
     }
+}
 
-    // Wakey wakey eggs and bakey
-    if (do_wake_up) {
+void linux_message_hub_t::wake_up() {
+    // This has to come after pushing the messages.  `sort_incoming_messages_by_priority`
+    // resets the flag before it takes the messages, so either it gets our messages or
+    // we see the reset flag and wake it up again.
+    if (__sync_bool_compare_and_swap(&is_woken_up_, 0, 1)) {
+        // Wakey wakey eggs and bakey
         event_.wakey_wakey();
     }
 }
@@ -175,31 +194,34 @@ void linux_message_hub_t::on_event(int events) {
             // Place wakey_wakey and then yield to the event processing.
             // It will wake us up again immediately, but can handle a few
             // OS events (such as timers, network messages etc.) in the meantime.
-            bool do_wake_up;
-            {
-                spinlock_acq_t acq(&incoming_messages_lock_);
-                do_wake_up = !check_and_set_is_woken_up();
-            }
-            if (do_wake_up) {
-                event_.wakey_wakey();
-            }
+            wake_up();
             break;
         }
     }
 }
 
 void linux_message_hub_t::sort_incoming_messages_by_priority() {
-    // We do this in two steps to release the spinlock faster.
-    // append_and_clear is a very cheap operation, while
-    // assigning each message to a different priority queue
-    // is more expensive.
+    // 1. Pull the messages.  We reset `is_woken_up_` first, so that anybody who pushes
+    // messages after we've taken the stack wakes us up again (see `wake_up()`).
+    __sync_bool_compare_and_swap(&is_woken_up_, 1, 0);
+    linux_thread_message_t *top = incoming_messages_;
+    for (;;) {
+        linux_thread_message_t *prev =
+            __sync_val_compare_and_swap(&incoming_messages_, top, NULL);
+        if (prev == top) {
+            break;
+        }
+        top = prev;
+    }
 
-    // 1. Pull the messages
+    // The stack has the message that was sent last on top, so pushing each message
+    // onto the front of the list puts them back in the order in which they were sent.
     msg_list_t new_messages;
-    {
-        spinlock_acq_t acq(&incoming_messages_lock_);
-        new_messages.append_and_clear(&incoming_messages_);
-        is_woken_up_ = false;
+    while (top != NULL) {
+        linux_thread_message_t *next = top->hub_next;
+        top->hub_next = NULL;
+        new_messages.push_front(top);
+        top = next;
     }
 
     // 2. Sort the messages into their respective priority queues
@@ -218,12 +240,6 @@ void linux_message_hub_t::sort_incoming_messages_by_priority() {
     }
 }
 
-bool linux_message_hub_t::check_and_set_is_woken_up() {
-    const bool was_woken_up = is_woken_up_;
-    is_woken_up_ = true;
-    return was_woken_up;
-}
-
 // Pushes messages collected locally global lists available to all
 // threads.
 void linux_message_hub_t::push_messages() {
@@ -232,24 +248,21 @@ void linux_message_hub_t::push_messages() {
         // message list.
         thread_queue_t *queue = &queues_[i];
         if (!queue->msg_local_list.empty()) {
-            // Transfer messages to the other core
-
-            bool do_wake_up;
-            {
-                spinlock_acq_t acq(&thread_pool_->threads[i]->message_hub.incoming_messages_lock_);
-
-                // We only need to do a wake up if we're the first people to do a
-                // wake up.
-                do_wake_up =
-                    !thread_pool_->threads[i]->message_hub.check_and_set_is_woken_up();
-
-                thread_pool_->threads[i]->message_hub.incoming_messages_.append_and_clear(&queue->msg_local_list);
+            // Transfer messages to the other core.  We link them up from the last
+            // one to the first one, which is the order that the incoming stack of the
+            // other hub wants them in.
+            linux_thread_message_t *tail = queue->msg_local_list.head();
+            linux_thread_message_t *head = NULL;
+            while (linux_thread_message_t *m = queue->msg_local_list.head()) {
+                queue->msg_local_list.remove(m);
+                m->hub_next = head;
+                head = m;
             }
 
+            linux_message_hub_t *hub = &thread_pool_->threads[i]->message_hub;
+            hub->push_incoming_messages(head, tail);
             // Wakey wakey, perhaps eggs and bakey
-            if (do_wake_up) {
-                thread_pool_->threads[i]->message_hub.event_.wakey_wakey();
-            }
+            hub->wake_up();
         }
     }
 }
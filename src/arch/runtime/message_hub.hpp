@@ -8,7 +8,6 @@
 #include "arch/runtime/event_queue.hpp"
 #include "arch/runtime/runtime_utils.hpp"
 #include "arch/runtime/system_event.hpp"
-#include "arch/spinlock.hpp"
 #include "config/args.hpp"
 #include "containers/intrusive_list.hpp"
 #include "threading.hpp"
@@ -24,7 +23,15 @@ class linux_thread_pool_t;
 /* There is one message hub per thread, NOT one message hub for the entire program.
 
 Each message hub stores messages that are going from that message hub's home thread to
-other threads. It keeps a separate queue for messages destined for each other thread. */
+other threads. It keeps a separate queue for messages destined for each other thread.
+
+Other threads hand their messages to a hub by pushing them onto its incoming stack,
+which is a lock-free multi-producer single-consumer stack: senders push a whole batch
+of messages with one compare-and-swap, and the hub's own thread takes everything at
+once. Each batch gets pushed in reverse order, so that the hub restores the order in
+which the messages were sent by reversing the stack once. Only the first sender after
+the hub has emptied the stack signals its event, so a busy hub doesn't get woken up for
+every batch. */
 
 class linux_message_hub_t : private linux_event_callback_t {
 public:
@@ -60,6 +67,16 @@ private:
     // priority_msg_lists, depending on the messages' priorities.
     void sort_incoming_messages_by_priority();
 
+    // Pushes the messages from `head` to `tail`, which are linked through their
+    // `hub_next` pointers from the last sent to the first sent, onto
+    // incoming_messages_.  Can be called from any thread.
+    void push_incoming_messages(linux_thread_message_t *head,
+                                linux_thread_message_t *tail);
+
+    // Signals `event_` unless somebody has done that since the last time the messages
+    // were taken off incoming_messages_.  Can be called from any thread.
+    void wake_up();
+
     msg_list_t &get_priority_msg_list(int priority);
 
     linux_event_queue_t *const queue_;
@@ -74,11 +91,11 @@ private:
         msg_list_t msg_local_list;
     } queues_[MAX_THREADS];
 
-    // Must only be used with acquired incoming_messages_lock_
-    bool check_and_set_is_woken_up();
-    bool is_woken_up_;
-    msg_list_t incoming_messages_;
-    spinlock_t incoming_messages_lock_;
+    // Both are accessed from other threads, using atomic operations only.
+    // The top of the incoming stack, i.e. the message that was sent last.
+    linux_thread_message_t *incoming_messages_;
+    // Whether `event_` has been signalled since we last emptied the stack.
+    int is_woken_up_;
 
     // Use `sort_incoming_messages_by_priority()` to sort incoming_messages_ into
     // these lists.
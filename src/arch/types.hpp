@@ -101,6 +101,16 @@ enum class file_direct_io_mode_t {
     buffered_desired
 };
 
+// Which mechanism the disk manager uses to run reads and writes.
+enum class io_backend_t {
+    // Blocking system calls on a pool of helper threads.
+    pool,
+    // Linux io_uring, submitted directly from the event loop.
+    uring,
+    // Like `uring`, but also registering files and bounce buffers with the ring.
+    uring_registered
+};
+
 class semantic_checking_file_t {
 public:
     semantic_checking_file_t() { }
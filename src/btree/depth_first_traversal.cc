@@ -17,7 +17,6 @@ scoped_key_value_t::scoped_key_value_t(scoped_key_value_t &&movee)
     : key_(movee.key_),
       value_(movee.value_),
       buf_(std::move(movee.buf_)) {
-    movee.key_ = NULL;
     movee.value_ = NULL;
 }
 
@@ -10,8 +10,9 @@
 
 class get_distribution_traversal_helper_t : public btree_traversal_helper_t, public home_thread_mixin_debug_only_t {
 public:
-    get_distribution_traversal_helper_t(int _depth_limit, std::vector<store_key_t> *_keys)
-        : depth_limit(_depth_limit), key_count(0), keys(_keys)
+    get_distribution_traversal_helper_t(int _depth_limit, const key_range_t &_range,
+                                        std::vector<store_key_t> *_keys)
+        : depth_limit(_depth_limit), range(_range), key_count(0), keys(_keys)
     { }
 
     void read_stat_block(buf_lock_t *stat_block) {
@@ -64,7 +65,12 @@ public:
                 const btree_key_t *left, *right;
                 ids_source->get_block_id_and_bounding_interval(i, &block_id, &left, &right);
 
-                cb->receive_interesting_child(i);
+                key_range_t child_range(
+                    left == NULL ? key_range_t::none : key_range_t::open, left,
+                    right == NULL ? key_range_t::none : key_range_t::closed, right);
+                if (child_range.overlaps(range)) {
+                    cb->receive_interesting_child(i);
+                }
             }
         } else {
             //We're over the depth limit and thus disinterested in all children
@@ -82,6 +88,7 @@ public:
     }
 
     int depth_limit;
+    key_range_t range;
     int64_t key_count;
 
     //TODO this is inefficient since each one is maximum size
@@ -90,11 +97,14 @@ public:
 
 void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
                                 int64_t *key_count_out,
-                                std::vector<store_key_t> *keys_out) {
-    get_distribution_traversal_helper_t helper(depth_limit, keys_out);
+                                std::vector<store_key_t> *keys_out,
+                                release_superblock_t release_superblock,
+                                const key_range_t &range) {
+    get_distribution_traversal_helper_t helper(depth_limit, range, keys_out);
     rassert(keys_out->empty(), "Why is this output parameter not an empty vector\n");
 
     cond_t non_interruptor;
-    btree_parallel_traversal(superblock, &helper, &non_interruptor);
+    btree_parallel_traversal(superblock, &helper, &non_interruptor,
+                             release_superblock);
     *key_count_out = helper.key_count;
 }
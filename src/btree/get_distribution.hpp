@@ -5,12 +5,17 @@
 #include <vector>
 
 #include "btree/keys.hpp"
+#include "btree/types.hpp"
 #include "buffer_cache/types.hpp"
 
 class superblock_t;
 
-void get_btree_key_distribution(superblock_t *superblock, int depth_limit,
-                                int64_t *key_count_out,
-                                std::vector<store_key_t> *keys_out);
+// Only the nodes that overlap `range` get visited below the root.
+void get_btree_key_distribution(
+        superblock_t *superblock, int depth_limit,
+        int64_t *key_count_out,
+        std::vector<store_key_t> *keys_out,
+        release_superblock_t release_superblock = release_superblock_t::RELEASE,
+        const key_range_t &range = key_range_t::universe());
 
 #endif /* BTREE_GET_DISTRIBUTION_HPP_ */
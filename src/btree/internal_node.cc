@@ -112,6 +112,19 @@ void split(block_size_t block_size, internal_node_t *node, internal_node_t *rnod
     validate(block_size, rnode);
 }
 
+void split_off_last_child(block_size_t block_size, internal_node_t *node, internal_node_t *rnode, btree_key_t *median) {
+    rassert(node->npairs > 2);
+    keycpy(median, &get_pair_by_index(node, node->npairs - 2)->key);
+
+    init(block_size, rnode, node, node->pair_offsets + node->npairs - 1, 1);
+
+    impl::delete_pair(node, node->pair_offsets[node->npairs - 1]);
+    node->npairs -= 1;
+    impl::make_last_pair_special(node);
+
+    validate(block_size, node);
+}
+
 void merge(block_size_t block_size, const internal_node_t *node, internal_node_t *rnode, const internal_node_t *parent) {
     validate(block_size, node);
     validate(block_size, rnode);
@@ -356,8 +369,30 @@ btree_internal_pair *get_pair_by_index(internal_node_t *node, int index) {
     return get_pair(node, node->pair_offsets[index]);
 }
 
+// Returns the index of the first pair (not counting the last one) whose key is not
+// less than `key`, like a `std::lower_bound` over the pair keys would.  See
+// `leaf::find_key` for how the common prefixes save us from re-comparing bytes.
 int get_offset_index(const internal_node_t *node, const btree_key_t *key) {
-    return std::lower_bound(node->pair_offsets, node->pair_offsets+node->npairs-1, (uint16_t) internal_key_comp::faux_offset, internal_key_comp(node, key)) - node->pair_offsets;
+    int beg = 0;
+    int end = node->npairs - 1;
+    int beg_prefix = 0;
+    int end_prefix = 0;
+    while (beg < end) {
+        const int test_point = beg + (end - beg) / 2;
+        const btree_key_t *pair_key = &get_pair_by_index(node, test_point)->key;
+        int common_prefix;
+        const int res = btree_key_cmp_skipping_prefix(key, pair_key,
+                                                      std::min(beg_prefix, end_prefix),
+                                                      &common_prefix);
+        if (res > 0) {
+            beg = test_point + 1;
+            beg_prefix = common_prefix;
+        } else {
+            end = test_point;
+            end_prefix = common_prefix;
+        }
+    }
+    return beg;
 }
 
 int nodecmp(const internal_node_t *node1, const internal_node_t *node2) {
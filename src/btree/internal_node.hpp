@@ -34,6 +34,10 @@ block_id_t lookup(const internal_node_t *node, const btree_key_t *key);
 bool insert(internal_node_t *node, const btree_key_t *key, block_id_t lnode, block_id_t rnode);
 bool remove(block_size_t block_size, internal_node_t *node, const btree_key_t *key);
 void split(block_size_t block_size, internal_node_t *node, internal_node_t *rnode, btree_key_t *median);
+// Moves only the last child of `node` into the empty node `rnode`, so that `node` stays
+// as full as possible.  Used for appending to the right edge of the tree when bulk
+// loading.  `rnode` must get a second child before it is used.
+void split_off_last_child(block_size_t block_size, internal_node_t *node, internal_node_t *rnode, btree_key_t *median);
 void merge(block_size_t block_size, const internal_node_t *node, internal_node_t *rnode, const internal_node_t *parent);
 bool level(block_size_t block_size, internal_node_t *node, internal_node_t *sibling,
            btree_key_t *replacement_key, const internal_node_t *parent,
@@ -1,6 +1,10 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "btree/keys.hpp"
 
+#include <stdint.h>
+
+#include <algorithm>
+
 #include "debug.hpp"
 #include "utils.hpp"
 
@@ -20,6 +24,37 @@ int sized_strcmp(const uint8_t *str1, int len1, const uint8_t *str2, int len2) {
     return res;
 }
 
+int btree_key_cmp_skipping_prefix(const btree_key_t *left, const btree_key_t *right,
+                                  int skip, int *common_prefix_out) {
+    const int min_len = std::min(left->size, right->size);
+    rassert(skip >= 0 && skip <= min_len);
+    int i = skip;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Compare eight bytes at a time.  The lowest set bit of the difference tells us
+    // where the first mismatching byte is.
+    for (; i + 8 <= min_len; i += 8) {
+        uint64_t l, r;
+        memcpy(&l, left->contents + i, sizeof(l));
+        memcpy(&r, right->contents + i, sizeof(r));
+        if (l != r) {
+            i += __builtin_ctzll(l ^ r) / 8;
+            *common_prefix_out = i;
+            return static_cast<int>(left->contents[i])
+                - static_cast<int>(right->contents[i]);
+        }
+    }
+#endif
+    for (; i < min_len; ++i) {
+        if (left->contents[i] != right->contents[i]) {
+            *common_prefix_out = i;
+            return static_cast<int>(left->contents[i])
+                - static_cast<int>(right->contents[i]);
+        }
+    }
+    *common_prefix_out = min_len;
+    return left->size - right->size;
+}
+
 bool unescaped_str_to_key(const char *str, int len, store_key_t *buf) {
     if (len <= MAX_KEY_SIZE) {
         memcpy(buf->contents(), str, len);
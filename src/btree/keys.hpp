@@ -22,6 +22,9 @@ enum class sorting_t {
     ASCENDING,
     DESCENDING
 };
+ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
+        sorting_t, int8_t,
+        sorting_t::UNORDERED, sorting_t::DESCENDING);
 // UNORDERED sortings aren't reversed
 bool reversed(sorting_t sorting);
 
@@ -42,6 +45,14 @@ inline int btree_key_cmp(const btree_key_t *left, const btree_key_t *right) {
     return sized_strcmp(left->contents, left->size, right->contents, right->size);
 }
 
+// Like `btree_key_cmp`, for keys that are already known to agree on their first
+// `skip` bytes.  Also sets `*common_prefix_out` to the length of the common prefix
+// of the two keys.  Binary searches over sorted keys use this to avoid comparing
+// the prefix that all the remaining candidates share with the searched key over
+// and over again.
+int btree_key_cmp_skipping_prefix(const btree_key_t *left, const btree_key_t *right,
+                                  int skip, int *common_prefix_out);
+
 struct store_key_t {
 public:
     store_key_t() {
@@ -5,11 +5,13 @@
 
 #include <algorithm>
 #include <set>
+#include <vector>
 
 #include "errors.hpp"
 #include <boost/optional.hpp>
 
 #include "btree/node.hpp"
+#include "containers/scoped.hpp"
 #include "repli_timestamp.hpp"
 #include "utils.hpp"
 
@@ -82,11 +84,113 @@ const int SKIP_ENTRY_RESERVED = 251;
 // itself three bytes, so it can't fit in a slot of size one or two. We don't
 // expect to actually see many entries of size one or two, but it pays to be
 // thorough.
+//
+// A node with a key prefix (see `key_prefix_magic()`) stores the prefix
+// right after the fixed part of the header, and its pair offsets start
+// after that:
+//
+// [magic'][num_pairs][live_size][frontmost][tstamp_cutpoint][prefix size][prefix]...[padding][off0][off1]...[offN-1]........[tstamp][entry]...
+//
+// All keys in the entries of such a node (and all keys that can ever be
+// inserted into it) start with the prefix, and the entries only store
+// the remaining bytes of the key.  Only the functions that hand keys to
+// the outside world rebuild full keys.
 
 
 struct entry_t;
 struct value_t;
 
+block_magic_t key_prefix_magic(block_magic_t leaf_magic) {
+    leaf_magic.bytes[0] |= 0x80;
+    return leaf_magic;
+}
+
+bool is_leaf_magic(value_sizer_t *sizer, block_magic_t magic) {
+    return magic == sizer->btree_leaf_magic()
+        || magic == key_prefix_magic(sizer->btree_leaf_magic());
+}
+
+bool has_key_prefix(const leaf_node_t *node) {
+    return (node->magic.bytes[0] & 0x80) != 0;
+}
+
+const btree_key_t *key_prefix(const leaf_node_t *node) {
+    if (!has_key_prefix(node)) {
+        return NULL;
+    }
+    return reinterpret_cast<const btree_key_t *>(node->pair_offsets);
+}
+
+int key_prefix_size(const leaf_node_t *node) {
+    return has_key_prefix(node) ? key_prefix(node)->size : 0;
+}
+
+// The prefix is padded to an even size to keep the pair offsets aligned.
+int key_prefix_storage_size(int prefix_size) {
+    return prefix_size == 0 ? 0 : (sizeof(uint8_t) + prefix_size + 1) & ~1;
+}
+
+// The size of the header, including the key prefix.  This is where the
+// pair offsets begin.
+int header_size(const leaf_node_t *node) {
+    return offsetof(leaf_node_t, pair_offsets)
+        + key_prefix_storage_size(key_prefix_size(node));
+}
+
+uint16_t *pair_offsets(leaf_node_t *node) {
+    return reinterpret_cast<uint16_t *>(reinterpret_cast<char *>(node) + header_size(node));
+}
+
+const uint16_t *pair_offsets(const leaf_node_t *node) {
+    return reinterpret_cast<const uint16_t *>(reinterpret_cast<const char *>(node) + header_size(node));
+}
+
+bool have_same_key_prefix(const leaf_node_t *x, const leaf_node_t *y) {
+    const btree_key_t *x_prefix = key_prefix(x);
+    const btree_key_t *y_prefix = key_prefix(y);
+    if (x_prefix == NULL || y_prefix == NULL) {
+        return x_prefix == y_prefix;
+    }
+    return btree_key_cmp(x_prefix, y_prefix) == 0;
+}
+
+bool key_starts_with(const btree_key_t *key, const uint8_t *prefix, int prefix_size) {
+    return key->size >= prefix_size && memcmp(key->contents, prefix, prefix_size) == 0;
+}
+
+// Returns the size that `key` takes up in an entry of `node`, including the
+// size byte.  `key` must start with the node's key prefix.
+int stored_key_size(const leaf_node_t *node, const btree_key_t *key) {
+    const btree_key_t *prefix = key_prefix(node);
+    if (prefix == NULL) {
+        return key->full_size();
+    }
+    rassert(key_starts_with(key, prefix->contents, prefix->size));
+    return key->full_size() - prefix->size;
+}
+
+// Writes `key` the way it is stored in `node` to `p`.  Returns the position
+// after it.
+char *write_stored_key(const leaf_node_t *node, const btree_key_t *key, char *p) {
+    const int prefix_size = key_prefix_size(node);
+    const int stored_size = key->size - prefix_size;
+    *reinterpret_cast<uint8_t *>(p) = stored_size;
+    memcpy(p + 1, key->contents + prefix_size, stored_size);
+    return p + 1 + stored_size;
+}
+
+// Writes the full key for the stored key `suffix` of `node` to `out`, which
+// must have room for `MAX_KEY_SIZE` bytes of contents.
+void full_key(const leaf_node_t *node, const btree_key_t *suffix, btree_key_t *out) {
+    const int prefix_size = key_prefix_size(node);
+    rassert(prefix_size + suffix->size <= MAX_KEY_SIZE);
+    if (prefix_size > 0) {
+        memcpy(out->contents, key_prefix(node)->contents, prefix_size);
+    }
+    memcpy(out->contents + prefix_size, suffix->contents, suffix->size);
+    out->size = prefix_size + suffix->size;
+}
+
 bool entry_is_deletion(const entry_t *p) {
     uint8_t x = *reinterpret_cast<const uint8_t *>(p);
     rassert(x != SKIP_ENTRY_RESERVED);
@@ -194,19 +298,20 @@ void strprint_entry(std::string *out, value_sizer_t *sizer, const entry_t *entry
 
 std::string strprint_leaf(value_sizer_t *sizer, const leaf_node_t *node) {
     std::string out;
-    out += strprintf("Leaf(magic='%4.4s', num_pairs=%u, live_size=%u, frontmost=%u, tstamp_cutpoint=%u)\n",
-            node->magic.bytes, node->num_pairs, node->live_size, node->frontmost, node->tstamp_cutpoint);
+    out += strprintf("Leaf(magic='%4.4s', num_pairs=%u, live_size=%u, frontmost=%u, tstamp_cutpoint=%u, key_prefix='%.*s')\n",
+            node->magic.bytes, node->num_pairs, node->live_size, node->frontmost, node->tstamp_cutpoint,
+            key_prefix_size(node), has_key_prefix(node) ? key_prefix(node)->contents : NULL);
 
     out += strprintf("  Offsets:");
     for (int i = 0; i < node->num_pairs; ++i) {
-        out += strprintf(" %d", node->pair_offsets[i]);
+        out += strprintf(" %d", pair_offsets(node)[i]);
     }
     out += strprintf("\n");
 
     out += strprintf("  By Key:");
     for (int i = 0; i < node->num_pairs; ++i) {
-        out += strprintf(" %d:", node->pair_offsets[i]);
-        strprint_entry(&out, sizer, get_entry(node, node->pair_offsets[i]));
+        out += strprintf(" %d:", pair_offsets(node)[i]);
+        strprint_entry(&out, sizer, get_entry(node, pair_offsets(node)[i]));
     }
     out += strprintf("\n");
 
@@ -247,20 +352,21 @@ void print_entry(FILE *fp, value_sizer_t *sizer, const entry_t *entry) {
 
 
 void print(FILE *fp, value_sizer_t *sizer, const leaf_node_t *node) {
-    fprintf(fp, "Leaf(magic='%4.4s', num_pairs=%u, live_size=%u, frontmost=%u, tstamp_cutpoint=%u)\n",
-            node->magic.bytes, node->num_pairs, node->live_size, node->frontmost, node->tstamp_cutpoint);
+    fprintf(fp, "Leaf(magic='%4.4s', num_pairs=%u, live_size=%u, frontmost=%u, tstamp_cutpoint=%u, key_prefix='%.*s')\n",
+            node->magic.bytes, node->num_pairs, node->live_size, node->frontmost, node->tstamp_cutpoint,
+            key_prefix_size(node), has_key_prefix(node) ? key_prefix(node)->contents : NULL);
 
     fprintf(fp, "  Offsets:");
     for (int i = 0; i < node->num_pairs; ++i) {
-        fprintf(fp, " %d", node->pair_offsets[i]);
+        fprintf(fp, " %d", pair_offsets(node)[i]);
     }
     fprintf(fp, "\n");
     fflush(fp);
 
     fprintf(fp, "  By Key:");
     for (int i = 0; i < node->num_pairs; ++i) {
-        fprintf(fp, " %d:", node->pair_offsets[i]);
-        print_entry(fp, sizer, get_entry(node, node->pair_offsets[i]));
+        fprintf(fp, " %d:", pair_offsets(node)[i]);
+        print_entry(fp, sizer, get_entry(node, pair_offsets(node)[i]));
     }
     fprintf(fp, "\n");
 
@@ -312,9 +418,11 @@ bool fsck(value_sizer_t *sizer, const btree_key_t *left_exclusive_or_null, const
     // is not before the end of pair_offsets
 
     // Basic sanity checks on fields' values.
-    if (failed(node->magic == sizer->btree_leaf_magic(),
+    if (failed(is_leaf_magic(sizer, node->magic),
                "bad leaf magic")
-        || failed(node->frontmost >= offsetof(leaf_node_t, pair_offsets) + node->num_pairs * sizeof(uint16_t),
+        || failed(!has_key_prefix(node) || key_prefix(node)->size > 0,
+                  "empty key prefix")
+        || failed(node->frontmost >= header_size(node) + node->num_pairs * sizeof(uint16_t),
                   "frontmost offset is before the end of pair_offsets")
         || failed(node->live_size <= (sizer->block_size().value() - node->frontmost) + sizeof(uint16_t) * node->num_pairs,
                   "live_size is impossibly large")
@@ -328,7 +436,7 @@ bool fsck(value_sizer_t *sizer, const btree_key_t *left_exclusive_or_null, const
 
     // sizeof(offs) is guaranteed to be less than the block_size() thanks to assertions above.
     scoped_array_t<uint16_t> offs(node->num_pairs);
-    memcpy(offs.data(), node->pair_offsets, node->num_pairs * sizeof(uint16_t));
+    memcpy(offs.data(), pair_offsets(node), node->num_pairs * sizeof(uint16_t));
 
     std::sort(offs.data(), offs.data() + node->num_pairs);
 
@@ -376,16 +484,23 @@ bool fsck(value_sizer_t *sizer, const btree_key_t *left_exclusive_or_null, const
 
         const entry_t *ent = get_entry(node, offset);
         if (entry_is_live(ent)) {
+            if (failed(key_prefix_size(node) + entry_key(ent)->size <= MAX_KEY_SIZE,
+                       "key is too long")) {
+                return false;
+            }
+            store_key_t key;
+            full_key(node, entry_key(ent), key.btree_key());
+
             const void *value = entry_value(ent);
             int space = sizer->block_size().value() - (reinterpret_cast<const char *>(value) - reinterpret_cast<const char *>(node));
             if (!sizer->fits(value, space)) {
-                *msg_out = strprintf("problem with key %.*s: value does not fit\n", entry_key(ent)->size, entry_key(ent)->contents);
+                *msg_out = strprintf("problem with key %.*s: value does not fit\n", key.size(), key.contents());
                 return false;
             }
 
             std::string fscker_msg;
-            if (!fscker->fsck(sizer, entry_key(ent), value, &fscker_msg)) {
-                *msg_out = strprintf("Problem with key %.*s: %s\n", entry_key(ent)->size, entry_key(ent)->contents, fscker_msg.c_str());
+            if (!fscker->fsck(sizer, key.btree_key(), value, &fscker_msg)) {
+                *msg_out = strprintf("Problem with key %.*s: %s\n", key.size(), key.contents(), fscker_msg.c_str());
                 return false;
             }
 
@@ -422,14 +537,22 @@ bool fsck(value_sizer_t *sizer, const btree_key_t *left_exclusive_or_null, const
 
     // Entries look valid, check key ordering.
 
+    store_key_t last_buf;
     const btree_key_t *last = left_exclusive_or_null;
     for (int k = 0; k < node->num_pairs; ++k) {
-        const btree_key_t *key = entry_key(get_entry(node, node->pair_offsets[k]));
-        if (failed(last == NULL || btree_key_cmp(last, key) < 0,
+        const btree_key_t *suffix = entry_key(get_entry(node, pair_offsets(node)[k]));
+        if (failed(key_prefix_size(node) + suffix->size <= MAX_KEY_SIZE,
+                   "key is too long")) {
+            return false;
+        }
+        store_key_t key;
+        full_key(node, suffix, key.btree_key());
+        if (failed(last == NULL || btree_key_cmp(last, key.btree_key()) < 0,
                    "keys out of order")) {
             return false;
         }
-        last = key;
+        last_buf = key;
+        last = last_buf.btree_key();
     }
 
     if (failed(last == NULL || right_inclusive_or_null == NULL
@@ -459,12 +582,12 @@ void init(value_sizer_t *sizer, leaf_node_t *node) {
     node->tstamp_cutpoint = node->frontmost;
 }
 
-int free_space(value_sizer_t *sizer) {
-    return sizer->block_size().value() - offsetof(leaf_node_t, pair_offsets);
+int free_space(value_sizer_t *sizer, const leaf_node_t *node) {
+    return sizer->block_size().value() - header_size(node);
 }
 
 // Returns the mandatory storage cost of the node, returning a value
-// in the closed interval [0, free_space(sizer)].  Outputs the offset
+// in the closed interval [0, free_space(sizer, node)].  Outputs the offset
 // of the first entry for which storing a timestamp is not mandatory.
 int mandatory_cost(value_sizer_t *sizer, const leaf_node_t *node, int required_timestamps, int *tstamp_back_offset_out) {
     int size = node->live_size;
@@ -476,7 +599,7 @@ int mandatory_cost(value_sizer_t *sizer, const leaf_node_t *node, int required_t
     entry_iter_t iter = entry_iter_t::make(node);
     int count = 0;
     int deletions_cost = 0;
-    int max_deletions_cost = free_space(sizer) / DELETION_RESERVE_FRACTION;
+    int max_deletions_cost = free_space(sizer, node) / DELETION_RESERVE_FRACTION;
     while (!(count == required_timestamps || iter.done(sizer) || iter.offset >= node->tstamp_cutpoint)) {
         const entry_t *ent = get_entry(node, iter.offset);
         if (entry_is_deletion(ent)) {
@@ -543,10 +666,20 @@ bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *k
     // insert.  We conservatively assume the key is not already
     // contained in the node.
 
-    size += sizeof(uint16_t) + sizeof(repli_timestamp_t) + key->full_size() + sizer->size(value);
+    size += sizeof(uint16_t) + sizeof(repli_timestamp_t) + stored_key_size(node, key) + sizer->size(value);
 
     // The node is full if we can't fit all that data within the free space.
-    return size > free_space(sizer);
+    return size > free_space(sizer, node);
+}
+
+bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value, double fill_factor) {
+    rassert(fill_factor > 0 && fill_factor <= 1);
+    if (is_full(sizer, node, key, value)) {
+        return true;
+    }
+    int size = mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS)
+        + sizeof(uint16_t) + sizeof(repli_timestamp_t) + stored_key_size(node, key) + sizer->size(value);
+    return size > free_space(sizer, node) * fill_factor;
 }
 
 bool is_underfull(value_sizer_t *sizer, const leaf_node_t *node) {
@@ -565,7 +698,7 @@ bool is_underfull(value_sizer_t *sizer, const leaf_node_t *node) {
     // free_space / 2 - leaf_epsilon.  We don't want an immediately
     // split node to be underfull, hence the threshold used below.
 
-    return mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS) < free_space(sizer) / 2 - leaf_epsilon(sizer);
+    return mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS) < free_space(sizer, node) / 2 - leaf_epsilon(sizer);
 }
 
 
@@ -595,7 +728,7 @@ void garbage_collect(
         indices[i] = i;
     }
 
-    std::sort(indices.data(), indices.data() + node->num_pairs, indirect_index_comparator_t(node->pair_offsets));
+    std::sort(indices.data(), indices.data() + node->num_pairs, indirect_index_comparator_t(pair_offsets(node)));
 
     int mand_offset;
     UNUSED int cost = mandatory_cost(sizer, node, num_tstamped, &mand_offset);
@@ -608,7 +741,7 @@ void garbage_collect(
     int w = sizer->block_size().value();
     int i = node->num_pairs - 1;
     for (; i >= 0; --i) {
-        int offset = node->pair_offsets[indices[i]];
+        int offset = pair_offsets(node)[indices[i]];
 
         if (offset < mand_offset) {
             break;
@@ -619,18 +752,18 @@ void garbage_collect(
             int sz = entry_size(sizer, ent);
             w -= sz;
             memmove(get_at_offset(node, w), ent, sz);
-            node->pair_offsets[indices[i]] = w;
+            pair_offsets(node)[indices[i]] = w;
         } else {
-            node->pair_offsets[indices[i]] = 0;
+            pair_offsets(node)[indices[i]] = 0;
         }
     }
 
-    // Either i < 0 or node->pair_offsets[indices[i]] < mand_offset.
+    // Either i < 0 or pair_offsets(node)[indices[i]] < mand_offset.
 
     node->tstamp_cutpoint = w;
 
     for (; i >= 0; --i) {
-        int offset = node->pair_offsets[indices[i]];
+        int offset = pair_offsets(node)[indices[i]];
         entry_t *ent = get_entry(node, offset);
         rassert(!entry_is_skip(ent));
 
@@ -640,7 +773,7 @@ void garbage_collect(
         w -= sz;
 
         memmove(get_at_offset(node, w), get_at_offset(node, offset), sz);
-        node->pair_offsets[indices[i]] = w;
+        pair_offsets(node)[indices[i]] = w;
     }
 
     node->frontmost = w;
@@ -652,8 +785,8 @@ void garbage_collect(
             *preserved_index = j;
         }
 
-        if (node->pair_offsets[k] != 0) {
-            node->pair_offsets[j] = node->pair_offsets[k];
+        if (pair_offsets(node)[k] != 0) {
+            pair_offsets(node)[j] = pair_offsets(node)[k];
 
             j += 1;
         }
@@ -695,6 +828,157 @@ void clean_entry(void *p, int sz) {
     }
 }
 
+// Writes a copy of the entries with pair_offsets indices in the clopen
+// range [beg, end) of `node` to `out`, storing their keys relative to
+// `prefix` (which may be empty).  All keys in `node` must start with
+// `prefix`.  Skip entries are dropped along the way, everything else keeps
+// its order and timestamp.  Returns false if the copy doesn't fit into a
+// block, in which case the contents of `out` are undefined.
+bool copy_with_key_prefix(value_sizer_t *sizer, const leaf_node_t *node,
+                          int beg, int end,
+                          const btree_key_t *prefix, leaf_node_t *out) {
+    rassert(node != out);
+    rassert(0 <= beg && beg <= end && end <= node->num_pairs);
+    const int old_prefix_size = key_prefix_size(node);
+    // Either prefix must be a prefix of the other one.
+    rassert(old_prefix_size == 0
+            || key_starts_with(prefix, key_prefix(node)->contents,
+                               std::min<int>(prefix->size, old_prefix_size)));
+
+    init(sizer, out);
+    if (prefix->size > 0) {
+        out->magic = key_prefix_magic(out->magic);
+        memcpy(out->pair_offsets, prefix, prefix->full_size());
+    }
+    out->num_pairs = end - beg;
+    const int min_frontmost = header_size(out) + sizeof(uint16_t) * out->num_pairs;
+    if (min_frontmost > out->frontmost) {
+        return false;
+    }
+
+    // Skip entries don't appear in the pair offsets, so this also gets rid
+    // of them.
+    std::vector<int> old_offsets(pair_offsets(node) + beg, pair_offsets(node) + end);
+    std::sort(old_offsets.begin(), old_offsets.end());
+
+    // We write the entries from the back of the block, so that the
+    // untimestamped ones come first.
+    std::vector<int> new_offsets(old_offsets.size());
+    int w = out->frontmost;
+    for (int i = old_offsets.size() - 1; i >= 0; --i) {
+        const int offset = old_offsets[i];
+        const bool has_tstamp = offset < node->tstamp_cutpoint;
+        const entry_t *ent = get_entry(node, offset);
+        const btree_key_t *key = entry_key(ent);
+        rassert(prefix->size <= old_prefix_size
+                || key_starts_with(key, prefix->contents + old_prefix_size,
+                                   prefix->size - old_prefix_size));
+        const int stored_size = old_prefix_size + key->size - prefix->size;
+        const int value_size = entry_is_live(ent) ? sizer->size(entry_value(ent)) : 0;
+        const int sz = (entry_is_deletion(ent) ? 1 : 0) + 1 + stored_size + value_size;
+
+        w -= sz + (has_tstamp ? sizeof(repli_timestamp_t) : 0);
+        if (w < min_frontmost) {
+            return false;
+        }
+        new_offsets[i] = w;
+
+        char *p = get_at_offset(out, w);
+        if (has_tstamp) {
+            *reinterpret_cast<repli_timestamp_t *>(p) = get_timestamp(node, offset);
+            p += sizeof(repli_timestamp_t);
+        } else {
+            out->tstamp_cutpoint = w;
+        }
+        if (entry_is_deletion(ent)) {
+            *p = static_cast<char>(DELETE_ENTRY_CODE);
+            ++p;
+        }
+        *reinterpret_cast<uint8_t *>(p) = stored_size;
+        ++p;
+        // Bytes of the new stored key that used to be part of the old prefix.
+        const int from_old_prefix = std::max(old_prefix_size - prefix->size, 0);
+        if (from_old_prefix > 0) {
+            memcpy(p, key_prefix(node)->contents + prefix->size, from_old_prefix);
+            p += from_old_prefix;
+        }
+        const int from_key = stored_size - from_old_prefix;
+        memcpy(p, key->contents + key->size - from_key, from_key);
+        p += from_key;
+        if (entry_is_live(ent)) {
+            memcpy(p, entry_value(ent), value_size);
+            out->live_size += sizeof(uint16_t) + sz;
+        }
+    }
+    out->frontmost = w;
+
+    for (int i = beg; i < end; ++i) {
+        auto it = std::lower_bound(old_offsets.begin(), old_offsets.end(),
+                                   pair_offsets(node)[i]);
+        rassert(it != old_offsets.end() && *it == pair_offsets(node)[i]);
+        pair_offsets(out)[i - beg] = new_offsets[it - old_offsets.begin()];
+    }
+
+    validate(sizer, out);
+    return true;
+}
+
+// Like `copy_with_key_prefix()`, but modifies `node` in place.
+bool set_key_prefix(value_sizer_t *sizer, leaf_node_t *node, const btree_key_t *prefix) {
+    scoped_malloc_t<leaf_node_t> copy(sizer->block_size().value());
+    if (!copy_with_key_prefix(sizer, node, 0, node->num_pairs, prefix, copy.get())) {
+        return false;
+    }
+    memcpy(node, copy.get(), sizer->block_size().value());
+    return true;
+}
+
+// Sets `*prefix_out` to the longest common prefix of the key prefixes of
+// `x` and `y`.
+void common_key_prefix(const leaf_node_t *x, const leaf_node_t *y, btree_key_t *prefix_out) {
+    prefix_out->size = 0;
+    const btree_key_t *x_prefix = key_prefix(x);
+    const btree_key_t *y_prefix = key_prefix(y);
+    if (x_prefix == NULL || y_prefix == NULL) {
+        return;
+    }
+    int n = 0;
+    while (n < x_prefix->size && n < y_prefix->size
+           && x_prefix->contents[n] == y_prefix->contents[n]) {
+        ++n;
+    }
+    memcpy(prefix_out->contents, x_prefix->contents, n);
+    prefix_out->size = n;
+}
+
+void grow_key_prefix(value_sizer_t *sizer, leaf_node_t *node,
+                     const btree_key_t *left_exclusive_or_null,
+                     const btree_key_t *right_inclusive_or_null) {
+    if (!sizer->btree_leaf_key_prefixes()
+        || left_exclusive_or_null == NULL || right_inclusive_or_null == NULL) {
+        return;
+    }
+
+    // Every key between the two bounds starts with their common prefix.
+    int prefix_size = 0;
+    btree_key_cmp_skipping_prefix(left_exclusive_or_null, right_inclusive_or_null, 0,
+                                  &prefix_size);
+    const int old_prefix_size = key_prefix_size(node);
+    rassert(prefix_size >= old_prefix_size);
+
+    // Only bother if the bytes we save on the entries pay for storing the
+    // longer prefix.  This also guarantees that the node still fits.
+    const int bytes_saved = (prefix_size - old_prefix_size) * node->num_pairs;
+    const int extra_storage = key_prefix_storage_size(prefix_size)
+        - key_prefix_storage_size(old_prefix_size);
+    if (prefix_size == old_prefix_size || bytes_saved < extra_storage) {
+        return;
+    }
+
+    store_key_t prefix(prefix_size, right_inclusive_or_null->contents);
+    guarantee(set_key_prefix(sizer, node, prefix.btree_key()));
+}
+
 // Moves entries with pair_offsets indices in the clopen range [beg,
 // end) from fro to tow.
 void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
@@ -703,16 +987,19 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
                    std::vector<const void *> *moved_values_out) {
     rassert(is_underfull(sizer, tow));
     rassert(end >= beg);
+    // Entries are copied verbatim, so both nodes must store their keys the
+    // same way.
+    rassert(have_same_key_prefix(fro, tow));
 
     // This assertion is a bit loose.
-    rassert(fro_copysize + mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS) <= free_space(sizer));
+    rassert(fro_copysize + mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS) <= free_space(sizer, tow));
 
     // Make tow have a nice big region we can copy entries to.  Also,
     // this means we have no "skip" entries in tow.
     garbage_collect(sizer, tow, MANDATORY_TIMESTAMPS, &wpoint);
 
     // Now resize and move tow's pair_offsets.
-    memmove(tow->pair_offsets + wpoint + (end - beg), tow->pair_offsets + wpoint, sizeof(uint16_t) * (tow->num_pairs - wpoint));
+    memmove(pair_offsets(tow) + wpoint + (end - beg), pair_offsets(tow) + wpoint, sizeof(uint16_t) * (tow->num_pairs - wpoint));
 
     tow->num_pairs += end - beg;
 
@@ -721,18 +1008,18 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
     // Now we're going to do something crazy.  Fill the new hole in
     // the pair offsets with the numbers in [0, end - beg).
     for (int i = 0; i < end - beg; ++i) {
-        tow->pair_offsets[wpoint + i] = i;
+        pair_offsets(tow)[wpoint + i] = i;
     }
 
     // We treat these numbers as indices into [beg, end) in fro, and
     // sort them so that we can access [beg, end) in order by
     // increasing offset.
-    std::sort(tow->pair_offsets + wpoint, tow->pair_offsets + wpoint + (end - beg), indirect_index_comparator_t(fro->pair_offsets + beg));
+    std::sort(pair_offsets(tow) + wpoint, pair_offsets(tow) + wpoint + (end - beg), indirect_index_comparator_t(pair_offsets(fro) + beg));
 
     int tow_offset = tow->frontmost;
 
     // The offset we read from (indirectly pointing to fro's [beg,
-    // end)) in tow->pair_offsets, and the offset at which we stop.
+    // end)) in pair_offsets(tow), and the offset at which we stop.
     int fro_index = wpoint;
     int fro_index_end = wpoint + (end - beg);
 
@@ -747,7 +1034,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
     int livesize = tow->live_size;
 
     for (int i = 0; i < wpoint; ++i) {
-        if (tow->pair_offsets[i] < tow->tstamp_cutpoint) {
+        if (pair_offsets(tow)[i] < tow->tstamp_cutpoint) {
             rassert(num_adjustable_tow_offsets < MANDATORY_TIMESTAMPS);
             adjustable_tow_offsets[num_adjustable_tow_offsets] = i;
             ++num_adjustable_tow_offsets;
@@ -755,7 +1042,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
     }
 
     for (int i = wpoint + (end - beg); i < tow->num_pairs; ++i) {
-        if (tow->pair_offsets[i] < tow->tstamp_cutpoint) {
+        if (pair_offsets(tow)[i] < tow->tstamp_cutpoint) {
             rassert(num_adjustable_tow_offsets < MANDATORY_TIMESTAMPS);
             adjustable_tow_offsets[num_adjustable_tow_offsets] = i;
             ++num_adjustable_tow_offsets;
@@ -771,7 +1058,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             break;
         }
 
-        int fro_offset = fro->pair_offsets[beg + tow->pair_offsets[fro_index]];
+        int fro_offset = pair_offsets(fro)[beg + pair_offsets(tow)[fro_index]];
 
         if (fro_offset >= fro_mand_offset) {
             // We have no more timestamped information to push.
@@ -798,7 +1085,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             // Update the pair offset in fro to be the offset in tow
             // -- we'll never use the old value again and we'll copy
             // the newer values to tow later.
-            fro->pair_offsets[beg + tow->pair_offsets[fro_index]] = wri_offset;
+            pair_offsets(fro)[beg + pair_offsets(tow)[fro_index]] = wri_offset;
 
             wri_offset += sz;
             fro_index++;
@@ -811,8 +1098,8 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             int i;
             for (i = 0; i < num_adjustable_tow_offsets; ++i) {
                 int j = adjustable_tow_offsets[i];
-                if (tow->pair_offsets[j] == tow_offset) {
-                    tow->pair_offsets[j] = wri_offset;
+                if (pair_offsets(tow)[j] == tow_offset) {
+                    pair_offsets(tow)[j] = wri_offset;
                     break;
                 }
             }
@@ -829,7 +1116,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
 
     // Now we have some untimestamped entries to write.
     for (; fro_index < fro_index_end; ++fro_index) {
-        int fro_offset = fro->pair_offsets[beg + tow->pair_offsets[fro_index]];
+        int fro_offset = pair_offsets(fro)[beg + pair_offsets(tow)[fro_index]];
         entry_t *ent = get_entry(fro, fro_offset);
         if (entry_is_live(ent)) {
             int sz = entry_size(sizer, ent);
@@ -837,7 +1124,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             clean_entry(ent, sz);
             fro_live_size_adjustment -= sz + sizeof(uint16_t);
 
-            fro->pair_offsets[beg + tow->pair_offsets[fro_index]] = wri_offset;
+            pair_offsets(fro)[beg + pair_offsets(tow)[fro_index]] = wri_offset;
 
             wri_offset += sz;
             livesize += sz + sizeof(uint16_t);
@@ -845,7 +1132,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             rassert(entry_is_deletion(ent));
 
             // This is a dead entry.  We'll need to squash this dead entry later.
-            fro->pair_offsets[beg + tow->pair_offsets[fro_index]] = 0;
+            pair_offsets(fro)[beg + pair_offsets(tow)[fro_index]] = 0;
 
             int sz = entry_size(sizer, ent);
             clean_entry(ent, sz);
@@ -868,8 +1155,8 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             int i;
             for (i = 0; i < num_adjustable_tow_offsets; ++i) {
                 int j = adjustable_tow_offsets[i];
-                if (tow->pair_offsets[j] == tow_offset) {
-                    tow->pair_offsets[j] = wri_offset;
+                if (pair_offsets(tow)[j] == tow_offset) {
+                    pair_offsets(tow)[j] = wri_offset;
                     break;
                 }
             }
@@ -885,8 +1172,8 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
             int i;
             for (i = 0; i < num_adjustable_tow_offsets; ++i) {
                 int j = adjustable_tow_offsets[i];
-                if (tow->pair_offsets[j] == tow_offset) {
-                    tow->pair_offsets[j] = 0;
+                if (pair_offsets(tow)[j] == tow_offset) {
+                    pair_offsets(tow)[j] = 0;
                 }
             }
         }
@@ -908,9 +1195,9 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
 
     // Copy the valid tow offsets from [beg, end) to the wpoint point
     // in tow, and move fro entries.
-    memcpy(tow->pair_offsets + wpoint, fro->pair_offsets + beg,
+    memcpy(pair_offsets(tow) + wpoint, pair_offsets(fro) + beg,
            sizeof(uint16_t) * (end - beg));
-    memmove(fro->pair_offsets + beg, fro->pair_offsets + end, sizeof(uint16_t) * (fro->num_pairs - end));
+    memmove(pair_offsets(fro) + beg, pair_offsets(fro) + end, sizeof(uint16_t) * (fro->num_pairs - end));
     fro->num_pairs -= end - beg;
 
     tow->frontmost = new_frontmost;
@@ -926,7 +1213,7 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
         moved_values_out->clear();
         moved_values_out->reserve(end - beg);
         for (int pair_idx = wpoint; pair_idx < wpoint + (end - beg); ++pair_idx) {
-            const int offset = tow->pair_offsets[pair_idx];
+            const int offset = pair_offsets(tow)[pair_idx];
             // Skip dead entries
             if (offset != 0) {
                 const entry_t *entry = get_entry(tow, offset);
@@ -943,8 +1230,8 @@ void move_elements(value_sizer_t *sizer, leaf_node_t *fro, int beg, int end,
         // for, and that we removed from tow, as well.
         int j, k;
         for (j = 0, k = 0; k < tow->num_pairs; ++k) {
-            if (tow->pair_offsets[k] != 0) {
-                tow->pair_offsets[j] = tow->pair_offsets[k];
+            if (pair_offsets(tow)[k] != 0) {
+                pair_offsets(tow)[j] = pair_offsets(tow)[k];
 
                 j += 1;
             }
@@ -960,7 +1247,7 @@ void split(value_sizer_t *sizer, leaf_node_t *node, leaf_node_t *rnode, btree_ke
     int tstamp_back_offset;
     int mandatory = mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS, &tstamp_back_offset);
 
-    rassert(mandatory >= free_space(sizer) - leaf_epsilon(sizer));
+    rassert(mandatory >= free_space(sizer, node) - leaf_epsilon(sizer));
 
     // We shall split the mandatory cost of this node as evenly as possible.
 
@@ -969,7 +1256,7 @@ void split(value_sizer_t *sizer, leaf_node_t *node, leaf_node_t *rnode, btree_ke
     int prev_rcost = 0;
     int rcost = 0;
     while (i >= 0 && rcost < mandatory / 2) {
-        int offset = node->pair_offsets[i];
+        int offset = pair_offsets(node)[i];
         entry_t *ent = get_entry(node, offset);
 
         // We only take mandatory entries' costs into consideration,
@@ -1018,39 +1305,73 @@ void split(value_sizer_t *sizer, leaf_node_t *node, leaf_node_t *rnode, btree_ke
 
     // If our math was right, neither node can be underfull just
     // considering the split of the mandatory costs.
-    rassert(end_rcost >= free_space(sizer) / 2 - leaf_epsilon(sizer));
-    rassert(mandatory - end_rcost >= free_space(sizer) / 2 - leaf_epsilon(sizer));
+    rassert(end_rcost >= free_space(sizer, node) / 2 - leaf_epsilon(sizer));
+    rassert(mandatory - end_rcost >= free_space(sizer, node) / 2 - leaf_epsilon(sizer));
 
     // Now we wish to move the elements at indices [s, num_pairs) to rnode.
 
     init(sizer, rnode);
+    if (has_key_prefix(node)) {
+        guarantee(set_key_prefix(sizer, rnode, key_prefix(node)));
+    }
 
     int node_copysize = end_rcost - num_mandatories * sizeof(uint16_t);
     move_elements(sizer, node, s, node->num_pairs, 0, rnode, node_copysize,
                   tstamp_back_offset, NULL);
 
-    keycpy(median_out, entry_key(get_entry(node, node->pair_offsets[s - 1])));
+    full_key(node, entry_key(get_entry(node, pair_offsets(node)[s - 1])), median_out);
+}
+
+// Returns the `fro_copysize` for moving all elements of `node` with
+// `move_elements()`, and outputs the matching `fro_mand_offset`.
+int copysize_of_all_elements(value_sizer_t *sizer, const leaf_node_t *node, int *tstamp_back_offset_out) {
+    int copysize = mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS, tstamp_back_offset_out);
+
+    // Uncount the uint16_t cost of mandatory  entries.  Sigh.
+    for (int i = 0; i < node->num_pairs; ++i) {
+        if (pair_offsets(node)[i] < *tstamp_back_offset_out || entry_is_deletion(get_entry(node, pair_offsets(node)[i]))) {
+            copysize -= sizeof(uint16_t);
+        }
+    }
+    return copysize;
 }
 
 void merge(value_sizer_t *sizer, leaf_node_t *left, leaf_node_t *right) {
     rassert(left != right);
 
+    if (!have_same_key_prefix(left, right)) {
+        // `is_mergable()` has made sure that this works out.
+        store_key_t prefix;
+        common_key_prefix(left, right, prefix.btree_key());
+        guarantee(set_key_prefix(sizer, left, prefix.btree_key()));
+        guarantee(set_key_prefix(sizer, right, prefix.btree_key()));
+    }
+
     rassert(is_underfull(sizer, left));
     rassert(is_underfull(sizer, right));
 
     int tstamp_back_offset;
-    int mandatory = mandatory_cost(sizer, left, MANDATORY_TIMESTAMPS, &tstamp_back_offset);
+    int left_copysize = copysize_of_all_elements(sizer, left, &tstamp_back_offset);
 
-    int left_copysize = mandatory;
-    // Uncount the uint16_t cost of mandatory  entries.  Sigh.
-    for (int i = 0; i < left->num_pairs; ++i) {
-        if (left->pair_offsets[i] < tstamp_back_offset || entry_is_deletion(get_entry(left, left->pair_offsets[i]))) {
-            left_copysize -= sizeof(uint16_t);
+    move_elements(sizer, left, 0, left->num_pairs, 0, right, left_copysize,
+                  tstamp_back_offset, NULL);
+}
+
+// Erases the entries with pair_offsets indices in the clopen range [beg,
+// end), leaving behind no trace.
+void erase_elements(value_sizer_t *sizer, leaf_node_t *node, int beg, int end) {
+    for (int i = beg; i < end; ++i) {
+        entry_t *ent = get_entry(node, pair_offsets(node)[i]);
+        int sz = entry_size(sizer, ent);
+        if (entry_is_live(ent)) {
+            node->live_size -= sizeof(uint16_t) + sz;
         }
+        clean_entry(ent, sz);
     }
+    memmove(pair_offsets(node) + beg, pair_offsets(node) + end, sizeof(uint16_t) * (node->num_pairs - end));
+    node->num_pairs -= end - beg;
 
-    move_elements(sizer, left, 0, left->num_pairs, 0, right, left_copysize,
-                  tstamp_back_offset, NULL);
+    validate(sizer, node);
 }
 
 // We move keys out of sibling and into node.
@@ -1060,19 +1381,43 @@ bool level(value_sizer_t *sizer, int nodecmp_node_with_sib,
            std::vector<const void *> *moved_values_out) {
     rassert(node != sibling);
 
+    // If the nodes have different key prefixes, `node` needs to switch to
+    // their common prefix (`sibling`'s key range shrinks, so it can keep
+    // its prefix).  That makes `node` larger, so we make our plans based on
+    // a converted copy of it, and only touch `node` once we know that
+    // leveling works out.
+    const bool same_key_prefix = have_same_key_prefix(node, sibling);
+    store_key_t prefix;
+    scoped_malloc_t<leaf_node_t> node_copy;
+    leaf_node_t *tow = node;
+    if (!same_key_prefix) {
+        common_key_prefix(node, sibling, prefix.btree_key());
+        node_copy = scoped_malloc_t<leaf_node_t>(sizer->block_size().value());
+        if (!copy_with_key_prefix(sizer, node, 0, node->num_pairs, prefix.btree_key(),
+                                  node_copy.get())
+            || !is_underfull(sizer, node_copy.get())
+            || is_underfull(sizer, sibling)) {
+            return false;
+        }
+        tow = node_copy.get();
+    }
+
     // If sibling were underfull, we'd just merge the nodes.
-    rassert(is_underfull(sizer, node));
+    rassert(is_underfull(sizer, tow));
     rassert(!is_underfull(sizer, sibling));
 
     // First figure out the inclusive range [beg, end] of elements we want to move
     // from sibling.
     int beg, end, *w, wstep;
 
-    int node_weight = mandatory_cost(sizer, node, MANDATORY_TIMESTAMPS);
+    int node_weight = mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS);
     int tstamp_back_offset;
     int sibling_weight = mandatory_cost(sizer, sibling, MANDATORY_TIMESTAMPS,
                                         &tstamp_back_offset);
 
+    if (!same_key_prefix && node_weight >= sibling_weight) {
+        return false;
+    }
     rassert(node_weight < sibling_weight);
 
     if (nodecmp_node_with_sib < 0) {
@@ -1100,7 +1445,7 @@ bool level(value_sizer_t *sizer, int nodecmp_node_with_sib,
     int num_mandatories = 0;
     int prev_diff = sizer->block_size().value();  // some impossibly large value
     for (;;) {
-        int offset = sibling->pair_offsets[*w];
+        int offset = pair_offsets(sibling)[*w];
         entry_t *ent = get_entry(sibling, offset);
 
         // We only take mandatory entries' costs into consideration.
@@ -1135,6 +1480,9 @@ bool level(value_sizer_t *sizer, int nodecmp_node_with_sib,
         *w += wstep;
     }
 
+    if (!same_key_prefix && end - beg == sibling->num_pairs - 1) {
+        return false;
+    }
     rassert(end - beg < sibling->num_pairs - 1);
 
     if (prev_diff <= sibling_weight - node_weight) {
@@ -1149,51 +1497,105 @@ bool level(value_sizer_t *sizer, int nodecmp_node_with_sib,
         return false;
     }
 
-    int sib_copysize = weight_movement - num_mandatories * sizeof(uint16_t);
-    move_elements(sizer, sibling, beg, end + 1,
-                  nodecmp_node_with_sib < 0 ? node->num_pairs : 0, node,
-                  sib_copysize, tstamp_back_offset, moved_values_out);
+    const int wpoint = nodecmp_node_with_sib < 0 ? node->num_pairs : 0;
+    if (same_key_prefix) {
+        int sib_copysize = weight_movement - num_mandatories * sizeof(uint16_t);
+        move_elements(sizer, sibling, beg, end + 1, wpoint, node,
+                      sib_copysize, tstamp_back_offset, moved_values_out);
+    } else {
+        // `move_elements()` copies entries verbatim, so we convert the
+        // entries we want to move to the common prefix first, then move
+        // them over and erase the originals from `sibling`.
+        scoped_malloc_t<leaf_node_t> moved(sizer->block_size().value());
+        if (!copy_with_key_prefix(sizer, sibling, beg, end + 1, prefix.btree_key(),
+                                  moved.get())) {
+            return false;
+        }
+        int moved_tstamp_back_offset;
+        int moved_copysize = copysize_of_all_elements(sizer, moved.get(),
+                                                      &moved_tstamp_back_offset);
+        if (moved_copysize + mandatory_cost(sizer, tow, MANDATORY_TIMESTAMPS)
+            > free_space(sizer, tow)) {
+            return false;
+        }
+
+        memcpy(node, tow, sizer->block_size().value());
+        move_elements(sizer, moved.get(), 0, moved->num_pairs, wpoint, node,
+                      moved_copysize, moved_tstamp_back_offset, moved_values_out);
+        erase_elements(sizer, sibling, beg, end + 1);
+    }
 
     guarantee(node->num_pairs > 0);
     guarantee(sibling->num_pairs > 0);
 
     if (nodecmp_node_with_sib < 0) {
-        keycpy(replacement_key_out, entry_key(get_entry(node, node->pair_offsets[node->num_pairs - 1])));
+        full_key(node, entry_key(get_entry(node, pair_offsets(node)[node->num_pairs - 1])),
+                 replacement_key_out);
     } else {
-        keycpy(replacement_key_out, entry_key(get_entry(sibling, sibling->pair_offsets[sibling->num_pairs - 1])));
+        full_key(sibling, entry_key(get_entry(sibling, pair_offsets(sibling)[sibling->num_pairs - 1])),
+                 replacement_key_out);
     }
 
     return true;
 }
 
 bool is_mergable(value_sizer_t *sizer, const leaf_node_t *node, const leaf_node_t *sibling) {
-    return is_underfull(sizer, node) && is_underfull(sizer, sibling);
+    if (!is_underfull(sizer, node) || !is_underfull(sizer, sibling)) {
+        return false;
+    }
+    if (have_same_key_prefix(node, sibling)) {
+        return true;
+    }
+
+    // `merge()` will have to switch both nodes to their common key prefix
+    // first, so that's what we have to check.
+    store_key_t prefix;
+    common_key_prefix(node, sibling, prefix.btree_key());
+    scoped_malloc_t<leaf_node_t> node_copy(sizer->block_size().value());
+    scoped_malloc_t<leaf_node_t> sibling_copy(sizer->block_size().value());
+    return copy_with_key_prefix(sizer, node, 0, node->num_pairs, prefix.btree_key(),
+                                node_copy.get())
+        && copy_with_key_prefix(sizer, sibling, 0, sibling->num_pairs, prefix.btree_key(),
+                                sibling_copy.get())
+        && is_underfull(sizer, node_copy.get())
+        && is_underfull(sizer, sibling_copy.get());
 }
 
-// Sets *index_out to the index for the live entry or deletion entry
-// for the key, or to the index the key would have if it were
-// inserted.  Returns true if the key at said index is actually equal.
-bool find_key(const leaf_node_t *node, const btree_key_t *key, int *index_out) {
+// Like `find_key()`, but `key` is in the form in which it would be stored in
+// the node (i.e. without the node's key prefix).
+bool find_stored_key(const leaf_node_t *node, const btree_key_t *key, int *index_out) {
+    const uint16_t *offsets = pair_offsets(node);
     int beg = 0;
     int end = node->num_pairs;
 
     // beg == 0 or key > *(beg - 1).
     // end == num_pairs or key < *end.
 
+    // The length of the common prefix of key and *(beg - 1), and of key and *end
+    // (0 if those don't exist).  All entries in [beg, end) share the shorter of
+    // the two prefixes with key, so we don't need to compare it again.
+    int beg_prefix = 0;
+    int end_prefix = 0;
+
     while (beg < end) {
         // when (end - beg) > 0, (end - beg) / 2 is always less than (end - beg).  So beg <= test_point < end.
         int test_point = beg + (end - beg) / 2;
 
-        const btree_key_t *ek = entry_key(get_entry(node, node->pair_offsets[test_point]));
+        const btree_key_t *ek = entry_key(get_entry(node, offsets[test_point]));
 
-        int res = btree_key_cmp(key, ek);
+        int common_prefix;
+        int res = btree_key_cmp_skipping_prefix(key, ek,
+                                                std::min(beg_prefix, end_prefix),
+                                                &common_prefix);
 
         if (res < 0) {
             // key < *test_point.
             end = test_point;
+            end_prefix = common_prefix;
         } else if (res > 0) {
             // key > *test_point.  Since test_point < end, we have test_point + 1 <= end.
             beg = test_point + 1;
+            beg_prefix = common_prefix;
         } else {
             // We found the key!
             *index_out = test_point;
@@ -1208,10 +1610,32 @@ bool find_key(const leaf_node_t *node, const btree_key_t *key, int *index_out) {
     return false;
 }
 
+// Sets *index_out to the index for the live entry or deletion entry
+// for the key, or to the index the key would have if it were
+// inserted.  Returns true if the key at said index is actually equal.
+bool find_key(const leaf_node_t *node, const btree_key_t *key, int *index_out) {
+    const btree_key_t *prefix = key_prefix(node);
+    if (prefix == NULL) {
+        return find_stored_key(node, key, index_out);
+    }
+
+    int common_prefix;
+    int res = btree_key_cmp_skipping_prefix(key, prefix, 0, &common_prefix);
+    if (common_prefix < prefix->size) {
+        // The key doesn't start with the prefix, so it's either smaller or
+        // larger than all keys in the node.
+        *index_out = res < 0 ? 0 : node->num_pairs;
+        return false;
+    }
+
+    store_key_t stored_key(key->size - prefix->size, key->contents + prefix->size);
+    return find_stored_key(node, stored_key.btree_key(), index_out);
+}
+
 bool lookup(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, void *value_out) {
     int index;
     if (find_key(node, key, &index)) {
-        const entry_t *ent = get_entry(node, node->pair_offsets[index]);
+        const entry_t *ent = get_entry(node, pair_offsets(node)[index]);
         if (entry_is_live(ent)) {
             const void *val = entry_value(ent);
             memcpy(value_out, val, sizer->size(val));
@@ -1281,7 +1705,7 @@ MUST_USE bool prepare_space_for_new_entry(
     bool found = find_key(node, key, &index);
 
     if (found) {
-        int offset = node->pair_offsets[index];
+        int offset = pair_offsets(node)[index];
         entry_t *ent = get_entry(node, offset);
 
         int sz = entry_size(sizer, ent);
@@ -1312,7 +1736,7 @@ MUST_USE bool prepare_space_for_new_entry(
     We check for this condition further down, and recover from it by dropping
     all existing timestamps and discarding the delete entry by returning `false`. */
 
-    if (offsetof(leaf_node_t, pair_offsets) +
+    if (header_size(node) +
             sizeof(uint16_t) * (node->num_pairs + (found ? 0 : 1)) +
             sizeof(repli_timestamp_t) +
             new_entry_size >
@@ -1322,8 +1746,8 @@ MUST_USE bool prepare_space_for_new_entry(
             /* We can't re-use an existing index if we're garbage collecting. */
             found = false;
             memmove(
-                node->pair_offsets + index,
-                node->pair_offsets + index + 1,
+                pair_offsets(node) + index,
+                pair_offsets(node) + index + 1,
                 sizeof(uint16_t) * (node->num_pairs - index - 1));
             --node->num_pairs;
         }
@@ -1391,7 +1815,7 @@ MUST_USE bool prepare_space_for_new_entry(
     bool drop_timestamps = false;
     if (actually_create_entry
         && !allow_after_tstamp_cutpoint
-        && offsetof(leaf_node_t, pair_offsets)
+        && header_size(node)
            + sizeof(uint16_t) * (node->num_pairs + (found ? 0 : 1))
            + new_entry_size
            + sizeof(repli_timestamp_t)
@@ -1406,8 +1830,8 @@ MUST_USE bool prepare_space_for_new_entry(
             a new one; close the gap in `pair_offsets`. `index` is the location
             of the open slot. */
             memmove(
-                node->pair_offsets + index,
-                node->pair_offsets + index + 1,
+                pair_offsets(node) + index,
+                pair_offsets(node) + index + 1,
                 sizeof(uint16_t) * (node->num_pairs - index - 1));
             --node->num_pairs;
         }
@@ -1426,8 +1850,8 @@ MUST_USE bool prepare_space_for_new_entry(
 
     if (!found) {
         memmove(
-            node->pair_offsets + index + 1,
-            node->pair_offsets + index,
+            pair_offsets(node) + index + 1,
+            pair_offsets(node) + index,
             sizeof(uint16_t) * (node->num_pairs - index));
         ++node->num_pairs;
     }
@@ -1452,14 +1876,14 @@ MUST_USE bool prepare_space_for_new_entry(
         the entries */
         for (int i = 0; i < node->num_pairs; ++i) {
             if (i == index) continue;
-            if (node->pair_offsets[i] < end_of_where_new_entry_should_go) {
-                node->pair_offsets[i] -= total_space_for_new_entry;
+            if (pair_offsets(node)[i] < end_of_where_new_entry_should_go) {
+                pair_offsets(node)[i] -= total_space_for_new_entry;
             }
         }
     }
 
     node->frontmost -= total_space_for_new_entry;
-    guarantee(offsetof(leaf_node_t, pair_offsets)
+    guarantee(header_size(node)
               + sizeof(uint16_t) * node->num_pairs <= node->frontmost);
 
     /* Write the timestamp if we need one, and update `node->tstamp_cutpoint` if
@@ -1475,7 +1899,7 @@ MUST_USE bool prepare_space_for_new_entry(
 
     /* Record the offset in `pair_offsets` */
 
-    node->pair_offsets[index] = start_of_where_new_entry_should_go;
+    pair_offsets(node)[index] = start_of_where_new_entry_should_go;
 
     /* Fill output variable */
 
@@ -1503,20 +1927,20 @@ void insert(
 
     /* Make space for the entry itself */
 
+    const int key_size = stored_key_size(node, key);
     char *location_to_write_data;
     bool should_write = prepare_space_for_new_entry(sizer, node,
-        key, key->full_size() + sizer->size(value), tstamp, maximum_existing_tstamp,
+        key, key_size + sizer->size(value), tstamp, maximum_existing_tstamp,
         true,
         &location_to_write_data);
     guarantee(should_write);
 
     /* Now copy the data into the node itself */
 
-    memcpy(location_to_write_data, key, key->full_size());
-    location_to_write_data += key->full_size();
+    location_to_write_data = write_stored_key(node, key, location_to_write_data);
     memcpy(location_to_write_data, value, sizer->size(value));
 
-    node->live_size += sizeof(uint16_t) + key->full_size() + sizer->size(value);
+    node->live_size += sizeof(uint16_t) + key_size + sizer->size(value);
 
     validate(sizer, node);
 }
@@ -1536,14 +1960,14 @@ void remove(
     char *location_to_write_data;
     if (prepare_space_for_new_entry(sizer, node,
             key,
-            1 + key->full_size(),   /* 1 for `DELETE_ENTRY_CODE` */
+            1 + stored_key_size(node, key),   /* 1 for `DELETE_ENTRY_CODE` */
             tstamp,
             maximum_existing_tstamp,
             false,
             &location_to_write_data)) {
         *location_to_write_data = static_cast<char>(DELETE_ENTRY_CODE);
         ++location_to_write_data;
-        memcpy(location_to_write_data, key, key->full_size());
+        write_stored_key(node, key, location_to_write_data);
     }
 
     validate(sizer, node);
@@ -1554,7 +1978,7 @@ void erase_presence(value_sizer_t *sizer, leaf_node_t *node, const btree_key_t *
     int index;
     bool found = find_key(node, key, &index);
     if (found) {
-        int offset = node->pair_offsets[index];
+        int offset = pair_offsets(node)[index];
         entry_t *ent = get_entry(node, offset);
 
         int sz = entry_size(sizer, ent);
@@ -1564,7 +1988,7 @@ void erase_presence(value_sizer_t *sizer, leaf_node_t *node, const btree_key_t *
 
         clean_entry(ent, sz);
 
-        memmove(node->pair_offsets + index, node->pair_offsets + index + 1, (node->num_pairs - (index + 1)) * sizeof(uint16_t));
+        memmove(pair_offsets(node) + index, pair_offsets(node) + index + 1, (node->num_pairs - (index + 1)) * sizeof(uint16_t));
         node->num_pairs -= 1;
     }
 
@@ -1646,13 +2070,13 @@ void erase_deletions(
     int src = 0, dst = 0;
     int num_deleted = deletion_offsets.size();
     for (; src < node->num_pairs; ++src) {
-        uint16_t off = node->pair_offsets[src];
+        uint16_t off = pair_offsets(node)[src];
         auto it = deletion_offsets.find(off);
         if (it == deletion_offsets.end()) {
             if (off >= new_tstamp_cutpoint && off < old_tstamp_cutpoint) {
                 off += sizeof(repli_timestamp_t);
             }
-            node->pair_offsets[dst++] = off;
+            pair_offsets(node)[dst++] = off;
         } else {
             guarantee(off >= new_tstamp_cutpoint && off < old_tstamp_cutpoint);
             deletion_offsets.erase(it);
@@ -1678,6 +2102,7 @@ continue_bool_t visit_entries(
             const void *value   /* null for deletion */
             )> &cb) {
     repli_timestamp_t earliest_so_far = maximum_existing_timestamp;
+    store_key_t key_buf;
     for (entry_iter_t iter = entry_iter_t::make(node);
             !iter.done(sizer); iter.step(sizer, node)) {
         repli_timestamp_t tstamp;
@@ -1694,7 +2119,13 @@ continue_bool_t visit_entries(
             continue;
         }
 
-        if (continue_bool_t::ABORT == cb(entry_key(ent), tstamp, entry_value(ent))) {
+        const btree_key_t *key = entry_key(ent);
+        if (has_key_prefix(node)) {
+            full_key(node, key, key_buf.btree_key());
+            key = key_buf.btree_key();
+        }
+
+        if (continue_bool_t::ABORT == cb(key, tstamp, entry_value(ent))) {
             return continue_bool_t::ABORT;
         }
     }
@@ -1710,8 +2141,13 @@ iterator::iterator(const leaf_node_t *node, int index)
 std::pair<const btree_key_t *, const void *> iterator::operator*() const {
     guarantee(index_ < static_cast<int>(node_->num_pairs));
     guarantee(index_ >= 0);
-    const entry_t *entree = get_entry(node_, node_->pair_offsets[index_]);
-    return std::make_pair(entry_key(entree), entry_value(entree));
+    const entry_t *entree = get_entry(node_, pair_offsets(node_)[index_]);
+    const btree_key_t *key = entry_key(entree);
+    if (has_key_prefix(node_)) {
+        full_key(node_, key, key_buf_.btree_key());
+        key = key_buf_.btree_key();
+    }
+    return std::make_pair(key, entry_value(entree));
 }
 
 iterator &iterator::operator++() {
@@ -1719,7 +2155,7 @@ iterator &iterator::operator++() {
               "Trying to increment past the end of an iterator.");
     do {
         ++index_;
-    } while (index_ < node_->num_pairs && !entry_is_live(get_entry(node_, node_->pair_offsets[index_])));
+    } while (index_ < node_->num_pairs && !entry_is_live(get_entry(node_, pair_offsets(node_)[index_])));
     return *this;
 }
 
@@ -1727,7 +2163,7 @@ iterator &iterator::operator--() {
     guarantee(index_ > -1, "Trying to decrement past the beginning of an iterator.");
     do {
         --index_;
-    } while (index_ >= 0 && !entry_is_live(get_entry(node_, node_->pair_offsets[index_])));
+    } while (index_ >= 0 && !entry_is_live(get_entry(node_, pair_offsets(node_)[index_])));
     return *this;
 }
 
@@ -1790,7 +2226,7 @@ leaf::iterator inclusive_lower_bound(const btree_key_t *key, const leaf_node_t &
     int index;
     leaf::find_key(&leaf_node, key, &index);
     if (index == leaf_node.num_pairs ||
-        entry_is_live(leaf::get_entry(&leaf_node, leaf_node.pair_offsets[index]))) {
+        entry_is_live(leaf::get_entry(&leaf_node, pair_offsets(&leaf_node)[index]))) {
         return leaf_node_t::iterator(&leaf_node, index);
     } else {
         return ++leaf_node_t::iterator(&leaf_node, index);
@@ -1799,12 +2235,10 @@ leaf::iterator inclusive_lower_bound(const btree_key_t *key, const leaf_node_t &
 
 leaf::reverse_iterator exclusive_upper_bound(const btree_key_t *key, const leaf_node_t &leaf_node) {
     int index;
-    leaf::find_key(&leaf_node, key, &index);
+    bool found = leaf::find_key(&leaf_node, key, &index);
     if (index < leaf_node.num_pairs) {
-        const leaf::entry_t *entry = leaf::get_entry(&leaf_node, leaf_node.pair_offsets[index]);
-        const btree_key_t *ekey = leaf::entry_key(entry);
-        if (entry_is_live(entry) &&
-            btree_key_cmp(ekey, key) == 0) {
+        const leaf::entry_t *entry = leaf::get_entry(&leaf_node, pair_offsets(&leaf_node)[index]);
+        if (entry_is_live(entry) && found) {
             // We have to skip this entry to make the iterator exclusive,
             // hence the ++.
             return ++leaf_node_t::reverse_iterator(&leaf_node, index);
@@ -9,11 +9,11 @@
 #include "errors.hpp"
 #include <boost/optional.hpp>
 
+#include "btree/keys.hpp"
 #include "btree/types.hpp"
 #include "buffer_cache/types.hpp"
 
 class value_sizer_t;
-struct btree_key_t;
 class repli_timestamp_t;
 
 // TODO: Could key_modification_proof_t not go in this file?
@@ -42,6 +42,8 @@ class reverse_iterator;
 struct leaf_node_t {
     // The value-type-specific magic value.  It's a bit of a hack, but
     // it's possible to construct a value_sizer_t based on this value.
+    // Nodes that store their keys relative to a key prefix use the
+    // variant returned by leaf::key_prefix_magic.
     block_magic_t magic;
 
     // The size of pair_offsets.
@@ -58,7 +60,9 @@ struct leaf_node_t {
     // The first offset whose entry is not accompanied by a timestamp.
     uint16_t tstamp_cutpoint;
 
-    // The pair offsets.
+    // The pair offsets.  If the node has a key prefix, the prefix is
+    // stored here instead (as a btree_key_t padded to an even size),
+    // and the pair offsets follow it.
     uint16_t pair_offsets[];
 
     //Iteration
@@ -94,6 +98,29 @@ leaf_node_t::reverse_iterator exclusive_upper_bound(const btree_key_t *key, cons
 const int MANDATORY_TIMESTAMPS = 5;
 const int DELETION_RESERVE_FRACTION = 10;
 
+// A leaf node can store its keys relative to a key prefix that every
+// key in the node's key range shares, so that the prefix is only
+// stored once per node.  Such nodes are marked by a variant of the
+// value type's leaf magic (the plain magic with the high bit of its
+// first byte set), which lets us tell the two formats apart without a
+// sizer.  Nodes without a prefix keep using the plain magic, so old
+// nodes stay valid and get converted as they split.
+block_magic_t key_prefix_magic(block_magic_t leaf_magic);
+
+// Returns true if `magic` is either of the leaf magics of `sizer`.
+bool is_leaf_magic(value_sizer_t *sizer, block_magic_t magic);
+
+// Returns the node's key prefix, or NULL if it has none.
+const btree_key_t *key_prefix(const leaf_node_t *node);
+
+// Called on a leaf node whose key range is (left_exclusive_or_null,
+// right_inclusive_or_null], where NULL stands for an unbounded side.
+// Extends the node's key prefix to the longest prefix shared by the
+// whole range, if the sizer allows key prefixes and doing so saves
+// space.
+void grow_key_prefix(value_sizer_t *sizer, leaf_node_t *node,
+                     const btree_key_t *left_exclusive_or_null,
+                     const btree_key_t *right_inclusive_or_null);
 
 
 
@@ -127,6 +154,10 @@ bool is_empty(const leaf_node_t *node);
 
 bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value);
 
+/* Like `is_full()`, but only lets the node's contents take up `fill_factor` (a value
+in (0, 1]) of the space in the node.  Used for packing nodes when bulk loading. */
+bool is_full(value_sizer_t *sizer, const leaf_node_t *node, const btree_key_t *key, const void *value, double fill_factor);
+
 bool is_underfull(value_sizer_t *sizer, const leaf_node_t *node);
 
 void split(value_sizer_t *sizer, leaf_node_t *node, leaf_node_t *sibling,
@@ -187,7 +218,8 @@ void erase_deletions(
 
 /* Calls `cb` on every entry in the node, whether a real entry or a deletion. The calls
 will be in order from most recent to least recent. For entries with no timestamp, the
-callback will get `min_deletion_timestamp() - 1`. */
+callback will get `min_deletion_timestamp() - 1`. The key pointer is only valid for the
+duration of the call. */
 continue_bool_t visit_entries(
     value_sizer_t *sizer,
     const leaf_node_t *node,
@@ -199,6 +231,9 @@ continue_bool_t visit_entries(
         const void *value   /* null for deletion */
         )> &cb);
 
+// If the node has a key prefix, the key pointers returned by the
+// iterators point into the iterator itself, and are only valid until the
+// iterator is changed or destroyed.
 class iterator {
 public:
     iterator();
@@ -217,6 +252,8 @@ private:
     int cmp(const iterator &other) const;
     const leaf_node_t *node_;
     int index_;
+    // Holds the full key for operator* if the node has a key prefix.
+    mutable store_key_t key_buf_;
 };
 
 class reverse_iterator {
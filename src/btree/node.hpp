@@ -26,6 +26,10 @@ public:
     virtual block_magic_t btree_leaf_magic() const = 0;
     virtual max_block_size_t block_size() const = 0;
 
+    // Whether leaf nodes may store their keys relative to a key prefix (see
+    // `leaf::grow_key_prefix()`).  Nodes in either format can be read regardless.
+    virtual bool btree_leaf_key_prefixes() const { return false; }
+
 private:
     DISABLE_COPYING(value_sizer_t);
 };
@@ -62,6 +62,36 @@ void detach_all_children(const node_t *node, buf_parent_t parent,
     }
 }
 
+// Helper function for `check_and_handle_split()`. `lbuf` and `rbuf` are the two
+// leaf nodes that were just split at `median`, which has already been inserted into
+// `parent`.
+void grow_leaf_key_prefixes(value_sizer_t *sizer, const internal_node_t *parent,
+                            const btree_key_t *median,
+                            buf_lock_t *lbuf, buf_lock_t *rbuf) {
+    // `lbuf` covers the keys in (key before `median`, `median`], `rbuf` the keys
+    // in (`median`, key after `median`]. The first and last child of `parent` are
+    // unbounded on one side (at least as far as `parent` knows), so they don't
+    // get a prefix.
+    const int index = internal_node::get_offset_index(parent, median);
+    rassert(index < parent->npairs - 1);
+    const btree_key_t *left_bound = index > 0
+        ? &internal_node::get_pair_by_index(parent, index - 1)->key
+        : NULL;
+    const btree_key_t *right_bound = index + 1 < parent->npairs - 1
+        ? &internal_node::get_pair_by_index(parent, index + 1)->key
+        : NULL;
+    if (left_bound != NULL) {
+        buf_write_t write(lbuf);
+        leaf::grow_key_prefix(sizer, static_cast<leaf_node_t *>(write.get_data_write()),
+                              left_bound, median);
+    }
+    if (right_bound != NULL) {
+        buf_write_t write(rbuf);
+        leaf::grow_key_prefix(sizer, static_cast<leaf_node_t *>(write.get_data_write()),
+                              median, right_bound);
+    }
+}
+
 // Split the node if necessary. If the node is a leaf_node, provide the new
 // value that will be inserted; if it's an internal node, provide NULL (we
 // split internal nodes proactively).
@@ -145,11 +175,18 @@ void check_and_handle_split(value_sizer_t *sizer,
 
     {
         buf_write_t last_write(last_buf);
+        internal_node_t *parent_node
+            = static_cast<internal_node_t *>(last_write.get_data_write());
         DEBUG_VAR bool success
-            = internal_node::insert(static_cast<internal_node_t *>(last_write.get_data_write()),
-                                    median,
+            = internal_node::insert(parent_node, median,
                                     buf->block_id(), rbuf.block_id());
         rassert(success, "could not insert internal btree node");
+
+        // The split has narrowed down the key ranges of both leaf nodes, so
+        // they might be able to use longer key prefixes now.
+        if (new_value != NULL) {
+            grow_leaf_key_prefixes(sizer, parent_node, median, buf, &rbuf);
+        }
     }
 
     // We've split the node; now figure out where the key goes and release the other buf (since we're done with it).
@@ -545,6 +582,105 @@ void find_keyvalue_location_for_read(
     }
 }
 
+// Looks up `keys[begin, end)` in the subtree rooted at `buf`.
+void find_keyvalues_in_subtree(
+        value_sizer_t *sizer,
+        buf_lock_t *buf,
+        const std::vector<const btree_key_t *> &keys,
+        size_t begin,
+        size_t end,
+        batched_read_callback_t *cb,
+        profile::trace_t *trace) {
+#ifndef NDEBUG
+    {
+        buf_read_t read(buf);
+        node::validate(sizer, static_cast<const node_t *>(read.get_data_read()));
+    }
+#endif  // NDEBUG
+
+    // The children that we have to visit, along with the end of the run of keys
+    // that belongs to each of them.  Since the keys are sorted, all keys that go to
+    // the same child are adjacent.
+    std::vector<std::pair<block_id_t, size_t> > children;
+    {
+        buf_read_t read(buf);
+        const void *data = read.get_data_read();
+        if (!node::is_internal(static_cast<const node_t *>(data))) {
+            const leaf_node_t *leaf = static_cast<const leaf_node_t *>(data);
+            scoped_malloc_t<void> value(sizer->max_possible_size());
+            for (size_t i = begin; i < end; ++i) {
+                if (leaf::lookup(sizer, leaf, keys[i], value.get())) {
+                    cb->on_value(i, value.get(), buf_parent_t(buf));
+                }
+            }
+            return;
+        }
+
+        const internal_node_t *internal = static_cast<const internal_node_t *>(data);
+        for (size_t i = begin; i < end; ++i) {
+            const block_id_t child_id = internal_node::lookup(internal, keys[i]);
+            rassert(child_id != NULL_BLOCK_ID && child_id != SUPERBLOCK_ID);
+            if (children.empty() || children.back().first != child_id) {
+                children.push_back(std::make_pair(child_id, i + 1));
+            } else {
+                children.back().second = i + 1;
+            }
+        }
+    }
+
+    size_t child_begin = begin;
+    for (size_t i = 0; i < children.size(); ++i) {
+        buf_lock_t child;
+        {
+            profile::starter_t starter("Acquire a block for read.", trace);
+            child = buf_lock_t(buf, children[i].first, access_t::read);
+        }
+        if (i + 1 == children.size()) {
+            // Like `find_keyvalue_location_for_read`, let go of the parent as soon as
+            // we no longer need it.
+            buf->reset_buf_lock();
+        }
+        find_keyvalues_in_subtree(sizer, &child, keys, child_begin, children[i].second,
+                                  cb, trace);
+        child_begin = children[i].second;
+    }
+}
+
+void find_keyvalues_for_read(
+        value_sizer_t *sizer,
+        superblock_t *superblock,
+        const std::vector<const btree_key_t *> &keys,
+        batched_read_callback_t *cb,
+        btree_stats_t *stats,
+        profile::trace_t *trace) {
+#ifndef NDEBUG
+    for (size_t i = 1; i < keys.size(); ++i) {
+        rassert(btree_key_cmp(keys[i - 1], keys[i]) < 0);
+    }
+#endif
+    stats->pm_keys_read.record(keys.size());
+    stats->pm_total_keys_read += keys.size();
+
+    const block_id_t root_id = superblock->get_root_block_id();
+    rassert(root_id != SUPERBLOCK_ID);
+
+    if (root_id == NULL_BLOCK_ID || keys.empty()) {
+        // There is no root, so the tree is empty.
+        superblock->release();
+        return;
+    }
+
+    buf_lock_t buf;
+    {
+        profile::starter_t starter("Acquire a block for read.", trace);
+        buf_lock_t tmp(superblock->expose_buf(), root_id, access_t::read);
+        superblock->release();
+        buf = std::move(tmp);
+    }
+
+    find_keyvalues_in_subtree(sizer, &buf, keys, 0, keys.size(), cb, trace);
+}
+
 void apply_keyvalue_change(
         value_sizer_t *sizer,
         keyvalue_location_t *kv_loc,
@@ -662,3 +798,240 @@ void apply_keyvalue_change(
         stat_block_buf->population += population_change;
     }
 }
+
+btree_bulk_loader_t::btree_bulk_loader_t(value_sizer_t *sizer,
+                                         const value_deleter_t *balancing_detacher,
+                                         double leaf_fill_factor)
+    : sizer_(sizer),
+      balancing_detacher_(balancing_detacher),
+      leaf_fill_factor_(leaf_fill_factor),
+      superblock_(NULL),
+      has_last_key_(false),
+      has_leaf_left_bound_(false),
+      num_appended_(0),
+      unrecorded_population_change_(0) {
+    guarantee(leaf_fill_factor_ > 0 && leaf_fill_factor_ <= 1);
+}
+
+btree_bulk_loader_t::~btree_bulk_loader_t() {
+    rassert(superblock_ == NULL, "btree_bulk_loader_t destroyed without calling stop()");
+}
+
+bool btree_bulk_loader_t::start(superblock_t *superblock, bool resume) {
+    guarantee(superblock_ == NULL);
+    guarantee(edge_.empty());
+    // Only a loader that hasn't appended anything can pick up someone else's tree.
+    resume = resume && !has_last_key_;
+    bool resumed = false;
+    store_key_t resumed_last_key;
+
+    // Walk down the right edge of the tree.  `get_root()` creates an empty leaf node if
+    // the tree doesn't have a root yet.
+    std::vector<buf_lock_t> path;
+    path.push_back(get_root(sizer_, superblock));
+    for (;;) {
+        block_id_t child_id;
+        {
+            buf_read_t read(&path.back());
+            const node_t *node = static_cast<const node_t *>(read.get_data_read());
+            // We can only continue where we left off, not append to an existing tree,
+            // unless we're resuming.
+            if (node::is_leaf(node)) {
+                const leaf_node_t *lnode = reinterpret_cast<const leaf_node_t *>(node);
+                if (!has_last_key_ && !leaf::is_empty(lnode)) {
+                    if (!resume) {
+                        return false;
+                    }
+                    resumed = true;
+                    resumed_last_key.assign((*leaf::rbegin(*lnode)).first);
+                } else if (resume && path.size() > 1) {
+                    // An empty leaf node that isn't the root doesn't tell us the
+                    // largest key in the tree.
+                    return false;
+                }
+                break;
+            }
+            if (!has_last_key_ && !resume) {
+                return false;
+            }
+            const internal_node_t *internal
+                = reinterpret_cast<const internal_node_t *>(node);
+            child_id = internal_node::get_pair_by_index(internal, internal->npairs - 1)->lnode;
+        }
+        buf_lock_t child(&path.back(), child_id, access_t::write);
+        path.push_back(std::move(child));
+    }
+
+    if (resumed) {
+        has_last_key_ = true;
+        last_key_ = resumed_last_key;
+    }
+    superblock_ = superblock;
+    edge_.reserve(path.size());
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        edge_.push_back(std::move(*it));
+    }
+    return true;
+}
+
+buf_parent_t btree_bulk_loader_t::leaf() {
+    guarantee(!edge_.empty());
+    return buf_parent_t(&edge_[0]);
+}
+
+buf_parent_t btree_bulk_loader_t::parent_of(size_t level) {
+    return level + 1 < edge_.size()
+        ? buf_parent_t(&edge_[level + 1])
+        : superblock_->expose_buf();
+}
+
+void btree_bulk_loader_t::append(const btree_key_t *key, const void *value,
+                                 repli_timestamp_t tstamp) {
+    guarantee(!edge_.empty());
+    rassert(!has_last_key_ || btree_key_cmp(last_key_.btree_key(), key) < 0,
+            "Keys must be appended in ascending order.");
+
+    bool leaf_is_full;
+    {
+        buf_read_t read(&edge_[0]);
+        const leaf_node_t *node = static_cast<const leaf_node_t *>(read.get_data_read());
+        leaf_is_full = !leaf::is_empty(node)
+            && leaf::is_full(sizer_, node, key, value, leaf_fill_factor_);
+    }
+    if (leaf_is_full) {
+        // The value's blobs (if any) were created below the old leaf node.
+        balancing_detacher_->delete_value(buf_parent_t(&edge_[0]), value);
+        start_new_leaf();
+    }
+
+    // Maintain the invariant that a node's recency is greater than or equal to that
+    // of anything below it.
+    for (size_t level = edge_.size(); level-- > 1;) {
+        edge_[level].set_recency(superceding_recency(tstamp, edge_[level].get_recency()));
+    }
+    const repli_timestamp_t previous_leaf_recency = edge_[0].get_recency();
+    edge_[0].set_recency(superceding_recency(tstamp, previous_leaf_recency));
+    {
+        buf_write_t write(&edge_[0]);
+        leaf_node_t *node = static_cast<leaf_node_t *>(write.get_data_write());
+        rassert(!leaf::is_full(sizer_, node, key, value));
+        leaf::insert(sizer_, node, key, value, tstamp, previous_leaf_recency,
+                     key_modification_proof_t::real_proof());
+    }
+
+    has_last_key_ = true;
+    last_key_.assign(key);
+    ++num_appended_;
+    ++unrecorded_population_change_;
+}
+
+void btree_bulk_loader_t::start_new_leaf() {
+    guarantee(has_last_key_);
+
+    // The old leaf node is complete now, so we know its key range.
+    if (has_leaf_left_bound_) {
+        buf_write_t write(&edge_[0]);
+        leaf::grow_key_prefix(sizer_, static_cast<leaf_node_t *>(write.get_data_write()),
+                              leaf_left_bound_.btree_key(), last_key_.btree_key());
+    }
+    has_leaf_left_bound_ = true;
+    leaf_left_bound_ = last_key_;
+
+    buf_lock_t new_leaf(parent_of(0), alt_create_t::create);
+    {
+        buf_write_t write(&new_leaf);
+        leaf::init(sizer_, static_cast<leaf_node_t *>(write.get_data_write()));
+    }
+    append_child(1, last_key_.btree_key(), edge_[0].block_id(), edge_[0].get_recency(),
+                 new_leaf.block_id());
+    edge_[0] = std::move(new_leaf);
+}
+
+void btree_bulk_loader_t::append_child(size_t level, const btree_key_t *separator,
+                                       block_id_t lchild_id,
+                                       repli_timestamp_t lchild_recency,
+                                       block_id_t rchild_id) {
+    if (level == edge_.size()) {
+        // The tree grows a new root, like in `check_and_handle_split()`.
+        buf_parent_t sb_buf = superblock_->expose_buf();
+        sb_buf.detach_child(lchild_id);
+        buf_lock_t root(sb_buf, alt_create_t::create);
+        {
+            buf_write_t write(&root);
+            internal_node_t *node = static_cast<internal_node_t *>(write.get_data_write());
+            internal_node::init(sizer_->block_size(), node);
+            DEBUG_VAR bool success
+                = internal_node::insert(node, separator, lchild_id, rchild_id);
+            rassert(success);
+        }
+        root.set_recency(lchild_recency);
+        insert_root(root.block_id(), superblock_);
+        edge_.push_back(std::move(root));
+        return;
+    }
+
+    bool full;
+    {
+        buf_read_t read(&edge_[level]);
+        full = internal_node::is_full(
+            static_cast<const internal_node_t *>(read.get_data_read()));
+    }
+    if (!full) {
+        buf_write_t write(&edge_[level]);
+        internal_node_t *node = static_cast<internal_node_t *>(write.get_data_write());
+        rassert(internal_node::get_pair_by_index(node, node->npairs - 1)->lnode
+                == lchild_id);
+        DEBUG_VAR bool success
+            = internal_node::insert(node, separator, lchild_id, rchild_id);
+        rassert(success);
+        return;
+    }
+
+    // Unlike `check_and_handle_split()`, we keep the full node full and only move its
+    // last child (`lchild_id`) over to the new node, because nothing is ever going to
+    // get inserted to the left of it.
+    buf_lock_t rbuf(parent_of(level), alt_create_t::create);
+    store_key_t median;
+    {
+        buf_write_t write(&edge_[level]);
+        buf_write_t rwrite(&rbuf);
+        internal_node_t *rnode = static_cast<internal_node_t *>(rwrite.get_data_write());
+        internal_node::split_off_last_child(
+            sizer_->block_size(),
+            static_cast<internal_node_t *>(write.get_data_write()),
+            rnode,
+            median.btree_key());
+        DEBUG_VAR bool success
+            = internal_node::insert(rnode, separator, lchild_id, rchild_id);
+        rassert(success);
+    }
+    buf_parent_t(&edge_[level]).detach_child(lchild_id);
+    rbuf.set_recency(edge_[level].get_recency());
+
+    append_child(level + 1, median.btree_key(), edge_[level].block_id(),
+                 edge_[level].get_recency(), rbuf.block_id());
+    edge_[level] = std::move(rbuf);
+}
+
+void btree_bulk_loader_t::stop() {
+    guarantee(superblock_ != NULL);
+
+    // Modify the stats block, like `apply_keyvalue_change()` does.
+    const block_id_t stat_block_id = superblock_->get_stat_block_id();
+    if (stat_block_id != NULL_BLOCK_ID && unrecorded_population_change_ != 0) {
+        buf_lock_t stat_block(buf_parent_t(superblock_->expose_buf().txn()),
+                              stat_block_id, access_t::write);
+        buf_write_t stat_block_write(&stat_block);
+        auto stat_block_buf = static_cast<btree_statblock_t *>(
+                stat_block_write.get_data_write(BTREE_STATBLOCK_SIZE));
+        stat_block_buf->population += unrecorded_population_change_;
+    }
+    unrecorded_population_change_ = 0;
+
+    // Release the leaf node first, and the root last.
+    for (auto &lock : edge_) {
+        lock.reset_buf_lock();
+    }
+    edge_.clear();
+    superblock_ = NULL;
+}
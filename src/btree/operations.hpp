@@ -10,6 +10,7 @@
 #include "btree/node.hpp"
 #include "buffer_cache/alt.hpp"
 #include "concurrency/fifo_enforcer.hpp"
+#include "config/args.hpp"
 #include "concurrency/new_semaphore.hpp"
 #include "concurrency/promise.hpp"
 #include "containers/archive/stl_types.hpp"
@@ -185,6 +186,85 @@ void check_and_handle_underfull(value_sizer_t *sizer,
                                 const btree_key_t *key,
                                 const value_deleter_t *detacher);
 
+/* `btree_bulk_loader_t` builds a B-tree from key/value pairs that arrive in ascending
+key order, without descending the tree for every key.  It only ever appends to the right
+edge of the tree: leaf nodes get packed up to `leaf_fill_factor` and are then left alone,
+and internal nodes are filled up bottom-up as the nodes below them fill up.
+
+A single loader can be used across many transactions, so that building a large tree
+doesn't have to happen in one giant transaction.  Call `start()` with the superblock of
+each transaction and `stop()` before releasing it.  The tree must be empty when the loader
+first starts, and nothing else may modify it until the loader is done, unless the loader
+is started with `resume` (see below). */
+class btree_bulk_loader_t {
+public:
+    btree_bulk_loader_t(value_sizer_t *sizer,
+                        const value_deleter_t *balancing_detacher,
+                        double leaf_fill_factor = BULK_LOAD_LEAF_FILL_FACTOR);
+    ~btree_bulk_loader_t();
+
+    /* Acquires the right edge of the tree below `superblock`.  Returns false without
+    holding on to anything if the tree isn't empty and wasn't built by this loader.
+
+    If `resume` is true, a loader that hasn't appended anything yet also starts on a
+    non-empty tree, and continues after the largest key in it (see `last_key()`).  That
+    lets a tree be loaded in several writes that each have their own loader. */
+    MUST_USE bool start(superblock_t *superblock, bool resume = false);
+
+    /* The leaf node that the next value will be appended to.  Blobs that belong to the
+    value should be created with this as their parent. */
+    buf_parent_t leaf();
+
+    /* `key` must be greater than any key that has been appended before. */
+    void append(const btree_key_t *key, const void *value, repli_timestamp_t tstamp);
+
+    /* Updates the stat block and releases the right edge of the tree.  The tree is
+    valid after every `stop()`, so the loader can just be dropped afterwards. */
+    void stop();
+
+    int64_t num_appended() const { return num_appended_; }
+
+    /* The largest key in the tree, if it isn't empty.  Only valid between `start()` and
+    `stop()`.  Keys that get appended have to be greater than this. */
+    bool has_last_key() const { return has_last_key_; }
+    const store_key_t &last_key() const {
+        guarantee(has_last_key_);
+        return last_key_;
+    }
+
+private:
+    // Adds `rchild_id` to the node at `level` of the right edge, to the right of its
+    // current last child `lchild_id`.  `separator` is the largest key below
+    // `lchild_id`.
+    void append_child(size_t level, const btree_key_t *separator,
+                      block_id_t lchild_id, repli_timestamp_t lchild_recency,
+                      block_id_t rchild_id);
+    void start_new_leaf();
+    buf_parent_t parent_of(size_t level);
+
+    value_sizer_t *const sizer_;
+    const value_deleter_t *const balancing_detacher_;
+    const double leaf_fill_factor_;
+
+    superblock_t *superblock_;
+    // The right edge of the tree.  `edge_[0]` is the rightmost leaf node and
+    // `edge_.back()` is the root.
+    std::vector<buf_lock_t> edge_;
+
+    // The last key that has been appended.
+    bool has_last_key_;
+    store_key_t last_key_;
+    // The last key of the leaf node to the left of `edge_[0]`.  Leaf nodes get their
+    // key prefixes from this and their own last key once they are complete.
+    bool has_leaf_left_bound_;
+    store_key_t leaf_left_bound_;
+
+    int64_t num_appended_;
+    int64_t unrecorded_population_change_;
+
+    DISABLE_COPYING(btree_bulk_loader_t);
+};
+
 /* Set sb to have root id as its root block and release sb */
 void insert_root(block_id_t root_id, superblock_t *sb);
 
@@ -213,6 +293,26 @@ void find_keyvalue_location_for_read(
         btree_stats_t *stats,
         profile::trace_t *trace);
 
+class batched_read_callback_t {
+public:
+    /* Called once for every key that has a value, in key order.  `value` and the
+    blocks reachable through `leaf` are only valid for the duration of the call. */
+    virtual void on_value(size_t key_index, const void *value, buf_parent_t leaf) = 0;
+protected:
+    virtual ~batched_read_callback_t() { }
+};
+
+/* Looks up several keys with a single descent of the tree: every node on the paths
+to the keys is acquired only once, no matter how many of the keys lie below it.
+`keys` must be sorted and must not contain duplicates.  Releases the superblock. */
+void find_keyvalues_for_read(
+        value_sizer_t *sizer,
+        superblock_t *superblock,
+        const std::vector<const btree_key_t *> &keys,
+        batched_read_callback_t *cb,
+        btree_stats_t *stats,
+        profile::trace_t *trace);
+
 /* `delete_mode_t` controls how `apply_keyvalue_change()` acts when `kv_loc->value` is
 empty. */
 enum class delete_mode_t {
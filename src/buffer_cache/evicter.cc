@@ -17,6 +17,7 @@ evicter_t::evicter_t()
       bytes_loaded_counter_(0),
       access_count_counter_(0),
       access_time_counter_(INITIAL_ACCESS_TIME),
+      block_reads_counter_(0),
       evict_if_necessary_active_(false) { }
 
 evicter_t::~evicter_t() {
@@ -84,6 +85,11 @@ uint64_t evicter_t::access_count() const {
     return access_count_counter_;
 }
 
+uint64_t evicter_t::block_reads() const {
+    assert_thread();
+    return block_reads_counter_;
+}
+
 void wake_up_balancer(cache_balancer_t *balancer,
                       UNUSED auto_drainer_t::lock_t drainer_lock) {
     on_thread_t th(balancer->home_thread());
@@ -58,6 +58,11 @@ public:
 
     uint64_t in_memory_size() const;
 
+    // Called whenever a page has to be read from the serializer.  Together with
+    // `next_access_time()`, this tells how well the eviction policy is doing.
+    void note_block_read() { ++block_reads_counter_; }
+    uint64_t block_reads() const;
+
     // This is decremented past UINT64_MAX to force code to be aware of access time
     // rollovers.
     static const uint64_t INITIAL_ACCESS_TIME = UINT64_MAX - 100;
@@ -89,6 +94,9 @@ private:
     // This gets incremented every time a page is accessed.
     uint64_t access_time_counter_;
 
+    // The number of blocks that have been read from the serializer.
+    uint64_t block_reads_counter_;
+
     // This is set to true while `evict_if_necessary()` is active.
     // It avoids reentrant calls to that function.
     bool evict_if_necessary_active_;
@@ -37,6 +37,27 @@ bool eviction_bag_t::has_page(page_t *page) const {
     return bag_.has_element(page);
 }
 
+// Returns true if `page` should be evicted before `other`.  This is a sampled version
+// of LRU-2: pages are ranked by their second most recent access, so that pages that
+// have only been touched once (for example by a table scan) go before pages that
+// get accessed repeatedly, no matter how recently the scan touched them.  Among pages
+// that have been accessed only once, or with the same previous access time, the
+// least recently used one goes first.
+//
+// We compare relative to the access time offset, so that in the unlikely event of a
+// 64-bit overflow, performance degradation is "smooth".
+static bool is_better_eviction_candidate(page_t *page, page_t *other,
+                                         uint64_t access_time_offset) {
+    const uint64_t previous_age = access_time_offset - page->previous_access_time();
+    const uint64_t other_previous_age
+        = access_time_offset - other->previous_access_time();
+    if (previous_age != other_previous_age) {
+        return previous_age > other_previous_age;
+    }
+    return access_time_offset - page->access_time() >
+        access_time_offset - other->access_time();
+}
+
 bool eviction_bag_t::remove_oldish(page_t **page_out, uint64_t access_time_offset,
                                    page_cache_t *page_cache) {
     if (bag_.size() == 0) {
@@ -46,10 +67,7 @@ bool eviction_bag_t::remove_oldish(page_t **page_out, uint64_t access_time_offse
         page_t *oldest = bag_.access_random(randsize(bag_.size()));
         for (size_t i = 1; i < num_randoms; ++i) {
             page_t *page = bag_.access_random(randsize(bag_.size()));
-            // We compare relative to the access time offset, so that in the unlikely
-            // event of a 64-bit overflow, performance degradation is "smooth".
-            if (access_time_offset - page->access_time() >
-                access_time_offset - oldest->access_time()) {
+            if (is_better_eviction_candidate(page, oldest, access_time_offset)) {
                 oldest = page;
             }
         }
@@ -60,5 +78,4 @@ bool eviction_bag_t::remove_oldish(page_t **page_out, uint64_t access_time_offse
     }
 }
 
-
 }  // namespace alt
@@ -51,11 +51,17 @@ private:
 // problem for now, as long as we increment it one value at a time.
 static const uint64_t READ_AHEAD_ACCESS_TIME = evicter_t::INITIAL_ACCESS_TIME - 1;
 
+// The previous access time of pages that haven't been accessed twice yet.  Like
+// READ_AHEAD_ACCESS_TIME, it's older than any real access time.
+static const uint64_t NO_PREVIOUS_ACCESS_TIME = evicter_t::INITIAL_ACCESS_TIME - 1;
+
 
 page_t::page_t(block_id_t block_id, page_cache_t *page_cache)
     : block_id_(block_id),
       loader_(NULL),
       access_time_(page_cache->evicter().next_access_time()),
+      previous_access_time_(NO_PREVIOUS_ACCESS_TIME),
+      awaiting_first_access_(true),
       snapshot_refcount_(0) {
     page_cache->evicter().add_deferred_loaded(this);
 
@@ -70,6 +76,8 @@ page_t::page_t(block_id_t block_id, page_cache_t *page_cache,
     : block_id_(block_id),
       loader_(NULL),
       access_time_(page_cache->evicter().next_access_time()),
+      previous_access_time_(NO_PREVIOUS_ACCESS_TIME),
+      awaiting_first_access_(true),
       snapshot_refcount_(0) {
     page_cache->evicter().add_not_yet_loaded(this);
 
@@ -86,6 +94,8 @@ page_t::page_t(block_id_t block_id, buf_ptr_t buf,
       loader_(NULL),
       buf_(std::move(buf)),
       access_time_(page_cache->evicter().next_access_time()),
+      previous_access_time_(NO_PREVIOUS_ACCESS_TIME),
+      awaiting_first_access_(true),
       snapshot_refcount_(0) {
     rassert(buf_.has());
     page_cache->evicter().add_to_evictable_unbacked(this);
@@ -100,6 +110,8 @@ page_t::page_t(block_id_t block_id,
       buf_(std::move(buf)),
       block_token_(block_token),
       access_time_(READ_AHEAD_ACCESS_TIME),
+      previous_access_time_(NO_PREVIOUS_ACCESS_TIME),
+      awaiting_first_access_(false),
       snapshot_refcount_(0) {
     rassert(buf_.has());
     page_cache->evicter().add_to_evictable_disk_backed(this);
@@ -109,6 +121,8 @@ page_t::page_t(page_t *copyee, page_cache_t *page_cache, cache_account_t *accoun
     : block_id_(copyee->block_id_),
       loader_(NULL),
       access_time_(page_cache->evicter().next_access_time()),
+      previous_access_time_(NO_PREVIOUS_ACCESS_TIME),
+      awaiting_first_access_(true),
       snapshot_refcount_(0) {
     page_cache->evicter().add_not_yet_loaded(this);
     coro_t::spawn_now_dangerously(std::bind(&page_t::load_from_copyee,
@@ -260,6 +274,7 @@ void page_t::catch_up_with_deferred_load(
 
     // Before blocking, tell the evicter to put us in the right category.
     page_cache->evicter().catch_up_deferred_load(page);
+    page_cache->evicter().note_block_read();
 
     buf_ptr_t buf;
     {
@@ -346,6 +361,8 @@ void page_t::load_with_block_id(page_t *page, block_id_t block_id,
 
     auto_drainer_t::lock_t lock = page_cache->drainer_lock();
 
+    page_cache->evicter().note_block_read();
+
     buf_ptr_t buf;
     counted_t<standard_block_token_t> block_token;
 
@@ -439,6 +456,7 @@ void page_t::load_using_block_token(page_t *page, page_cache_t *page_cache,
     page->loader_ = &loader;
 
     page_cache->evicter().reloading_page(page);
+    page_cache->evicter().note_block_read();
 
     auto_drainer_t::lock_t lock = page_cache->drainer_lock();
 
@@ -501,7 +519,13 @@ uint32_t page_t::hypothetical_memory_usage(page_cache_t *page_cache) const {
 
 void *page_t::get_page_buf(page_cache_t *page_cache) {
     rassert(buf_.has());
-    access_time_ = page_cache->evicter().next_access_time();
+    const uint64_t access_time = page_cache->evicter().next_access_time();
+    if (awaiting_first_access_) {
+        awaiting_first_access_ = false;
+    } else {
+        previous_access_time_ = access_time_;
+    }
+    access_time_ = access_time;
     return buf_.cache_data();
 }
 
@@ -55,6 +55,9 @@ public:
 
     uint32_t hypothetical_memory_usage(page_cache_t *page_cache) const;
     uint64_t access_time() const { return access_time_; }
+    // The access time before the most recent one.  (This is the "oldest" possible
+    // access time for pages that have only been accessed once.)
+    uint64_t previous_access_time() const { return previous_access_time_; }
 
     bool is_loading() const {
         return loader_ != NULL && page_t::loader_is_loading(loader_);
@@ -130,7 +133,12 @@ private:
     buf_ptr_t buf_;
     counted_t<standard_block_token_t> block_token_;
 
+    // The eviction policy looks at the last two times the page's buf was accessed.
     uint64_t access_time_;
+    uint64_t previous_access_time_;
+    // True until the buf is accessed for the first time, so that the acquisition
+    // that created the page doesn't count as two accesses.
+    bool awaiting_first_access_;
 
     // How many page_ptr_t's point at this page, expecting nothing to modify it,
     // other than themselves.
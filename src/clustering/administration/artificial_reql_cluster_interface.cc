@@ -398,6 +398,21 @@ bool artificial_reql_cluster_interface_t::sindex_list(
         db, table, interruptor, error_out, configs_and_statuses_out);
 }
 
+bool artificial_reql_cluster_interface_t::sindex_list_cached(
+        counted_t<const ql::db_t> db,
+        const name_string_t &table,
+        signal_t *interruptor,
+        admin_err_t *error_out,
+        std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+            *configs_and_statuses_out) {
+    if (db->name == database) {
+        configs_and_statuses_out->clear();
+        return true;
+    }
+    return next->sindex_list_cached(
+        db, table, interruptor, error_out, configs_and_statuses_out);
+}
+
 admin_artificial_tables_t::admin_artificial_tables_t(
         real_reql_cluster_interface_t *_next_reql_cluster_interface,
         boost::shared_ptr<semilattice_readwrite_view_t<
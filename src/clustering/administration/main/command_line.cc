@@ -652,6 +652,7 @@ void run_rethinkdb_create(const base_path_t &base_path,
                           boost::optional<uint64_t> total_cache_size,
                           const file_direct_io_mode_t direct_io_mode,
                           const int max_concurrent_io_requests,
+                          const io_backend_t io_backend,
                           bool *const result_out) {
     server_id_t our_server_id = generate_uuid();
 
@@ -665,7 +666,7 @@ void run_rethinkdb_create(const base_path_t &base_path,
     server_config.config.cache_size_bytes = total_cache_size;
     server_config.version = 1;
 
-    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests);
+    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests, io_backend);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -721,6 +722,7 @@ void run_rethinkdb_serve(const base_path_t &base_path,
                          serve_info_t *serve_info,
                          const file_direct_io_mode_t direct_io_mode,
                          const int max_concurrent_io_requests,
+                         const io_backend_t io_backend,
                          const boost::optional<boost::optional<uint64_t> >
                             &total_cache_size,
                          const server_id_t *our_server_id,
@@ -734,7 +736,7 @@ void run_rethinkdb_serve(const base_path_t &base_path,
 
     logNTC("Loading data from directory %s\n", base_path.path().c_str());
 
-    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests);
+    io_backender_t io_backender(direct_io_mode, max_concurrent_io_requests, io_backend);
 
     perfmon_collection_t metadata_perfmon_collection;
     perfmon_membership_t metadata_perfmon_membership(&get_global_perfmon_collection(), &metadata_perfmon_collection, "metadata");
@@ -820,6 +822,7 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
                              const std::set<name_string_t> &server_tag_names,
                              const file_direct_io_mode_t direct_io_mode,
                              const int max_concurrent_io_requests,
+                             const io_backend_t io_backend,
                              const boost::optional<boost::optional<uint64_t> >
                                 &total_cache_size,
                              const bool new_directory,
@@ -828,7 +831,7 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
                              bool *const result_out) {
     if (!new_directory) {
         run_rethinkdb_serve(base_path, serve_info, direct_io_mode,
-                            max_concurrent_io_requests, total_cache_size,
+                            max_concurrent_io_requests, io_backend, total_cache_size,
                             NULL, NULL, NULL, data_directory_lock,
                             result_out);
     } else {
@@ -864,7 +867,7 @@ void run_rethinkdb_porcelain(const base_path_t &base_path,
         server_config.version = 1;
 
         run_rethinkdb_serve(base_path, serve_info, direct_io_mode,
-                            max_concurrent_io_requests,
+                            max_concurrent_io_requests, io_backend,
                             boost::optional<boost::optional<uint64_t> >(),
                             &our_server_id, &server_config, &cluster_metadata,
                             data_directory_lock, result_out);
@@ -923,6 +926,22 @@ options::help_section_t get_file_options(std::vector<options::option_t> *options
                                              strprintf("%d", DEFAULT_MAX_CONCURRENT_IO_REQUESTS)));
     help.add("--io-threads n",
              "how many simultaneous I/O operations can happen at the same time");
+    options_out->push_back(options::option_t(options::names_t("--io-backend"),
+                                             options::OPTIONAL,
+                                             "pool"));
+    help.add("--io-backend {pool|uring|uring-registered}",
+             "how to perform file I/O: on a thread pool (the default), or through "
+             "Linux io_uring, optionally with registered files and buffers");
+    options_out->push_back(options::option_t(options::names_t("--block-compression"),
+                                             options::OPTIONAL,
+                                             "none"));
+    help.add("--block-compression {none|zlib}",
+             "compress the data blocks of tables before writing them to disk");
+    options_out->push_back(options::option_t(options::names_t("--lba-snapshot"),
+                                             options::OPTIONAL_NO_PARAMETER));
+    help.add("--lba-snapshot",
+             "save the block index of each table on clean shutdown, so that the "
+             "next startup doesn't have to rebuild it");
     options_out->push_back(options::option_t(options::names_t("--no-direct-io"),
                                              options::OPTIONAL_NO_PARAMETER));
     // `--no-direct-io` is deprecated (it's now the default). Not adding to help.
@@ -1099,6 +1118,26 @@ options::help_section_t get_network_options(const bool join_required, std::vecto
                                              options::OPTIONAL_REPEAT));
     help.add("--canonical-address addr", "address that other rethinkdb instances will use to connect to us, can be specified multiple times");
 
+    options_out->push_back(options::option_t(options::names_t("--cluster-compression"),
+                                             options::OPTIONAL,
+                                             "none"));
+    help.add("--cluster-compression {none|zlib}",
+             "compress large messages to other servers that support it");
+
+    options_out->push_back(options::option_t(options::names_t("--cluster-flush-delay"),
+                                             options::OPTIONAL,
+                                             "0"));
+    help.add("--cluster-flush-delay ms",
+             "how long to wait for more messages before sending small messages to "
+             "another server, so that they can be sent together");
+
+    options_out->push_back(options::option_t(options::names_t("--cluster-connections"),
+                                             options::OPTIONAL,
+                                             "1"));
+    help.add("--cluster-connections n",
+             "how many TCP connections to open to each server that supports it, so "
+             "that messages to different places don't have to wait for each other");
+
     return help;
 }
 
@@ -1108,6 +1147,11 @@ options::help_section_t get_cpu_options(std::vector<options::option_t> *options_
                                              options::OPTIONAL,
                                              strprintf("%d", get_cpu_count())));
     help.add("-c [ --cores ] n", "the number of cores to use");
+    options_out->push_back(options::option_t(options::names_t("--js-workers"),
+                                             options::OPTIONAL));
+    help.add("--js-workers n",
+             "the number of processes to use for JavaScript evaluation, defaults to "
+             "the number of cores");
     return help;
 }
 
@@ -1122,6 +1166,26 @@ MUST_USE bool parse_cores_option(const std::map<std::string, options::values_t>
     return true;
 }
 
+MUST_USE bool parse_js_workers_option(
+        const std::map<std::string, options::values_t> &opts,
+        size_t *js_workers_out) {
+    boost::optional<std::string> js_workers = get_optional_option(opts, "--js-workers");
+    if (!js_workers) {
+        // `serve()` uses one per thread.
+        *js_workers_out = 0;
+        return true;
+    }
+    uint64_t value;
+    if (!strtou64_strict(*js_workers, 10, &value)
+            || value == 0 || value > MAX_JS_WORKERS) {
+        fprintf(stderr, "ERROR: number specified for js-workers must be between 1 "
+                "and %d\n", MAX_JS_WORKERS);
+        return false;
+    }
+    *js_workers_out = value;
+    return true;
+}
+
 options::help_section_t get_service_options(std::vector<options::option_t> *options_out) {
     options::help_section_t help("Service options");
     options_out->push_back(options::option_t(options::names_t("--pid-file"),
@@ -1287,6 +1351,64 @@ file_direct_io_mode_t parse_direct_io_mode_option(const std::map<std::string, op
         file_direct_io_mode_t::buffered_desired;
 }
 
+io_backend_t parse_io_backend_option(const std::map<std::string, options::values_t> &opts) {
+    const std::string io_backend = get_single_option(opts, "--io-backend");
+    if (io_backend == "pool") {
+        return io_backend_t::pool;
+    } else if (io_backend == "uring") {
+        return io_backend_t::uring;
+    } else if (io_backend == "uring-registered") {
+        return io_backend_t::uring_registered;
+    } else {
+        throw std::runtime_error(strprintf(
+            "ERROR: io-backend should be 'pool', 'uring' or 'uring-registered', "
+            "got '%s'", io_backend.c_str()));
+    }
+}
+
+block_compression_t parse_block_compression_option(
+        const std::map<std::string, options::values_t> &opts) {
+    const std::string block_compression = get_single_option(opts, "--block-compression");
+    if (block_compression == "none") {
+        return block_compression_t::none;
+    } else if (block_compression == "zlib") {
+        return block_compression_t::zlib;
+    } else {
+        throw std::runtime_error(strprintf(
+            "ERROR: block-compression should be 'none' or 'zlib', got '%s'",
+            block_compression.c_str()));
+    }
+}
+
+cluster_connection_config_t parse_cluster_connection_config(
+        const std::map<std::string, options::values_t> &opts) {
+    cluster_connection_config_t config;
+    const std::string compression = get_single_option(opts, "--cluster-compression");
+    if (compression == "none") {
+        config.compress_messages = false;
+    } else if (compression == "zlib") {
+        config.compress_messages = true;
+    } else {
+        throw std::runtime_error(strprintf(
+            "ERROR: cluster-compression should be 'none' or 'zlib', got '%s'",
+            compression.c_str()));
+    }
+    config.flush_delay_ms = get_single_int(opts, "--cluster-flush-delay");
+    if (config.flush_delay_ms < 0 || config.flush_delay_ms > 1000) {
+        throw std::runtime_error(strprintf(
+            "ERROR: cluster-flush-delay should be between 0 and 1000, got %" PRIi64,
+            config.flush_delay_ms));
+    }
+    const int lanes = get_single_int(opts, "--cluster-connections");
+    if (lanes < 1 || lanes > CLUSTER_MAX_CONNECTION_LANES) {
+        throw std::runtime_error(strprintf(
+            "ERROR: cluster-connections should be between 1 and %d, got %d",
+            CLUSTER_MAX_CONNECTION_LANES, lanes));
+    }
+    config.lanes = lanes;
+    return config;
+}
+
 int main_rethinkdb_create(int argc, char *argv[]) {
     std::vector<options::option_t> options;
     std::vector<options::help_section_t> help;
@@ -1333,6 +1455,7 @@ int main_rethinkdb_create(int argc, char *argv[]) {
         recreate_temporary_directory(base_path);
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
+        const io_backend_t io_backend = parse_io_backend_option(opts);
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_create, base_path,
@@ -1341,6 +1464,7 @@ int main_rethinkdb_create(int argc, char *argv[]) {
                                      total_cache_size,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      &result),
                            num_workers);
 
@@ -1426,6 +1550,11 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        size_t js_workers;
+        if (!parse_js_workers_option(opts, &js_workers)) {
+            return EXIT_FAILURE;
+        }
+
         int max_concurrent_io_requests;
         if (!parse_io_threads_option(opts, &max_concurrent_io_requests)) {
             return EXIT_FAILURE;
@@ -1468,8 +1597,15 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                 address_ports,
                                 get_optional_option(opts, "--config-file"),
                                 std::vector<std::string>(argv, argv + argc));
+        serve_info.serializer_config.block_compression =
+            parse_block_compression_option(opts);
+        serve_info.serializer_config.lba_snapshot =
+            exists_option(opts, "--lba-snapshot");
+        serve_info.cluster_config = parse_cluster_connection_config(opts);
+        serve_info.js_workers = js_workers;
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
+        const io_backend_t io_backend = parse_io_backend_option(opts);
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_serve,
@@ -1477,6 +1613,7 @@ int main_rethinkdb_serve(int argc, char *argv[]) {
                                      &serve_info,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      total_cache_size,
                                      static_cast<server_id_t*>(NULL),
                                      static_cast<server_config_versioned_t *>(NULL),
@@ -1552,6 +1689,7 @@ int main_rethinkdb_proxy(int argc, char *argv[]) {
                                 address_ports,
                                 get_optional_option(opts, "--config-file"),
                                 std::vector<std::string>(argv, argv + argc));
+        serve_info.cluster_config = parse_cluster_connection_config(opts);
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_proxy, &serve_info, &result),
@@ -1657,6 +1795,11 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
 
+        size_t js_workers;
+        if (!parse_js_workers_option(opts, &js_workers)) {
+            return EXIT_FAILURE;
+        }
+
         int max_concurrent_io_requests;
         if (!parse_io_threads_option(opts, &max_concurrent_io_requests)) {
             return EXIT_FAILURE;
@@ -1719,8 +1862,15 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                 address_ports,
                                 get_optional_option(opts, "--config-file"),
                                 std::vector<std::string>(argv, argv + argc));
+        serve_info.serializer_config.block_compression =
+            parse_block_compression_option(opts);
+        serve_info.serializer_config.lba_snapshot =
+            exists_option(opts, "--lba-snapshot");
+        serve_info.cluster_config = parse_cluster_connection_config(opts);
+        serve_info.js_workers = js_workers;
 
         const file_direct_io_mode_t direct_io_mode = parse_direct_io_mode_option(opts);
+        const io_backend_t io_backend = parse_io_backend_option(opts);
 
         bool result;
         run_in_thread_pool(std::bind(&run_rethinkdb_porcelain,
@@ -1729,6 +1879,7 @@ int main_rethinkdb_porcelain(int argc, char *argv[]) {
                                      server_tag_names,
                                      direct_io_mode,
                                      max_concurrent_io_requests,
+                                     io_backend,
                                      total_cache_size,
                                      is_new_directory,
                                      &serve_info,
@@ -97,7 +97,9 @@ bool do_serve(io_backender_t *io_backender,
         /* `extproc_pool` spawns several subprocesses that can be used to run tasks that
         we don't want to run in the main RethinkDB process, such as Javascript
         evaluations. */
-        extproc_pool_t extproc_pool(get_num_threads());
+        extproc_pool_t extproc_pool(serve_info.js_workers != 0
+                                    ? serve_info.js_workers
+                                    : get_num_threads());
 
         /* `thread_pool_log_writer_t` automatically registers itself. While it exists,
         log messages will be written using the event loop instead of blocking. */
@@ -208,7 +210,8 @@ bool do_serve(io_backender_t *io_backender,
                 serve_info.ports.canonical_addresses,
                 serve_info.ports.port,
                 serve_info.ports.client_port,
-                semilattice_manager_heartbeat.get_root_view()));
+                semilattice_manager_heartbeat.get_root_view(),
+                serve_info.cluster_config));
         } catch (const address_in_use_exc_t &ex) {
             throw address_in_use_exc_t(strprintf("Could not bind to cluster port: %s", ex.what()));
         }
@@ -252,7 +255,9 @@ bool do_serve(io_backender_t *io_backender,
                               NULL,   /* we'll fill this in later */
                               semilattice_manager_auth.get_root_view(),
                               &get_global_perfmon_collection(),
-                              serve_info.reql_http_proxy);
+                              serve_info.reql_http_proxy,
+                              io_backender,
+                              base_path);
         {
             /* Extract a subview of the directory with all the table meta manager
             business cards. */
@@ -278,6 +283,7 @@ bool do_serve(io_backender_t *io_backender,
                 table_persistence_interface.init(
                     new real_table_persistence_interface_t(
                         io_backender,
+                        serve_info.serializer_config,
                         cache_balancer.get(),
                         base_path,
                         &rdb_ctx,
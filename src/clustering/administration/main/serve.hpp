@@ -11,6 +11,8 @@
 #include "clustering/administration/persist/file.hpp"
 #include "clustering/administration/main/version_check.hpp"
 #include "arch/address.hpp"
+#include "rpc/connectivity/cluster.hpp"
+#include "serializer/log/config.hpp"
 
 class os_signal_cond_t;
 
@@ -102,7 +104,8 @@ public:
         do_version_checking(_do_version_checking),
         ports(_ports),
         config_file(_config_file),
-        argv(std::move(_argv))
+        argv(std::move(_argv)),
+        js_workers(0)
     { }
 
     void look_up_peers() {
@@ -119,6 +122,13 @@ public:
     /* The original arguments, so we can display them in `server_status`. All the
     argument parsing has already been completed at this point. */
     std::vector<std::string> argv;
+    /* The configuration of the serializers of the tables on this server (for example
+    how their data blocks are compressed). */
+    log_serializer_dynamic_config_t serializer_config;
+    /* How messages get sent to the other servers of the cluster. */
+    cluster_connection_config_t cluster_config;
+    /* How many JavaScript worker processes to use, or 0 for one per thread. */
+    size_t js_workers;
 };
 
 /* This has been factored out from `command_line.hpp` because it takes a very
@@ -23,6 +23,7 @@ public:
             scoped_ptr_t<real_branch_history_manager_t> &&bhm,
             const base_path_t &base_path,
             io_backender_t *io_backender,
+            const log_serializer_dynamic_config_t &serializer_config,
             cache_balancer_t *cache_balancer,
             rdb_context_t *rdb_context,
             perfmon_collection_t *perfmon_collection_serializers,
@@ -61,7 +62,7 @@ public:
         // now, we don't.
 
         scoped_ptr_t<serializer_t> inner_serializer(new standard_serializer_t(
-            standard_serializer_t::dynamic_config_t(),
+            serializer_config,
             &file_opener,
             perfmon_collection_serializers));
         serializer.init(new merger_serializer_t(
@@ -284,6 +285,7 @@ void real_table_persistence_interface_t::load_multistore(
         std::move(bhm),
         base_path,
         io_backender,
+        serializer_config,
         cache_balancer,
         rdb_context,
         perfmon_collection_serializers,
@@ -314,6 +316,11 @@ void real_table_persistence_interface_t::destroy_multistore(
     const int res = ::unlink(filepath.c_str());
     guarantee_err(res == 0 || get_errno() == ENOENT,
                   "unlink failed for file %s", filepath.c_str());
+
+    std::string snapshot_filepath = lba_snapshot_file_name(file_name_for(table_id));
+    const int snapshot_res = ::unlink(snapshot_filepath.c_str());
+    guarantee_err(snapshot_res == 0 || get_errno() == ENOENT,
+                  "unlink failed for file %s", snapshot_filepath.c_str());
 }
 
 serializer_filepath_t real_table_persistence_interface_t::file_name_for(
@@ -951,6 +951,7 @@ bool real_reql_cluster_interface_t::sindex_create(
             table_config_and_shards_change_t::sindex_create_t{name, config});
         table_meta_client->set_config(
             table_id, table_config_and_shards_change, &interruptor_on_home);
+        sindex_list_cache.erase(table_id);
 
         return true;
     } catch (const config_change_exc_t &) {
@@ -983,6 +984,7 @@ bool real_reql_cluster_interface_t::sindex_drop(
             table_config_and_shards_change_t::sindex_drop_t{name});
         table_meta_client->set_config(
             table_id, table_config_and_shards_change, &interruptor_on_home);
+        sindex_list_cache.erase(table_id);
 
         return true;
     } catch (const config_change_exc_t &) {
@@ -1018,6 +1020,7 @@ bool real_reql_cluster_interface_t::sindex_rename(
                 name, new_name, overwrite});
         table_meta_client->set_config(
             table_id, table_config_and_shards_change, &interruptor_on_home);
+        sindex_list_cache.erase(table_id);
 
         return true;
     } catch (const config_change_exc_t &) {
@@ -1064,6 +1067,37 @@ bool real_reql_cluster_interface_t::sindex_list(
         "Failed to retrieve all secondary indexes.")
 }
 
+bool real_reql_cluster_interface_t::sindex_list_cached(
+        counted_t<const ql::db_t> db,
+        const name_string_t &table_name,
+        signal_t *interruptor_on_caller,
+        admin_err_t *error_out,
+        std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+            *configs_and_statuses_out) {
+    guarantee(db->name != name_string_t::guarantee_valid("rethinkdb"),
+        "real_reql_cluster_interface_t should never get queries for system tables");
+    cross_thread_signal_t interruptor_on_home(interruptor_on_caller, home_thread());
+    try {
+        on_thread_t thread_switcher(home_thread());
+        namespace_id_t table_id;
+        table_meta_client->find(db->id, table_name, &table_id);
+        auto it = sindex_list_cache.find(table_id);
+        if (it != sindex_list_cache.end()
+            && it->second.first + SINDEX_LIST_CACHE_MS * 1000 > current_microtime()) {
+            *configs_and_statuses_out = it->second.second;
+            return true;
+        }
+        const microtime_t fetched = current_microtime();
+        table_meta_client->get_sindex_status(
+            table_id, &interruptor_on_home, configs_and_statuses_out);
+        sindex_list_cache[table_id] = std::make_pair(fetched, *configs_and_statuses_out);
+        return true;
+    } CATCH_NAME_ERRORS(db->name, table_name, error_out)
+      CATCH_OP_ERRORS(db->name, table_name, error_out,
+        "Failed to retrieve all secondary indexes.",
+        "Failed to retrieve all secondary indexes.")
+}
+
 /* Checks that divisor is indeed a divisor of multiple. */
 template <class T>
 bool is_joined(const T &multiple, const T &divisor) {
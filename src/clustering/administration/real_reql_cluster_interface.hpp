@@ -2,8 +2,10 @@
 #ifndef CLUSTERING_ADMINISTRATION_REAL_REQL_CLUSTER_INTERFACE_HPP_
 #define CLUSTERING_ADMINISTRATION_REAL_REQL_CLUSTER_INTERFACE_HPP_
 
+#include <map>
 #include <set>
 #include <string>
+#include <utility>
 
 #include "clustering/administration/admin_op_exc.hpp"
 #include "clustering/administration/metadata.hpp"
@@ -13,6 +15,7 @@
 #include "concurrency/watchable.hpp"
 #include "rdb_protocol/context.hpp"
 #include "rpc/semilattice/view.hpp"
+#include "time.hpp"
 
 class admin_artificial_tables_t;
 class artificial_table_backend_t;
@@ -171,6 +174,13 @@ public:
             admin_err_t *error_out,
             std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
                 *configs_and_statuses_out);
+    bool sindex_list_cached(
+            counted_t<const ql::db_t> db,
+            const name_string_t &table,
+            signal_t *interruptor,
+            admin_err_t *error_out,
+            std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+                *configs_and_statuses_out);
 
     /* `calculate_split_points_with_distribution` needs access to the underlying
     `namespace_interface_t` and `table_meta_client_t`. */
@@ -198,6 +208,14 @@ private:
     ql::changefeed::client_t changefeed_client;
     server_config_client_t *server_config_client;
 
+    /* The answers of `sindex_list()` for `sindex_list_cached()`, by table, with the time
+    they were fetched at.  Only accessed on the home thread.  `sindex_create()`,
+    `sindex_drop()` and `sindex_rename()` drop the table's entry, so that changes made
+    through this server show up right away. */
+    std::map<namespace_id_t, std::pair<microtime_t,
+        std::map<std::string, std::pair<sindex_config_t, sindex_status_t> > > >
+            sindex_list_cache;
+
     void wait_for_metadata_to_propagate(const cluster_semilattice_metadata_t &metadata,
                                         signal_t *interruptor);
 
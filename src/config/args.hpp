@@ -51,6 +51,20 @@
 // useful.
 #define DEFAULT_IO_BATCH_FACTOR                   1
 
+// Settings for the io_uring disk backend (see arch/io/disk/uring.hpp).
+// The number of blocker pool threads that run resizes and datasync-wrapped
+// writes, which io_uring doesn't handle for us.
+#define URING_FALLBACK_IO_THREADS                 4
+// The size of the file table that gets registered with each ring.
+#define URING_FIXED_FILE_SLOTS                    1024
+// The registered bounce buffers. Single-buffer requests up to this size get
+// copied through a registered buffer if one is available.
+#define URING_REGISTERED_BUFFER_SIZE              (KILOBYTE * 16)
+#define URING_REGISTERED_BUFFER_COUNT             256
+// How long to wait before retrying a submission that the kernel refused for lack of
+// resources while none of our requests were in flight.
+#define URING_SUBMIT_RETRY_MS                     1
+
 // I/O priority of index writes in the log serializer
 #define INDEX_WRITE_IO_PRIORITY                   128
 
@@ -73,6 +87,10 @@
 // 0 = minimal priority
 #define SINDEX_POST_CONSTRUCTION_CACHE_PRIORITY   5
 
+// How much memory the sort that precedes building an empty secondary index with the
+// bulk loader may use per index.  Anything beyond that gets sorted on disk.
+#define SINDEX_BULK_BUILD_SORT_MEMORY             (64 * MEGABYTE)
+
 // Size of the buffer used to perform IO operations (in bytes).
 #define IO_BUFFER_SIZE                            (4 * KILOBYTE)
 
@@ -85,11 +103,20 @@
 // Size of each btree node (in bytes) on disk
 #define DEFAULT_BTREE_BLOCK_SIZE                  (4 * KILOBYTE)
 
+// The fraction of each leaf node that gets used when building a B-tree with the bulk
+// loader (see btree_bulk_loader_t).  Leaving some room means that later inserts into a
+// bulk loaded tree don't have to split every leaf node right away.
+#define BULK_LOAD_LEAF_FILL_FACTOR                0.9
+
 // Size of each extent (in bytes)
 // This should not be too small, or garbage collection will become
 // inefficient (especially on rotational drives).
 #define DEFAULT_EXTENT_SIZE                       (2 * MEGABYTE)
 
+// The zlib compression level used for data blocks if block compression is enabled.
+// Blocks are compressed on the serializer thread, so we favor speed over ratio.
+#define BLOCK_COMPRESSION_ZLIB_LEVEL              1
+
 // Ratio of free ram to use for the cache by default
 #define DEFAULT_MAX_CACHE_RATIO                   2
 
@@ -166,6 +193,10 @@
 // block infos.
 #define LBA_RECONSTRUCTION_BATCH_SIZE             1024
 
+// The size of the reads and writes that the log serializer uses for the optional
+// snapshot of the in-memory LBA index.
+#define LBA_SNAPSHOT_CHUNK_SIZE                   (4 * MEGABYTE)
+
 #define COROUTINE_STACK_SIZE                      131072
 
 // How many unused coroutine stacks to keep around (maximally), before they are
@@ -176,6 +207,64 @@
 // allocated on one thread.
 #define COROS_PER_THREAD_WARN_LEVEL               10000
 
+// How many queries a single client connection may PREPARE.  Prepared queries stay
+// around until the connection is closed.
+#define MAX_PREPARED_QUERIES_PER_CONNECTION       4096
+
+// How many partitions a hash join splits both of its inputs into when they don't fit
+// into the query's memory limit (see `hash_join_datum_stream_t`).
+#define HASH_JOIN_SPILL_PARTITIONS                16
+
+// How many primary keys `filter()` may collect from one index range when it reads the
+// intersection of several index ranges (see `read_index_intersection`).  Ranges with
+// more rows than this are left out of the intersection, and if every range is larger,
+// only the first index gets read.
+#define INDEX_INTERSECTION_MAX_KEYS               10000
+
+// How many of the rows in the intersection of several index ranges `filter()` reads at
+// a time.  The rows are read as the query asks for them, so that a `limit()` after the
+// `filter()` doesn't read all of them.
+#define INDEX_INTERSECTION_READ_ROWS              100
+
+// How long a server keeps using the list of a table's secondary indexes that it got
+// from the other servers, when deciding whether `filter()` can read an index (see
+// `reql_cluster_interface_t::sindex_list_cached`).
+#define SINDEX_LIST_CACHE_MS                      1000
+
+// Range reads on the primary index that only compute a terminal (e.g. a `group` with a
+// `reduce`) get split into up to this many parts per hash shard, if the range looks
+// like it has at least `RGET_PARALLEL_MIN_ROWS` rows.  The rows of each part are
+// evaluated on a different thread, `RGET_PARALLEL_BATCH_SIZE` rows at a time.
+#define RGET_PARALLEL_MAX_PARTS                   4
+#define RGET_PARALLEL_MIN_ROWS                    10000
+#define RGET_PARALLEL_BATCH_SIZE                  256
+
+// Messages to other servers only get compressed if they are at least this large, and
+// then with this zlib compression level (if the compression is enabled).
+#define CLUSTER_COMPRESSION_MIN_MESSAGE_SIZE      (1 * KILOBYTE)
+#define CLUSTER_COMPRESSION_ZLIB_LEVEL            1
+
+// A compressed message from another server that claims to be larger than this, before
+// or after decompression, is treated as invalid and closes the connection, so that the
+// sizes in its header can't make us allocate arbitrary amounts of memory.
+#define CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE      (1 * GIGABYTE)
+
+// Writes to another server only get held back for the flush delay (see
+// `cluster_connection_config_t`) while less than this much data is waiting to be sent.
+#define CLUSTER_FLUSH_DELAY_MAX_BYTES             (64 * KILOBYTE)
+
+// The most TCP connections ("lanes") that a connection to another server can consist
+// of, and how long a server waits for the other lanes after the first one got set up.
+#define CLUSTER_MAX_CONNECTION_LANES              16
+#define CLUSTER_LANE_CONNECT_TIMEOUT_MS           10000
+
+// `r.js` functions that `map` calls on a batch of rows get sent up to this many rows
+// per round trip to the JavaScript worker process.
+#define JS_CALL_BATCH_MAX_SIZE                    100
+
+// The most JavaScript worker processes that a server can be configured to use.
+#define MAX_JS_WORKERS                            1024
+
 
 /**
  * Message scheduler configuration
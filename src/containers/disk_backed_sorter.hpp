@@ -0,0 +1,187 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef CONTAINERS_DISK_BACKED_SORTER_HPP_
+#define CONTAINERS_DISK_BACKED_SORTER_HPP_
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "concurrency/new_mutex.hpp"
+#include "config/args.hpp"
+#include "containers/archive/stl_types.hpp"
+#include "containers/disk_backed_queue.hpp"
+#include "containers/scoped.hpp"
+#include "math.hpp"
+#include "utils.hpp"
+
+/* `disk_backed_sorter_t` sorts more values than fit into memory (an external merge
+sort).  Pushed values are collected in memory until they take up `memory_limit` bytes,
+and are then sorted and written out to disk as a sorted run.  Each run gets its own
+`internal_disk_backed_queue_t`, which stores the run in chunks of about
+`CHUNK_SIZE` bytes.  Once everything has been pushed, `pop()` merges the runs.
+
+Memory usage is about `memory_limit` while pushing, and `CHUNK_SIZE` per run while
+popping.  `T` must be serializable, and `push()` may be called from concurrent
+coroutines. */
+template <class T, class Less = std::less<T> >
+class disk_backed_sorter_t {
+public:
+    static const size_t CHUNK_SIZE = MEGABYTE;
+
+    disk_backed_sorter_t(io_backender_t *io_backender,
+                         const base_path_t &base_path,
+                         const std::string &file_prefix,
+                         perfmon_collection_t *stats_parent,
+                         size_t memory_limit,
+                         const Less &less = Less())
+        : io_backender_(io_backender), base_path_(base_path),
+          file_prefix_(file_prefix), stats_parent_(stats_parent),
+          memory_limit_(memory_limit), less_(less),
+          buffer_size_(0), pushing_(true),
+          heap_(run_greater_t(this)) { }
+
+    /* `size` is the (approximate) amount of memory that `value` takes up. */
+    void push(T &&value, size_t size) {
+        guarantee(pushing_);
+        new_mutex_acq_t acq(&mutex_);
+        buffer_.push_back(std::move(value));
+        buffer_size_ += size;
+        if (buffer_size_ >= memory_limit_) {
+            spill_buffer();
+        }
+    }
+
+    /* Must be called after the last `push()` and before the first `pop()`. */
+    void finish_pushing() {
+        guarantee(pushing_);
+        new_mutex_acq_t acq(&mutex_);
+        pushing_ = false;
+        // The last run stays in memory.
+        std::sort(buffer_.begin(), buffer_.end(), less_);
+        runs_.push_back(make_scoped<run_t>());
+        runs_.back()->chunk = std::move(buffer_);
+        buffer_.clear();
+        buffer_size_ = 0;
+        for (size_t i = 0; i < runs_.size(); ++i) {
+            if (load_chunk_if_needed(runs_[i].get())) {
+                heap_.push(i);
+            }
+        }
+    }
+
+    /* Pops the smallest remaining value into `out`.  Returns false if there are no
+    values left. */
+    bool pop(T *out) {
+        guarantee(!pushing_);
+        if (heap_.empty()) {
+            return false;
+        }
+        const size_t index = heap_.top();
+        heap_.pop();
+        run_t *run = runs_[index].get();
+        *out = std::move(run->chunk[run->position]);
+        ++run->position;
+        if (load_chunk_if_needed(run)) {
+            heap_.push(index);
+        } else {
+            runs_[index].reset();
+        }
+        return true;
+    }
+
+    size_t num_runs() const { return runs_.size(); }
+
+private:
+    struct run_t {
+        run_t() : position(0) { }
+        // Empty for the run that never went to disk.
+        scoped_ptr_t<internal_disk_backed_queue_t> queue;
+        std::vector<T> chunk;
+        size_t position;
+    };
+
+    // Orders run indices by their next value.  `std::priority_queue` puts the greatest
+    // element on top, so this is reversed.
+    class run_greater_t {
+    public:
+        explicit run_greater_t(const disk_backed_sorter_t *parent) : parent_(parent) { }
+        bool operator()(size_t a, size_t b) const {
+            const run_t *run_a = parent_->runs_[a].get();
+            const run_t *run_b = parent_->runs_[b].get();
+            return parent_->less_(run_b->chunk[run_b->position],
+                                  run_a->chunk[run_a->position]);
+        }
+    private:
+        const disk_backed_sorter_t *parent_;
+    };
+
+    void spill_buffer() {
+        std::sort(buffer_.begin(), buffer_.end(), less_);
+
+        scoped_ptr_t<run_t> run = make_scoped<run_t>();
+        run->queue.init(new internal_disk_backed_queue_t(
+            io_backender_,
+            serializer_filepath_t(base_path_,
+                                  strprintf("%s_%zu", file_prefix_.c_str(), runs_.size())),
+            stats_parent_));
+
+        // The chunk boundaries don't have to be exact, so we just split the run into
+        // `ceil(buffer_size_ / CHUNK_SIZE)` equally long chunks.
+        const size_t chunk_size = CHUNK_SIZE;
+        const size_t num_chunks = std::max<size_t>(1, ceil_divide(buffer_size_, chunk_size));
+        const size_t chunk_length = ceil_divide(buffer_.size(), num_chunks);
+        for (size_t i = 0; i < buffer_.size(); i += chunk_length) {
+            std::vector<T> chunk;
+            chunk.reserve(std::min(chunk_length, buffer_.size() - i));
+            for (size_t j = i; j < buffer_.size() && j < i + chunk_length; ++j) {
+                chunk.push_back(std::move(buffer_[j]));
+            }
+            // Like `disk_backed_queue_t`, the files don't outlive the process, so we
+            // can always use the latest version.
+            write_message_t wm;
+            serialize<cluster_version_t::LATEST_OVERALL>(&wm, chunk);
+            run->queue->push(wm);
+        }
+
+        runs_.push_back(std::move(run));
+        buffer_.clear();
+        buffer_size_ = 0;
+    }
+
+    // Makes sure that `run->chunk[run->position]` is valid if there are any values left
+    // in `run`.  Returns false if there are none.
+    bool load_chunk_if_needed(run_t *run) {
+        while (run->position == run->chunk.size()) {
+            if (!run->queue.has() || run->queue->empty()) {
+                return false;
+            }
+            run->chunk.clear();
+            run->position = 0;
+            deserializing_viewer_t<std::vector<T> > viewer(&run->chunk);
+            run->queue->pop(&viewer);
+        }
+        return true;
+    }
+
+    io_backender_t *const io_backender_;
+    const base_path_t base_path_;
+    const std::string file_prefix_;
+    perfmon_collection_t *const stats_parent_;
+    const size_t memory_limit_;
+    const Less less_;
+
+    new_mutex_t mutex_;
+    std::vector<T> buffer_;
+    size_t buffer_size_;
+    bool pushing_;
+
+    std::vector<scoped_ptr_t<run_t> > runs_;
+    std::priority_queue<size_t, std::vector<size_t>, run_greater_t> heap_;
+
+    DISABLE_COPYING(disk_backed_sorter_t);
+};
+
+#endif  // CONTAINERS_DISK_BACKED_SORTER_HPP_
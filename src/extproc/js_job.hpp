@@ -24,6 +24,11 @@ public:
 
     js_result_t eval(const std::string &source);
     js_result_t call(js_id_t id, const std::vector<ql::datum_t> &args);
+    // Calls the function once for each element of `args`, with a single request. The
+    // worker sends the result of each call as soon as it has it, and
+    // `read_call_batch_result()` reads the next one.
+    void send_call_batch(js_id_t id, const std::vector<std::vector<ql::datum_t> > &args);
+    js_result_t read_call_batch_result();
     void release(js_id_t id);
     void exit();
 
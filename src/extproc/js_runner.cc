@@ -3,9 +3,13 @@
 
 #include <inttypes.h>   // For PRIu64
 
+#include <algorithm>
+#include <iterator>
 #include <map>
 
+#include "config/args.hpp"
 #include "extproc/js_job.hpp"
+#include "perfmon/perfmon.hpp"
 #include "time.hpp"
 #include "utils.hpp"
 
@@ -42,6 +46,18 @@ private:
     signal_timer_t timer;
 };
 
+// Records the duration of a round trip to the worker in `pm`, unless that is NULL
+class js_round_trip_timer_t {
+public:
+    explicit js_round_trip_timer_t(perfmon_duration_sampler_t *pm) {
+        if (pm != NULL) {
+            timer.create(pm);
+        }
+    }
+private:
+    object_buffer_t<block_pm_duration> timer;
+};
+
 // Contains all the data relevant to a single worker process, so we can
 //  easily clear it all and replace it
 class js_runner_t::job_data_t {
@@ -101,8 +117,10 @@ bool js_runner_t::connected() const {
 
 // Starts the javascript function in the worker process
 void js_runner_t::begin(extproc_pool_t *pool, signal_t *interruptor,
-                        const ql::configured_limits_t &limits) {
+                        const ql::configured_limits_t &limits,
+                        const stats_t &_stats) {
     assert_thread();
+    stats = _stats;
     if (interruptor == nullptr) {
         job_data.init(new job_data_t(pool, limits));
     } else {
@@ -130,6 +148,7 @@ js_result_t js_runner_t::eval(const std::string &source,
     bool is_timeout = false;
     try {
         try {
+            js_round_trip_timer_t round_trip_timer(stats.worker_round_trips);
             result = job_data->js_job.eval(source);
         } catch (...) {
             // This inner try-catch block deals with cleanup after an exception, but due
@@ -189,6 +208,7 @@ js_result_t js_runner_t::call(const std::string &source,
     bool is_timeout = false;
     try {
         try {
+            js_round_trip_timer_t round_trip_timer(stats.worker_round_trips);
             result = job_data->js_job.call(*fn_id, args);
         } catch (...) {
             // This inner try-catch block deals with cleanup after an exception, but due
@@ -216,6 +236,10 @@ js_result_t js_runner_t::call(const std::string &source,
         }
     }
 
+    if (stats.calls_per_sec != NULL) {
+        stats.calls_per_sec->record();
+    }
+
     // If the call returned a function, cache it
     js_id_t *any_id = boost::get<js_id_t>(&result);
     if (any_id != nullptr) {
@@ -225,6 +249,98 @@ js_result_t js_runner_t::call(const std::string &source,
     return result;
 }
 
+std::vector<js_result_t> js_runner_t::call_batch(
+        const std::string &source,
+        const std::vector<std::vector<ql::datum_t> > &args,
+        const req_config_t &config) {
+    assert_thread();
+    guarantee(job_data.has());
+
+    // This will retrieve the function from the cache if it's there, or re-eval it
+    js_result_t fn_result = eval(source, config);
+    js_id_t *fn_id = boost::get<js_id_t>(&fn_result);
+    if (fn_id == nullptr) {
+        if (boost::get<ql::datum_t>(&fn_result) != nullptr) {
+            fn_result = strprintf("Javascript query `%s` returned a value when it "
+                                  "should have returned a function.", source.c_str());
+        }
+        return std::vector<js_result_t>(args.size(), fn_result);
+    }
+
+    std::vector<js_result_t> results;
+    results.reserve(args.size());
+    for (size_t begin = 0; begin < args.size(); begin += JS_CALL_BATCH_MAX_SIZE) {
+        const size_t end = std::min<size_t>(args.size(), begin + JS_CALL_BATCH_MAX_SIZE);
+        const std::vector<std::vector<ql::datum_t> > batch(args.begin() + begin,
+                                                           args.begin() + end);
+
+        // Every call gets `config.timeout_ms` of its own, from when the previous call's
+        // result arrived. The first one's timer also covers sending the batch.
+        object_buffer_t<js_timeout_t::sentry_t> sentry;
+        sentry.create(&job_data->js_timeout, config.timeout_ms);
+
+        bool is_timeout = false;
+        try {
+            try {
+                js_round_trip_timer_t round_trip_timer(stats.worker_round_trips);
+                job_data->js_job.send_call_batch(*fn_id, batch);
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    if (i != 0) {
+                        sentry.reset();
+                        sentry.create(&job_data->js_timeout, config.timeout_ms);
+                    }
+                    results.push_back(job_data->js_job.read_call_batch_result());
+                }
+            } catch (...) {
+                // This inner try-catch block deals with cleanup after an exception, but
+                // due to this we must store whether we triggered the timeout signal.
+                is_timeout = job_data->js_timeout.get_signal()->is_pulsed();
+
+                // Sentry must be destroyed before the js_timeout
+                sentry.reset();
+                // This will mark the worker as errored so we don't try to re-sync with
+                //  it on the next line (since we're in a catch statement, we aren't
+                //  allowed)
+                job_data->js_job.worker_error();
+                job_data.reset();
+
+                throw;
+            }
+        } catch (interrupted_exc_t const &e) {
+            // This outer try-catch block explicitly checks whether it was an
+            // `interrupted_exc_t`, and if so deals with the timeout if set. The call
+            // that timed out ends the batch: the worker is gone, so the remaining calls
+            // don't get made and get the same error.
+            if (is_timeout) {
+                results.resize(args.size(), strprintf(
+                    "JavaScript query `%s` timed out after %" PRIu64 ".%03" PRIu64
+                    " seconds.",
+                    source.c_str(), config.timeout_ms / 1000, config.timeout_ms % 1000));
+                return results;
+            } else {
+                throw;
+            }
+        }
+        sentry.reset();
+
+        if (stats.calls_per_sec != NULL) {
+            stats.calls_per_sec->record(batch.size());
+        }
+    }
+
+    // A call that returned a function can't give the function's id to anyone, since
+    // `call_batch()` is only used for calls that should return values. Unlike with
+    // `call()`, there can be many of them for the same source, so instead of caching
+    // the ids we release them right away.
+    for (const js_result_t &result : results) {
+        if (const js_id_t *id = boost::get<js_id_t>(&result)) {
+            release_id(*id);
+        }
+    }
+
+    return results;
+}
+
 void js_runner_t::cache_id(js_id_t id, const std::string &source) {
     guarantee(job_data.has());
     guarantee(id != INVALID_ID);
@@ -27,6 +27,8 @@ typedef boost::variant<ql::datum_t, js_id_t, std::string> js_result_t;
 
 class extproc_pool_t;
 class js_runner_t;
+class perfmon_rate_monitor_t;
+struct perfmon_duration_sampler_t;
 class js_job_t;
 class js_timeout_sentry_t;
 
@@ -43,9 +45,18 @@ public:
         uint64_t timeout_ms;
     };
 
+    // Where to record the function calls and the round trips to the worker that they
+    // take (including the time spent in the JavaScript). Either may be NULL.
+    struct stats_t {
+        stats_t() : calls_per_sec(NULL), worker_round_trips(NULL) { }
+        perfmon_rate_monitor_t *calls_per_sec;
+        perfmon_duration_sampler_t *worker_round_trips;
+    };
+
     void begin(extproc_pool_t *pool,
                signal_t *interruptor,
-               const ql::configured_limits_t &limits);
+               const ql::configured_limits_t &limits,
+               const stats_t &stats = stats_t());
 
     void end();
 
@@ -58,6 +69,17 @@ public:
                      const std::vector<ql::datum_t> &args,
                      const req_config_t &config);
 
+    // Calls a previously compiled function once for each element of `args`, and
+    // returns one result per call. The calls get sent to the worker in batches of up
+    // to `JS_CALL_BATCH_MAX_SIZE`, and each call may take `config.timeout_ms`. If one
+    // of them times out, the calls after it don't get made and get the timeout error
+    // as well. If the function can't be compiled, each result is the error. Function
+    // ids that calls return get released, rather than cached like `call()` does.
+    std::vector<js_result_t> call_batch(
+        const std::string &source,
+        const std::vector<std::vector<ql::datum_t> > &args,
+        const req_config_t &config);
+
 private:
     static const size_t CACHE_SIZE;
 
@@ -72,6 +94,8 @@ private:
     class job_data_t;
     scoped_ptr_t<job_data_t> job_data;
 
+    stats_t stats;
+
     DISABLE_COPYING(js_runner_t);
 };
 
@@ -200,6 +200,7 @@ private:
         case Datum::R_JSON:
             return prepend_r_dot(make_c(json, lparen, quote, make_text(d.r_str()),
                                         quote, rparen));
+        case Datum::R_DATUM: // Only used in responses.
         default:
             unreachable();
         }
@@ -919,6 +920,7 @@ static void pprint_update_reminder() {
     case Datum::R_NUM:
     case Datum::R_STR:
     case Datum::R_JSON:
+    case Datum::R_DATUM:
     case Datum::R_ARRAY:
     case Datum::R_OBJECT:
         break;
@@ -132,6 +132,7 @@ private:
             return make_concat({lparen, json, cond_linebreak,
                                 quote, make_text(d.r_str()), quote,
                                 rparen});
+        case Datum::R_DATUM: // Only used in responses.
         default:
             unreachable();
         }
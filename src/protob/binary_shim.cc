@@ -0,0 +1,72 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "protob/binary_shim.hpp"
+
+#include "containers/archive/varint.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/ql2.pb.h"
+#include "rdb_protocol/serialize_datum.hpp"
+
+namespace binary_shim {
+
+void write_datum(const Datum &d, write_message_t *out) {
+    if (d.type() == Datum::R_DATUM) {
+        // Already serialized, so we just copy it over.
+        out->append(d.r_str().data(), d.r_str().size());
+    } else if (d.type() == Datum::R_STR) {
+        UNUSED ql::serialization_result_t res = ql::datum_serialize(
+            out, ql::datum_t(datum_string_t(d.r_str())),
+            ql::check_datum_serialization_errors_t::NO);
+    } else {
+        unreachable();
+    }
+}
+
+void write_binary_pb(const Response &r, write_message_t *out) THROWS_NOTHING {
+    serialize_universal(out, static_cast<int32_t>(r.type()));
+    int32_t error_type = 0;
+    if (r.type() == Response::RUNTIME_ERROR && r.has_error_type()) {
+        error_type = r.error_type();
+    }
+    serialize_universal(out, error_type);
+
+    serialize_varint_uint64(out, r.response_size());
+    for (int i = 0; i < r.response_size(); ++i) {
+        write_datum(r.response(i), out);
+    }
+
+    serialize_varint_uint64(out, r.notes_size());
+    for (int i = 0; i < r.notes_size(); ++i) {
+        serialize_varint_uint64(out, r.notes(i));
+    }
+
+    ql::datum_t backtrace = ql::datum_t::null();
+    if (r.has_backtrace()) {
+        ql::datum_array_builder_t frames(ql::configured_limits_t::unlimited);
+        const Backtrace *bt = &r.backtrace();
+        for (int i = 0; i < bt->frames_size(); ++i) {
+            const Frame *f = &bt->frames(i);
+            switch (f->type()) {
+            case Frame::POS:
+                frames.add(ql::datum_t(static_cast<double>(f->pos())));
+                break;
+            case Frame::OPT:
+                frames.add(ql::datum_t(datum_string_t(f->opt())));
+                break;
+            default:
+                unreachable();
+            }
+        }
+        backtrace = std::move(frames).to_datum();
+    }
+    UNUSED ql::serialization_result_t res = ql::datum_serialize(
+        out, backtrace, ql::check_datum_serialization_errors_t::NO);
+
+    if (r.has_profile()) {
+        write_datum(r.profile(), out);
+    } else {
+        res = ql::datum_serialize(
+            out, ql::datum_t::null(), ql::check_datum_serialization_errors_t::NO);
+    }
+}
+
+}  // namespace binary_shim
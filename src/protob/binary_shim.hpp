@@ -0,0 +1,16 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef PROTOB_BINARY_SHIM_HPP_
+#define PROTOB_BINARY_SHIM_HPP_
+
+#include "containers/archive/archive.hpp"
+#include "utils.hpp"
+
+class Response;
+
+namespace binary_shim {
+// `write_binary_pb()` encodes a response for the BINARY protocol (see `ql2.proto`).
+// The datums in `r` must be of type `R_DATUM`, except for error messages.
+void write_binary_pb(const Response &r, write_message_t *out) THROWS_NOTHING;
+}  // namespace binary_shim
+
+#endif // PROTOB_BINARY_SHIM_HPP_
@@ -27,7 +27,9 @@
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/queue/limited_fifo.hpp"
 #include "containers/auth_key.hpp"
+#include "containers/archive/string_stream.hpp"
 #include "perfmon/perfmon.hpp"
+#include "protob/binary_shim.hpp"
 #include "protob/json_shim.hpp"
 #include "rapidjson/stringbuffer.h"
 #include "rdb_protocol/backtrace.hpp"
@@ -204,47 +206,57 @@ std::string too_large_response_message(size_t size) {
                      size, TOO_LARGE_RESPONSE_SIZE - 1);
 }
 
-class json_protocol_t {
-public:
-    static bool parse_query(tcp_conn_t *conn,
-                            signal_t *interruptor,
-                            query_handler_t *handler,
-                            ql::protob_t<Query> *query_out) {
-        int64_t token;
-        uint32_t size;
-        conn->read(&token, sizeof(token), interruptor);
-        conn->read(&size, sizeof(size), interruptor);
+// Reads a query in the format of the JSON protocol, which the BINARY protocol shares.
+// Errors are reported with `protocol_t::send_response()`.
+template <class protocol_t>
+bool parse_json_query(tcp_conn_t *conn,
+                      signal_t *interruptor,
+                      query_handler_t *handler,
+                      ql::protob_t<Query> *query_out) {
+    int64_t token;
+    uint32_t size;
+    conn->read(&token, sizeof(token), interruptor);
+    conn->read(&size, sizeof(size), interruptor);
 
-        if (size >= TOO_LARGE_QUERY_SIZE) {
+    if (size >= TOO_LARGE_QUERY_SIZE) {
+        Response error_response;
+        error_response.set_token(token);
+        ql::fill_error(&error_response,
+                       Response::CLIENT_ERROR,
+                       Response::RESOURCE_LIMIT,
+                       too_large_query_message(size),
+                       ql::backtrace_registry_t::EMPTY_BACKTRACE);
+        protocol_t::send_response(error_response, handler, conn, interruptor);
+        throw tcp_conn_read_closed_exc_t();
+    } else {
+        scoped_array_t<char> data(size + 1);
+        conn->read(data.data(), size, interruptor);
+        data[size] = 0; // Null terminate the string, which the json parser requires
+
+        if (!json_shim::parse_json_pb(query_out->get(),
+                                      token,
+                                      data.data())) {
             Response error_response;
             error_response.set_token(token);
             ql::fill_error(&error_response,
                            Response::CLIENT_ERROR,
-                           Response::RESOURCE_LIMIT,
-                           too_large_query_message(size),
+                           Response::QUERY_LOGIC,
+                           unparseable_query_message,
                            ql::backtrace_registry_t::EMPTY_BACKTRACE);
-            send_response(error_response, handler, conn, interruptor);
-            throw tcp_conn_read_closed_exc_t();
-        } else {
-            scoped_array_t<char> data(size + 1);
-            conn->read(data.data(), size, interruptor);
-            data[size] = 0; // Null terminate the string, which the json parser requires
-
-            if (!json_shim::parse_json_pb(query_out->get(),
-                                          token,
-                                          data.data())) {
-                Response error_response;
-                error_response.set_token(token);
-                ql::fill_error(&error_response,
-                               Response::CLIENT_ERROR,
-                               Response::QUERY_LOGIC,
-                               unparseable_query_message,
-                               ql::backtrace_registry_t::EMPTY_BACKTRACE);
-                send_response(error_response, handler, conn, interruptor);
-                return false;
-            }
+            protocol_t::send_response(error_response, handler, conn, interruptor);
+            return false;
         }
-        return true;
+    }
+    return true;
+}
+
+class json_protocol_t {
+public:
+    static bool parse_query(tcp_conn_t *conn,
+                            signal_t *interruptor,
+                            query_handler_t *handler,
+                            ql::protob_t<Query> *query_out) {
+        return parse_json_query<json_protocol_t>(conn, interruptor, handler, query_out);
     }
 
     static void send_response(const Response &response,
@@ -289,6 +301,54 @@ public:
     }
 };
 
+class binary_protocol_t {
+public:
+    static bool parse_query(tcp_conn_t *conn,
+                            signal_t *interruptor,
+                            query_handler_t *handler,
+                            ql::protob_t<Query> *query_out) {
+        if (!parse_json_query<binary_protocol_t>(conn, interruptor, handler,
+                                                 query_out)) {
+            return false;
+        }
+        query_out->get()->set_accepts_r_datum(true);
+        return true;
+    }
+
+    static void send_response(const Response &response,
+                              query_handler_t *handler,
+                              tcp_conn_t *conn,
+                              signal_t *interruptor) {
+        const int64_t token = response.token();
+
+        write_message_t wm;
+        binary_shim::write_binary_pb(response, &wm);
+
+        if (wm.size() >= TOO_LARGE_RESPONSE_SIZE) {
+            Response error_response;
+            error_response.set_token(response.token());
+            ql::fill_error(&error_response,
+                           Response::RUNTIME_ERROR,
+                           Response::RESOURCE_LIMIT,
+                           too_large_response_message(wm.size()),
+                           ql::backtrace_registry_t::EMPTY_BACKTRACE);
+            send_response(error_response, handler, conn, interruptor);
+            return;
+        }
+
+        const uint32_t data_size = static_cast<uint32_t>(wm.size());
+        string_stream_t stream;
+        stream.str().reserve(sizeof(token) + sizeof(data_size) + data_size);
+        stream.str().append(reinterpret_cast<const char *>(&token), sizeof(token));
+        stream.str().append(reinterpret_cast<const char *>(&data_size),
+                            sizeof(data_size));
+        int res = send_write_message(&stream, &wm);
+        guarantee(res == 0);
+
+        conn->write(stream.str().data(), stream.str().size(), interruptor);
+    }
+};
+
 class protobuf_protocol_t {
 public:
     static bool parse_query(tcp_conn_t *conn,
@@ -473,6 +533,7 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
 
         switch (wire_protocol) {
             case VersionDummy::JSON:
+            case VersionDummy::BINARY:
             case VersionDummy::PROTOBUF: break;
             default: {
                 throw protob_server_exc_t(
@@ -488,6 +549,9 @@ void query_server_t::handle_conn(const scoped_ptr_t<tcp_conn_descriptor_t> &ncon
         if (wire_protocol == VersionDummy::JSON) {
             connection_loop<json_protocol_t>(
                 conn.get(), max_concurrent_queries, &query_cache, &ct_keepalive);
+        } else if (wire_protocol == VersionDummy::BINARY) {
+            connection_loop<binary_protocol_t>(
+                conn.get(), max_concurrent_queries, &query_cache, &ct_keepalive);
         } else if (wire_protocol == VersionDummy::PROTOBUF) {
             connection_loop<protobuf_protocol_t>(
                 conn.get(), max_concurrent_queries, &query_cache, &ct_keepalive);
@@ -56,6 +56,16 @@ ql::datum_t artificial_table_t::read_row(ql::env_t *env,
     return row;
 }
 
+std::vector<ql::datum_t> artificial_table_t::read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode) {
+    std::vector<ql::datum_t> rows;
+    rows.reserve(pvals.size());
+    for (const ql::datum_t &pval : pvals) {
+        rows.push_back(read_row(env, pval, read_mode));
+    }
+    return rows;
+}
+
 counted_t<ql::datum_stream_t> artificial_table_t::read_all(
         ql::env_t *env,
         const std::string &get_all_sindex_id,
@@ -175,6 +185,7 @@ ql::datum_t artificial_table_t::write_batched_insert(
         std::vector<bool> &&pkey_was_autogenerated,
         conflict_behavior_t conflict_behavior,
         return_changes_t return_changes,
+        UNUSED bool bulk,
         UNUSED durability_requirement_t durability) {
     ql::datum_t stats = ql::datum_t::empty_object();
     std::set<std::string> conditions;
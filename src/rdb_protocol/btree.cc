@@ -1,6 +1,7 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/btree.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <iterator>
 #include <set>
@@ -18,10 +19,14 @@
 #include "btree/superblock.hpp"
 #include "buffer_cache/serialize_onto_blob.hpp"
 #include "concurrency/coro_pool.hpp"
+#include "concurrency/cross_thread_signal.hpp"
+#include "concurrency/pmap.hpp"
 #include "concurrency/queue/unlimited_fifo.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/buffer_group_stream.hpp"
 #include "containers/archive/buffer_stream.hpp"
+#include "containers/archive/vector_stream.hpp"
+#include "containers/disk_backed_sorter.hpp"
 #include "containers/scoped.hpp"
 #include "rdb_protocol/geo/exceptions.hpp"
 #include "rdb_protocol/geo/indexing.hpp"
@@ -32,6 +37,7 @@
 #include "rdb_protocol/pseudo_geometry.hpp"
 #include "rdb_protocol/serialize_datum_onto_blob.hpp"
 #include "rdb_protocol/shards.hpp"
+#include "rdb_protocol/sindex_selection.hpp"
 #include "rdb_protocol/table_common.hpp"
 
 #include "debug.hpp"
@@ -65,6 +71,8 @@ block_magic_t rdb_value_sizer_t::btree_leaf_magic() const {
 
 max_block_size_t rdb_value_sizer_t::block_size() const { return block_size_; }
 
+bool rdb_value_sizer_t::btree_leaf_key_prefixes() const { return true; }
+
 bool btree_value_fits(max_block_size_t bs, int data_length, const rdb_value_t *value) {
     return blob::ref_fits(bs, data_length, value->value_ref(), blob::btree_maxreflen);
 }
@@ -105,6 +113,41 @@ void rdb_get(const store_key_t &store_key, btree_slice_t *slice,
     }
 }
 
+class rdb_get_batch_callback_t : public batched_read_callback_t {
+public:
+    rdb_get_batch_callback_t(const std::vector<store_key_t> *_keys,
+                             batched_point_read_response_t *_response)
+        : keys(_keys), response(_response) { }
+
+    void on_value(size_t key_index, const void *value, buf_parent_t leaf) {
+        response->data[(*keys)[key_index]] =
+            get_data(static_cast<const rdb_value_t *>(value), leaf);
+    }
+
+private:
+    const std::vector<store_key_t> *keys;
+    batched_point_read_response_t *response;
+};
+
+void rdb_get_batch(const std::vector<store_key_t> &keys, btree_slice_t *slice,
+                   superblock_t *superblock, batched_point_read_response_t *response,
+                   profile::trace_t *trace) {
+    // `find_keyvalues_for_read` wants the keys in order and without duplicates.
+    std::vector<store_key_t> sorted_keys(keys);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()),
+                      sorted_keys.end());
+    std::vector<const btree_key_t *> btree_keys;
+    btree_keys.reserve(sorted_keys.size());
+    for (const store_key_t &key : sorted_keys) {
+        btree_keys.push_back(key.btree_key());
+    }
+
+    rdb_value_sizer_t sizer(superblock->cache()->max_block_size());
+    rdb_get_batch_callback_t cb(&sorted_keys, response);
+    find_keyvalues_for_read(&sizer, superblock, btree_keys, &cb, &slice->stats, trace);
+}
+
 void kv_location_delete(keyvalue_location_t *kv_location,
                         const store_key_t &key,
                         repli_timestamp_t timestamp,
@@ -444,6 +487,113 @@ batched_replace_response_t rdb_batched_replace(
     return std::move(out).to_datum();
 }
 
+bool rdb_bulk_insert(
+    const btree_info_t &info,
+    scoped_ptr_t<real_superblock_t> *superblock,
+    const std::vector<store_key_t> &keys,
+    const btree_batched_replacer_t *replacer,
+    rdb_modification_report_cb_t *sindex_cb,
+    ql::configured_limits_t limits,
+    profile::sampler_t *sampler,
+    profile::trace_t *trace,
+    batched_replace_response_t *response_out) {
+    std::vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return keys[a] < keys[b];
+    });
+    for (size_t i = 1; i < order.size(); ++i) {
+        if (keys[order[i - 1]] == keys[order[i]]) {
+            return false;
+        }
+    }
+
+    const max_block_size_t block_size = (*superblock)->cache()->max_block_size();
+    rdb_value_sizer_t sizer(block_size);
+    rdb_live_deletion_context_t deletion_context;
+    btree_bulk_loader_t loader(&sizer, deletion_context.balancing_detacher());
+    if (!loader.start(superblock->get(), true)) {
+        return false;
+    }
+    if (loader.has_last_key() && !(loader.last_key() < keys[order.front()])) {
+        loader.stop();
+        return false;
+    }
+
+    sampler->new_sample();
+    profile::starter_t profile_starter("Perform bulk insert.", trace);
+    const return_changes_t return_changes = replacer->should_return_changes();
+    const datum_string_t &primary_key = info.primary_key;
+    ql::datum_t stats = ql::datum_t::empty_object();
+    std::set<std::string> conditions;
+    std::vector<rdb_modification_report_t> mod_reports;
+    for (size_t index : order) {
+        const store_key_t &key = keys[index];
+        const ql::datum_t old_val = ql::datum_t::null();
+        ql::datum_t resp;
+        try {
+            ql::datum_t new_val = replacer->replace(old_val, index);
+            rcheck_row_replacement(primary_key, key, old_val, new_val);
+            bool was_changed;
+            resp = make_row_replacement_stats(
+                primary_key, key, old_val, new_val, return_changes, &was_changed);
+            if (was_changed) {
+                r_sanity_check(new_val.get_field(primary_key, ql::NOTHROW).has());
+                scoped_malloc_t<rdb_value_t> value(blob::btree_maxreflen);
+                memset(value.get(), 0, blob::btree_maxreflen);
+                ql::serialization_result_t res;
+                {
+                    blob_t blob(block_size, value->value_ref(), blob::btree_maxreflen);
+                    res = datum_serialize_onto_blob(loader.leaf(), &blob, new_val);
+                }
+                if (res & ql::serialization_result_t::ARRAY_TOO_BIG) {
+                    rfail_typed_target(&new_val, "Array too large for disk writes "
+                                       "(limit 100,000 elements).");
+                } else if (res & ql::serialization_result_t::EXTREMA_PRESENT) {
+                    rfail_typed_target(&new_val, "`r.minval` and `r.maxval` cannot be "
+                                       "written to disk.");
+                }
+
+                loader.append(key.btree_key(), value.get(), info.timestamp);
+                info.slice->stats.pm_keys_set.record();
+                info.slice->stats.pm_total_keys_set += 1;
+
+                rdb_modification_report_t mod_report(key);
+                mod_report.info.added.first = new_val;
+                mod_report.info.added.second.assign(
+                    value->value_ref(),
+                    value->value_ref() + value->inline_size(block_size));
+                mod_reports.push_back(std::move(mod_report));
+            }
+        } catch (const ql::base_exc_t &e) {
+            resp = make_row_replacement_error_stats(old_val, return_changes, e.what());
+        }
+        stats = stats.merge(resp, ql::stats_merge, limits, &conditions);
+    }
+    loader.stop();
+
+    // Secondary indexes and changefeeds get updated just like for
+    // `rdb_batched_replace()`, except that we still hold the superblock.
+    bool update_pkey_cfeeds = sindex_cb->has_pkey_cfeeds(keys);
+    for (const rdb_modification_report_t &mod_report : mod_reports) {
+        rwlock_in_line_t stamp_spot = sindex_cb->get_in_line_for_cfeed_stamp();
+        new_mutex_in_line_t sindex_spot = sindex_cb->get_in_line_for_sindex();
+        sindex_cb->on_mod_report(
+            mod_report, update_pkey_cfeeds, &sindex_spot, &stamp_spot);
+    }
+    if (update_pkey_cfeeds) {
+        sindex_cb->finish(info.slice, superblock->get());
+    }
+    superblock->reset();
+
+    ql::datum_object_builder_t out(stats);
+    out.add_warnings(conditions, limits);
+    *response_out = std::move(out).to_datum();
+    return true;
+}
+
 void rdb_set(const store_key_t &key,
              ql::datum_t data,
              bool overwrite,
@@ -534,14 +684,88 @@ void rdb_value_detacher_t::delete_value(buf_parent_t parent, const void *value)
 typedef ql::transform_variant_t transform_variant_t;
 typedef ql::terminal_variant_t terminal_variant_t;
 
+// Whether `transforms` give the same results on objects that only have the fields
+// `fields` of the rows as on the whole rows.  That's the case if all of the filters
+// before the first map, and that map, only use those fields.  Sets `*maps_rows_out` to
+// whether there is such a map, because otherwise the objects end up in the results.
+bool transforms_only_use_fields(const std::vector<transform_variant_t> &transforms,
+                                const std::set<std::string> &fields,
+                                bool *maps_rows_out) {
+    *maps_rows_out = false;
+    for (const transform_variant_t &transform : transforms) {
+        if (const ql::map_wire_func_t *map =
+                boost::get<ql::map_wire_func_t>(&transform)) {
+            *maps_rows_out = true;
+            return ql::func_only_uses_fields(map->compile_wire_func(), fields);
+        } else if (const ql::filter_wire_func_t *filter =
+                       boost::get<ql::filter_wire_func_t>(&transform)) {
+            if (filter->default_filter_val
+                || !ql::func_only_uses_fields(
+                    filter->filter_func.compile_wire_func(), fields)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
 class rget_sindex_data_t {
 public:
     rget_sindex_data_t(const key_range_t &_pkey_range, const ql::datum_range_t &_range,
                        reql_version_t wire_func_reql_version,
-                       ql::map_wire_func_t wire_func, sindex_multi_bool_t _multi)
+                       ql::map_wire_func_t wire_func, sindex_multi_bool_t _multi,
+                       const std::string &_primary_key,
+                       const std::vector<transform_variant_t> &transforms)
         : pkey_range(_pkey_range), range(_range),
           func_reql_version(wire_func_reql_version),
-          func(wire_func.compile_wire_func()), multi(_multi) { }
+          func(wire_func.compile_wire_func()), multi(_multi),
+          primary_key(_primary_key) {
+        if (multi == sindex_multi_bool_t::SINGLE) {
+            if (boost::optional<std::string> field = ql::get_field_func_name(func)) {
+                sindex_field = *field;
+            }
+        }
+        std::set<std::string> fields;
+        if (!sindex_field.empty()) {
+            fields.insert(sindex_field);
+        }
+        if (!primary_key.empty()) {
+            fields.insert(primary_key);
+        }
+        transforms_covered =
+            transforms_only_use_fields(transforms, fields, &transforms_map_rows);
+    }
+
+    // Gets the value of the secondary index from `key`, and an object with the fields
+    // of the row that the key holds.  Returns false if the key doesn't hold them
+    // (e.g. because it got truncated).
+    bool values_from_key(const store_key_t &key,
+                         ql::datum_t *sindex_val_out,
+                         ql::datum_t *row_out) const {
+        ql::datum_t sindex_val = ql::datum_t::extract_secondary_value(key);
+        if (!sindex_val.has()) {
+            return false;
+        }
+        ql::datum_object_builder_t row;
+        if (!sindex_field.empty()) {
+            bool dup = row.add(datum_string_t(sindex_field), sindex_val);
+            guarantee(!dup);
+        }
+        if (!primary_key.empty() && primary_key != sindex_field) {
+            ql::datum_t primary_val = ql::datum_t::from_primary_key(
+                ql::datum_t::extract_primary(key_to_unescaped_str(key)));
+            if (!primary_val.has()) {
+                return false;
+            }
+            bool dup = row.add(datum_string_t(primary_key), primary_val);
+            guarantee(!dup);
+        }
+        *sindex_val_out = std::move(sindex_val);
+        *row_out = std::move(row).to_datum();
+        return true;
+    }
 private:
     friend class rget_cb_t;
     const key_range_t pkey_range;
@@ -549,6 +773,15 @@ private:
     const reql_version_t func_reql_version;
     const counted_t<const ql::func_t> func;
     const sindex_multi_bool_t multi;
+
+    // The fields of the rows that the sindex keys hold: the indexed field if the
+    // index is on a single field, and the primary key if we know its name.
+    std::string sindex_field;
+    const std::string primary_key;
+    // Whether the transforms only use those fields, and whether they map the rows to
+    // something else (see `transforms_only_use_fields`).
+    bool transforms_covered;
+    bool transforms_map_rows;
 };
 
 class job_data_t {
@@ -610,6 +843,8 @@ private:
     const rget_io_data_t io; // How do get data in/out.
     job_data_t job; // What to do next (stateful).
     const boost::optional<rget_sindex_data_t> sindex; // Optional sindex information.
+    // Whether we can get what we need of the rows from the sindex keys.
+    const bool covered;
 
     // State for internal bookkeeping.
     bool bad_init;
@@ -624,6 +859,8 @@ rget_cb_t::rget_cb_t(rget_io_data_t &&_io,
     : io(std::move(_io)),
       job(std::move(_job)),
       sindex(std::move(_sindex)),
+      covered(sindex && sindex->transforms_covered
+              && (sindex->transforms_map_rows || !job.accumulator->uses_val())),
       bad_init(false) {
     io.response->last_key = !reversed(job.sorting)
         ? range.left
@@ -663,12 +900,16 @@ continue_bool_t rget_cb_t::handle_pair(
     lazy_json_t row(static_cast<const rdb_value_t *>(keyvalue.value()),
                     keyvalue.expose_buf());
     ql::datum_t val;
+    ql::datum_t sindex_val; // NULL if no sindex.
 
     // Count stats whether or not we deserialize the value
     io.slice->stats.pm_keys_read.record();
     io.slice->stats.pm_total_keys_read += 1;
-    // We only load the value if we actually use it (`count` does not).
-    if (job.accumulator->uses_val() || job.transformers.size() != 0 || sindex) {
+    // We only load the value if we actually use it (`count` does not), and not at all
+    // if the sindex key has everything we need.
+    if (covered && sindex->values_from_key(key, &sindex_val, &val)) {
+        row.reset();
+    } else if (job.accumulator->uses_val() || job.transformers.size() != 0 || sindex) {
         val = row.get();
     } else {
         row.reset();
@@ -685,8 +926,7 @@ continue_bool_t rget_cb_t::handle_pair(
         }
 
         // Check whether we're out of sindex range.
-        ql::datum_t sindex_val; // NULL if no sindex.
-        if (sindex) {
+        if (sindex && !sindex_val.has()) {
             // Secondary index functions are deterministic (so no need for an
             // rdb_context_t) and evaluated in a pristine environment (without global
             // optargs).
@@ -701,9 +941,9 @@ continue_bool_t rget_cb_t::handle_pair(
                 sindex_val = sindex_val.get(*tag, ql::NOTHROW);
                 guarantee(sindex_val.has());
             }
-            if (!sindex->range.contains(sindex_val)) {
-                return continue_bool_t::CONTINUE;
-            }
+        }
+        if (sindex && !sindex->range.contains(sindex_val)) {
+            return continue_bool_t::CONTINUE;
         }
 
         ql::groups_t data;
@@ -732,6 +972,373 @@ continue_bool_t rget_cb_t::handle_pair(
     }
 }
 
+class find_any_key_cb_t : public depth_first_traversal_callback_t {
+public:
+    continue_bool_t handle_pair(scoped_key_value_t &&, signal_t *) {
+        return continue_bool_t::ABORT;
+    }
+};
+
+// Reads the number of rows in the B-tree from its stat block.  Writers update the stat
+// block on their own after they have released the superblock, so the population can
+// be off by the writes that are in flight, and doesn't have to match the snapshot
+// that `superblock` reads.  It's good for estimates, not for results.
+bool get_btree_population(superblock_t *superblock, int64_t *population_out) {
+    const block_id_t stat_block_id = superblock->get_stat_block_id();
+    if (stat_block_id == NULL_BLOCK_ID) {
+        return false;
+    }
+    buf_lock_t stat_block(superblock->expose_buf(), stat_block_id, access_t::read);
+    buf_read_t read(&stat_block);
+    uint32_t sb_size;
+    const btree_statblock_t *sb_data =
+        static_cast<const btree_statblock_t *>(read.get_data_read(&sb_size));
+    guarantee(sb_size == BTREE_STATBLOCK_SIZE);
+    *population_out = sb_data->population;
+    return true;
+}
+
+// A plain `count` over `range` is just the population that the stat block keeps track
+// of (give or take the writes in flight), as long as there are no rows outside of
+// `range` in this B-tree (i.e. unless the store holds data of more than one shard).
+// Checking that only takes a descent down each edge of `range`.  Returns false if the
+// count can't be answered this way, which includes a population that has gone
+// negative because of the writes in flight.
+bool count_from_stat_block(superblock_t *superblock,
+                           const key_range_t &range,
+                           signal_t *interruptor,
+                           uint64_t *count_out) {
+    int64_t population;
+    if (!get_btree_population(superblock, &population) || population < 0) {
+        return false;
+    }
+    std::vector<key_range_t> outside;
+    if (range.left != store_key_t::min()) {
+        outside.push_back(key_range_t(key_range_t::none, store_key_t(),
+                                      key_range_t::open, range.left));
+    }
+    if (!range.right.unbounded) {
+        outside.push_back(key_range_t(key_range_t::closed, range.right.key(),
+                                      key_range_t::none, store_key_t()));
+    }
+    for (auto it = outside.begin(); it != outside.end(); ++it) {
+        find_any_key_cb_t cb;
+        if (btree_depth_first_traversal(superblock, *it, &cb, access_t::read, FORWARD,
+                                        release_superblock_t::KEEP, interruptor)
+            == continue_bool_t::ABORT) {
+            return false;
+        }
+    }
+    *count_out = population;
+    return true;
+}
+
+// The keys of `keys` that `range` could be split at.
+std::vector<store_key_t> split_keys_in_range(std::vector<store_key_t> *keys,
+                                             const key_range_t &range) {
+    // The traversal doesn't visit the nodes in order.
+    std::sort(keys->begin(), keys->end());
+    std::vector<store_key_t> splits;
+    for (auto it = keys->begin(); it != keys->end(); ++it) {
+        if (range.left < *it && range.contains_key(*it)) {
+            splits.push_back(*it);
+        }
+    }
+    return splits;
+}
+
+std::vector<key_range_t> split_rget_range(superblock_t *superblock,
+                                          const key_range_t &range) {
+    std::vector<key_range_t> parts(1, range);
+    const size_t max_parts =
+        std::min<size_t>(RGET_PARALLEL_MAX_PARTS, get_num_db_threads());
+    if (max_parts < 2) {
+        return parts;
+    }
+
+    // Most reads are much smaller than this, and this only takes the stat block.
+    int64_t population;
+    if (!get_btree_population(superblock, &population)
+        || population < RGET_PARALLEL_MIN_ROWS) {
+        return parts;
+    }
+
+    // `range` overlaps `splits.size() + 1` of the `root_keys.size() + 1` children of
+    // the root, which have about the same number of rows each.
+    int64_t key_count;
+    std::vector<store_key_t> root_keys;
+    get_btree_key_distribution(superblock, 1, &key_count, &root_keys,
+                               release_superblock_t::KEEP, range);
+    std::vector<store_key_t> splits = split_keys_in_range(&root_keys, range);
+    const int64_t children = splits.size() + 1;
+    if (population * children / static_cast<int64_t>(root_keys.size() + 1)
+        < RGET_PARALLEL_MIN_ROWS) {
+        return parts;
+    }
+
+    if (splits.size() + 1 < max_parts) {
+        // The root's keys aren't enough to split at, so we look at the keys of the
+        // children it has in `range` as well.  Between them, those children have
+        // `keys.size() - root_keys.size() + children` children of their own, of which
+        // `range` overlaps `splits.size() + 1`.
+        std::vector<store_key_t> keys;
+        get_btree_key_distribution(superblock, 2, &key_count, &keys,
+                                   release_superblock_t::KEEP, range);
+        splits = split_keys_in_range(&keys, range);
+        const int64_t grandchildren = keys.size() - root_keys.size() + children;
+        const int64_t estimate =
+            population * children * static_cast<int64_t>(splits.size() + 1)
+            / (static_cast<int64_t>(root_keys.size() + 1) * grandchildren);
+        if (splits.empty() || estimate < RGET_PARALLEL_MIN_ROWS) {
+            return parts;
+        }
+    }
+
+    const size_t num_parts = std::min(max_parts, splits.size() + 1);
+    parts.clear();
+    store_key_t left = range.left;
+    for (size_t i = 1; i < num_parts; ++i) {
+        const store_key_t &split = splits[i * splits.size() / num_parts];
+        parts.push_back(key_range_t(key_range_t::closed, left,
+                                    key_range_t::open, split));
+        left = split;
+    }
+    key_range_t last = range;
+    last.left = left;
+    parts.push_back(last);
+    return parts;
+}
+
+/* `rget_part_cb_t` reads one part of a range that `rdb_rget_slice` has split up.  The
+B-tree is only accessed on the store's thread, but the rows are evaluated on
+`eval_thread` in batches of `RGET_PARALLEL_BATCH_SIZE`, so that the parts can use
+different cores. */
+class rget_part_cb_t : public concurrent_traversal_callback_t {
+public:
+    // `job` is the serialized transforms, terminal and global optargs.  Every part
+    // deserializes its own copy on its own thread, because `wire_func_t`s share their
+    // compiled functions.
+    rget_part_cb_t(btree_slice_t *_slice,
+                   threadnum_t _eval_thread,
+                   rdb_context_t *ctx,
+                   signal_t *interruptor,
+                   const std::vector<char> &job,
+                   const key_range_t &range);
+    ~rget_part_cb_t();
+
+    virtual continue_bool_t handle_pair(
+        scoped_key_value_t &&keyvalue,
+        concurrent_traversal_fifo_enforcer_signal_t waiter)
+        THROWS_ONLY(interrupted_exc_t);
+    void finish() THROWS_ONLY(interrupted_exc_t);
+
+    ql::result_t *get_result() { return &result; }
+    const store_key_t &get_last_key() const { return last_key; }
+
+private:
+    class eval_job_t;
+
+    continue_bool_t evaluate_batch() THROWS_ONLY(interrupted_exc_t);
+    bool failed() const { return boost::get<ql::exc_t>(&result) != NULL; }
+
+    btree_slice_t *const slice;
+    const threadnum_t eval_thread;
+    cross_thread_signal_t eval_interruptor;
+    // Lives on `eval_thread`.
+    scoped_ptr_t<eval_job_t> eval_job;
+
+    std::vector<std::pair<store_key_t, ql::datum_t> > batch;
+    ql::result_t result;
+    store_key_t last_key;
+};
+
+class rget_part_cb_t::eval_job_t {
+public:
+    eval_job_t(rdb_context_t *ctx,
+               signal_t *interruptor,
+               std::map<std::string, ql::wire_func_t> &&optargs,
+               const std::vector<transform_variant_t> &transforms,
+               const terminal_variant_t &terminal)
+        : env(ctx, ql::return_empty_normal_batches_t::NO, interruptor,
+              std::move(optargs), nullptr),
+          accumulator(ql::make_terminal(terminal)) {
+        for (auto it = transforms.begin(); it != transforms.end(); ++it) {
+            transformers.push_back(ql::make_op(*it));
+        }
+    }
+
+    ql::env_t env;
+    std::vector<scoped_ptr_t<ql::op_t> > transformers;
+    scoped_ptr_t<ql::accumulator_t> accumulator;
+};
+
+rget_part_cb_t::rget_part_cb_t(btree_slice_t *_slice,
+                               threadnum_t _eval_thread,
+                               rdb_context_t *ctx,
+                               signal_t *interruptor,
+                               const std::vector<char> &job,
+                               const key_range_t &range)
+    : slice(_slice),
+      eval_thread(_eval_thread),
+      eval_interruptor(interruptor, eval_thread),
+      last_key(range.left) {
+    std::vector<char> job_copy = job;
+    on_thread_t thread_switcher(eval_thread);
+    std::vector<transform_variant_t> transforms;
+    terminal_variant_t terminal;
+    std::map<std::string, ql::wire_func_t> optargs;
+    vector_read_stream_t stream(std::move(job_copy));
+    archive_result_t res =
+        deserialize<cluster_version_t::CLUSTER>(&stream, &transforms);
+    guarantee_deserialization(res, "rget transforms");
+    res = deserialize<cluster_version_t::CLUSTER>(&stream, &terminal);
+    guarantee_deserialization(res, "rget terminal");
+    res = deserialize<cluster_version_t::CLUSTER>(&stream, &optargs);
+    guarantee_deserialization(res, "rget optargs");
+    eval_job.init(new eval_job_t(
+        ctx, &eval_interruptor, std::move(optargs), transforms, terminal));
+}
+
+rget_part_cb_t::~rget_part_cb_t() {
+    on_thread_t thread_switcher(eval_thread);
+    eval_job.reset();
+}
+
+continue_bool_t rget_part_cb_t::handle_pair(
+    scoped_key_value_t &&keyvalue,
+    concurrent_traversal_fifo_enforcer_signal_t waiter)
+    THROWS_ONLY(interrupted_exc_t) {
+    if (failed()) {
+        return continue_bool_t::ABORT;
+    }
+
+    store_key_t key(keyvalue.key());
+    lazy_json_t row(static_cast<const rdb_value_t *>(keyvalue.value()),
+                    keyvalue.expose_buf());
+    slice->stats.pm_keys_read.record();
+    slice->stats.pm_total_keys_read += 1;
+    ql::datum_t val = row.get();
+    guarantee(!row.references_parent());
+    keyvalue.reset();
+    waiter.wait_interruptible();
+
+    if (failed()) {
+        return continue_bool_t::ABORT;
+    }
+    if (last_key < key) {
+        last_key = key;
+    }
+    batch.push_back(std::make_pair(std::move(key), std::move(val)));
+    return batch.size() >= RGET_PARALLEL_BATCH_SIZE
+        ? evaluate_batch()
+        : continue_bool_t::CONTINUE;
+}
+
+continue_bool_t rget_part_cb_t::evaluate_batch() THROWS_ONLY(interrupted_exc_t) {
+    std::vector<std::pair<store_key_t, ql::datum_t> > rows;
+    rows.swap(batch);
+    // Nothing on this thread holds on to the rows any more, so they can move to
+    // `eval_thread` along with us.
+    on_thread_t thread_switcher(eval_thread);
+    ql::env_t *env = &eval_job->env;
+    try {
+        for (auto it = rows.begin(); it != rows.end(); ++it) {
+            ql::groups_t data = {{ql::datum_t(), ql::datums_t{std::move(it->second)}}};
+            for (auto op = eval_job->transformers.begin();
+                 op != eval_job->transformers.end();
+                 ++op) {
+                (**op)(env, &data, ql::datum_t());
+            }
+            (*eval_job->accumulator)(env, &data, std::move(it->first), ql::datum_t());
+        }
+    } catch (const ql::exc_t &e) {
+        result = e;
+        return continue_bool_t::ABORT;
+    } catch (const ql::datum_exc_t &e) {
+#ifndef NDEBUG
+        unreachable();
+#else
+        result = ql::exc_t(e, ql::backtrace_id_t::empty());
+        return continue_bool_t::ABORT;
+#endif // NDEBUG
+    }
+    return continue_bool_t::CONTINUE;
+}
+
+void rget_part_cb_t::finish() THROWS_ONLY(interrupted_exc_t) {
+    if (!failed() && !batch.empty()) {
+        evaluate_batch();
+    }
+    on_thread_t thread_switcher(eval_thread);
+    eval_job->accumulator->finish(&result);
+}
+
+// Runs a terminal over `parts` of a range concurrently, and unshards the results of
+// the parts like the results from different shards.
+void rdb_rget_slice_parallel(
+        btree_slice_t *slice,
+        const std::vector<key_range_t> &parts,
+        superblock_t *superblock,
+        ql::env_t *ql_env,
+        const std::vector<transform_variant_t> &transforms,
+        const terminal_variant_t &terminal,
+        rget_read_response_t *response) {
+    std::vector<char> job;
+    {
+        write_message_t wm;
+        serialize<cluster_version_t::CLUSTER>(&wm, transforms);
+        serialize<cluster_version_t::CLUSTER>(&wm, terminal);
+        serialize<cluster_version_t::CLUSTER>(&wm, ql_env->get_all_optargs());
+        vector_stream_t stream;
+        int res = send_write_message(&stream, &wm);
+        guarantee(res == 0);
+        stream.swap(&job);
+    }
+
+    std::vector<scoped_ptr_t<rget_part_cb_t> > callbacks(parts.size());
+    const int32_t home_thread = get_thread_id().threadnum;
+    bool interrupted = false;
+    pmap(parts.size(), [&](int64_t i) {
+        const threadnum_t eval_thread(
+            (home_thread + static_cast<int32_t>(i)) % get_num_db_threads());
+        callbacks[i].init(new rget_part_cb_t(
+            slice, eval_thread, ql_env->get_rdb_ctx(), ql_env->interruptor, job,
+            parts[i]));
+        try {
+            // The read is snapshotted, so keeping the superblock around until all
+            // parts have been traversed doesn't hold up any writes.
+            btree_concurrent_traversal(
+                superblock, parts[i], callbacks[i].get(), FORWARD,
+                release_superblock_t::KEEP);
+            callbacks[i]->finish();
+        } catch (const interrupted_exc_t &) {
+            interrupted = true;
+        }
+    });
+    if (interrupted) {
+        throw interrupted_exc_t();
+    }
+
+    std::vector<ql::result_t *> results;
+    for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+        if (boost::get<ql::exc_t>((*it)->get_result()) != NULL) {
+            response->result = std::move(*(*it)->get_result());
+            return;
+        }
+        results.push_back((*it)->get_result());
+        if (response->last_key < (*it)->get_last_key()) {
+            response->last_key = (*it)->get_last_key();
+        }
+    }
+    try {
+        scoped_ptr_t<ql::accumulator_t> acc = ql::make_terminal(terminal);
+        acc->unshard(ql_env, response->last_key, results);
+        acc->finish(&response->result);
+    } catch (const ql::exc_t &e) {
+        response->result = e;
+    }
+}
+
 // TODO: Having two functions which are 99% the same sucks.
 void rdb_rget_slice(
         btree_slice_t *slice,
@@ -743,10 +1350,57 @@ void rdb_rget_slice(
         const boost::optional<terminal_variant_t> &terminal,
         sorting_t sorting,
         rget_read_response_t *response,
-        release_superblock_t release_superblock) {
+        release_superblock_t release_superblock,
+        read_mode_t read_mode) {
 
     r_sanity_check(boost::get<ql::exc_t>(&response->result) == NULL);
     profile::starter_t starter("Do range scan on primary index.", ql_env->trace);
+
+    // The stat block isn't part of the read's snapshot (see `get_btree_population`),
+    // so only outdated reads, which don't promise a consistent result anyway, take
+    // their count from it.
+    uint64_t count;
+    if (read_mode == read_mode_t::OUTDATED
+        && terminal
+        && boost::get<ql::count_wire_func_t>(&*terminal) != NULL
+        && transforms.empty()
+        && count_from_stat_block(superblock, range, ql_env->interruptor, &count)) {
+        ql::grouped_t<uint64_t> counts;
+        if (count != 0) {
+            counts.insert(std::make_pair(ql::datum_t(), count));
+        }
+        response->result = std::move(counts);
+        response->last_key = !reversed(sorting)
+            ? (!range.right.unbounded ? range.right.key() : store_key_t::max())
+            : range.left;
+        if (release_superblock == release_superblock_t::RELEASE) {
+            superblock->release();
+        }
+        return;
+    }
+
+    // Terminals that don't care about the order of the rows can run on several parts
+    // of the range at once.  `count` alone isn't worth it, since it doesn't even look
+    // at the rows.
+    if (terminal
+        && boost::get<ql::limit_read_t>(&*terminal) == NULL
+        && sorting == sorting_t::UNORDERED
+        && ql_env->get_rdb_ctx() != NULL) {
+        std::vector<key_range_t> parts;
+        if (ql::make_terminal(*terminal)->uses_val() || !transforms.empty()) {
+            parts = split_rget_range(superblock, range);
+        }
+        if (parts.size() > 1) {
+            response->last_key = range.left;
+            rdb_rget_slice_parallel(slice, parts, superblock, ql_env, transforms,
+                                    *terminal, response);
+            if (release_superblock == release_superblock_t::RELEASE) {
+                superblock->release();
+            }
+            return;
+        }
+    }
+
     rget_cb_t callback(
         rget_io_data_t(response, slice),
         job_data_t(ql_env, batchspec, transforms, terminal, sorting),
@@ -770,6 +1424,7 @@ void rdb_rget_secondary_slice(
         const key_range_t &pk_range,
         sorting_t sorting,
         const sindex_disk_info_t &sindex_info,
+        const std::string &primary_key,
         rget_read_response_t *response,
         release_superblock_t release_superblock) {
 
@@ -783,7 +1438,8 @@ void rdb_rget_secondary_slice(
         rget_io_data_t(response, slice),
         job_data_t(ql_env, batchspec, transforms, terminal, sorting),
         rget_sindex_data_t(pk_range, sindex_range, sindex_func_reql_version,
-                           sindex_info.mapping, sindex_info.multi),
+                           sindex_info.mapping, sindex_info.multi, primary_key,
+                           transforms),
         sindex_region.inner);
     btree_concurrent_traversal(
         superblock,
@@ -1706,12 +2362,254 @@ public:
     signal_t *interruptor_;
 };
 
-void post_construct_secondary_indexes(
+// A secondary index entry: the secondary key and the value reference of the row.
+typedef std::pair<store_key_t, std::vector<char> > sindex_entry_t;
+
+struct sindex_entry_less_t {
+    bool operator()(const sindex_entry_t &a, const sindex_entry_t &b) const {
+        return a.first < b.first;
+    }
+};
+
+typedef disk_backed_sorter_t<sindex_entry_t, sindex_entry_less_t> sindex_entry_sorter_t;
+
+struct sindex_bulk_build_t {
+    sindex_disk_info_t info;
+    scoped_ptr_t<sindex_entry_sorter_t> sorter;
+};
+
+/* Computes the secondary index entries of every row and hands them to the sorters. */
+class sindex_entry_collector_t : public btree_traversal_helper_t {
+public:
+    sindex_entry_collector_t(store_t *store,
+                             std::map<uuid_u, sindex_bulk_build_t> *builds)
+        : store_(store), builds_(builds) { }
+
+    void process_a_leaf(buf_lock_t *leaf_node_buf,
+                        const btree_key_t *, const btree_key_t *,
+                        signal_t *, int *) THROWS_ONLY(interrupted_exc_t) {
+        buf_read_t leaf_read(leaf_node_buf);
+        const leaf_node_t *leaf_node
+            = static_cast<const leaf_node_t *>(leaf_read.get_data_read());
+        const max_block_size_t block_size = leaf_node_buf->cache()->max_block_size();
+
+        for (auto it = leaf::begin(*leaf_node); it != leaf::end(*leaf_node); ++it) {
+            store_->btree->stats.pm_keys_read.record();
+            store_->btree->stats.pm_total_keys_read += 1;
+
+            const btree_key_t *key = (*it).first;
+            guarantee(key);
+            const store_key_t pk(key);
+            const rdb_value_t *rdb_value = static_cast<const rdb_value_t *>((*it).second);
+            const ql::datum_t row = get_data(rdb_value, buf_parent_t(leaf_node_buf));
+            const std::vector<char> value_ref(
+                rdb_value->value_ref(),
+                rdb_value->value_ref() + rdb_value->inline_size(block_size));
+
+            for (auto &&build : *builds_) {
+                std::vector<std::pair<store_key_t, ql::datum_t> > keys;
+                try {
+                    compute_keys(pk, row, build.second.info, &keys);
+                } catch (const ql::base_exc_t &) {
+                    // Just like `rdb_update_single_sindex()`, we drop the row from the
+                    // index.
+                    continue;
+                }
+                for (auto &&pair : keys) {
+                    build.second.sorter->push(
+                        std::make_pair(pair.first, value_ref),
+                        sizeof(sindex_entry_t) + value_ref.size());
+                }
+            }
+        }
+    }
+
+    void postprocess_internal_node(buf_lock_t *) { }
+
+    void filter_interesting_children(buf_parent_t,
+                                     ranged_block_ids_t *ids_source,
+                                     interesting_children_callback_t *cb) {
+        for (int i = 0, e = ids_source->num_block_ids(); i < e; ++i) {
+            cb->receive_interesting_child(i);
+        }
+        cb->no_more_interesting_children();
+    }
+
+    access_t btree_superblock_mode() { return access_t::read; }
+    access_t btree_node_mode() { return access_t::read; }
+
+private:
+    store_t *store_;
+    std::map<uuid_u, sindex_bulk_build_t> *builds_;
+};
+
+/* Writes the sorted entries of `sorter` into the (empty) secondary index `sindex_id`
+with a `btree_bulk_loader_t`.  Returns false if the index turns out not to be empty.  If
+the index gets deleted in the meantime, we just stop. */
+bool bulk_load_sindex(store_t *store,
+                      const uuid_u &sindex_id,
+                      sindex_entry_sorter_t *sorter,
+                      signal_t *interruptor)
+    THROWS_ONLY(interrupted_exc_t) {
+    // The loader only ever touches the right edge of the tree, so we can afford much
+    // larger chunks than the regular post construction.
+    const int MAX_CHUNK_SIZE = 1000;
+    const rdb_post_construction_deletion_context_t deletion_context;
+    scoped_ptr_t<rdb_value_sizer_t> sizer;
+    scoped_ptr_t<btree_bulk_loader_t> loader;
+
+    sindex_entry_t entry;
+    bool has_entry = sorter->pop(&entry);
+    store_key_t last_key;
+    bool has_last_key = false;
+    while (has_entry) {
+        write_token_t token;
+        store->new_write_token(&token);
+
+        scoped_ptr_t<txn_t> wtxn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        store_t::sindex_access_vector_t sindexes;
+
+        // We use HARD durability for the same reason as
+        // `post_construct_traversal_helper_t`.  A chunk fills up to about
+        // `MAX_CHUNK_SIZE / 10` leaf nodes.
+        store->acquire_superblock_for_write(
+            2 + MAX_CHUNK_SIZE / 10,
+            write_durability_t::HARD,
+            &token,
+            &wtxn,
+            &superblock,
+            interruptor);
+        {
+            buf_lock_t sindex_block(superblock->expose_buf(),
+                                    superblock->get_sindex_block_id(),
+                                    access_t::write);
+            superblock.reset();
+            store->acquire_sindex_superblocks_for_write(
+                std::set<uuid_u>{sindex_id}, &sindex_block, &sindexes);
+        }
+        if (sindexes.empty()) {
+            return true;
+        }
+
+        if (!loader.has()) {
+            sizer.init(new rdb_value_sizer_t(wtxn->cache()->max_block_size()));
+            loader.init(new btree_bulk_loader_t(
+                sizer.get(), deletion_context.balancing_detacher()));
+        }
+        if (!loader->start(sindexes[0]->superblock.get())) {
+            return false;
+        }
+        for (int i = 0; i < MAX_CHUNK_SIZE && has_entry; ++i) {
+            // Secondary keys contain the primary key, so we shouldn't ever see the
+            // same key twice.  But the B-tree couldn't hold it, so we skip duplicates.
+            if (!has_last_key || entry.first != last_key) {
+                loader->append(entry.first.btree_key(), entry.second.data(),
+                               repli_timestamp_t::distant_past);
+                last_key = entry.first;
+                has_last_key = true;
+                store->btree->stats.pm_keys_set.record();
+                store->btree->stats.pm_total_keys_set += 1;
+            }
+            has_entry = sorter->pop(&entry);
+        }
+        loader->stop();
+
+        sindexes.clear();
+        wtxn.reset();
+        coro_t::yield();
+    }
+    return true;
+}
+
+/* Builds the secondary indexes in `sindexes_to_post_construct` that are still empty
+bottom-up: we first compute all of their entries in one traversal of the primary index,
+sort them with an external merge sort and then append them to the index in order.
+Returns the indexes that weren't empty, which have to be post constructed the regular
+way. */
+std::set<uuid_u> bulk_post_construct_secondary_indexes(
         store_t *store,
         const std::set<uuid_u> &sindexes_to_post_construct,
         signal_t *interruptor,
         parallel_traversal_progress_t *progress_tracker)
     THROWS_ONLY(interrupted_exc_t) {
+    std::map<uuid_u, sindex_bulk_build_t> builds;
+    {
+        read_token_t read_token;
+        store->new_read_token(&read_token);
+
+        cache_account_t cache_account;
+        scoped_ptr_t<txn_t> txn;
+        scoped_ptr_t<real_superblock_t> superblock;
+        store->acquire_superblock_for_read(
+            &read_token,
+            &txn,
+            &superblock,
+            interruptor,
+            true /* USE_SNAPSHOT */);
+
+        cache_account
+            = txn->cache()->create_cache_account(SINDEX_POST_CONSTRUCTION_CACHE_PRIORITY);
+        txn->set_account(&cache_account);
+
+        std::map<sindex_name_t, secondary_index_t> sindexes;
+        {
+            buf_lock_t sindex_block(superblock->expose_buf(),
+                                    superblock->get_sindex_block_id(),
+                                    access_t::read);
+            get_secondary_indexes(&sindex_block, &sindexes);
+        }
+        for (const auto &pair : sindexes) {
+            if (sindexes_to_post_construct.count(pair.second.id) == 0) {
+                continue;
+            }
+            sindex_bulk_build_t *build = &builds[pair.second.id];
+            try {
+                deserialize_sindex_info_or_crash(pair.second.opaque_definition,
+                                                 &build->info);
+            } catch (const archive_exc_t &e) {
+                crash("%s", e.what());
+            }
+            build->sorter.init(new sindex_entry_sorter_t(
+                store->io_backender_,
+                store->base_path_,
+                "sindex_sort_" + uuid_to_str(pair.second.id),
+                &store->perfmon_collection,
+                SINDEX_BULK_BUILD_SORT_MEMORY));
+        }
+
+        sindex_entry_collector_t helper(store, &builds);
+        helper.progress = progress_tracker;
+        btree_parallel_traversal(superblock.get(), &helper, interruptor);
+    }
+
+    std::set<uuid_u> not_empty;
+    for (auto &&build : builds) {
+        build.second.sorter->finish_pushing();
+        if (!bulk_load_sindex(store, build.first, build.second.sorter.get(),
+                              interruptor)) {
+            not_empty.insert(build.first);
+        }
+        build.second.sorter.reset();
+    }
+    return not_empty;
+}
+
+void post_construct_secondary_indexes(
+        store_t *store,
+        const std::set<uuid_u> &sindexes_to_post_construct_in,
+        signal_t *interruptor,
+        parallel_traversal_progress_t *progress_tracker)
+    THROWS_ONLY(interrupted_exc_t) {
+    // Indexes that are still empty (which is the normal case) get built with the bulk
+    // loader.  Only the remaining ones need the traversal below.
+    const std::set<uuid_u> sindexes_to_post_construct =
+        bulk_post_construct_secondary_indexes(
+            store, sindexes_to_post_construct_in, interruptor, progress_tracker);
+    if (sindexes_to_post_construct.empty()) {
+        return;
+    }
+
     cond_t local_interruptor;
 
     wait_any_t wait_any(&local_interruptor, interruptor);
@@ -46,6 +46,8 @@ public:
 
     max_block_size_t block_size() const;
 
+    bool btree_leaf_key_prefixes() const;
+
 private:
     // The block size.  It's convenient for leaf node code and for
     // some subclasses, too.
@@ -65,6 +67,14 @@ void rdb_get(
     point_read_response_t *response,
     profile::trace_t *trace);
 
+/* Looks up all of `keys` with a single descent of the B-tree. */
+void rdb_get_batch(
+    const std::vector<store_key_t> &keys,
+    btree_slice_t *slice,
+    superblock_t *superblock,
+    batched_point_read_response_t *response,
+    profile::trace_t *trace);
+
 struct btree_info_t {
     btree_info_t(btree_slice_t *_slice,
                  repli_timestamp_t _timestamp,
@@ -115,6 +125,23 @@ batched_replace_response_t rdb_batched_replace(
     profile::sampler_t *sampler,
     profile::trace_t *trace);
 
+/* Inserts the rows with a `btree_bulk_loader_t`, which is a lot faster than
+`rdb_batched_replace()`.  This only works if `keys` doesn't contain any duplicates and
+they all go into an empty part of the primary index, that is if the index is empty or
+they are all greater than its largest key.  Returns false without changing anything
+otherwise.  A large sorted import that arrives in many batches thus gets loaded with one
+loader per batch, each continuing where the last one stopped. */
+MUST_USE bool rdb_bulk_insert(
+    const btree_info_t &info,
+    scoped_ptr_t<real_superblock_t> *superblock,
+    const std::vector<store_key_t> &keys,
+    const btree_batched_replacer_t *replacer,
+    rdb_modification_report_cb_t *sindex_cb,
+    ql::configured_limits_t limits,
+    profile::sampler_t *sampler,
+    profile::trace_t *trace,
+    batched_replace_response_t *response_out);
+
 void rdb_set(const store_key_t &key, ql::datum_t data,
              bool overwrite,
              btree_slice_t *slice, repli_timestamp_t timestamp,
@@ -134,6 +161,14 @@ void rdb_delete(const store_key_t &key, btree_slice_t *slice, repli_timestamp_t
                 profile::trace_t *trace,
                 promise_t<superblock_t *> *pass_back_superblock = nullptr);
 
+// Splits `range` into up to `RGET_PARALLEL_MAX_PARTS` parts with about the same number
+// of rows, going by the keys in the upper levels of the B-tree, so that `rdb_rget_slice`
+// can run a terminal on them concurrently.  Returns just `range` if it doesn't look like
+// it has at least `RGET_PARALLEL_MIN_ROWS` rows.  That gets decided on the stat block
+// and the root first, and only the nodes that overlap `range` ever get read.
+std::vector<key_range_t> split_rget_range(superblock_t *superblock,
+                                          const key_range_t &range);
+
 void rdb_rget_slice(
     btree_slice_t *slice,
     const key_range_t &range,
@@ -144,7 +179,8 @@ void rdb_rget_slice(
     const boost::optional<ql::terminal_variant_t> &terminal,
     sorting_t sorting,
     rget_read_response_t *response,
-    release_superblock_t release_superblock);
+    release_superblock_t release_superblock,
+    read_mode_t read_mode);
 
 void rdb_rget_secondary_slice(
     btree_slice_t *slice,
@@ -158,6 +194,8 @@ void rdb_rget_secondary_slice(
     const key_range_t &pk_range,
     sorting_t sorting,
     const sindex_disk_info_t &sindex_info,
+    // The name of the primary key, or empty if unknown.
+    const std::string &primary_key,
     rget_read_response_t *response,
     release_superblock_t release_superblock);
 
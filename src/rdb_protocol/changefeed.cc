@@ -7,6 +7,7 @@
 #include "concurrency/cross_thread_signal.hpp"
 #include "concurrency/interruptor.hpp"
 #include "containers/archive/boost_types.hpp"
+#include "containers/archive/vector_stream.hpp"
 #include "rdb_protocol/artificial_table/backend.hpp"
 #include "rdb_protocol/btree.hpp"
 #include "rdb_protocol/env.hpp"
@@ -941,7 +942,8 @@ public:
                     is_primary_t::YES, n, sorting, ops}),
             sorting,
             &resp,
-            release_superblock_t::KEEP);
+            release_superblock_t::KEEP,
+            read_mode_t::SINGLE);
         auto *gs = boost::get<ql::grouped_t<ql::stream_t> >(&resp.result);
         if (gs == NULL) {
             auto *exc = boost::get<ql::exc_t>(&resp.result);
@@ -987,6 +989,7 @@ public:
             *pk_range,
             sorting,
             *ref.sindex_info,
+            std::string(), // The limit terminal needs the whole rows anyway.
             &resp,
             release_superblock_t::KEEP);
         auto *gs = boost::get<ql::grouped_t<ql::stream_t> >(&resp.result);
@@ -1348,6 +1351,11 @@ public:
 
     void each_range_sub(const auto_drainer_t::lock_t &lock,
                         const std::function<void(range_sub_t *)> &f) THROWS_NOTHING;
+    // Calls `f` once on each thread that has range subscriptions, with all of the
+    // range subscriptions on that thread, so that `f` can share work between them.
+    void each_range_sub_set(
+        const auto_drainer_t::lock_t &lock,
+        const std::function<void(const std::set<range_sub_t *> &)> &f) THROWS_NOTHING;
     void each_point_sub(const std::function<void(point_sub_t *)> &f) THROWS_NOTHING;
     void each_limit_sub(const std::function<void(limit_sub_t *)> &f) THROWS_NOTHING;
     void each_sub(const auto_drainer_t::lock_t &lock,
@@ -1384,10 +1392,16 @@ private:
         const auto_drainer_t::lock_t &lock,
         const std::function<void(Sub *)> &f) THROWS_NOTHING;
     template<class Sub>
-    void each_sub_in_vec_cb(const std::function<void(Sub *)> &f,
-                            const std::vector<std::set<Sub *> > &vec,
-                            const std::vector<int> &sub_threads,
-                            int i);
+    void each_sub_set_in_vec(
+        const std::vector<std::set<Sub *> > &vec,
+        rwlock_in_line_t *spot,
+        const auto_drainer_t::lock_t &lock,
+        const std::function<void(const std::set<Sub *> &)> &f) THROWS_NOTHING;
+    template<class Sub>
+    void each_sub_set_in_vec_cb(const std::function<void(const std::set<Sub *> &)> &f,
+                                const std::vector<std::set<Sub *> > &vec,
+                                const std::vector<int> &sub_threads,
+                                int i);
     void each_point_sub_cb(const std::function<void(point_sub_t *)> &f, int i);
     void each_limit_sub_cb(const std::function<void(limit_sub_t *)> &f, int i);
 
@@ -1734,6 +1748,17 @@ public:
         for (const auto &transform : spec.transforms) {
             ops.push_back(make_op(transform));
         }
+        // The array size limit is part of the key because it decides whether the
+        // transforms fail on a value.
+        write_message_t wm;
+        serialize<cluster_version_t::CLUSTER>(&wm, spec.transforms);
+        serialize<cluster_version_t::CLUSTER>(
+            &wm, static_cast<uint64_t>(limits.array_size_limit()));
+        vector_stream_t stream;
+        stream.reserve(wm.size());
+        int res = send_write_message(&stream, &wm);
+        guarantee(res == 0);
+        stream.swap(&ops_key);
         feed->add_range_sub(this);
     }
     feed_type_t cfeed_type() const final { return feed_type_t::stream; }
@@ -1757,6 +1782,9 @@ public:
     }
 
     bool has_ops() { return ops.size() != 0; }
+    // Subscriptions with the same `ops_key` produce the same values from
+    // `apply_ops`.
+    const std::vector<char> &get_ops_key() const { return ops_key; }
 
     boost::optional<datum_t> apply_ops(datum_t val) {
         guarantee(active());
@@ -1890,6 +1918,8 @@ private:
 
     scoped_ptr_t<env_t> env;
     std::vector<scoped_ptr_t<op_t> > ops;
+    // `spec.transforms` and the array size limit, serialized.
+    std::vector<char> ops_key;
 
     // The stamp (see `stamped_msg_t`) associated with our `changefeed_stamp_t`
     // read.  We use these to make sure we don't see changes from writes before
@@ -2246,91 +2276,16 @@ public:
             });
     }
     void operator()(const msg_t::change_t &change) const {
-        datum_t null = datum_t::null();
-
-        feed->each_range_sub(*lock, [&](range_sub_t *sub) {
-            datum_t new_val = null, old_val = null;
-            if (!sub->active()) return;
-            if (sub->has_ops()) {
-                if (change.new_val.has()) {
-                    if (boost::optional<datum_t> d = sub->apply_ops(change.new_val)) {
-                        new_val = *d;
-                    }
-                }
-                if (!sub->active()) return;
-                if (change.old_val.has()) {
-                    if (boost::optional<datum_t> d = sub->apply_ops(change.old_val)) {
-                        old_val = *d;
-                    }
-                }
-                if (!sub->active()) return;
-                // Duplicate values are caught before being written to disk and
-                // don't generate a `mod_report`, but if we have transforms the
-                // values might have changed.
-                if (new_val == old_val) {
-                    return;
-                }
-            } else {
-                guarantee(change.old_val.has() || change.new_val.has());
-                if (change.new_val.has()) {
-                    new_val = change.new_val;
-                }
-                if (change.old_val.has()) {
-                    old_val = change.old_val;
-                }
-            }
-            ASSERT_NO_CORO_WAITING;
-            boost::optional<std::string> sindex = sub->sindex();
-            if (sindex) {
-                std::vector<std::pair<datum_t, boost::optional<uint64_t> > >
-                    old_idxs, new_idxs;
-                auto old_it = change.old_indexes.find(*sindex);
-                if (old_it != change.old_indexes.end()) {
-                    for (const auto &idx : old_it->second) {
-                        if (sub->contains(idx.first)) old_idxs.push_back(idx);
-                    }
-                }
-                auto new_it = change.new_indexes.find(*sindex);
-                if (new_it != change.new_indexes.end()) {
-                    for (const auto &idx : new_it->second) {
-                        if (sub->contains(idx.first)) new_idxs.push_back(idx);
-                    }
-                }
-                while (old_idxs.size() > 0 && new_idxs.size() > 0) {
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                indexed_datum_t(old_val,
-                                                std::move(old_idxs.back().first),
-                                                std::move(old_idxs.back().second)),
-                                indexed_datum_t(new_val,
-                                                std::move(new_idxs.back().first),
-                                                std::move(new_idxs.back().second)));
-                    old_idxs.pop_back();
-                    new_idxs.pop_back();
-                }
-                while (old_idxs.size() > 0) {
-                    guarantee(new_idxs.size() == 0);
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                indexed_datum_t(old_val,
-                                                std::move(old_idxs.back().first),
-                                                std::move(old_idxs.back().second)),
-                                boost::none);
-                    old_idxs.pop_back();
-                }
-                while (new_idxs.size() > 0) {
-                    guarantee(old_idxs.size() == 0);
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                boost::none,
-                                indexed_datum_t(new_val,
-                                                std::move(new_idxs.back().first),
-                                                std::move(new_idxs.back().second)));
-                    new_idxs.pop_back();
-                }
-            } else {
-                if (sub->contains(change.pkey)) {
-                    sub->add_el(server_uuid, stamp, change.pkey, sindex,
-                                indexed_datum_t(old_val, datum_t(), boost::none),
-                                indexed_datum_t(new_val, datum_t(), boost::none));
-                }
+        // Subscriptions with the same transforms get the same transformed values,
+        // so when many clients run the same `filter(...).changes()` we evaluate the
+        // transforms once per change on each thread rather than once per
+        // subscription.  This is safe because we ban non-deterministic terms in the
+        // transforms.  The results are only shared between the subscriptions on one
+        // thread because `datum_t`s can't be shared between threads.
+        feed->each_range_sub_set(*lock, [&](const std::set<range_sub_t *> &subs) {
+            std::map<std::vector<char>, std::pair<datum_t, datum_t> > transformed;
+            for (range_sub_t *sub : subs) {
+                on_range_sub_change(sub, change, &transformed);
             }
         });
         feed->on_point_sub(
@@ -2361,6 +2316,105 @@ public:
                                  detach_t::NO));
     }
 private:
+    void on_range_sub_change(
+        range_sub_t *sub,
+        const msg_t::change_t &change,
+        std::map<std::vector<char>, std::pair<datum_t, datum_t> > *transformed) const {
+        datum_t null = datum_t::null();
+        datum_t new_val = null, old_val = null;
+        if (!sub->active()) return;
+        if (sub->has_ops()) {
+            auto it = transformed->find(sub->get_ops_key());
+            if (it != transformed->end()) {
+                new_val = it->second.first;
+                old_val = it->second.second;
+            } else {
+                if (change.new_val.has()) {
+                    if (boost::optional<datum_t> d = sub->apply_ops(change.new_val)) {
+                        new_val = *d;
+                    }
+                }
+                if (!sub->active()) return;
+                if (change.old_val.has()) {
+                    if (boost::optional<datum_t> d = sub->apply_ops(change.old_val)) {
+                        old_val = *d;
+                    }
+                }
+                if (!sub->active()) return;
+                transformed->insert(
+                    std::make_pair(sub->get_ops_key(),
+                                   std::make_pair(new_val, old_val)));
+            }
+            // Duplicate values are caught before being written to disk and
+            // don't generate a `mod_report`, but if we have transforms the
+            // values might have changed.
+            if (new_val == old_val) {
+                return;
+            }
+        } else {
+            guarantee(change.old_val.has() || change.new_val.has());
+            if (change.new_val.has()) {
+                new_val = change.new_val;
+            }
+            if (change.old_val.has()) {
+                old_val = change.old_val;
+            }
+        }
+        ASSERT_NO_CORO_WAITING;
+        boost::optional<std::string> sindex = sub->sindex();
+        if (sindex) {
+            std::vector<std::pair<datum_t, boost::optional<uint64_t> > >
+                old_idxs, new_idxs;
+            auto old_it = change.old_indexes.find(*sindex);
+            if (old_it != change.old_indexes.end()) {
+                for (const auto &idx : old_it->second) {
+                    if (sub->contains(idx.first)) old_idxs.push_back(idx);
+                }
+            }
+            auto new_it = change.new_indexes.find(*sindex);
+            if (new_it != change.new_indexes.end()) {
+                for (const auto &idx : new_it->second) {
+                    if (sub->contains(idx.first)) new_idxs.push_back(idx);
+                }
+            }
+            while (old_idxs.size() > 0 && new_idxs.size() > 0) {
+                sub->add_el(server_uuid, stamp, change.pkey, sindex,
+                            indexed_datum_t(old_val,
+                                            std::move(old_idxs.back().first),
+                                            std::move(old_idxs.back().second)),
+                            indexed_datum_t(new_val,
+                                            std::move(new_idxs.back().first),
+                                            std::move(new_idxs.back().second)));
+                old_idxs.pop_back();
+                new_idxs.pop_back();
+            }
+            while (old_idxs.size() > 0) {
+                guarantee(new_idxs.size() == 0);
+                sub->add_el(server_uuid, stamp, change.pkey, sindex,
+                            indexed_datum_t(old_val,
+                                            std::move(old_idxs.back().first),
+                                            std::move(old_idxs.back().second)),
+                            boost::none);
+                old_idxs.pop_back();
+            }
+            while (new_idxs.size() > 0) {
+                guarantee(old_idxs.size() == 0);
+                sub->add_el(server_uuid, stamp, change.pkey, sindex,
+                            boost::none,
+                            indexed_datum_t(new_val,
+                                            std::move(new_idxs.back().first),
+                                            std::move(new_idxs.back().second)));
+                new_idxs.pop_back();
+            }
+        } else {
+            if (sub->contains(change.pkey)) {
+                sub->add_el(server_uuid, stamp, change.pkey, sindex,
+                            indexed_datum_t(old_val, datum_t(), boost::none),
+                            indexed_datum_t(new_val, datum_t(), boost::none));
+            }
+        }
+    }
+
     feed_t *feed;
     const auto_drainer_t::lock_t *lock;
     uuid_u server_uuid;
@@ -2732,9 +2786,6 @@ void subscription_t::destructor_cleanup(std::function<void()> del_sub) THROWS_NO
         guarantee(exc);
     }
 }
-ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
-        sorting_t, int8_t,
-        sorting_t::UNORDERED, sorting_t::DESCENDING);
 
 keyspec_t::~keyspec_t() { }
 
@@ -2850,6 +2901,21 @@ void feed_t::each_sub_in_vec(
     rwlock_in_line_t *spot,
     const auto_drainer_t::lock_t &lock,
     const std::function<void(Sub *)> &f) THROWS_NOTHING {
+    each_sub_set_in_vec<Sub>(
+        vec, spot, lock,
+        [&f](const std::set<Sub *> &subs) {
+            for (Sub *sub : subs) {
+                f(sub);
+            }
+        });
+}
+
+template<class Sub>
+void feed_t::each_sub_set_in_vec(
+    const std::vector<std::set<Sub *> > &vec,
+    rwlock_in_line_t *spot,
+    const auto_drainer_t::lock_t &lock,
+    const std::function<void(const std::set<Sub *> &)> &f) THROWS_NOTHING {
     assert_thread();
     guarantee(lock.has_lock());
     spot->read_signal()->wait_lazily_unordered();
@@ -2861,7 +2927,7 @@ void feed_t::each_sub_in_vec(
         }
     }
     pmap(subscription_threads.size(),
-         std::bind(&feed_t::each_sub_in_vec_cb<Sub>,
+         std::bind(&feed_t::each_sub_set_in_vec_cb<Sub>,
                    this,
                    std::cref(f),
                    std::cref(vec),
@@ -2870,15 +2936,14 @@ void feed_t::each_sub_in_vec(
 }
 
 template<class Sub>
-void feed_t::each_sub_in_vec_cb(const std::function<void(Sub *)> &f,
-                                const std::vector<std::set<Sub *> > &vec,
-                                const std::vector<int> &subscription_threads,
-                                int i) {
+void feed_t::each_sub_set_in_vec_cb(
+    const std::function<void(const std::set<Sub *> &)> &f,
+    const std::vector<std::set<Sub *> > &vec,
+    const std::vector<int> &subscription_threads,
+    int i) {
     guarantee(vec[subscription_threads[i]].size() != 0);
     on_thread_t th((threadnum_t(subscription_threads[i])));
-    for (Sub *sub : vec[subscription_threads[i]]) {
-        f(sub);
-    }
+    f(vec[subscription_threads[i]]);
 }
 
 void feed_t::each_range_sub(
@@ -2889,6 +2954,14 @@ void feed_t::each_range_sub(
     each_sub_in_vec(range_subs, &spot, lock, f);
 }
 
+void feed_t::each_range_sub_set(
+    const auto_drainer_t::lock_t &lock,
+    const std::function<void(const std::set<range_sub_t *> &)> &f) THROWS_NOTHING {
+    assert_thread();
+    rwlock_in_line_t spot(&range_subs_lock, access_t::read);
+    each_sub_set_in_vec(range_subs, &spot, lock, f);
+}
+
 void feed_t::each_point_sub(
     const std::function<void(point_sub_t *)> &f) THROWS_NOTHING {
     assert_thread();
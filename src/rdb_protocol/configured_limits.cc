@@ -9,6 +9,7 @@ configured_limits_t from_optargs(
     rdb_context_t *ctx, signal_t *interruptor, global_optargs_t *args) {
     size_t changefeed_queue_size = configured_limits_t::default_changefeed_queue_size;
     size_t array_size_limit = configured_limits_t::default_array_size_limit;
+    size_t memory_limit = configured_limits_t::default_memory_limit;
     // Fake an environment with no arguments.  We have to fake it
     // because of a chicken/egg problem; this function gets called
     // before there are any extant environments at all.  Only
@@ -19,7 +20,8 @@ configured_limits_t from_optargs(
     if (args != nullptr) {
         bool has_changefeed_queue_size = args->has_optarg("changefeed_queue_size");
         bool has_array_limit = args->has_optarg("array_limit");
-        if (has_changefeed_queue_size || has_array_limit) {
+        bool has_memory_limit = args->has_optarg("memory_limit");
+        if (has_changefeed_queue_size || has_array_limit || has_memory_limit) {
             env_t env(ctx,
                       return_empty_normal_batches_t::NO,
                       interruptor,
@@ -33,9 +35,13 @@ configured_limits_t from_optargs(
                 int64_t limit = args->get_optarg(&env, "array_limit")->as_int();
                 array_size_limit = check_limit("array size limit", limit);
             }
+            if (has_memory_limit) {
+                int64_t limit = args->get_optarg(&env, "memory_limit")->as_int();
+                memory_limit = check_limit("memory limit", limit);
+            }
         }
     }
-    return configured_limits_t(changefeed_queue_size, array_size_limit);
+    return configured_limits_t(changefeed_queue_size, array_size_limit, memory_limit);
 }
 
 size_t check_limit(const char *name, int64_t limit) {
@@ -45,10 +51,12 @@ size_t check_limit(const char *name, int64_t limit) {
     return limit;
 }
 
-RDB_IMPL_SERIALIZABLE_2(configured_limits_t, changefeed_queue_size_, array_size_limit_);
+RDB_IMPL_SERIALIZABLE_3(configured_limits_t,
+                        changefeed_queue_size_, array_size_limit_, memory_limit_);
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(configured_limits_t);
 
 const configured_limits_t configured_limits_t::unlimited(
+    std::numeric_limits<size_t>::max(),
     std::numeric_limits<size_t>::max(),
     std::numeric_limits<size_t>::max());
 
@@ -17,20 +17,28 @@ class configured_limits_t {
 public:
     configured_limits_t() :
         changefeed_queue_size_(default_changefeed_queue_size),
-        array_size_limit_(default_array_size_limit) {}
-    configured_limits_t(size_t changefeed_queue_size, size_t array_size_limit)
+        array_size_limit_(default_array_size_limit),
+        memory_limit_(default_memory_limit) {}
+    configured_limits_t(size_t changefeed_queue_size, size_t array_size_limit,
+                        size_t memory_limit)
         : changefeed_queue_size_(changefeed_queue_size),
-          array_size_limit_(array_size_limit) {}
+          array_size_limit_(array_size_limit),
+          memory_limit_(memory_limit) {}
 
     static const size_t default_changefeed_queue_size = 100000;
     static const size_t default_array_size_limit = 100000;
+    static const size_t default_memory_limit = 64 * 1024 * 1024;
     static const configured_limits_t unlimited;
 
     size_t changefeed_queue_size() const { return changefeed_queue_size_; }
     size_t array_size_limit() const { return array_size_limit_; }
+    // How many bytes of rows a single operator that can spill to disk (like a join)
+    // may hold in memory before it does so.
+    size_t memory_limit() const { return memory_limit_; }
 private:
     size_t changefeed_queue_size_;
     size_t array_size_limit_;
+    size_t memory_limit_;
     RDB_DECLARE_ME_SERIALIZABLE(configured_limits_t);
 };
 
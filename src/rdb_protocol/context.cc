@@ -48,13 +48,27 @@ rdb_context_t::stats_t::stats_t(perfmon_collection_t *global_stats)
       queries_per_sec_membership(&qe_stats_collection,
                                  &queries_per_sec, "queries_per_sec"),
       queries_total_membership(&qe_stats_collection,
-                               &queries_total, "queries_total") { }
+                               &queries_total, "queries_total"),
+      prepared_queries_executed_membership(&qe_stats_collection,
+                                           &prepared_queries_executed,
+                                           "prepared_queries_executed"),
+      prepared_compile_time_saved_membership(&qe_stats_collection,
+                                             &prepared_compile_time_saved,
+                                             "prepared_compile_time_saved_usec"),
+      js_calls_per_sec(secs_to_ticks(1)),
+      js_calls_per_sec_membership(&qe_stats_collection,
+                                  &js_calls_per_sec, "js_calls_per_sec"),
+      js_worker_round_trips(secs_to_ticks(1), true),
+      js_worker_round_trips_membership(&qe_stats_collection,
+                                       &js_worker_round_trips,
+                                       "js_worker_round_trips") { }
 
 rdb_context_t::rdb_context_t()
     : extproc_pool(nullptr),
       cluster_interface(nullptr),
       manager(nullptr),
       reql_http_proxy(),
+      io_backender(nullptr),
       stats(&get_global_perfmon_collection()) { }
 
 rdb_context_t::rdb_context_t(
@@ -64,6 +78,7 @@ rdb_context_t::rdb_context_t(
       cluster_interface(_cluster_interface),
       manager(nullptr),
       reql_http_proxy(),
+      io_backender(nullptr),
       stats(&get_global_perfmon_collection()) { }
 
 rdb_context_t::rdb_context_t(
@@ -73,12 +88,16 @@ rdb_context_t::rdb_context_t(
         boost::shared_ptr< semilattice_readwrite_view_t<auth_semilattice_metadata_t> >
             _auth_metadata,
         perfmon_collection_t *global_stats,
-        const std::string &_reql_http_proxy)
+        const std::string &_reql_http_proxy,
+        io_backender_t *_io_backender,
+        const base_path_t &_base_path)
     : extproc_pool(_extproc_pool),
       cluster_interface(_cluster_interface),
       auth_metadata(_auth_metadata),
       manager(_mailbox_manager),
       reql_http_proxy(_reql_http_proxy),
+      io_backender(_io_backender),
+      base_path(_base_path),
       stats(global_stats)
 { }
 
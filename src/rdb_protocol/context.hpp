@@ -40,6 +40,7 @@ ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
 class auth_semilattice_metadata_t;
 class ellipsoid_spec_t;
 class extproc_pool_t;
+class io_backender_t;
 class name_string_t;
 class namespace_interface_t;
 template <class> class semilattice_readwrite_view_t;
@@ -133,6 +134,10 @@ public:
 
     virtual ql::datum_t read_row(ql::env_t *env,
         ql::datum_t pval, read_mode_t read_mode) = 0;
+    /* Returns the rows for all of `pvals` in the same order, with `null` for rows
+    that don't exist. */
+    virtual std::vector<ql::datum_t> read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode) = 0;
     virtual counted_t<ql::datum_stream_t> read_all(
         ql::env_t *env,
         const std::string &sindex,
@@ -177,7 +182,7 @@ public:
         std::vector<ql::datum_t> &&inserts,
         std::vector<bool> &&pkey_was_autogenerated,
         conflict_behavior_t conflict_behavior, return_changes_t return_changes,
-        durability_requirement_t durability) = 0;
+        bool bulk, durability_requirement_t durability) = 0;
     virtual bool write_sync_depending_on_durability(ql::env_t *env,
         durability_requirement_t durability) = 0;
 
@@ -331,6 +336,16 @@ public:
             admin_err_t *error_out,
             std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
                 *configs_and_statuses_out) = 0;
+    /* Like `sindex_list()`, but the answer may be up to `SINDEX_LIST_CACHE_MS` old.
+    Query evaluation uses this to decide whether it can read an index instead of the
+    whole table, which happens too often to ask every server every time. */
+    virtual bool sindex_list_cached(
+            counted_t<const ql::db_t> db,
+            const name_string_t &table,
+            signal_t *interruptor,
+            admin_err_t *error_out,
+            std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+                *configs_and_statuses_out) = 0;
 
 protected:
     virtual ~reql_cluster_interface_t() { }   // silence compiler warnings
@@ -354,7 +369,9 @@ public:
                     semilattice_readwrite_view_t<
                         auth_semilattice_metadata_t> > _auth_metadata,
                   perfmon_collection_t *global_stats,
-                  const std::string &_reql_http_proxy);
+                  const std::string &_reql_http_proxy,
+                  io_backender_t *_io_backender,
+                  const base_path_t &_base_path);
 
     ~rdb_context_t();
 
@@ -368,6 +385,12 @@ public:
 
     const std::string reql_http_proxy;
 
+    // Queries that run out of memory (see `configured_limits_t::memory_limit()`) put
+    // their temporary files below `base_path`.  `io_backender` is NULL on proxies and in
+    // most unit tests, in which case they keep everything in memory instead.
+    io_backender_t *io_backender;
+    const base_path_t base_path;
+
     class stats_t {
     public:
         explicit stats_t(perfmon_collection_t *global_stats);
@@ -382,6 +405,18 @@ public:
         perfmon_membership_t queries_per_sec_membership;
         perfmon_counter_t queries_total;
         perfmon_membership_t queries_total_membership;
+        perfmon_counter_t prepared_queries_executed;
+        perfmon_membership_t prepared_queries_executed_membership;
+        // The compile time of the prepared queries that got executed, in
+        // microseconds.
+        perfmon_counter_t prepared_compile_time_saved;
+        perfmon_membership_t prepared_compile_time_saved_membership;
+        // The calls to `r.js` functions, and the round trips to the JavaScript worker
+        // processes that they and the evaluations of `r.js` take.
+        perfmon_rate_monitor_t js_calls_per_sec;
+        perfmon_membership_t js_calls_per_sec_membership;
+        perfmon_duration_sampler_t js_worker_round_trips;
+        perfmon_membership_t js_worker_round_trips_membership;
     private:
         DISABLE_COPYING(stats_t);
     } stats;
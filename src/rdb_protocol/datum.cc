@@ -17,6 +17,7 @@
 #include "arch/runtime/coroutines.hpp"
 #include "cjson/json.hpp"
 #include "containers/archive/stl_types.hpp"
+#include "containers/archive/string_stream.hpp"
 #include "containers/scoped.hpp"
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/rapidjson.h"
@@ -1183,6 +1184,68 @@ std::string datum_t::extract_truncated_secondary(
     return skey;
 }
 
+datum_t datum_t::from_primary_key(const std::string &primary) {
+    if (primary.empty()) {
+        return datum_t();
+    }
+    if (primary[0] == 'S') {
+        return datum_t(datum_string_t(primary.size() - 1, primary.data() + 1));
+    } else if (primary == "Bt" || primary == "Bf") {
+        return datum_t::boolean(primary[1] == 't');
+    } else if (primary[0] == 'N') {
+        // See `num_to_str_key()` for the format.
+        const size_t hex_digits = sizeof(double) * 2;
+        if (primary.size() <= hex_digits + 1 || primary[hex_digits + 1] != '#') {
+            return datum_t();
+        }
+        union {
+            double d;
+            uint64_t u;
+        } packed;
+        packed.u = 0;
+        for (size_t i = 1; i <= hex_digits; ++i) {
+            const char c = primary[i];
+            uint64_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                digit = c - 'a' + 10;
+            } else {
+                return datum_t();
+            }
+            packed.u = (packed.u << 4) | digit;
+        }
+        if (packed.u & (1ULL << 63)) {
+            packed.u ^= (1ULL << 63);
+        } else {
+            packed.u = ~packed.u;
+        }
+        // `num_to_str_key()` prints -0 as 0, so we can't tell which one it was.
+        if (packed.d == 0.0) {
+            return datum_t();
+        }
+        return datum_t(packed.d);
+    } else {
+        return datum_t();
+    }
+}
+
+datum_t datum_t::extract_secondary_value(const store_key_t &key) {
+    if (key_is_truncated(key)) {
+        return datum_t();
+    }
+    std::string secondary = extract_secondary(key_to_unescaped_str(key));
+    // Only 1.16+ keys have their top bit set and a terminator after the value.
+    if (secondary.size() < 2
+        || !(secondary[0] & 0x80)
+        || secondary[secondary.size() - 1] != '\x00') {
+        return datum_t();
+    }
+    secondary[0] &= 0x7F;
+    secondary.erase(secondary.size() - 1);
+    return from_primary_key(secondary);
+}
+
 boost::optional<uint64_t> datum_t::extract_tag(const std::string &secondary) {
     components_t components = parse_secondary(secondary);
     return components.tag_num;
@@ -1682,6 +1745,85 @@ int datum_t::cmp(const datum_t &rhs) const {
         }, MIN_DATUM_RECURSION_STACK_SPACE);
 }
 
+size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+size_t hash_bytes(const char *data, size_t size) {
+    // FNV-1a
+    uint64_t res = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        res ^= static_cast<uint8_t>(data[i]);
+        res *= 1099511628211ULL;
+    }
+    return res;
+}
+
+size_t datum_t::hash_unchecked_stack() const {
+    // This has to follow `cmp_unchecked_stack` closely.
+    if (is_ptype() && !pseudo_compares_as_obj()) {
+        if (get_type() == R_BINARY) {
+            const datum_string_t &data = as_binary();
+            return hash_combine(R_BINARY, hash_bytes(data.data(), data.size()));
+        }
+        const std::string reql_type = get_reql_type();
+        const size_t type_hash = hash_bytes(reql_type.data(), reql_type.size());
+        if (reql_type == pseudo::time_string) {
+            const double epoch_time = pseudo::time_to_epoch_time(*this);
+            return hash_combine(type_hash, datum_t(epoch_time).hash());
+        }
+        // Other pseudotypes can't be compared (see `pseudo_cmp`).
+        return type_hash;
+    }
+
+    switch (get_type()) {
+    case R_NULL: return R_NULL;
+    case MINVAL: return MINVAL;
+    case MAXVAL: return MAXVAL;
+    case R_BOOL: return hash_combine(R_BOOL, as_bool() ? 1 : 0);
+    case R_NUM: {
+        // `-0.0 == 0.0`, so they must hash the same.
+        double d = as_num();
+        if (d == 0.0) {
+            d = 0.0;
+        }
+        return hash_combine(R_NUM, hash_bytes(reinterpret_cast<const char *>(&d),
+                                              sizeof(d)));
+    }
+    case R_STR: {
+        const datum_string_t &str = as_str();
+        return hash_combine(R_STR, hash_bytes(str.data(), str.size()));
+    }
+    case R_ARRAY: {
+        size_t res = R_ARRAY;
+        const size_t sz = arr_size();
+        for (size_t i = 0; i < sz; ++i) {
+            res = hash_combine(res, unchecked_get(i).hash());
+        }
+        return res;
+    }
+    case R_OBJECT: {
+        size_t res = R_OBJECT;
+        const size_t sz = obj_size();
+        for (size_t i = 0; i < sz; ++i) {
+            auto pair = unchecked_get_pair(i);
+            res = hash_combine(res, hash_bytes(pair.first.data(), pair.first.size()));
+            res = hash_combine(res, pair.second.hash());
+        }
+        return res;
+    }
+    case R_BINARY: // This should be handled by the ptype code above
+    case UNINITIALIZED: // fallthru
+    default: unreachable();
+    }
+}
+
+size_t datum_t::hash() const {
+    return call_with_enough_stack<size_t>([&] {
+            return this->hash_unchecked_stack();
+        }, MIN_DATUM_RECURSION_STACK_SPACE);
+}
+
 bool datum_t::operator==(const datum_t &rhs) const { return cmp(rhs) == 0; }
 bool datum_t::operator!=(const datum_t &rhs) const { return cmp(rhs) != 0; }
 bool datum_t::operator<(const datum_t &rhs) const { return cmp(rhs) < 0; }
@@ -1722,6 +1864,10 @@ datum_t to_datum(const Datum *d, const configured_limits_t &limits,
             return to_datum(json, limits, reql_version);
         }
     } break;
+    case Datum::R_DATUM: {
+        rfail_datum(base_exc_t::LOGIC,
+                    "Datums of type R_DATUM are only used in responses.");
+    } break;
     case Datum::R_ARRAY: {
         datum_array_builder_t out(limits);
         out.reserve(d->r_array_size());
@@ -1877,6 +2023,18 @@ void datum_t::write_to_protobuf(Datum *d, use_json_t use_json) const {
         write_json(&writer);
         d->set_r_str(buffer.GetString(), buffer.GetSize());
     } break;
+    case use_json_t::BINARY: {
+        // Arrays and objects that we've read from disk are still backed by their
+        // serialization, which `datum_serialize` just copies over.
+        d->set_type(Datum::R_DATUM);
+        write_message_t wm;
+        UNUSED serialization_result_t res =
+            datum_serialize(&wm, *this, check_datum_serialization_errors_t::NO);
+        string_stream_t stream;
+        int write_res = send_write_message(&stream, &wm);
+        guarantee(write_res == 0);
+        d->set_r_str(std::move(stream.str()));
+    } break;
     default: unreachable();
     }
 }
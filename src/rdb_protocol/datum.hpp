@@ -64,7 +64,9 @@ enum throw_bool_t { NOTHROW = 0, THROW = 1 };
 // CLOBBER: Overwrite existing values.
 enum clobber_bool_t { NOCLOBBER = 0, CLOBBER = 1 };
 
-enum class use_json_t { NO = 0, YES = 1 };
+// How `write_to_protobuf` encodes datums.  BINARY writes `Datum::R_DATUM`s, which
+// hold the serialization from `serialize_datum.hpp` instead of JSON.
+enum class use_json_t { NO = 0, YES = 1, BINARY = 2 };
 
 // When getting the typename of a datum, this should be YES if the name will be
 // used for sorting datums by type, and NO if the name is to be given to a user.
@@ -245,6 +247,14 @@ public:
         const std::string &secondary_and_primary);
     static boost::optional<uint64_t> extract_tag(const store_key_t &key);
     static components_t extract_all(const std::string &secondary_and_primary);
+    /* Inverse to `print_primary()` for numbers, strings and booleans.  Returns an
+    uninitialized datum for keys of other types. */
+    static datum_t from_primary_key(const std::string &primary);
+    /* The value that a secondary index key was printed from, for numbers, strings and
+    booleans in keys of the 1.16+ skey version that didn't get truncated.  Returns an
+    uninitialized datum for all other keys.  For multi indexes, this is the element of
+    the array that the key's tag refers to. */
+    static datum_t extract_secondary_value(const store_key_t &key);
     store_key_t truncated_secondary(
         skey_version_t skey_version,
         extrema_ok_t extrema_ok = extrema_ok_t::NOT_OK) const;
@@ -303,6 +313,8 @@ public:
     // same type should compare appropriately, while disparate types are compared
     // alphabetically by type name.
     int cmp(const datum_t &rhs) const;
+    // Data that are equal according to `cmp` have the same hash.
+    size_t hash() const;
 
     // operator== and operator!= don't take a reql_version_t, unlike other comparison
     // functions, because we know (by inspection) that the behavior of cmp() hasn't
@@ -372,6 +384,7 @@ private:
     void extrema_to_str_key(std::string *str_out) const;
 
     int cmp_unchecked_stack(const datum_t &rhs) const;
+    size_t hash_unchecked_stack() const;
 
     int pseudo_cmp(const datum_t &rhs) const;
     bool pseudo_compares_as_obj() const;
@@ -4,6 +4,9 @@
 #include <map>
 
 #include "boost_utils.hpp"
+#include "containers/disk_backed_queue.hpp"
+#include "containers/disk_backed_sorter.hpp"
+#include "containers/uuid.hpp"
 #include "rdb_protocol/batching.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/func.hpp"
@@ -520,6 +523,7 @@ sindex_readgen_t::sindex_readgen_t(
     const std::map<std::string, wire_func_t> &global_optargs,
     std::string table_name,
     const std::string &_sindex,
+    const std::string &_primary_key,
     datum_range_t range,
     profile_bool_t _profile,
     read_mode_t _read_mode,
@@ -527,6 +531,7 @@ sindex_readgen_t::sindex_readgen_t(
     : rget_readgen_t(global_optargs, std::move(table_name), range,
                      _profile, _read_mode, sorting),
       sindex(_sindex),
+      primary_key(_primary_key),
       sent_first_read(false) { }
 
 scoped_ptr_t<readgen_t> sindex_readgen_t::make(
@@ -534,6 +539,7 @@ scoped_ptr_t<readgen_t> sindex_readgen_t::make(
     std::string table_name,
     read_mode_t read_mode,
     const std::string &sindex,
+    const std::string &primary_key,
     datum_range_t range,
     sorting_t sorting) {
     return scoped_ptr_t<readgen_t>(
@@ -541,6 +547,7 @@ scoped_ptr_t<readgen_t> sindex_readgen_t::make(
             env->get_all_optargs(),
             std::move(table_name),
             sindex,
+            primary_key,
             range,
             env->profile(),
             read_mode,
@@ -608,7 +615,8 @@ rget_read_t sindex_readgen_t::next_read_impl(
         batchspec,
         std::move(transforms),
         boost::optional<terminal_variant_t>(),
-        sindex_rangespec_t(sindex, std::move(region), original_datum_range),
+        sindex_rangespec_t(
+            sindex, std::move(region), original_datum_range, primary_key),
         sorting);
 }
 
@@ -657,7 +665,8 @@ boost::optional<read_t> sindex_readgen_t::sindex_sort_read(
                         sindex_rangespec_t(
                             sindex,
                             region_t(key_range_t(rng)),
-                            original_datum_range),
+                            original_datum_range,
+                            primary_key),
                         sorting),
                     profile,
                     read_mode);
@@ -1072,6 +1081,191 @@ indexed_sort_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batch
     return ret;
 }
 
+// SORT_DATUM_STREAM_T
+std::vector<sorting_t> sort_directions(
+        const std::vector<std::pair<sorting_t, counted_t<const func_t> > > &comps) {
+    std::vector<sorting_t> directions;
+    for (auto it = comps.begin(); it != comps.end(); ++it) {
+        directions.push_back(it->first);
+    }
+    return directions;
+}
+
+bool can_sort_on_disk(env_t *env, const counted_t<datum_stream_t> &source) {
+    rdb_context_t *ctx = env->get_rdb_ctx();
+    return ctx != nullptr && ctx->io_backender != nullptr && !source->is_array();
+}
+
+sort_datum_stream_t::sort_datum_stream_t(
+        env_t *env,
+        counted_t<datum_stream_t> _source,
+        std::vector<std::pair<sorting_t, counted_t<const func_t> > > _comparisons,
+        backtrace_id_t bt)
+    : eager_datum_stream_t(bt),
+      source(std::move(_source)),
+      comparisons(std::move(_comparisons)),
+      less(sort_directions(comparisons)),
+      can_spill(can_sort_on_disk(env, source)),
+      limit(std::numeric_limits<size_t>::max()),
+      sorted(false),
+      index(0),
+      sorter_exhausted(false) { }
+
+sort_datum_stream_t::~sort_datum_stream_t() { }
+
+counted_t<datum_stream_t> sort_datum_stream_t::slice(size_t l, size_t r) {
+    // Transformations like `filter` could drop rows, so we can only do this if
+    // there are none.
+    if (!sorted && !ops_to_do()) {
+        limit = std::min(limit, r);
+    }
+    return datum_stream_t::slice(l, r);
+}
+
+bool sort_datum_stream_t::is_array() const {
+    return !can_spill;
+}
+
+datum_t sort_datum_stream_t::as_array(env_t *env) {
+    if (is_grouped()) {
+        return datum_t();
+    }
+    sort(env);
+    return eager_datum_stream_t::as_array(env);
+}
+
+bool sort_datum_stream_t::is_exhausted() const {
+    return sorted
+        && (sorter.has() ? sorter_exhausted : index == items.size())
+        && batch_cache_exhausted();
+}
+
+feed_type_t sort_datum_stream_t::cfeed_type() const {
+    return feed_type_t::not_feed;
+}
+
+bool sort_datum_stream_t::is_infinite() const {
+    return source->is_infinite();
+}
+
+void sort_datum_stream_t::sort(env_t *env) {
+    if (sorted) {
+        return;
+    }
+    const configured_limits_t limits = env->limits();
+    // With a small enough `limit`, we only keep the `limit` smallest rows in a heap
+    // with the largest one on top.
+    const bool top_k = limit <= limits.array_size_limit();
+
+    if (top_k && !source->is_grouped()) {
+        // The heap is a terminal, so that it gets pushed down to the shards when
+        // `source` reads a table.
+        top_k_wire_func_t tk;
+        tk.n = limit;
+        for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
+            tk.directions.push_back(it->first);
+            tk.funcs.push_back(wire_func_t(it->second));
+        }
+        datum_t rows;
+        {
+            profile::sampler_t sampler("Evaluating the orderings.", env->trace);
+            rows = source->run_terminal(env, tk)->as_datum();
+        }
+        items.reserve(rows.arr_size());
+        for (size_t i = 0; i < rows.arr_size(); ++i) {
+            sort_item_t item;
+            item.position = i;
+            item.row = rows.get(i);
+            items.push_back(std::move(item));
+        }
+        index = 0;
+        sorted = true;
+        return;
+    }
+
+    batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env);
+    uint64_t position = 0;
+    {
+        profile::sampler_t sampler("Evaluating the orderings.", env->trace);
+        for (;;) {
+            std::vector<datum_t> data = source->next_batch(env, batchspec);
+            if (data.size() == 0) {
+                break;
+            }
+            for (auto it = data.begin(); it != data.end(); ++it) {
+                sort_item_t item = make_sort_item(
+                    env, comparisons, std::move(*it), store_key_t(), position++);
+                sampler.new_sample();
+                if (top_k) {
+                    push_top_k(&items, limit, std::move(item), less);
+                } else if (sorter.has()) {
+                    const size_t size = serialized_size<cluster_version_t::CLUSTER>(
+                        item.row);
+                    sorter->push(std::move(item), sizeof(sort_item_t) + size);
+                } else {
+                    items.push_back(std::move(item));
+                    if (items.size() > limits.array_size_limit() && can_spill) {
+                        rdb_context_t *ctx = env->get_rdb_ctx();
+                        sorter.init(new sorter_t(
+                            ctx->io_backender,
+                            ctx->base_path,
+                            "sort_" + uuid_to_str(generate_uuid()),
+                            &sorter_collection,
+                            limits.memory_limit(),
+                            less));
+                        for (auto &&spilled : items) {
+                            const size_t size =
+                                serialized_size<cluster_version_t::CLUSTER>(
+                                    spilled.row);
+                            sorter->push(std::move(spilled),
+                                         sizeof(sort_item_t) + size);
+                        }
+                        items = std::vector<sort_item_t>();
+                    }
+                    rcheck_array_size(items, limits);
+                }
+            }
+        }
+    }
+
+    if (sorter.has()) {
+        profile::sampler_t sampler("Sorting on disk.", env->trace);
+        sorter->finish_pushing();
+    } else if (top_k) {
+        profile::sampler_t sampler("Sorting in-memory.", env->trace);
+        std::sort_heap(items.begin(), items.end(), less);
+    } else {
+        profile::sampler_t sampler("Sorting in-memory.", env->trace);
+        std::sort(items.begin(), items.end(), less);
+    }
+    index = 0;
+    sorted = true;
+}
+
+std::vector<datum_t>
+sort_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &batchspec) {
+    sort(env);
+    std::vector<datum_t> ret;
+    batcher_t batcher = batchspec.to_batcher();
+    if (sorter.has()) {
+        sort_item_t item;
+        while (!sorter_exhausted && !batcher.should_send_batch()) {
+            if (sorter->pop(&item)) {
+                batcher.note_el(item.row);
+                ret.push_back(std::move(item.row));
+            } else {
+                sorter_exhausted = true;
+            }
+        }
+    } else {
+        for (; index < items.size() && !batcher.should_send_batch(); ++index) {
+            batcher.note_el(items[index].row);
+            ret.push_back(std::move(items[index].row));
+        }
+    }
+    return ret;
+}
+
 // ORDERED_DISTINCT_DATUM_STREAM_T
 ordered_distinct_datum_stream_t::ordered_distinct_datum_stream_t(
     counted_t<datum_stream_t> _source) : wrapper_datum_stream_t(_source) { }
@@ -1120,6 +1314,294 @@ offsets_of_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &bs) {
     return ret;
 }
 
+// EQ_JOIN_DATUM_STREAM_T
+eq_join_datum_stream_t::eq_join_datum_stream_t(counted_t<datum_stream_t> _source,
+                                               counted_t<const func_t> _left_attr,
+                                               counted_t<table_t> _table,
+                                               boost::optional<std::string> _sindex)
+    : wrapper_datum_stream_t(_source), left_attr(_left_attr), table(_table),
+      sindex(std::move(_sindex)) {
+    guarantee(left_attr.has() && table.has() && source.has());
+}
+
+datum_t make_eq_join_pair(const datum_t &left, const datum_t &right) {
+    std::map<datum_string_t, datum_t> pair;
+    pair[datum_string_t("left")] = left;
+    pair[datum_string_t("right")] = right;
+    return datum_t(std::move(pair));
+}
+
+std::vector<datum_t>
+eq_join_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &bs) {
+    std::vector<datum_t> ret;
+    profile::sampler_t sampler("Joining eagerly.", env->trace);
+    while (ret.size() == 0) {
+        std::vector<datum_t> v = source->next_batch(env, bs);
+        if (v.size() == 0) {
+            break;
+        }
+
+        std::vector<datum_t> lefts, keys;
+        lefts.reserve(v.size());
+        keys.reserve(v.size());
+        for (auto it = v.begin(); it != v.end(); ++it) {
+            // Rows that are `null` or that don't have the join attribute don't
+            // match anything.
+            if (it->get_type() == datum_t::R_NULL) {
+                continue;
+            }
+            datum_t key;
+            try {
+                key = left_attr->call(env, *it)->as_datum();
+            } catch (const base_exc_t &e) {
+                if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                    throw;
+                }
+                continue;
+            }
+            // Neither do join keys that are `null`, or that can't be primary keys if
+            // we join on the primary key.  (This used to be `get_all(key).default([])`,
+            // which matched nothing for those keys either.)
+            if (key.get_type() == datum_t::R_NULL) {
+                continue;
+            }
+            if (!sindex) {
+                try {
+                    key.print_primary();
+                } catch (const base_exc_t &) {
+                    continue;
+                }
+            }
+            keys.push_back(std::move(key));
+            lefts.push_back(*it);
+        }
+
+        if (!sindex) {
+            std::vector<datum_t> rights = table->get_rows(env, keys);
+            r_sanity_check(rights.size() == lefts.size());
+            for (size_t i = 0; i < lefts.size(); ++i) {
+                if (rights[i].get_type() != datum_t::R_NULL) {
+                    ret.push_back(make_eq_join_pair(lefts[i], rights[i]));
+                }
+                sampler.new_sample();
+            }
+        } else {
+            for (size_t i = 0; i < lefts.size(); ++i) {
+                counted_t<datum_stream_t> matches =
+                    table->get_all(env, keys[i], *sindex, backtrace());
+                for (;;) {
+                    std::vector<datum_t> rights = matches->next_batch(env, bs);
+                    if (rights.size() == 0) {
+                        break;
+                    }
+                    for (auto r = rights.begin(); r != rights.end(); ++r) {
+                        ret.push_back(make_eq_join_pair(lefts[i], *r));
+                    }
+                }
+                sampler.new_sample();
+            }
+        }
+    }
+    return ret;
+}
+
+// HASH_JOIN_DATUM_STREAM_T
+class hash_join_spill_t {
+public:
+    // The rows of one side of the join, together with their keys.
+    typedef disk_backed_queue_t<std::pair<datum_t, datum_t> > queue_t;
+
+    explicit hash_join_spill_t(rdb_context_t *ctx) : partition(0), loaded(false) {
+        const std::string prefix = "hash_join_" + uuid_to_str(generate_uuid());
+        for (size_t i = 0; i < HASH_JOIN_SPILL_PARTITIONS; ++i) {
+            lefts.push_back(make_scoped<queue_t>(
+                ctx->io_backender,
+                serializer_filepath_t(ctx->base_path,
+                                      strprintf("%s_left_%zu", prefix.c_str(), i)),
+                &perfmon_collection));
+            rights.push_back(make_scoped<queue_t>(
+                ctx->io_backender,
+                serializer_filepath_t(ctx->base_path,
+                                      strprintf("%s_right_%zu", prefix.c_str(), i)),
+                &perfmon_collection));
+        }
+    }
+
+    queue_t *left_partition(const datum_t &key) {
+        return lefts[key.hash() % HASH_JOIN_SPILL_PARTITIONS].get();
+    }
+    queue_t *right_partition(const datum_t &key) {
+        return rights[key.hash() % HASH_JOIN_SPILL_PARTITIONS].get();
+    }
+
+    // The queues don't show up in the stats, they go away with the query anyway.
+    perfmon_collection_t perfmon_collection;
+    std::vector<scoped_ptr_t<queue_t> > lefts, rights;
+
+    // The partition that is being joined, and whether its right rows have been
+    // loaded into the hash table yet.
+    size_t partition;
+    bool loaded;
+};
+
+hash_join_datum_stream_t::hash_join_datum_stream_t(
+        counted_t<datum_stream_t> _source,
+        counted_t<const func_t> _left_key,
+        counted_t<datum_stream_t> _right,
+        counted_t<const func_t> _right_key,
+        hash_join_type_t _type)
+    : wrapper_datum_stream_t(_source), left_key(_left_key), right(_right),
+      right_key(_right_key), type(_type), built(false), table_size(0) {
+    guarantee(left_key.has() && right.has() && right_key.has() && source.has());
+}
+
+hash_join_datum_stream_t::~hash_join_datum_stream_t() { }
+
+std::vector<datum_t>
+hash_join_datum_stream_t::next_raw_batch(env_t *env, const batchspec_t &bs) {
+    std::vector<datum_t> ret;
+    profile::sampler_t sampler("Hash joining.", env->trace);
+    while (ret.size() == 0) {
+        if (spill.has()) {
+            if (!next_spilled_batch(bs, &ret)) {
+                break;
+            }
+            continue;
+        }
+
+        std::vector<datum_t> lefts = source->next_batch(env, bs);
+        if (lefts.size() == 0) {
+            break;
+        }
+        if (!built) {
+            // Just like the nested loop, we don't touch `right` unless there's
+            // something to join it with.
+            build(env, lefts, bs);
+            built = true;
+            if (spill.has()) {
+                continue;
+            }
+        }
+        for (auto it = lefts.begin(); it != lefts.end(); ++it) {
+            // There's no need to compute the key if nothing can match it.
+            probe(*it,
+                  table.empty() ? datum_t() : left_key->call(env, *it)->as_datum(),
+                  &ret);
+            sampler.new_sample();
+        }
+    }
+    return ret;
+}
+
+void hash_join_datum_stream_t::build(env_t *env,
+                                     const std::vector<datum_t> &first_lefts,
+                                     const batchspec_t &bs) {
+    rdb_context_t *ctx = env->get_rdb_ctx();
+    // We can only spill if we have somewhere to put the files, and if we can read
+    // all of `source` before returning anything.
+    const bool can_spill = ctx != nullptr
+        && ctx->io_backender != nullptr
+        && !source->is_infinite();
+    const size_t memory_limit = env->limits().memory_limit();
+
+    for (;;) {
+        std::vector<datum_t> rights = right->next_batch(env, bs);
+        if (rights.size() == 0) {
+            break;
+        }
+        for (auto it = rights.begin(); it != rights.end(); ++it) {
+            datum_t key = right_key->call(env, *it)->as_datum();
+            if (spill.has()) {
+                spill->right_partition(key)->push(std::make_pair(key, *it));
+                continue;
+            }
+            table_size += serialized_size<cluster_version_t::CLUSTER>(key)
+                + serialized_size<cluster_version_t::CLUSTER>(*it);
+            table[std::move(key)].push_back(*it);
+            if (can_spill && table_size > memory_limit) {
+                start_spilling(env);
+            }
+        }
+    }
+
+    if (spill.has()) {
+        std::vector<datum_t> lefts = first_lefts;
+        while (lefts.size() != 0) {
+            for (auto it = lefts.begin(); it != lefts.end(); ++it) {
+                datum_t key = left_key->call(env, *it)->as_datum();
+                spill->left_partition(key)->push(std::make_pair(key, *it));
+            }
+            lefts = source->next_batch(env, bs);
+        }
+    }
+}
+
+void hash_join_datum_stream_t::start_spilling(env_t *env) {
+    spill.init(new hash_join_spill_t(env->get_rdb_ctx()));
+    for (auto it = table.begin(); it != table.end(); ++it) {
+        hash_join_spill_t::queue_t *queue = spill->right_partition(it->first);
+        for (auto row = it->second.begin(); row != it->second.end(); ++row) {
+            queue->push(std::make_pair(it->first, *row));
+        }
+    }
+    table.clear();
+    table_size = 0;
+}
+
+bool hash_join_datum_stream_t::next_spilled_batch(const batchspec_t &bs,
+                                                  std::vector<datum_t> *out) {
+    batcher_t batcher = bs.to_batcher();
+    std::pair<datum_t, datum_t> pair;
+    while (spill->partition < HASH_JOIN_SPILL_PARTITIONS) {
+        const size_t i = spill->partition;
+        if (!spill->loaded) {
+            // We don't split partitions any further, so a partition that's still
+            // too large just takes more memory.
+            table.clear();
+            while (!spill->rights[i]->empty()) {
+                spill->rights[i]->pop(&pair);
+                table[std::move(pair.first)].push_back(std::move(pair.second));
+            }
+            spill->loaded = true;
+        }
+        while (!spill->lefts[i]->empty()) {
+            if (batcher.should_send_batch()) {
+                return true;
+            }
+            spill->lefts[i]->pop(&pair);
+            const size_t old_size = out->size();
+            probe(pair.second, pair.first, out);
+            for (size_t j = old_size; j < out->size(); ++j) {
+                batcher.note_el((*out)[j]);
+            }
+        }
+        // Delete the files of the partition right away.
+        spill->lefts[i].reset();
+        spill->rights[i].reset();
+        ++spill->partition;
+        spill->loaded = false;
+    }
+    table.clear();
+    return out->size() != 0;
+}
+
+void hash_join_datum_stream_t::probe(const datum_t &left,
+                                     const datum_t &key,
+                                     std::vector<datum_t> *out) {
+    auto it = key.has() ? table.find(key) : table.end();
+    if (it != table.end()) {
+        for (auto right_row = it->second.begin();
+             right_row != it->second.end();
+             ++right_row) {
+            out->push_back(make_eq_join_pair(left, *right_row));
+        }
+    } else if (type == hash_join_type_t::OUTER) {
+        std::map<datum_string_t, datum_t> pair;
+        pair[datum_string_t("left")] = left;
+        out->push_back(datum_t(std::move(pair)));
+    }
+}
+
 // SLICE_DATUM_STREAM_T
 slice_datum_stream_t::slice_datum_stream_t(
     uint64_t _left, uint64_t _right, counted_t<datum_stream_t> _src)
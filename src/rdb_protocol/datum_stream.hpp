@@ -9,6 +9,7 @@
 #include <queue>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -26,11 +27,14 @@
 #include "rdb_protocol/real_table.hpp"
 #include "rdb_protocol/shards.hpp"
 
+template <class T, class Less> class disk_backed_sorter_t;
+
 namespace ql {
 
 class env_t;
 class scope_env_t;
 class func_t;
+class table_t;
 
 enum class return_empty_normal_batches_t { NO, YES };
 
@@ -85,7 +89,7 @@ public:
     scoped_ptr_t<val_t> to_array(env_t *env);
 
     // stream -> stream (always eager)
-    counted_t<datum_stream_t> slice(size_t l, size_t r);
+    virtual counted_t<datum_stream_t> slice(size_t l, size_t r);
     counted_t<datum_stream_t> offsets_of(counted_t<const func_t> f);
     counted_t<datum_stream_t> ordered_distinct();
 
@@ -194,6 +198,79 @@ private:
     int64_t index;
 };
 
+// Joins each row of `source` with the rows of `table` whose `sindex` (or primary key,
+// if `sindex` is empty) equals `left_attr(row)`, producing `{left: row, right: match}`
+// in the order of `source`.  Primary key lookups for a whole batch of left rows go
+// out as a single read, which gets sharded into at most one read per shard.
+class eq_join_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    eq_join_datum_stream_t(counted_t<datum_stream_t> _source,
+                           counted_t<const func_t> _left_attr,
+                           counted_t<table_t> _table,
+                           boost::optional<std::string> _sindex);
+
+private:
+    std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    counted_t<const func_t> left_attr;
+    counted_t<table_t> table;
+    boost::optional<std::string> sindex;
+};
+
+enum class hash_join_type_t { INNER, OUTER };
+
+class hash_join_spill_t;
+
+// Joins each row of `source` with the rows of `right` whose `right_key` equals its
+// `left_key`, producing `{left: row, right: match}`.  For `OUTER` joins, rows of
+// `source` that match nothing produce `{left: row}`.  The results are the same and
+// come in the same order as with a nested loop over both sequences, but `right` is
+// only read once: it gets loaded into a hash table, which the rows of `source` are
+// then looked up in as they stream by.
+//
+// If `right` takes up more than `configured_limits_t::memory_limit()` bytes, both
+// sides get split into `HASH_JOIN_SPILL_PARTITIONS` partitions on disk by the hash of
+// their key, and the partitions are joined one by one.  The results then come
+// partition by partition rather than in the order of `source`.
+class hash_join_datum_stream_t : public wrapper_datum_stream_t {
+public:
+    hash_join_datum_stream_t(counted_t<datum_stream_t> _source,
+                             counted_t<const func_t> _left_key,
+                             counted_t<datum_stream_t> _right,
+                             counted_t<const func_t> _right_key,
+                             hash_join_type_t _type);
+    ~hash_join_datum_stream_t();
+
+private:
+    struct datum_hash_t {
+        size_t operator()(const datum_t &d) const { return d.hash(); }
+    };
+    typedef std::unordered_map<datum_t, std::vector<datum_t>, datum_hash_t>
+        hash_table_t;
+
+    std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    void build(env_t *env, const std::vector<datum_t> &first_lefts,
+               const batchspec_t &batchspec);
+    void start_spilling(env_t *env);
+    // Returns false once all the partitions have been joined.
+    bool next_spilled_batch(const batchspec_t &batchspec, std::vector<datum_t> *out);
+    void probe(const datum_t &left, const datum_t &key, std::vector<datum_t> *out);
+
+    counted_t<const func_t> left_key;
+    counted_t<datum_stream_t> right;
+    counted_t<const func_t> right_key;
+    const hash_join_type_t type;
+
+    bool built;
+    hash_table_t table;
+    // The approximate size of `table` in bytes.
+    size_t table_size;
+    scoped_ptr_t<hash_join_spill_t> spill;
+};
+
 class ordered_distinct_datum_stream_t : public wrapper_datum_stream_t {
 public:
     explicit ordered_distinct_datum_stream_t(counted_t<datum_stream_t> _source);
@@ -260,6 +337,59 @@ size_t index;
 std::vector<datum_t> data;
 };
 
+// Sorts `source` by `comparisons` (the unindexed `order_by`).  Nothing happens until
+// the first batch is requested, so that a `slice` (i.e. a `limit`) can tell us how many
+// rows are actually needed first: then we only keep that many rows around in a heap,
+// which is run as a terminal on `source` (see `top_k_wire_func_t`) so that each shard
+// only sends us its own first rows.
+//
+// If there is a data directory and `source` isn't an array, results of more than
+// `array_size_limit()` rows get sorted on disk in runs of `memory_limit()` bytes (see
+// `disk_backed_sorter_t`), and the stream is a stream.  Otherwise all rows are sorted
+// in memory and the stream counts as an array, like before.  Which one it is gets
+// decided up front, so that it doesn't change in the middle of a query.
+class sort_datum_stream_t : public eager_datum_stream_t {
+public:
+    sort_datum_stream_t(
+        env_t *env,
+        counted_t<datum_stream_t> _source,
+        std::vector<std::pair<sorting_t, counted_t<const func_t> > > _comparisons,
+        backtrace_id_t bt);
+    ~sort_datum_stream_t();
+
+    virtual counted_t<datum_stream_t> slice(size_t l, size_t r);
+
+private:
+    typedef disk_backed_sorter_t<sort_item_t, sort_item_less_t> sorter_t;
+
+    virtual bool is_array() const;
+    virtual datum_t as_array(env_t *env);
+    virtual bool is_exhausted() const;
+    virtual feed_type_t cfeed_type() const;
+    virtual bool is_infinite() const;
+    virtual std::vector<datum_t>
+    next_raw_batch(env_t *env, const batchspec_t &batchspec);
+
+    void sort(env_t *env);
+
+    const counted_t<datum_stream_t> source;
+    const std::vector<std::pair<sorting_t, counted_t<const func_t> > > comparisons;
+    const sort_item_less_t less;
+    // Whether we may sort on disk; we count as an array if we may not.
+    const bool can_spill;
+    // The number of rows anyone is going to look at.
+    size_t limit;
+
+    bool sorted;
+    // The sorted rows, if they fit into memory.
+    std::vector<sort_item_t> items;
+    size_t index;
+    // Otherwise the sorted rows come from here.
+    perfmon_collection_t sorter_collection;
+    scoped_ptr_t<sorter_t> sorter;
+    bool sorter_exhausted;
+};
+
 struct coro_info_t;
 class coro_stream_t;
 
@@ -523,6 +653,7 @@ public:
         std::string table_name,
         read_mode_t read_mode,
         const std::string &sindex,
+        const std::string &primary_key,
         datum_range_t range = datum_range_t::universe(),
         sorting_t sorting = sorting_t::UNORDERED);
 
@@ -541,6 +672,7 @@ private:
         const std::map<std::string, wire_func_t> &global_optargs,
         std::string table_name,
         const std::string &sindex,
+        const std::string &primary_key,
         datum_range_t sindex_range,
         profile_bool_t profile,
         read_mode_t read_mode,
@@ -552,6 +684,7 @@ private:
         const batchspec_t &batchspec) const;
 
     const std::string sindex;
+    const std::string primary_key;
     bool sent_first_read;
 };
 
@@ -130,7 +130,10 @@ js_runner_t *env_t::get_js_runner() {
     assert_thread();
     extproc_pool_t *extproc_pool = get_extproc_pool();
     if (!js_runner_.connected()) {
-        js_runner_.begin(extproc_pool, interruptor, limits());
+        js_runner_t::stats_t stats;
+        stats.calls_per_sec = &rdb_ctx_->stats.js_calls_per_sec;
+        stats.worker_round_trips = &rdb_ctx_->stats.js_worker_round_trips;
+        js_runner_.begin(extproc_pool, interruptor, limits(), stats);
     }
     return &js_runner_;
 }
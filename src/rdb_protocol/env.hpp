@@ -120,7 +120,8 @@ public:
             return configured_limits_t(
                 check_limit("changefeed queue size",
                             changefeed_queue_size->as_int()),
-                limits_.array_size_limit());
+                limits_.array_size_limit(),
+                limits_.memory_limit());
         } else {
             return limits_;
         }
@@ -32,6 +32,16 @@ scoped_ptr_t<val_t> func_t::call(env_t *env,
     return call(env, make_vector(arg1, arg2), eval_flags);
 }
 
+std::vector<datum_t> func_t::call_batch(env_t *env,
+                                        const std::vector<datum_t> &args) const {
+    std::vector<datum_t> results;
+    results.reserve(args.size());
+    for (const datum_t &arg : args) {
+        results.push_back(call(env, arg)->as_datum());
+    }
+    return results;
+}
+
 void func_t::assert_deterministic(const char *extra_msg) const {
     rcheck(is_deterministic(),
            base_exc_t::LOGIC,
@@ -125,6 +135,48 @@ scoped_ptr_t<val_t> js_func_t::call(
     }
 }
 
+std::vector<datum_t> js_func_t::call_batch(env_t *env,
+                                           const std::vector<datum_t> &args) const {
+    try {
+        js_runner_t::req_config_t config;
+        config.timeout_ms = js_timeout_ms;
+
+        r_sanity_check(!js_source.empty());
+        std::vector<std::vector<datum_t> > call_args;
+        call_args.reserve(args.size());
+        for (const datum_t &arg : args) {
+            call_args.push_back(make_vector(arg));
+        }
+        std::vector<js_result_t> js_results;
+
+        try {
+            js_results = env->get_js_runner()->call_batch(js_source, call_args, config);
+        } catch (const extproc_worker_exc_t &e) {
+            rfail(base_exc_t::INTERNAL,
+                  "Javascript query `%s` caused a crash in a worker process.",
+                  js_source.c_str());
+        } catch (const interrupted_exc_t &e) {
+            rfail(base_exc_t::LOGIC,
+                  "JavaScript query `%s` timed out after "
+                  "%" PRIu64 ".%03" PRIu64 " seconds.",
+                  js_source.c_str(), js_timeout_ms / 1000, js_timeout_ms % 1000);
+        }
+
+        std::vector<datum_t> results;
+        results.reserve(js_results.size());
+        for (const js_result_t &js_result : js_results) {
+            scoped_ptr_t<val_t> result(
+                boost::apply_visitor(
+                    js_result_visitor_t(js_source, js_timeout_ms, this), js_result));
+            results.push_back(result->as_datum());
+        }
+        return results;
+    } catch (const datum_exc_t &e) {
+        rfail(e.get_type(), "%s", e.what());
+        unreachable();
+    }
+}
+
 boost::optional<size_t> js_func_t::arity() const {
     return boost::none;
 }
@@ -36,6 +36,12 @@ public:
 
     virtual boost::optional<size_t> arity() const = 0;
 
+    // Calls the function once for each element of `args`, with that element as the
+    // only argument, and returns the results, which must be datums. `js_func_t` makes
+    // all of the calls in a few round trips to the JavaScript worker.
+    virtual std::vector<datum_t> call_batch(env_t *env,
+                                            const std::vector<datum_t> &args) const;
+
     virtual bool is_deterministic() const = 0;
 
     // Used by info_term_t.
@@ -89,6 +95,9 @@ public:
 
     void visit(func_visitor_t *visitor) const;
 
+    const std::vector<sym_t> &get_arg_names() const { return arg_names; }
+    const counted_t<const term_t> &get_body() const { return body; }
+
 private:
     template <cluster_version_t> friend class wire_func_serialization_visitor_t;
     bool filter_helper(env_t *env, datum_t arg) const;
@@ -120,6 +129,9 @@ public:
 
     boost::optional<size_t> arity() const;
 
+    std::vector<datum_t> call_batch(env_t *env,
+                                    const std::vector<datum_t> &args) const;
+
     bool is_deterministic() const;
 
     std::string print_source() const;
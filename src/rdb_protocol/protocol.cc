@@ -321,6 +321,8 @@ key_range_t sindex_key_range(const store_key_t &start,
 
 }  // namespace rdb_protocol
 
+region_t region_from_keys(const std::vector<store_key_t> &keys);
+
 /* read_t::get_region implementation */
 struct rdb_r_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const point_read_t &pr) const {
@@ -362,6 +364,10 @@ struct rdb_r_get_region_visitor : public boost::static_visitor<region_t> {
     region_t operator()(const dummy_read_t &d) const {
         return d.region;
     }
+
+    region_t operator()(const batched_point_read_t &br) const {
+        return region_from_keys(br.keys);
+    }
 };
 
 region_t read_t::get_region() const THROWS_NOTHING {
@@ -446,6 +452,21 @@ struct rdb_r_shard_visitor_t : public boost::static_visitor<bool> {
         return rangey_read(d);
     }
 
+    bool operator()(const batched_point_read_t &br) const {
+        batched_point_read_t tmp;
+        for (const store_key_t &key : br.keys) {
+            if (region_contains_key(*region, key)) {
+                tmp.keys.push_back(key);
+            }
+        }
+        if (!tmp.keys.empty()) {
+            *payload_out = std::move(tmp);
+            return true;
+        } else {
+            return false;
+        }
+    }
+
     const hash_region_t<key_range_t> *region;
     read_t::variant_t *payload_out;
 };
@@ -512,6 +533,7 @@ public:
     void operator()(const changefeed_stamp_t &);
     void operator()(const changefeed_point_stamp_t &);
     void operator()(const dummy_read_t &);
+    void operator()(const batched_point_read_t &);
 
 private:
     // Shared by rget_read_t and intersecting_geo_read_t operators
@@ -611,6 +633,17 @@ void rdb_r_unshard_visitor_t::operator()(const point_read_t &) {
     *response_out = responses[0];
 }
 
+void rdb_r_unshard_visitor_t::operator()(const batched_point_read_t &) {
+    batched_point_read_response_t res;
+    for (size_t i = 0; i < count; ++i) {
+        auto resp = boost::get<batched_point_read_response_t>(&responses[i].response);
+        guarantee(resp != NULL);
+        // The shards have disjoint keys, so this doesn't overwrite anything.
+        res.data.insert(resp->data.begin(), resp->data.end());
+    }
+    response_out->response = std::move(res);
+}
+
 void rdb_r_unshard_visitor_t::operator()(const intersecting_geo_read_t &query) {
     unshard_range_batch<rget_read_response_t>(query, sorting_t::UNORDERED);
 }
@@ -856,6 +889,7 @@ void read_t::unshard(read_response_t *responses, size_t count,
 
 struct use_snapshot_visitor_t : public boost::static_visitor<bool> {
     bool operator()(const point_read_t &) const {                 return false; }
+    bool operator()(const batched_point_read_t &) const {         return false; }
     bool operator()(const dummy_read_t &) const {                 return false; }
     bool operator()(const rget_read_t &) const {                  return true;  }
     bool operator()(const intersecting_geo_read_t &) const {      return true;  }
@@ -877,6 +911,7 @@ struct route_to_primary_visitor_t : public boost::static_visitor<bool> {
         return static_cast<bool>(rget.stamp);
     }
     bool operator()(const point_read_t &) const {                 return false; }
+    bool operator()(const batched_point_read_t &) const {         return false; }
     bool operator()(const dummy_read_t &) const {                 return false; }
     bool operator()(const intersecting_geo_read_t &) const {      return false; }
     bool operator()(const nearest_geo_read_t &) const {           return false; }
@@ -1025,7 +1060,7 @@ struct rdb_w_shard_visitor_t : public boost::static_visitor<bool> {
         if (!shard_inserts.empty()) {
             *payload_out = batched_insert_t(std::move(shard_inserts), bi.pkey,
                                             bi.conflict_behavior, bi.limits,
-                                            bi.return_changes);
+                                            bi.return_changes, bi.bulk);
             return true;
         } else {
             return false;
@@ -1183,6 +1218,7 @@ int write_t::expected_document_changes() const {
 }
 
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(point_read_response_t, data);
+RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(batched_point_read_response_t, data);
 ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
     ql::skey_version_t, int8_t,
     ql::skey_version_t::pre_1_16, ql::skey_version_t::post_1_16);
@@ -1205,12 +1241,11 @@ RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(read_response_t, response, event_log, n_shar
 RDB_IMPL_SERIALIZABLE_0_FOR_CLUSTER(dummy_read_response_t);
 
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(point_read_t, key);
+RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(batched_point_read_t, keys);
 RDB_IMPL_SERIALIZABLE_1_FOR_CLUSTER(dummy_read_t, region);
-RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(sindex_rangespec_t, id, region, original_range);
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(
+    sindex_rangespec_t, id, region, original_range, primary_key);
 
-ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
-        sorting_t, int8_t,
-        sorting_t::UNORDERED, sorting_t::DESCENDING);
 RDB_IMPL_SERIALIZABLE_9_FOR_CLUSTER(rget_read_t,
                                     stamp, region, optargs, table_name, batchspec,
                                     transforms, terminal, sindex, sorting);
@@ -1241,8 +1276,9 @@ RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(write_response_t, response, event_log, n_sha
 
 RDB_IMPL_SERIALIZABLE_5_FOR_CLUSTER(
         batched_replace_t, keys, pkey, f, optargs, return_changes);
-RDB_IMPL_SERIALIZABLE_5_FOR_CLUSTER(
-        batched_insert_t, inserts, pkey, conflict_behavior, limits, return_changes);
+RDB_IMPL_SERIALIZABLE_6_FOR_CLUSTER(
+        batched_insert_t, inserts, pkey, conflict_behavior, limits, return_changes,
+        bulk);
 
 RDB_IMPL_SERIALIZABLE_3_SINCE_v1_13(point_write_t, key, data, overwrite);
 RDB_IMPL_SERIALIZABLE_1_SINCE_v1_13(point_delete_t, key);
@@ -112,6 +112,12 @@ struct point_read_response_t {
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(point_read_response_t);
 
+struct batched_point_read_response_t {
+    // Only the keys that exist have an entry.
+    std::map<store_key_t, ql::datum_t> data;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(batched_point_read_response_t);
+
 struct changefeed_stamp_response_t {
     changefeed_stamp_response_t() { }
     // The `uuid_u` below is the uuid of the changefeed `server_t`.  (We have
@@ -228,7 +234,8 @@ struct read_response_t {
                            changefeed_stamp_response_t,
                            changefeed_point_stamp_response_t,
                            distribution_read_response_t,
-                           dummy_read_response_t> variant_t;
+                           dummy_read_response_t,
+                           batched_point_read_response_t> variant_t;
     variant_t response;
     profile::event_log_t event_log;
     size_t n_shards;
@@ -248,6 +255,18 @@ public:
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(point_read_t);
 
+// Like a `point_read_t` for each of `keys`, but gets sharded into at most one read
+// per shard, and each of those only descends the B-tree once.
+class batched_point_read_t {
+public:
+    batched_point_read_t() { }
+    explicit batched_point_read_t(std::vector<store_key_t> &&_keys)
+        : keys(std::move(_keys)) { }
+
+    std::vector<store_key_t> keys;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(batched_point_read_t);
+
 // `dummy_read_t` can be used to poll for table readiness - it will go through all
 // the clustering layers, but is a no-op in the protocol layer.
 class dummy_read_t {
@@ -265,13 +284,18 @@ struct sindex_rangespec_t {
                        // sometimes smaller than the datum range below when
                        // dealing with truncated keys.
                        boost::optional<region_t> &&_region,
-                       const ql::datum_range_t _original_range)
-        : id(_id), region(std::move(_region)), original_range(_original_range) { }
+                       const ql::datum_range_t _original_range,
+                       const std::string &_primary_key = std::string())
+        : id(_id), region(std::move(_region)), original_range(_original_range),
+          primary_key(_primary_key) { }
     std::string id; // What sindex we're using.
     // What keyspace we're currently operating on.  If empty, assume the
     // original range and create the readgen on the shards.
     boost::optional<region_t> region;
     ql::datum_range_t original_range; // For dealing with truncation.
+    // The name of the table's primary key, so that reads that only need the primary
+    // key and the indexed field can get them from the sindex keys.  Empty if unknown.
+    std::string primary_key;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(sindex_rangespec_t);
 
@@ -463,7 +487,8 @@ struct read_t {
                            changefeed_limit_subscribe_t,
                            changefeed_point_stamp_t,
                            distribution_read_t,
-                           dummy_read_t> variant_t;
+                           dummy_read_t,
+                           batched_point_read_t> variant_t;
     variant_t read;
     profile_bool_t profile;
     read_mode_t read_mode;
@@ -568,10 +593,11 @@ struct batched_insert_t {
             std::vector<ql::datum_t> &&_inserts,
             const std::string &_pkey, conflict_behavior_t _conflict_behavior,
             const ql::configured_limits_t &_limits,
-            return_changes_t _return_changes)
+            return_changes_t _return_changes,
+            bool _bulk)
         : inserts(std::move(_inserts)), pkey(_pkey),
           conflict_behavior(_conflict_behavior), limits(_limits),
-          return_changes(_return_changes) {
+          return_changes(_return_changes), bulk(_bulk) {
         r_sanity_check(inserts.size() != 0);
 #ifndef NDEBUG
         // These checks are done above us, but in debug mode we do them
@@ -596,6 +622,9 @@ struct batched_insert_t {
     conflict_behavior_t conflict_behavior;
     ql::configured_limits_t limits;
     return_changes_t return_changes;
+    // If the documents go into an empty part of the shard, append them to the B-tree
+    // with a `btree_bulk_loader_t` instead of inserting them one by one.
+    bool bulk;
 };
 RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(batched_insert_t);
 
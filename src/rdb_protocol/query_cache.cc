@@ -2,12 +2,82 @@
 #include "rdb_protocol/query_cache.hpp"
 
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
 #include "rdb_protocol/term_walker.hpp"
 
 #include "debug.hpp"
 
 namespace ql {
 
+// The minimum amount of stack space we require to be available on a coroutine
+// before converting the arguments of an EXECUTE query or scanning a PREPARE query.
+const size_t MIN_LITERAL_STACK_SPACE = 16 * KILOBYTE;
+
+datum_t literal_to_datum(const Term &t);
+
+datum_t literal_to_datum_on_current_stack(const Term &t) {
+    if (t.type() == Term::DATUM) {
+        return to_datum(&t.datum(), configured_limits_t::unlimited,
+                        reql_version_t::LATEST);
+    } else if (t.type() == Term::MAKE_ARRAY) {
+        std::vector<datum_t> items;
+        items.reserve(t.args_size());
+        for (int i = 0; i < t.args_size(); ++i) {
+            items.push_back(literal_to_datum(t.args(i)));
+        }
+        return datum_t(std::move(items), configured_limits_t::unlimited);
+    } else if (t.type() == Term::MAKE_OBJ) {
+        std::map<datum_string_t, datum_t> fields;
+        for (int i = 0; i < t.optargs_size(); ++i) {
+            const Term::AssocPair &ap = t.optargs(i);
+            auto res = fields.insert(std::make_pair(datum_string_t(ap.key()),
+                                                    literal_to_datum(ap.val())));
+            rcheck_toplevel(res.second, base_exc_t::LOGIC,
+                            strprintf("Duplicate key `%s` in object.",
+                                      ap.key().c_str()));
+        }
+        return datum_t(std::move(fields));
+    } else {
+        rfail_toplevel(base_exc_t::LOGIC,
+                       "Arguments to prepared queries must be literal values.");
+    }
+}
+
+// Converts the arguments of an EXECUTE query without compiling them.
+datum_t literal_to_datum(const Term &t) {
+    return call_with_enough_stack<datum_t>([&] () {
+            return literal_to_datum_on_current_stack(t);
+        }, MIN_LITERAL_STACK_SPACE);
+}
+
+bool term_contains_now(const Term &t);
+
+bool term_contains_now_on_current_stack(const Term &t) {
+    if (t.type() == Term::NOW && t.args_size() == 0) {
+        return true;
+    }
+    for (int i = 0; i < t.args_size(); ++i) {
+        if (term_contains_now(t.args(i))) {
+            return true;
+        }
+    }
+    for (int i = 0; i < t.optargs_size(); ++i) {
+        if (term_contains_now(t.optargs(i).val())) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// `preprocess_term()` replaces `r.now()` with the time at which the query gets
+// compiled.  For a prepared query that would be the time of the PREPARE rather than
+// that of each EXECUTE, so we don't allow `r.now()` in prepared queries.
+bool term_contains_now(const Term &t) {
+    return call_with_enough_stack<bool>([&] () {
+            return term_contains_now_on_current_stack(t);
+        }, MIN_LITERAL_STACK_SPACE);
+}
+
 query_id_t::query_id_t(query_id_t &&other) :
         intrusive_list_node_t(std::move(other)),
         parent(other.parent),
@@ -60,6 +130,7 @@ query_cache_t::query_cache_t(
         rdb_ctx(_rdb_ctx),
         client_addr_port(_client_addr_port),
         return_empty_normal_batches(_return_empty_normal_batches),
+        next_prepared_query_id(0),
         next_query_id(0),
         oldest_outstanding_query_id(0) {
     auto res = rdb_ctx->get_query_caches_for_this_thread()->insert(this);
@@ -148,6 +219,126 @@ scoped_ptr_t<query_cache_t::ref_t> query_cache_t::get(
                                          interruptor));
 }
 
+int64_t query_cache_t::prepare(protob_t<Query> original_query) {
+    if (prepared_queries.size() >= MAX_PREPARED_QUERIES_PER_CONNECTION) {
+        throw bt_exc_t(
+            Response::CLIENT_ERROR,
+            Response::RESOURCE_LIMIT,
+            strprintf("Cannot prepare more than %d queries on one connection.",
+                      MAX_PREPARED_QUERIES_PER_CONNECTION),
+            backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+    if (original_query->query().type() != Term::FUNC) {
+        throw bt_exc_t(
+            Response::CLIENT_ERROR,
+            Response::QUERY_LOGIC,
+            "PREPARE queries must contain a function.",
+            backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+
+    const microtime_t start_time = current_microtime();
+    counted_t<const term_t> func_term;
+    backtrace_registry_t bt_reg;
+    try {
+        rcheck_toplevel(!term_contains_now(original_query->query()),
+                        base_exc_t::LOGIC,
+                        "Prepared queries cannot use `r.now()`.");
+        preprocess_term(original_query->mutable_query(), &bt_reg);
+
+        Term *t = original_query->mutable_query();
+        compile_env_t compile_env((var_visibility_t()));
+        func_term = compile_term(&compile_env, original_query.make_child(t));
+    } catch (const exc_t &e) {
+        throw bt_exc_t(Response::COMPILE_ERROR,
+                       e.get_error_type(),
+                       e.what(),
+                       bt_reg.datum_backtrace(e));
+    } catch (const datum_exc_t &e) {
+        throw bt_exc_t(Response::COMPILE_ERROR,
+                       e.get_error_type(),
+                       e.what(),
+                       backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+
+    const int64_t id = next_prepared_query_id++;
+    auto insert_res = prepared_queries.insert(std::make_pair(
+        id,
+        make_counted<const prepared_query_t>(original_query,
+                                             std::move(bt_reg),
+                                             std::move(func_term),
+                                             current_microtime() - start_time)));
+    guarantee(insert_res.second);
+    return id;
+}
+
+scoped_ptr_t<query_cache_t::ref_t> query_cache_t::execute(
+        int64_t token,
+        protob_t<Query> original_query,
+        use_json_t use_json,
+        signal_t *interruptor) {
+    if (queries.find(token) != queries.end()) {
+        throw bt_exc_t(
+            Response::CLIENT_ERROR,
+            Response::QUERY_LOGIC,
+            strprintf("ERROR: duplicate token %" PRIi64, token),
+            backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+
+    const Term &t = original_query->query();
+    int64_t id;
+    if (t.type() != Term::MAKE_ARRAY
+        || t.args_size() == 0
+        || t.args(0).type() != Term::DATUM
+        || t.args(0).datum().type() != Datum::R_NUM
+        || !number_as_integer(t.args(0).datum().r_num(), &id)) {
+        throw bt_exc_t(
+            Response::CLIENT_ERROR,
+            Response::QUERY_LOGIC,
+            "EXECUTE queries must contain an array of a prepared query id "
+            "followed by its arguments.",
+            backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+    auto prepared_it = prepared_queries.find(id);
+    if (prepared_it == prepared_queries.end()) {
+        throw bt_exc_t(
+            Response::CLIENT_ERROR,
+            Response::QUERY_LOGIC,
+            strprintf("Prepared query %" PRIi64 " does not exist.", id),
+            backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+
+    std::vector<datum_t> args;
+    std::map<std::string, wire_func_t> global_optargs;
+    try {
+        args.reserve(t.args_size() - 1);
+        for (int i = 1; i < t.args_size(); ++i) {
+            args.push_back(literal_to_datum(t.args(i)));
+        }
+        global_optargs = parse_global_optargs(original_query);
+    } catch (const base_exc_t &e) {
+        throw bt_exc_t(Response::COMPILE_ERROR,
+                       e.get_error_type(),
+                       e.what(),
+                       backtrace_registry_t::EMPTY_BACKTRACE);
+    }
+
+    ++rdb_ctx->stats.prepared_queries_executed;
+    rdb_ctx->stats.prepared_compile_time_saved += prepared_it->second->compile_time;
+
+    scoped_ptr_t<entry_t> entry(new entry_t(original_query,
+                                            std::move(global_optargs),
+                                            prepared_it->second,
+                                            std::move(args)));
+    scoped_ptr_t<ref_t> ref(new ref_t(this,
+                                      token,
+                                      entry.get(),
+                                      use_json,
+                                      interruptor));
+    auto insert_res = queries.insert(std::make_pair(token, std::move(entry)));
+    guarantee(insert_res.second);
+    return ref;
+}
+
 void query_cache_t::noreply_wait(const query_id_t &query_id,
                                  int64_t token,
                                  signal_t *interruptor) {
@@ -271,13 +462,14 @@ void query_cache_t::ref_t::fill_response(
         throw bt_exc_t(Response::RUNTIME_ERROR,
                        ex.get_error_type(),
                        ex.what(),
-                       entry->bt_reg.datum_backtrace(ex));
+                       entry->get_bt_reg().datum_backtrace(ex));
     } catch (const datum_exc_t &ex) {
         query_cache->terminate_internal(entry);
         throw bt_exc_t(Response::RUNTIME_ERROR,
                        ex.get_error_type(),
                        ex.what(),
-                       entry->bt_reg.datum_backtrace(backtrace_id_t::empty(), 0));
+                       entry->get_bt_reg().datum_backtrace(backtrace_id_t::empty(),
+                                                           0));
     } catch (const std::exception &ex) {
         query_cache->terminate_internal(entry);
         throw bt_exc_t(Response::RUNTIME_ERROR,
@@ -290,6 +482,9 @@ void query_cache_t::ref_t::fill_response(
 void query_cache_t::ref_t::run(env_t *env, Response *res) {
     scope_env_t scope_env(env, var_scope_t());
     scoped_ptr_t<val_t> val = entry->root_term->eval(&scope_env);
+    if (entry->prepared_query.has()) {
+        val = val->as_func()->call(env, entry->prepared_args);
+    }
 
     if (val->get_type().is_convertible(val_t::type_t::DATUM)) {
         res->set_type(Response::SUCCESS_ATOM);
@@ -416,6 +611,35 @@ query_cache_t::entry_t::entry_t(protob_t<Query> _original_query,
         root_term(_root_term),
         has_sent_batch(false) { }
 
+query_cache_t::entry_t::entry_t(protob_t<Query> _original_query,
+                                std::map<std::string, wire_func_t> &&_global_optargs,
+                                counted_t<const prepared_query_t> _prepared_query,
+                                std::vector<datum_t> &&_prepared_args) :
+        state(state_t::START),
+        job_id(generate_uuid()),
+        original_query(_original_query),
+        global_optargs(std::move(_global_optargs)),
+        profile(profile_bool_optarg(original_query)),
+        start_time(current_microtime()),
+        root_term(_prepared_query->func_term),
+        prepared_query(std::move(_prepared_query)),
+        prepared_args(std::move(_prepared_args)),
+        has_sent_batch(false) { }
+
 query_cache_t::entry_t::~entry_t() { }
 
+const backtrace_registry_t &query_cache_t::entry_t::get_bt_reg() const {
+    return prepared_query.has() ? prepared_query->bt_reg : bt_reg;
+}
+
+query_cache_t::prepared_query_t::prepared_query_t(
+            protob_t<Query> _original_query,
+            backtrace_registry_t &&_bt_reg,
+            counted_t<const term_t> _func_term,
+            microtime_t _compile_time) :
+        original_query(_original_query),
+        bt_reg(std::move(_bt_reg)),
+        func_term(std::move(_func_term)),
+        compile_time(_compile_time) { }
+
 } // namespace ql
@@ -8,6 +8,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "arch/address.hpp"
 #include "concurrency/auto_drainer.hpp"
@@ -24,6 +25,7 @@
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/ql2.pb.h"
 #include "rdb_protocol/term.hpp"
+#include "time.hpp"
 
 namespace ql {
 class env_t;
@@ -107,18 +109,56 @@ public:
                             use_json_t use_json,
                             signal_t *interruptor);
 
+    // Compiles the function in a PREPARE query and returns the id that EXECUTE
+    // queries use to refer to it.  Prepared queries live as long as the connection.
+    int64_t prepare(protob_t<Query> original_query);
+
+    // Like `create()`, but for an EXECUTE query, which calls a prepared function
+    // instead of compiling a new term.
+    scoped_ptr_t<ref_t> execute(int64_t token,
+                                protob_t<Query> original_query,
+                                use_json_t use_json,
+                                signal_t *interruptor);
+
     void noreply_wait(const query_id_t &query_id,
                       int64_t token,
                       signal_t *interruptor);
 
 private:
+    // A function compiled by `prepare()`.  Entries that execute it keep a
+    // reference, so that it stays valid while they run.
+    struct prepared_query_t : public single_threaded_countable_t<prepared_query_t> {
+        prepared_query_t(protob_t<Query> _original_query,
+                         backtrace_registry_t &&_bt_reg,
+                         counted_t<const term_t> _func_term,
+                         microtime_t _compile_time);
+
+        const protob_t<Query> original_query;
+        const backtrace_registry_t bt_reg;
+        const counted_t<const term_t> func_term;
+        // How long it took to compile the function, which is what we save every
+        // time it gets executed.
+        const microtime_t compile_time;
+
+    private:
+        DISABLE_COPYING(prepared_query_t);
+    };
+
     struct entry_t {
         entry_t(protob_t<Query> _original_query,
                 backtrace_registry_t &&_bt_reg,
                 std::map<std::string, wire_func_t> &&_global_optargs,
                 counted_t<const term_t> _root_term);
+        entry_t(protob_t<Query> _original_query,
+                std::map<std::string, wire_func_t> &&_global_optargs,
+                counted_t<const prepared_query_t> _prepared_query,
+                std::vector<datum_t> &&_prepared_args);
         ~entry_t();
 
+        // The backtraces of `root_term`, which belong to the prepared query if
+        // there is one.
+        const backtrace_registry_t &get_bt_reg() const;
+
         enum class state_t { START, STREAM, DONE, DELETING } state;
 
         const uuid_u job_id;
@@ -133,6 +173,11 @@ private:
         // This will be empty if the root term has already been run
         counted_t<const term_t> root_term;
 
+        // Only set for EXECUTE queries, in which case `root_term` is the prepared
+        // function and gets called with `prepared_args`.
+        const counted_t<const prepared_query_t> prepared_query;
+        const std::vector<datum_t> prepared_args;
+
         // This will be empty until the root term has been evaluated
         // If this resulted in a stream, this will not be empty until the
         // stream is finished
@@ -155,6 +200,9 @@ private:
     return_empty_normal_batches_t return_empty_normal_batches;
     std::map<int64_t, scoped_ptr_t<entry_t> > queries;
 
+    std::map<int64_t, counted_t<const prepared_query_t> > prepared_queries;
+    int64_t next_prepared_query_id;
+
     // Used for noreply waiting, this contains all allocated-but-incomplete query ids
     friend class query_id_t;
     uint64_t next_query_id;
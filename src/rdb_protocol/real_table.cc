@@ -82,6 +82,32 @@ ql::datum_t real_table_t::read_row(ql::env_t *env,
     return p_res->data;
 }
 
+std::vector<ql::datum_t> real_table_t::read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode) {
+    std::vector<ql::datum_t> rows;
+    if (pvals.empty()) {
+        return rows;
+    }
+    std::vector<store_key_t> keys;
+    keys.reserve(pvals.size());
+    for (const ql::datum_t &pval : pvals) {
+        keys.push_back(store_key_t(pval.print_primary()));
+    }
+    read_t read(batched_point_read_t(std::vector<store_key_t>(keys)),
+                env->profile(), read_mode);
+    read_response_t res;
+    read_with_profile(env, read, &res);
+    batched_point_read_response_t *b_res =
+        boost::get<batched_point_read_response_t>(&res.response);
+    r_sanity_check(b_res);
+    rows.reserve(keys.size());
+    for (const store_key_t &key : keys) {
+        auto it = b_res->data.find(key);
+        rows.push_back(it == b_res->data.end() ? ql::datum_t::null() : it->second);
+    }
+    return rows;
+}
+
 counted_t<ql::datum_stream_t> real_table_t::read_all(
         ql::env_t *env,
         const std::string &sindex,
@@ -101,7 +127,8 @@ counted_t<ql::datum_stream_t> real_table_t::read_all(
             make_scoped<ql::rget_reader_t>(
                 counted_t<real_table_t>(this),
                 ql::sindex_readgen_t::make(
-                    env, table_name, read_mode, sindex, range, sorting)),
+                    env, table_name, read_mode, sindex, get_pkey(), range,
+                    sorting)),
             bt);
     }
 }
@@ -280,6 +307,7 @@ ql::datum_t real_table_t::write_batched_insert(
     UNUSED std::vector<bool> &&pkey_is_autogenerated,
     conflict_behavior_t conflict_behavior,
     return_changes_t return_changes,
+    bool bulk,
     durability_requirement_t durability) {
 
     ql::datum_t stats((std::map<datum_string_t, ql::datum_t>()));
@@ -287,7 +315,8 @@ ql::datum_t real_table_t::write_batched_insert(
     std::vector<std::vector<ql::datum_t> > batches = split(std::move(inserts));
     for (auto &&batch : batches) {
         batched_insert_t write(
-            std::move(batch), pkey, conflict_behavior, env->limits(), return_changes);
+            std::move(batch), pkey, conflict_behavior, env->limits(), return_changes,
+            bulk);
         write_t w(std::move(write), durability, env->profile(), env->limits());
         write_response_t response;
         write_with_profile(env, &w, &response);
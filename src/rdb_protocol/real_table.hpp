@@ -67,6 +67,8 @@ public:
 
     ql::datum_t read_row(ql::env_t *env,
         ql::datum_t pval, read_mode_t read_mode);
+    std::vector<ql::datum_t> read_rows(ql::env_t *env,
+        const std::vector<ql::datum_t> &pvals, read_mode_t read_mode);
     counted_t<ql::datum_stream_t> read_all(
         ql::env_t *env,
         const std::string &sindex,
@@ -111,7 +113,7 @@ public:
         std::vector<ql::datum_t> &&inserts,
         std::vector<bool> &&pkey_is_autogenerated,
         conflict_behavior_t conflict_behavior, return_changes_t return_changes,
-        durability_requirement_t durability);
+        bool bulk, durability_requirement_t durability);
     bool write_sync_depending_on_durability(ql::env_t *env,
         durability_requirement_t durability);
 
@@ -692,6 +692,122 @@ private:
     counted_t<const func_t> f;
 };
 
+bool sort_item_less_t::operator()(const sort_item_t &l, const sort_item_t &r) const {
+    r_sanity_check(l.keys.size() == directions.size());
+    r_sanity_check(r.keys.size() == directions.size());
+    for (size_t i = 0; i < directions.size(); ++i) {
+        const bool desc = directions[i] == sorting_t::DESCENDING;
+        if (!l.keys[i].first && !r.keys[i].first) {
+            continue;
+        }
+        if (!l.keys[i].first) {
+            return !desc;
+        }
+        if (!r.keys[i].first) {
+            return desc;
+        }
+        int cmp_res = l.keys[i].second.cmp(r.keys[i].second);
+        if (cmp_res != 0) {
+            return (cmp_res < 0) != desc;
+        }
+    }
+    if (l.key != r.key) {
+        return l.key < r.key;
+    }
+    return l.position < r.position;
+}
+
+sort_item_t make_sort_item(
+        env_t *env,
+        const std::vector<std::pair<sorting_t, counted_t<const func_t> > > &comparisons,
+        datum_t row,
+        const store_key_t &key,
+        uint64_t position) {
+    sort_item_t item;
+    item.keys.reserve(comparisons.size());
+    for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
+        try {
+            item.keys.push_back(
+                std::make_pair(true, it->second->call(env, row)->as_datum()));
+        } catch (const base_exc_t &e) {
+            if (e.get_type() != base_exc_t::NON_EXISTENCE) {
+                throw;
+            }
+            item.keys.push_back(std::make_pair(false, datum_t::null()));
+        }
+    }
+    item.key = key;
+    item.position = position;
+    item.row = std::move(row);
+    return item;
+}
+
+void push_top_k(sort_items_t *heap,
+                size_t n,
+                sort_item_t &&item,
+                const sort_item_less_t &less) {
+    if (heap->size() < n) {
+        heap->push_back(std::move(item));
+        std::push_heap(heap->begin(), heap->end(), less);
+    } else if (n != 0 && less(item, heap->front())) {
+        std::pop_heap(heap->begin(), heap->end(), less);
+        heap->back() = std::move(item);
+        std::push_heap(heap->begin(), heap->end(), less);
+    }
+}
+
+// Rows with equal orderings come out in the order of their btree keys when they were
+// read from a table, so that the result doesn't depend on how the table is sharded or
+// on the order the shards answer in.  Otherwise they come out in the order they were
+// read in.
+class top_k_terminal_t : public terminal_t<sort_items_t> {
+public:
+    explicit top_k_terminal_t(const top_k_wire_func_t &f)
+        : terminal_t<sort_items_t>(sort_items_t()),
+          n(f.n),
+          less(f.directions),
+          position(0) {
+        r_sanity_check(f.directions.size() == f.funcs.size());
+        for (size_t i = 0; i < f.funcs.size(); ++i) {
+            comparisons.push_back(
+                std::make_pair(f.directions[i], f.funcs[i].compile_wire_func()));
+        }
+    }
+private:
+    virtual bool accumulate(env_t *env,
+                            const datum_t &el,
+                            sort_items_t *out,
+                            const store_key_t &key,
+                            const datum_t &) {
+        push_top_k(out, n, make_sort_item(env, comparisons, el, key, position++), less);
+        return true;
+    }
+    virtual bool accumulate(env_t *env,
+                            const datum_t &el,
+                            sort_items_t *out) {
+        return accumulate(env, el, out, store_key_t(), datum_t());
+    }
+    virtual datum_t unpack(sort_items_t *items) {
+        std::sort_heap(items->begin(), items->end(), less);
+        std::vector<datum_t> rows;
+        rows.reserve(items->size());
+        for (auto it = items->begin(); it != items->end(); ++it) {
+            rows.push_back(std::move(it->row));
+        }
+        return datum_t(std::move(rows), datum_t::no_array_size_limit_check_t());
+    }
+    virtual void unshard_impl(env_t *, sort_items_t *out, sort_items_t *el) {
+        for (auto it = el->begin(); it != el->end(); ++it) {
+            push_top_k(out, n, std::move(*it), less);
+        }
+    }
+
+    const size_t n;
+    const sort_item_less_t less;
+    std::vector<std::pair<sorting_t, counted_t<const func_t> > > comparisons;
+    uint64_t position;
+};
+
 template<class T>
 class terminal_visitor_t : public boost::static_visitor<T *> {
 public:
@@ -717,6 +833,9 @@ public:
         return new limit_append_t(
             lr.is_primary, lr.n, lr.sorting, lr.ops);
     }
+    T *operator()(const top_k_wire_func_t &f) const {
+        return new top_k_terminal_t(f);
+    }
 };
 
 scoped_ptr_t<accumulator_t> make_terminal(const terminal_variant_t &t) {
@@ -868,9 +987,7 @@ private:
     virtual void lst_transform(
         env_t *env, datums_t *lst, const datum_t &) {
         try {
-            for (auto it = lst->begin(); it != lst->end(); ++it) {
-                *it = f->call(env, *it)->as_datum();
-            }
+            *lst = f->call_batch(env, *lst);
         } catch (const datum_exc_t &e) {
             throw exc_t(e, f->backtrace(), 1);
         }
@@ -1010,9 +1127,6 @@ scoped_ptr_t<op_t> make_op(const transform_variant_t &tv) {
 
 RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(rget_item_t, key, sindex_key, data);
 
-ARCHIVE_PRIM_MAKE_RANGED_SERIALIZABLE(
-        sorting_t, int8_t,
-        sorting_t::UNORDERED, sorting_t::DESCENDING);
 template<cluster_version_t W>
 void serialize(write_message_t *, const limit_read_t &) {
     crash("Cannot serialize a `limit_read_t`.");
@@ -1023,4 +1137,7 @@ archive_result_t deserialize(read_stream_t *, limit_read_t *) {
 }
 INSTANTIATE_SERIALIZABLE_FOR_CLUSTER(limit_read_t);
 
+RDB_IMPL_SERIALIZABLE_4_FOR_CLUSTER(sort_item_t, keys, key, position, row);
+RDB_IMPL_SERIALIZABLE_3_FOR_CLUSTER(top_k_wire_func_t, n, directions, funcs);
+
 } // namespace ql
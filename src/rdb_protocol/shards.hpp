@@ -92,6 +92,45 @@ archive_result_t deserialize_grouped(read_stream_t *s, optimizer_t *o) {
     return archive_result_t::SUCCESS;
 }
 
+// A row of an unindexed `order_by`, together with the values it's sorted by.
+// Orderings that don't exist for the row (e.g. because it doesn't have the field) are
+// `{false, null}`, they sort before everything else.
+struct sort_item_t {
+    std::vector<std::pair<bool, datum_t> > keys;
+    // The row's btree key if it was read from a table, and empty otherwise.  Rows read
+    // from different shards are ordered by it, since their `position`s are only
+    // meaningful within one shard.
+    store_key_t key;
+    // The position of the row in its input, which keeps the sort stable.
+    uint64_t position;
+    datum_t row;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(sort_item_t);
+
+class sort_item_less_t {
+public:
+    sort_item_less_t() { }
+    explicit sort_item_less_t(std::vector<sorting_t> _directions)
+        : directions(std::move(_directions)) { }
+    bool operator()(const sort_item_t &l, const sort_item_t &r) const;
+private:
+    std::vector<sorting_t> directions;
+};
+
+sort_item_t make_sort_item(
+    env_t *env,
+    const std::vector<std::pair<sorting_t, counted_t<const func_t> > > &comparisons,
+    datum_t row,
+    const store_key_t &key,
+    uint64_t position);
+
+// The `n` smallest items seen so far, as a heap with the largest one on top.
+typedef std::vector<sort_item_t> sort_items_t;
+void push_top_k(sort_items_t *heap,
+                size_t n,
+                sort_item_t &&item,
+                const sort_item_less_t &less);
+
 // We write all of these serializations and deserializations explicitly because:
 // * It stops people from inadvertently using a new `grouped_t<T>` without thinking.
 // * Some grouped elements need specialized serialization.
@@ -125,6 +164,10 @@ template <cluster_version_t W>
 void serialize_grouped(write_message_t *wm, const datums_t &ds) {
     serialize<W>(wm, ds);
 }
+template <cluster_version_t W>
+void serialize_grouped(write_message_t *wm, const sort_items_t &items) {
+    serialize<W>(wm, items);
+}
 
 template <cluster_version_t W>
 archive_result_t deserialize_grouped(
@@ -162,6 +205,10 @@ template <cluster_version_t W>
 archive_result_t deserialize_grouped(read_stream_t *s, datums_t *ds) {
     return deserialize<W>(s, ds);
 }
+template <cluster_version_t W>
+archive_result_t deserialize_grouped(read_stream_t *s, sort_items_t *items) {
+    return deserialize<W>(s, items);
+}
 
 // This is basically a templated typedef with special serialization.
 template<class T>
@@ -284,6 +331,7 @@ typedef boost::variant<
     grouped_t<ql::datum_t>, // Reduce (may be NULL)
     grouped_t<optimizer_t>, // min, max
     grouped_t<stream_t>, // No terminal.
+    grouped_t<sort_items_t>, // Unindexed order_by + limit
     exc_t // Don't re-order (we don't want this to initialize to an error.)
     > result_t;
 
@@ -315,13 +363,23 @@ struct limit_read_t {
 // it is a runtime error to serialize it.
 RDB_DECLARE_SERIALIZABLE(limit_read_t);
 
+// The first `n` rows of an unindexed `order_by`.  Every shard only sends back its own
+// first `n` rows, which then get merged.
+struct top_k_wire_func_t {
+    uint64_t n;
+    std::vector<sorting_t> directions;
+    std::vector<wire_func_t> funcs;
+};
+RDB_DECLARE_SERIALIZABLE_FOR_CLUSTER(top_k_wire_func_t);
+
 typedef boost::variant<count_wire_func_t,
                        sum_wire_func_t,
                        avg_wire_func_t,
                        min_wire_func_t,
                        max_wire_func_t,
                        reduce_wire_func_t,
-                       limit_read_t
+                       limit_read_t,
+                       top_k_wire_func_t
                        > terminal_variant_t;
 
 class accumulator_t {
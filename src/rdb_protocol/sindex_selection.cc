@@ -0,0 +1,460 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/sindex_selection.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <set>
+
+#include "clustering/administration/admin_op_exc.hpp"
+#include "rdb_protocol/changefeed.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/datum_stream.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/func.hpp"
+#include "rdb_protocol/ql2.pb.h"
+#include "rdb_protocol/val.hpp"
+
+namespace ql {
+
+/* Extracts the argument and the body of a one-argument ReQL function. */
+class one_arg_func_visitor_t : public func_visitor_t {
+public:
+    void on_reql_func(const reql_func_t *reql_func) {
+        if (reql_func->get_arg_names().size() == 1) {
+            arg = reql_func->get_arg_names()[0];
+            body = reql_func->get_body()->get_src();
+        }
+    }
+    void on_js_func(const js_func_t *) { }
+
+    boost::optional<sym_t> arg;
+    protob_t<const Term> body;
+};
+
+/* Recognizes `row(<field>)` in the body of a one-argument function, where the row is
+either the argument or the implicit variable `r.row`. */
+class row_field_matcher_t {
+public:
+    explicit row_field_matcher_t(sym_t _arg) : arg(_arg) { }
+
+    boost::optional<std::string> get_field(const Term &t) const {
+        if ((t.type() != Term::GET_FIELD && t.type() != Term::BRACKET)
+            || t.args_size() != 2 || t.optargs_size() != 0 || !is_row(t.args(0))) {
+            return boost::none;
+        }
+        const Term &field = t.args(1);
+        if (field.type() != Term::DATUM || field.datum().type() != Datum::R_STR) {
+            return boost::none;
+        }
+        return field.datum().r_str();
+    }
+
+    bool is_row(const Term &t) const {
+        if (t.type() == Term::IMPLICIT_VAR) {
+            return true;
+        }
+        return t.type() == Term::VAR
+            && t.args_size() == 1
+            && t.args(0).type() == Term::DATUM
+            && t.args(0).datum().type() == Datum::R_NUM
+            && t.args(0).datum().r_num() == static_cast<double>(arg.value);
+    }
+
+private:
+    sym_t arg;
+};
+
+/* Everything that the comparisons in a predicate say about a single field.  Only the
+first equality and the tightest bound on either side are kept; that's still implied by
+the predicate. */
+class field_constraint_t {
+public:
+    field_constraint_t()
+        : left_type(key_range_t::open), right_type(key_range_t::open) { }
+
+    void add(Term::TermType op, const datum_t &value) {
+        if (op == Term::EQ) {
+            if (!equal_to.has()) {
+                equal_to = value;
+            }
+        } else if (op == Term::GT || op == Term::GE) {
+            add_bound(&left, &left_type, value,
+                      op == Term::GT ? key_range_t::open : key_range_t::closed, 1);
+        } else if (op == Term::LT || op == Term::LE) {
+            add_bound(&right, &right_type, value,
+                      op == Term::LT ? key_range_t::open : key_range_t::closed, -1);
+        } else {
+            unreachable();
+        }
+    }
+
+    /* Secondary indexes don't contain rows that have `null` or an object in the
+    indexed field, so the range must not contain either of those.  In the ReQL ordering,
+    every value between two numbers is a number, and every value between two strings
+    is a string. */
+    boost::optional<field_range_t> to_range() const {
+        if (equal_to.has()) {
+            datum_t::type_t type = equal_to.get_type();
+            if (type == datum_t::R_NUM || type == datum_t::R_STR
+                || type == datum_t::R_BOOL) {
+                return field_range_t{datum_range_t(equal_to), true};
+            }
+        }
+        if (left.has() && right.has() && left.get_type() == right.get_type()
+            && (left.get_type() == datum_t::R_NUM
+                || left.get_type() == datum_t::R_STR)) {
+            return field_range_t{
+                datum_range_t(left, left_type, right, right_type), false};
+        }
+        return boost::none;
+    }
+
+private:
+    // `tighter` is 1 if greater values make a tighter bound, -1 if smaller ones do.
+    static void add_bound(datum_t *bound, key_range_t::bound_t *bound_type,
+                          const datum_t &value, key_range_t::bound_t type,
+                          int tighter) {
+        if (!bound->has()) {
+            *bound = value;
+            *bound_type = type;
+        } else if (bound->get_type() == value.get_type()) {
+            int c = value.cmp(*bound) * tighter;
+            if (c > 0 || (c == 0 && type == key_range_t::open)) {
+                *bound = value;
+                *bound_type = type;
+            }
+        }
+    }
+
+    datum_t equal_to;
+    datum_t left, right;
+    key_range_t::bound_t left_type, right_type;
+};
+
+Term::TermType flip_comparison(Term::TermType op) {
+    if (op == Term::LT) return Term::GT;
+    if (op == Term::LE) return Term::GE;
+    if (op == Term::GT) return Term::LT;
+    if (op == Term::GE) return Term::LE;
+    return op;
+}
+
+void collect_constraints(const Term &t,
+                         const row_field_matcher_t &matcher,
+                         std::map<std::string, field_constraint_t> *constraints_out) {
+    if (t.optargs_size() != 0) {
+        return;
+    }
+    if (t.type() == Term::AND) {
+        for (int i = 0; i < t.args_size(); ++i) {
+            collect_constraints(t.args(i), matcher, constraints_out);
+        }
+        return;
+    }
+    if (t.type() != Term::EQ && t.type() != Term::LT && t.type() != Term::LE
+        && t.type() != Term::GT && t.type() != Term::GE) {
+        return;
+    }
+    if (t.args_size() != 2) {
+        return;
+    }
+
+    Term::TermType op = t.type();
+    boost::optional<std::string> field = matcher.get_field(t.args(0));
+    const Term *literal = &t.args(1);
+    if (!field) {
+        field = matcher.get_field(t.args(1));
+        literal = &t.args(0);
+        op = flip_comparison(op);
+    }
+    if (!field || literal->type() != Term::DATUM) {
+        return;
+    }
+    (*constraints_out)[*field].add(
+        op, to_datum(&literal->datum(), configured_limits_t::unlimited,
+                     reql_version_t::LATEST));
+}
+
+boost::optional<std::string> get_field_func_name(const counted_t<const func_t> &func) {
+    one_arg_func_visitor_t visitor;
+    func->visit(&visitor);
+    if (!visitor.arg) {
+        return boost::none;
+    }
+    return row_field_matcher_t(*visitor.arg).get_field(*visitor.body);
+}
+
+bool term_only_uses_fields(const Term &t,
+                           const row_field_matcher_t &matcher,
+                           const std::set<std::string> &fields) {
+    if (boost::optional<std::string> field = matcher.get_field(t)) {
+        return fields.count(*field) != 0;
+    }
+    // `pluck(...)` and `(<field>)` on a sequence turn into a map with a function whose
+    // body is the same term with the `_NO_RECURSE_` optarg on the function's argument.
+    if ((t.type() == Term::PLUCK || t.type() == Term::GET_FIELD
+         || t.type() == Term::BRACKET)
+        && t.args_size() >= 2 && matcher.is_row(t.args(0))) {
+        if (t.type() != Term::PLUCK && t.args_size() != 2) {
+            return false;
+        }
+        for (int i = 0; i < t.optargs_size(); ++i) {
+            if (t.optargs(i).key() != "_NO_RECURSE_") {
+                return false;
+            }
+        }
+        for (int i = 1; i < t.args_size(); ++i) {
+            const Term &field = t.args(i);
+            if (field.type() != Term::DATUM || field.datum().type() != Datum::R_STR
+                || fields.count(field.datum().r_str()) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (matcher.is_row(t)) {
+        return false;
+    }
+    for (int i = 0; i < t.args_size(); ++i) {
+        if (!term_only_uses_fields(t.args(i), matcher, fields)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < t.optargs_size(); ++i) {
+        if (!term_only_uses_fields(t.optargs(i).val(), matcher, fields)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool func_only_uses_fields(const counted_t<const func_t> &func,
+                           const std::set<std::string> &fields) {
+    one_arg_func_visitor_t visitor;
+    func->visit(&visitor);
+    if (!visitor.arg) {
+        return false;
+    }
+    return term_only_uses_fields(
+        *visitor.body, row_field_matcher_t(*visitor.arg), fields);
+}
+
+std::map<std::string, field_range_t> get_filter_field_ranges(
+        const counted_t<const func_t> &predicate) {
+    std::map<std::string, field_range_t> ranges;
+    one_arg_func_visitor_t visitor;
+    predicate->visit(&visitor);
+    if (!visitor.arg) {
+        return ranges;
+    }
+    std::map<std::string, field_constraint_t> constraints;
+    collect_constraints(
+        *visitor.body, row_field_matcher_t(*visitor.arg), &constraints);
+    for (const auto &pair : constraints) {
+        if (boost::optional<field_range_t> range = pair.second.to_range()) {
+            ranges.insert(std::make_pair(pair.first, *range));
+        }
+    }
+    return ranges;
+}
+
+std::vector<index_range_t> choose_filter_indexes(
+        env_t *env,
+        const counted_t<table_t> &table,
+        const counted_t<const func_t> &predicate) {
+    std::vector<index_range_t> single_value_indexes, range_indexes;
+    std::map<std::string, field_range_t> ranges = get_filter_field_ranges(predicate);
+    if (ranges.empty()) {
+        return single_value_indexes;
+    }
+
+    auto pkey_it = ranges.find(table->get_pkey());
+    if (pkey_it != ranges.end()) {
+        const field_range_t &range = pkey_it->second;
+        (range.single_value ? single_value_indexes : range_indexes).push_back(
+            index_range_t{table->get_pkey(), range.range});
+        ranges.erase(pkey_it);
+        if (range.single_value) {
+            return single_value_indexes;
+        }
+    }
+
+    if (!ranges.empty() && env->get_rdb_ctx() != NULL) {
+        std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+            configs_and_statuses;
+        admin_err_t error;
+        if (env->reql_cluster_interface()->sindex_list_cached(
+                table->db, name_string_t::guarantee_valid(table->name.c_str()),
+                env->interruptor, &error, &configs_and_statuses)) {
+            for (const auto &pair : configs_and_statuses) {
+                const sindex_config_t &config = pair.second.first;
+                const sindex_status_t &status = pair.second.second;
+                if (!status.ready || status.outdated
+                    || config.multi != sindex_multi_bool_t::SINGLE
+                    || config.geo != sindex_geo_bool_t::REGULAR) {
+                    continue;
+                }
+                boost::optional<std::string> field =
+                    get_field_func_name(config.func.compile_wire_func());
+                if (!field) {
+                    continue;
+                }
+                auto it = ranges.find(*field);
+                if (it == ranges.end()) {
+                    continue;
+                }
+                const field_range_t &range = it->second;
+                (range.single_value ? single_value_indexes : range_indexes).push_back(
+                    index_range_t{pair.first, range.range});
+                // One index per field is enough.
+                ranges.erase(it);
+            }
+        }
+    }
+
+    single_value_indexes.insert(
+        single_value_indexes.end(), range_indexes.begin(), range_indexes.end());
+    return single_value_indexes;
+}
+
+/* Reads the rows with the primary keys `keys` as they are asked for, at most
+`INDEX_INTERSECTION_READ_ROWS` at a time. */
+class index_intersection_datum_stream_t : public eager_datum_stream_t {
+public:
+    index_intersection_datum_stream_t(
+            backtrace_id_t bt,
+            counted_t<table_t> &&_table,
+            std::vector<datum_t> &&_keys,
+            changefeed::keyspec_t &&_changespec)
+        : eager_datum_stream_t(bt),
+          table(std::move(_table)),
+          keys(std::move(_keys)),
+          next_key(0),
+          next_row(0),
+          changespec(std::move(_changespec)) { }
+
+private:
+    std::vector<datum_t> next_raw_batch(env_t *env, const batchspec_t &bs) {
+        std::vector<datum_t> batch;
+        batcher_t batcher = bs.to_batcher();
+        while (!is_exhausted()) {
+            if (next_row == rows.size()) {
+                read_rows(env);
+                continue;
+            }
+            datum_t row = std::move(rows[next_row++]);
+            // Rows that got deleted since their keys were read come back as `null`.
+            if (row.get_type() == datum_t::R_NULL) {
+                continue;
+            }
+            batcher.note_el(row);
+            batch.push_back(std::move(row));
+            if (batcher.should_send_batch()) {
+                break;
+            }
+        }
+        return batch;
+    }
+
+    void read_rows(env_t *env) {
+        const size_t end = std::min<size_t>(
+            keys.size(), next_key + INDEX_INTERSECTION_READ_ROWS);
+        rows = table->get_rows(
+            env, std::vector<datum_t>(keys.begin() + next_key, keys.begin() + end));
+        next_key = end;
+        next_row = 0;
+    }
+
+    void add_transformation(transform_variant_t &&tv, backtrace_id_t bt) {
+        if (auto *rng = boost::get<changefeed::keyspec_t::range_t>(&changespec.spec)) {
+            rng->transforms.push_back(tv);
+        }
+        eager_datum_stream_t::add_transformation(std::move(tv), bt);
+    }
+
+    bool is_exhausted() const {
+        return next_key == keys.size() && next_row == rows.size();
+    }
+    feed_type_t cfeed_type() const { return feed_type_t::not_feed; }
+    bool is_array() const { return false; }
+    bool is_infinite() const { return false; }
+
+    std::vector<changespec_t> get_changespecs() {
+        return std::vector<changespec_t>{changespec_t(changespec, counted_from_this())};
+    }
+
+    const counted_t<table_t> table;
+    const std::vector<datum_t> keys;
+    size_t next_key;
+    // The rows of the last `INDEX_INTERSECTION_READ_ROWS` keys.
+    std::vector<datum_t> rows;
+    size_t next_row;
+    changefeed::keyspec_t changespec;
+};
+
+counted_t<datum_stream_t> read_index_intersection(
+        env_t *env,
+        const counted_t<table_t> &table,
+        const std::vector<index_range_t> &indexes,
+        backtrace_id_t bt) {
+    r_sanity_check(indexes.size() >= 2);
+    const datum_t pkey(datum_string_t(table->get_pkey()));
+
+    // Collects the primary keys in the range of `index` into `keys_out`, unless there
+    // are more than `INDEX_INTERSECTION_MAX_KEYS` of them.  At most one more key than
+    // that gets read.
+    auto read_keys = [&](const index_range_t &index, std::set<datum_t> *keys_out) {
+        counted_t<datum_stream_t> stream = make_counted<table_slice_t>(table)
+            ->with_bounds(index.index, index.range)->as_seq(env, bt);
+        stream->add_transformation(map_wire_func_t(new_get_field_func(pkey, bt)), bt);
+        keys_out->clear();
+        while (keys_out->size() <= INDEX_INTERSECTION_MAX_KEYS) {
+            std::vector<datum_t> batch = stream->next_batch(
+                env,
+                batchspec_t::all().with_at_most(
+                    INDEX_INTERSECTION_MAX_KEYS + 1 - keys_out->size()));
+            if (batch.empty()) {
+                return true;
+            }
+            keys_out->insert(batch.begin(), batch.end());
+        }
+        return false;
+    };
+
+    // Only the ranges that turn out to be small take part in the intersection.  The
+    // predicate still gets evaluated on every row that's read, so leaving a range out
+    // only means reading more rows.
+    std::set<datum_t> keys;
+    bool have_keys = false;
+    for (size_t i = 0; i < indexes.size() && !(have_keys && keys.empty()); ++i) {
+        std::set<datum_t> range_keys;
+        if (!read_keys(indexes[i], &range_keys)) {
+            continue;
+        }
+        if (!have_keys) {
+            keys.swap(range_keys);
+            have_keys = true;
+        } else {
+            std::set<datum_t> found;
+            std::set_intersection(keys.begin(), keys.end(),
+                                  range_keys.begin(), range_keys.end(),
+                                  std::inserter(found, found.end()));
+            keys.swap(found);
+        }
+    }
+    if (!have_keys) {
+        return counted_t<datum_stream_t>();
+    }
+
+    return make_counted<index_intersection_datum_stream_t>(
+        bt,
+        counted_t<table_t>(table),
+        std::vector<datum_t>(keys.begin(), keys.end()),
+        changefeed::keyspec_t(
+            make_counted<table_slice_t>(table)
+                ->with_bounds(indexes[0].index, indexes[0].range)->get_range_spec(),
+            counted_t<base_table_t>(table->tbl),
+            table->display_name()));
+}
+
+}  // namespace ql
@@ -0,0 +1,82 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef RDB_PROTOCOL_SINDEX_SELECTION_HPP_
+#define RDB_PROTOCOL_SINDEX_SELECTION_HPP_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "errors.hpp"
+#include <boost/optional.hpp>
+
+#include "containers/counted.hpp"
+#include "rdb_protocol/backtrace.hpp"
+#include "rdb_protocol/datum.hpp"
+
+/* `filter()` on a table reads the whole table and evaluates its predicate on every
+row.  If the predicate compares a field of the row with a literal and there is an index
+on exactly that field, the table can instead be read over the index range that the
+comparison allows, with the predicate still evaluated on every row of that range.  If
+there are several such indexes, only the rows that are in the ranges of all of them need
+to be read. */
+
+namespace ql {
+
+class datum_stream_t;
+class env_t;
+class func_t;
+class table_t;
+
+struct field_range_t {
+    datum_range_t range;
+    // Whether the predicate pins the field to a single value.
+    bool single_value;
+};
+
+/* Returns the name of the field if `func` is `function(row) { return row(<field>); }`,
+which is what `index_create(<field>)` creates. */
+boost::optional<std::string> get_field_func_name(const counted_t<const func_t> &func);
+
+/* Whether `func` is a one-argument function that only gets the fields `fields` of its
+argument, with `row(<field>)` or `row.pluck(<fields>...)`.  If it is, it returns the
+same on an object that only has those fields as on the whole row. */
+bool func_only_uses_fields(const counted_t<const func_t> &func,
+                           const std::set<std::string> &fields);
+
+/* For every field of the row that `predicate` compares with a literal, a range that
+contains the value of that field in every row that satisfies `predicate`.  Comparisons
+that are nested in anything but `and` are ignored, and so are fields that can have
+values that don't go into a secondary index (`null` and objects), so that an index read
+over one of these ranges finds all of the rows that `predicate` accepts. */
+std::map<std::string, field_range_t> get_filter_field_ranges(
+        const counted_t<const func_t> &predicate);
+
+struct index_range_t {
+    std::string index;
+    datum_range_t range;
+};
+
+/* Picks the primary key and the ready secondary indexes of `table` that `predicate`
+can be evaluated over, one per field.  Indexes that the predicate pins to a single value
+come first.  If the predicate pins the primary key to a single value, that's the only
+index that gets returned. */
+std::vector<index_range_t> choose_filter_indexes(
+        env_t *env,
+        const counted_t<table_t> &table,
+        const counted_t<const func_t> &predicate);
+
+/* Reads the primary keys in the range of each of `indexes` that has at most
+`INDEX_INTERSECTION_MAX_KEYS` rows, and returns a stream of the rows whose primary keys
+are in all of those ranges, in primary key order.  The rows are read as the stream gets
+asked for them.  Returns an empty pointer if all of the ranges are larger than that.  The
+returned stream's changefeed covers the range of the first index. */
+counted_t<datum_stream_t> read_index_intersection(
+        env_t *env,
+        const counted_t<table_t> &table,
+        const std::vector<index_range_t> &indexes,
+        backtrace_id_t bt);
+
+}  // namespace ql
+
+#endif  // RDB_PROTOCOL_SINDEX_SELECTION_HPP_
@@ -199,12 +199,13 @@ void do_read(ql::env_t *env,
              real_superblock_t *superblock,
              const rget_read_t &rget,
              rget_read_response_t *res,
-             release_superblock_t release_superblock) {
+             release_superblock_t release_superblock,
+             read_mode_t read_mode) {
     if (!rget.sindex) {
         // Normal rget
         rdb_rget_slice(btree, rget.region.inner, superblock,
                        env, rget.batchspec, rget.transforms, rget.terminal,
-                       rget.sorting, res, release_superblock);
+                       rget.sorting, res, release_superblock, read_mode);
     } else {
         sindex_disk_info_t sindex_info;
         uuid_u sindex_uuid;
@@ -252,7 +253,8 @@ void do_read(ql::env_t *env,
             rget.sindex->original_range, std::move(true_region),
             sindex_sb.get(), env, rget.batchspec, rget.transforms,
             rget.terminal, rget.region.inner, rget.sorting,
-            sindex_info, res, release_superblock_t::RELEASE);
+            sindex_info, rget.sindex->primary_key, res,
+            release_superblock_t::RELEASE);
     }
 }
 
@@ -304,7 +306,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
             // shortly after this function returns.
             rget_read_response_t resp;
             do_read(&env, store, btree, superblock, rget, &resp,
-                    release_superblock_t::KEEP);
+                    release_superblock_t::KEEP, read_mode);
             auto *gs = boost::get<ql::grouped_t<ql::stream_t> >(&resp.result);
             if (gs == NULL) {
                 auto *exc = boost::get<ql::exc_t>(&resp.result);
@@ -386,6 +388,13 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         rdb_get(get.key, btree, superblock, res, trace);
     }
 
+    void operator()(const batched_point_read_t &get) {
+        response->response = batched_point_read_response_t();
+        batched_point_read_response_t *res =
+            boost::get<batched_point_read_response_t>(&response->response);
+        rdb_get_batch(get.keys, btree, superblock, res, trace);
+    }
+
     void operator()(const intersecting_geo_read_t &geo_read) {
         ql::env_t ql_env(ctx, ql::return_empty_normal_batches_t::NO,
                          interruptor, geo_read.optargs, trace);
@@ -511,7 +520,7 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
         ql::env_t ql_env(ctx, ql::return_empty_normal_batches_t::NO,
                          interruptor, rget.optargs, trace);
         do_read(&ql_env, store, btree, superblock, rget, res,
-                release_superblock_t::RELEASE);
+                release_superblock_t::RELEASE, read_mode);
     }
 
     void operator()(const distribution_read_t &dg) {
@@ -547,14 +556,16 @@ struct rdb_read_visitor_t : public boost::static_visitor<void> {
                        rdb_context_t *_ctx,
                        read_response_t *_response,
                        profile::trace_t *_trace,
-                       signal_t *_interruptor) :
+                       signal_t *_interruptor,
+                       read_mode_t _read_mode) :
         response(_response),
         ctx(_ctx),
         interruptor(_interruptor),
         btree(_btree),
         store(_store),
         superblock(_superblock),
-        trace(_trace) { }
+        trace(_trace),
+        read_mode(_read_mode) { }
 
 private:
 
@@ -565,6 +576,7 @@ private:
     store_t *const store;
     real_superblock_t *const superblock;
     profile::trace_t *const trace;
+    const read_mode_t read_mode;
 
     DISABLE_COPYING(rdb_read_visitor_t);
 };
@@ -579,7 +591,8 @@ void store_t::protocol_read(const read_t &read,
         profile::starter_t start_read("Perform read on shard.", trace);
         rdb_read_visitor_t v(btree.get(), this,
                              superblock,
-                             ctx, response, trace.get_or_null(), interruptor);
+                             ctx, response, trace.get_or_null(), interruptor,
+                             read.read_mode);
         boost::apply_visitor(v, read.read);
     }
 
@@ -659,6 +672,22 @@ struct rdb_write_visitor_t : public boost::static_visitor<void> {
         for (auto it = bi.inserts.begin(); it != bi.inserts.end(); ++it) {
             keys.emplace_back(it->get_field(datum_string_t(bi.pkey)).print_primary());
         }
+        if (bi.bulk) {
+            batched_replace_response_t bulk_response;
+            if (rdb_bulk_insert(
+                    btree_info_t(btree, timestamp, datum_string_t(bi.pkey)),
+                    superblock,
+                    keys,
+                    &replacer,
+                    &sindex_cb,
+                    bi.limits,
+                    sampler,
+                    trace,
+                    &bulk_response)) {
+                response->response = bulk_response;
+                return;
+            }
+        }
         response->response =
             rdb_batched_replace(
                 btree_info_t(btree, timestamp, datum_string_t(bi.pkey)),
@@ -262,7 +262,12 @@ void run(query_id_t &&query_id,
 #endif // INSTRUMENT
 
     int64_t token = q->token();
-    use_json_t use_json = q->accepts_r_json() ? use_json_t::YES : use_json_t::NO;
+    use_json_t use_json = use_json_t::NO;
+    if (q->accepts_r_datum()) {
+        use_json = use_json_t::BINARY;
+    } else if (q->accepts_r_json()) {
+        use_json = use_json_t::YES;
+    }
 
     try {
         switch (q->type()) {
@@ -278,6 +283,19 @@ void run(query_id_t &&query_id,
                 query_cache->get(token, use_json, interruptor);
             query_ref->fill_response(res, throttler);
         } break;
+        case Query_QueryType_PREPARE: {
+            maybe_release_query_id(std::move(query_id), q);
+            const int64_t id = query_cache->prepare(q);
+            res->set_type(Response::SUCCESS_ATOM);
+            datum_t(static_cast<double>(id)).write_to_protobuf(res->add_response(),
+                                                               use_json);
+        } break;
+        case Query_QueryType_EXECUTE: {
+            maybe_release_query_id(std::move(query_id), q);
+            scoped_ptr_t<query_cache_t::ref_t> query_ref =
+                query_cache->execute(token, q, use_json, interruptor);
+            query_ref->fill_response(res, throttler);
+        } break;
         case Query_QueryType_STOP: {
             query_cache->terminate_query(token);
             res->set_type(Response::SUCCESS_SEQUENCE);
@@ -1,14 +1,18 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "rdb_protocol/terms/terms.hpp"
 
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "rdb_protocol/counted_term.hpp"
 #include "rdb_protocol/error.hpp"
 #include "rdb_protocol/func.hpp"
 #include "rdb_protocol/math_utils.hpp"
 #include "rdb_protocol/op.hpp"
+#include "rdb_protocol/sindex_selection.hpp"
+#include "rdb_protocol/term_walker.hpp"
 
 namespace ql {
 
@@ -211,6 +215,183 @@ private:
     virtual const char *name() const { return "concatmap"; }
 };
 
+class eq_join_term_t : public grouped_seq_op_term_t {
+public:
+    eq_join_term_t(compile_env_t *env, const protob_t<const Term> &term)
+        : grouped_seq_op_term_t(env, term, argspec_t(3),
+                                optargspec_t({"index", "ordered"})) { }
+private:
+    virtual scoped_ptr_t<val_t> eval_impl(scope_env_t *env, args_t *args, eval_flags_t) const {
+        counted_t<datum_stream_t> stream = args->arg(env, 0)->as_seq(env->env);
+        counted_t<const func_t> left_attr =
+            args->arg(env, 1)->as_func(GET_FIELD_SHORTCUT);
+        counted_t<table_t> table = args->arg(env, 2)->as_table();
+        boost::optional<std::string> sindex;
+        if (scoped_ptr_t<val_t> index = args->optarg(env, "index")) {
+            std::string index_str = index->as_str().to_std();
+            if (index_str != table->get_pkey()) {
+                sindex = std::move(index_str);
+            }
+        }
+        // The results always come back in the order of the left sequence, so
+        // there's nothing to do for `ordered` beyond checking its type.
+        if (scoped_ptr_t<val_t> ordered = args->optarg(env, "ordered")) {
+            ordered->as_bool();
+        }
+        return new_val(env->env, make_counted<eq_join_datum_stream_t>(
+            stream, left_attr, table, std::move(sindex)));
+    }
+    virtual const char *name() const { return "eq_join"; }
+};
+
+// `inner_join` and `outer_join` with a predicate of the form `f(left) == g(right)`.
+// Everything else gets rewritten into a nested loop (see `rewrites.cc`).
+class hash_join_term_t : public grouped_seq_op_term_t {
+public:
+    hash_join_term_t(compile_env_t *env, const protob_t<const Term> &term,
+                     hash_join_type_t _type,
+                     counted_t<const term_t> _left_key,
+                     counted_t<const term_t> _right_key)
+        : grouped_seq_op_term_t(env, term, argspec_t(3)),
+          type(_type), left_key(std::move(_left_key)),
+          right_key(std::move(_right_key)) { }
+private:
+    virtual scoped_ptr_t<val_t> eval_impl(scope_env_t *env, args_t *args, eval_flags_t) const {
+        counted_t<datum_stream_t> left = args->arg(env, 0)->as_seq(env->env);
+        counted_t<datum_stream_t> right = args->arg(env, 1)->as_seq(env->env);
+        rcheck(!right->is_infinite(), base_exc_t::LOGIC,
+               strprintf("Cannot use an infinite stream as the second argument "
+                         "of `%s`.", name()));
+        return new_val(env->env, make_counted<hash_join_datum_stream_t>(
+            left, left_key->eval(env)->as_func(),
+            right, right_key->eval(env)->as_func(),
+            type));
+    }
+    virtual const char *name() const {
+        return type == hash_join_type_t::INNER ? "inner_join" : "outer_join";
+    }
+
+    const hash_join_type_t type;
+    const counted_t<const term_t> left_key;
+    const counted_t<const term_t> right_key;
+};
+
+// Reads the parameters of the FUNC term `func`.
+bool get_func_params(const Term &func, std::vector<double> *params_out) {
+    const Term &vars = func.args(0);
+    if (vars.type() == Term::DATUM) {
+        if (vars.datum().type() != Datum::R_ARRAY) {
+            return false;
+        }
+        for (int i = 0; i < vars.datum().r_array_size(); ++i) {
+            if (vars.datum().r_array(i).type() != Datum::R_NUM) {
+                return false;
+            }
+            params_out->push_back(vars.datum().r_array(i).r_num());
+        }
+    } else if (vars.type() == Term::MAKE_ARRAY) {
+        for (int i = 0; i < vars.args_size(); ++i) {
+            if (vars.args(i).type() != Term::DATUM
+                || vars.args(i).datum().type() != Datum::R_NUM) {
+                return false;
+            }
+            params_out->push_back(vars.args(i).datum().r_num());
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Finds the variables that `term` refers to.  Returns false if `term` contains a
+// function, which could rebind them.
+bool find_vars(const Term &term, std::set<double> *vars_out) {
+    std::vector<const Term *> todo(1, &term);
+    while (!todo.empty()) {
+        const Term *t = todo.back();
+        todo.pop_back();
+        if (t->type() == Term::FUNC || t->type() == Term::IMPLICIT_VAR) {
+            return false;
+        } else if (t->type() == Term::VAR) {
+            if (t->args_size() != 1
+                || t->args(0).type() != Term::DATUM
+                || t->args(0).datum().type() != Datum::R_NUM) {
+                return false;
+            }
+            vars_out->insert(t->args(0).datum().r_num());
+        }
+        for (int i = 0; i < t->args_size(); ++i) {
+            todo.push_back(&t->args(i));
+        }
+        for (int i = 0; i < t->optargs_size(); ++i) {
+            todo.push_back(&t->optargs(i).val());
+        }
+    }
+    return true;
+}
+
+// Wraps `body` into a one-argument function of `param`.
+protob_t<Term> make_key_func(const Term &func, double param, const Term &body) {
+    protob_t<Term> key_func = make_counted_term();
+    key_func->set_type(Term::FUNC);
+    Term *vars = key_func->add_args();
+    vars->set_type(Term::MAKE_ARRAY);
+    Term *var = vars->add_args();
+    var->set_type(Term::DATUM);
+    var->mutable_datum()->set_type(Datum::R_NUM);
+    var->mutable_datum()->set_r_num(param);
+    *key_func->add_args() = body;
+    propagate_backtrace(key_func.get(), backtrace_id_t(&func));
+    return key_func;
+}
+
+counted_t<term_t> maybe_make_hash_join_term(
+        compile_env_t *env, const protob_t<const Term> &term, hash_join_type_t type) {
+    if (term->args_size() != 3 || term->optargs_size() != 0) {
+        return counted_t<term_t>();
+    }
+    const Term &func = term->args(2);
+    std::vector<double> params;
+    if (func.type() != Term::FUNC
+        || func.args_size() != 2
+        || !get_func_params(func, &params)
+        || params.size() != 2) {
+        return counted_t<term_t>();
+    }
+    const Term &body = func.args(1);
+    if (body.type() != Term::EQ
+        || body.args_size() != 2
+        || body.optargs_size() != 0) {
+        return counted_t<term_t>();
+    }
+
+    // Each side of the comparison has to depend on exactly one of the rows.
+    std::set<double> vars[2];
+    if (!find_vars(body.args(0), &vars[0]) || !find_vars(body.args(1), &vars[1])) {
+        return counted_t<term_t>();
+    }
+    int left_side = -1;
+    for (int i = 0; i < 2; ++i) {
+        if (vars[i].count(params[0]) == 1 && vars[i].count(params[1]) == 0
+            && vars[1 - i].count(params[1]) == 1 && vars[1 - i].count(params[0]) == 0) {
+            left_side = i;
+        }
+    }
+    if (left_side == -1) {
+        return counted_t<term_t>();
+    }
+
+    counted_t<const term_t> left_key =
+        compile_term(env, make_key_func(func, params[0], body.args(left_side)));
+    counted_t<const term_t> right_key =
+        compile_term(env, make_key_func(func, params[1], body.args(1 - left_side)));
+    // The nested loop evaluates the keys many times, we only do so once.
+    if (!left_key->is_deterministic() || !right_key->is_deterministic()) {
+        return counted_t<term_t>();
+    }
+    return make_counted<hash_join_term_t>(env, term, type, left_key, right_key);
+}
+
 class group_term_t : public grouped_seq_op_term_t {
 public:
     group_term_t(compile_env_t *env, const protob_t<const Term> &term)
@@ -281,7 +462,39 @@ private:
         }
 
         if (v0->get_type().is_convertible(val_t::type_t::SELECTION)) {
-            counted_t<selection_t> ts = v0->as_selection(env->env);
+            counted_t<selection_t> ts;
+            std::vector<index_range_t> indexes;
+            // With a default the predicate can accept rows that don't have the
+            // field at all, which an index read wouldn't find.
+            if (v0->get_type().get_raw_type() == val_t::type_t::TABLE && !defval) {
+                indexes = choose_filter_indexes(env->env, v0->as_table(), f);
+            }
+            if (indexes.size() >= 2) {
+                std::string names;
+                for (const index_range_t &index : indexes) {
+                    names += (names.empty() ? "`" : ", `") + index.index + "`";
+                }
+                profile::starter_t starter(
+                    strprintf("Intersecting indexes %s for filter.", names.c_str()),
+                    env->env->trace);
+                counted_t<datum_stream_t> stream = read_index_intersection(
+                    env->env, v0->as_table(), indexes, backtrace());
+                if (stream.has()) {
+                    ts = make_counted<selection_t>(v0->as_table(), stream);
+                }
+            }
+            if (!ts.has() && !indexes.empty()) {
+                profile::starter_t starter(
+                    strprintf("Using index `%s` for filter.", indexes[0].index.c_str()),
+                    env->env->trace);
+                counted_t<table_slice_t> slice = make_counted<table_slice_t>(
+                    v0->as_table())->with_bounds(indexes[0].index, indexes[0].range);
+                ts = make_counted<selection_t>(
+                    slice->get_tbl(), slice->as_seq(env->env, backtrace()));
+            }
+            if (!ts.has()) {
+                ts = v0->as_selection(env->env);
+            }
             ts->seq->add_transformation(filter_wire_func_t(f, defval), backtrace());
             return new_val(ts);
         } else {
@@ -646,6 +859,21 @@ counted_t<term_t> make_concatmap_term(
     return make_counted<concatmap_term_t>(env, term);
 }
 
+counted_t<term_t> make_eq_join_term(
+        compile_env_t *env, const protob_t<const Term> &term) {
+    return make_counted<eq_join_term_t>(env, term);
+}
+
+counted_t<term_t> maybe_make_inner_hash_join_term(
+        compile_env_t *env, const protob_t<const Term> &term) {
+    return maybe_make_hash_join_term(env, term, hash_join_type_t::INNER);
+}
+
+counted_t<term_t> maybe_make_outer_hash_join_term(
+        compile_env_t *env, const protob_t<const Term> &term) {
+    return maybe_make_hash_join_term(env, term, hash_join_type_t::OUTER);
+}
+
 counted_t<term_t> make_group_term(
         compile_env_t *env, const protob_t<const Term> &term) {
     return make_counted<group_term_t>(env, term);
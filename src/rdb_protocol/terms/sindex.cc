@@ -106,7 +106,34 @@ ql::datum_t sindex_status_to_datum(
 class sindex_create_term_t : public op_term_t {
 public:
     sindex_create_term_t(compile_env_t *env, const protob_t<const Term> &term)
-        : op_term_t(env, term, argspec_t(2, 3), optargspec_t({"multi", "geo"})) { }
+        : op_term_t(env, term, argspec_t(2, 3),
+                    optargspec_t({"multi", "geo", "filter"})) { }
+
+    /* Compiles `function(x) { return <value>; }`, where `value` uses the variable
+    `SINDEXCREATE_X`.  If `index_create` got a `filter` function, the result is a partial
+    index function that fails on the rows that `filter` doesn't accept.  Rows that an
+    index function fails on don't go into the index, so the index only holds the rows
+    that `filter` accepts, without any changes to how indexes are stored. */
+    map_wire_func_t make_index_func(scope_env_t *env, r::reql_t &&value) const {
+        pb::dummy_var_t x = pb::dummy_var_t::SINDEXCREATE_X;
+        r::reql_t body = std::move(value);
+        protob_t<const Term> src = get_src();
+        for (int i = 0; i < src->optargs_size(); ++i) {
+            if (src->optargs(i).key() == "filter") {
+                body = r::branch(r::reql_t(src->optargs(i).val())(r::var(x)),
+                                 std::move(body),
+                                 r::error(std::string(
+                                     "Row is filtered out of the index.")));
+            }
+        }
+        protob_t<Term> func_term = r::fun(x, std::move(body)).release_counted();
+        propagate_backtrace(func_term.get(), backtrace());
+
+        compile_env_t compile_env(env->scope.compute_visibility());
+        counted_t<func_term_t> func_term_term =
+            make_counted<func_term_t>(&compile_env, func_term);
+        return map_wire_func_t(func_term_term->eval_to_func(env->scope));
+    }
 
     virtual scoped_ptr_t<val_t> eval_impl(
         scope_env_t *env, args_t *args, eval_flags_t) const {
@@ -118,6 +145,18 @@ public:
                strprintf("Index name conflict: `%s` is the name of the primary key.",
                          name.c_str()));
 
+        /* The filter gets called on every row from inside the index function, so it
+        has to be a deterministic function of one argument. */
+        if (scoped_ptr_t<val_t> filter_val = args->optarg(env, "filter")) {
+            counted_t<const func_t> filter = filter_val->as_func();
+            boost::optional<size_t> filter_arity = filter->arity();
+            rcheck(!filter_arity || *filter_arity == 1, base_exc_t::LOGIC,
+                   strprintf("The `filter` of an index must take 1 argument, "
+                             "but takes %zu.", *filter_arity));
+            filter->assert_deterministic(
+                "Index filter functions must be deterministic.");
+        }
+
         /* Parse the sindex configuration */
         sindex_config_t config;
         config.multi = sindex_multi_bool_t::SINGLE;
@@ -128,6 +167,9 @@ public:
             if (v->get_type().is_convertible(val_t::type_t::DATUM)) {
                 datum_t d = v->as_datum();
                 if (d.get_type() == datum_t::R_BINARY) {
+                    rcheck(!args->optarg(env, "filter"), base_exc_t::LOGIC,
+                           "Cannot add a `filter` to an index function from "
+                           "`index_status`.");
                     config = sindex_config_from_string(d.as_binary(), v.get());
                     // We ignore the sindex's old `reql_version` and make the new version
                     // just be `reql_version_t::LATEST`; but in the future we may have
@@ -139,21 +181,23 @@ public:
             // We do it this way so that if someone passes a string, we produce
             // a type error asking for a function rather than BINARY.
             if (!got_func) {
-                config.func = ql::map_wire_func_t(v->as_func());
+                counted_t<const func_t> func = v->as_func();
+                if (!args->optarg(env, "filter")) {
+                    config.func = ql::map_wire_func_t(func);
+                } else {
+                    // We call the function term, so we need it as it was passed.
+                    rcheck(get_src()->args_size() == 3, base_exc_t::LOGIC,
+                           "Cannot use `r.args` with a `filter` in `index_create`.");
+                    config.func = make_index_func(
+                        env,
+                        r::reql_t(get_src()->args(2))(
+                            r::var(pb::dummy_var_t::SINDEXCREATE_X)));
+                }
                 config.func_version = reql_version_t::LATEST;
             }
         } else {
-
-            pb::dummy_var_t x = pb::dummy_var_t::SINDEXCREATE_X;
-            protob_t<Term> func_term
-                = r::fun(x, r::var(x)[name_datum]).release_counted();
-            propagate_backtrace(func_term.get(), backtrace());
-
-            compile_env_t empty_compile_env((var_visibility_t()));
-            counted_t<func_term_t> func_term_term = make_counted<func_term_t>(
-                &empty_compile_env, func_term);
-
-            config.func = ql::map_wire_func_t(func_term_term->eval_to_func(env->scope));
+            config.func = make_index_func(
+                env, r::var(pb::dummy_var_t::SINDEXCREATE_X)[name_datum]);
             config.func_version = reql_version_t::LATEST;
         }
 
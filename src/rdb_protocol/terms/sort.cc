@@ -3,9 +3,7 @@
 
 #include <string>
 #include <utility>
-
-#include "errors.hpp"
-#include <boost/bind.hpp>
+#include <vector>
 
 #include "rdb_protocol/datum_stream.hpp"
 #include "rdb_protocol/error.hpp"
@@ -183,23 +181,14 @@ private:
             }
             rcheck(!comparisons.empty(), base_exc_t::LOGIC,
                    "Must specify something to order by.");
-            std::vector<datum_t> to_sort;
-            batchspec_t batchspec = batchspec_t::user(batch_type_t::TERMINAL, env->env);
-            for (;;) {
-                std::vector<datum_t> data
-                    = seq->next_batch(env->env, batchspec);
-                if (data.size() == 0) {
-                    break;
-                }
-                std::move(data.begin(), data.end(), std::back_inserter(to_sort));
-                rcheck_array_size(to_sort, env->env->limits());
+            std::vector<std::pair<sorting_t, counted_t<const func_t> > > sortings;
+            for (auto it = comparisons.begin(); it != comparisons.end(); ++it) {
+                sortings.push_back(std::make_pair(
+                    it->first == DESC ? sorting_t::DESCENDING : sorting_t::ASCENDING,
+                    it->second));
             }
-            profile::sampler_t sampler("Sorting in-memory.", env->env->trace);
-            auto fn = boost::bind(lt_cmp, env->env, &sampler, _1, _2);
-            std::stable_sort(to_sort.begin(), to_sort.end(), fn);
-            seq = make_counted<array_datum_stream_t>(
-                datum_t(std::move(to_sort), env->env->limits()),
-                backtrace());
+            seq = make_counted<sort_datum_stream_t>(
+                env->env, seq, std::move(sortings), backtrace());
         }
         return tbl_slice.has()
             ? new_val(make_counted<selection_t>(tbl_slice->get_tbl(), seq))
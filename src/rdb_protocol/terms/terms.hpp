@@ -224,8 +224,6 @@ counted_t<term_t> make_inner_join_term(
     compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_outer_join_term(
     compile_env_t *env, const protob_t<const Term> &term);
-counted_t<term_t> make_eq_join_term(
-    compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_update_term(
     compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_delete_term(
@@ -254,6 +252,13 @@ counted_t<term_t> make_filter_term(
     compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_concatmap_term(
     compile_env_t *env, const protob_t<const Term> &term);
+counted_t<term_t> make_eq_join_term(
+    compile_env_t *env, const protob_t<const Term> &term);
+// These return an empty `counted_t` unless the join predicate is an equality.
+counted_t<term_t> maybe_make_inner_hash_join_term(
+    compile_env_t *env, const protob_t<const Term> &term);
+counted_t<term_t> maybe_make_outer_hash_join_term(
+    compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_group_term(
     compile_env_t *env, const protob_t<const Term> &term);
 counted_t<term_t> make_count_term(
@@ -83,7 +83,7 @@ class insert_term_t : public op_term_t {
 public:
     insert_term_t(compile_env_t *env, const protob_t<const Term> &term)
         : op_term_t(env, term, argspec_t(2),
-                    optargspec_t({"conflict", "durability", "return_vals",
+                    optargspec_t({"bulk", "conflict", "durability", "return_vals",
                                   "return_changes"})) { }
 
 private:
@@ -132,6 +132,10 @@ private:
             = parse_conflict_optarg(args->optarg(env, "conflict"));
         const durability_requirement_t durability_requirement
             = parse_durability_optarg(args->optarg(env, "durability"));
+        bool bulk = false;
+        if (scoped_ptr_t<val_t> v = args->optarg(env, "bulk")) {
+            bulk = v->as_bool();
+        }
 
         bool done = false;
         datum_t stats = new_stats_object();
@@ -156,7 +160,7 @@ private:
                 }
                 datum_t replace_stats = t->batched_insert(
                     env->env, std::move(datums), std::move(pkey_was_autogenerated),
-                    conflict_behavior, durability_requirement, return_changes);
+                    conflict_behavior, durability_requirement, return_changes, bulk);
                 stats = stats.merge(
                     replace_stats, stats_merge, env->env->limits(), &conditions);
                 done = true;
@@ -188,9 +192,11 @@ private:
                     }
                 }
 
+                // Every batch gets bulk loaded separately if it goes into an empty
+                // part of the table (see `rdb_bulk_insert()`).
                 datum_t replace_stats = t->batched_insert(
                     env->env, std::move(datums), std::move(pkey_was_autogenerated),
-                    conflict_behavior, durability_requirement, return_changes);
+                    conflict_behavior, durability_requirement, return_changes, bulk);
                 stats = stats.merge(
                     replace_stats, stats_merge, env->env->limits(), &conditions);
             }
@@ -268,7 +268,8 @@ datum_t table_t::batched_replace(
         std::vector<bool> pkey_was_autogenerated(vals.size(), false);
         datum_t insert_stats = batched_insert(
             env, std::move(replacement_values), std::move(pkey_was_autogenerated),
-            conflict_behavior_t::REPLACE, durability_requirement, return_changes);
+            conflict_behavior_t::REPLACE, durability_requirement, return_changes,
+            false);
         std::set<std::string> conditions;
         datum_t merged
             = std::move(stats).to_datum().merge(insert_stats, stats_merge,
@@ -289,7 +290,8 @@ datum_t table_t::batched_insert(
     std::vector<bool> &&pkey_was_autogenerated,
     conflict_behavior_t conflict_behavior,
     durability_requirement_t durability_requirement,
-    return_changes_t return_changes) {
+    return_changes_t return_changes,
+    bool bulk) {
 
     datum_object_builder_t stats;
     std::vector<datum_t> valid_inserts;
@@ -315,7 +317,7 @@ datum_t table_t::batched_insert(
     datum_t insert_stats =
         tbl->write_batched_insert(
             env, std::move(valid_inserts), std::move(pkey_was_autogenerated),
-            conflict_behavior, return_changes, durability_requirement);
+            conflict_behavior, return_changes, bulk, durability_requirement);
     std::set<std::string> conditions;
     datum_t merged
         = std::move(stats).to_datum().merge(insert_stats, stats_merge,
@@ -349,6 +351,10 @@ datum_t table_t::get_row(env_t *env, datum_t pval) {
     return tbl->read_row(env, pval, read_mode);
 }
 
+std::vector<datum_t> table_t::get_rows(env_t *env, const std::vector<datum_t> &pvals) {
+    return tbl->read_rows(env, pvals, read_mode);
+}
+
 counted_t<datum_stream_t> table_t::get_all(
         env_t *env,
         datum_t value,
@@ -56,7 +56,9 @@ const size_t MIN_VALIDATE_STACK_SPACE = 16 * KILOBYTE;
 
 void validate_pb(const Query &q) {
     check_type(Query, q);
-    if (q.type() == Query::START) {
+    if (q.type() == Query::START
+        || q.type() == Query::PREPARE
+        || q.type() == Query::EXECUTE) {
         check_has(q, has_query, "query");
         validate_pb(q.query());
     } else {
@@ -110,7 +112,8 @@ void validate_pb_datum(const Datum &d) {
     } else {
         check_not_has(d, has_r_num, "r_num");
     }
-    if (d.type() == Datum::R_STR || d.type() == Datum::R_JSON) {
+    if (d.type() == Datum::R_STR || d.type() == Datum::R_JSON
+        || d.type() == Datum::R_DATUM) {
         check_has(d, has_r_str, "r_str");
     } else {
         check_not_has(d, has_r_str, "r_str");
@@ -204,6 +207,7 @@ static std::set<std::string> acceptable_keys = {
     "auth",
     "base",
     "binary_format",
+    "bulk",
     "changefeed_queue_size",
     "conflict",
     "data",
@@ -230,6 +234,7 @@ static std::set<std::string> acceptable_keys = {
     "max_batch_seconds",
     "max_dist",
     "max_results",
+    "memory_limit",
     "method",
     "min_batch_rows",
     "multi",
@@ -237,6 +242,7 @@ static std::set<std::string> acceptable_keys = {
     "nonvoting_replica_tags",
     "noreply",
     "num_vertices",
+    "ordered",
     "overwrite",
     "page",
     "page_limit",
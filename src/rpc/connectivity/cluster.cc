@@ -2,6 +2,7 @@
 #include "rpc/connectivity/cluster.hpp"
 
 #include <netinet/in.h>
+#include <zlib.h>
 
 #include <algorithm>
 #include <functional>
@@ -116,7 +117,7 @@ const std::string connectivity_cluster_t::cluster_build_mode("debug");
 
 void connectivity_cluster_t::connection_t::kill_connection() {
     /* `heartbeat_manager_t` assumes this doesn't block as long as it's called on the
-    home thread. */
+    home thread. Closing the first lane makes `handle()` close the other ones. */
     guarantee(!is_loopback(), "Attempted to kill connection to myself.");
     on_thread_t thread_switcher(conn->home_thread());
 
@@ -128,29 +129,97 @@ void connectivity_cluster_t::connection_t::kill_connection() {
     }
 }
 
-connectivity_cluster_t::connection_t::connection_t(run_t *p,
-                                                   peer_id_t id,
-                                                   keepalive_tcp_conn_stream_t *c,
-                                                   const peer_address_t &a) THROWS_NOTHING :
+void connectivity_cluster_t::connection_t::kill_lanes() {
+    pmap(lanes.size(), [this](size_t i) {
+        on_thread_t thread_switcher(lanes[i]->conn->home_thread());
+        kill_lane(i);
+    });
+}
+
+void connectivity_cluster_t::connection_t::kill_lane(size_t i) {
+    keepalive_tcp_conn_stream_t *lane_conn = lanes[i]->conn;
+    rassert(lane_conn->home_thread() == get_thread_id());
+    if (lane_conn->is_read_open()) {
+        lane_conn->shutdown_read();
+    }
+    if (lane_conn->is_write_open()) {
+        lane_conn->shutdown_write();
+    }
+}
+
+connectivity_cluster_t::connection_t::lane_t::lane_t(connection_t *parent,
+                                                     keepalive_tcp_conn_stream_t *c,
+                                                     bool rethread) :
     conn(c),
-    peer_address(a),
-    flusher([&](signal_t *) {
-        guarantee(this->conn != nullptr);
+    messages_since_flush(0),
+    bytes_since_flush(0),
+    flusher([this, parent](signal_t *interruptor) {
+        // Give other messages a chance to go out in the same write, unless there is
+        // already enough to send.
+        if (parent->flush_delay_ms > 0
+                && bytes_since_flush < CLUSTER_FLUSH_DELAY_MAX_BYTES) {
+            nap(parent->flush_delay_ms, interruptor);
+        }
         // We need to acquire the send_mutex because flushing the buffer
         // must not interleave with other writes (restriction of linux_tcp_conn_t).
-        mutex_t::acq_t acq(&this->send_mutex);
+        mutex_t::acq_t acq(&send_mutex);
+        // Everything that has been written so far goes out with this flush, so the
+        // senders that are waiting for it don't need another one.
+        flusher.include_latest_notifications();
+        if (messages_since_flush > 0) {
+            parent->pm_messages_per_flush.record(messages_since_flush);
+        }
+        messages_since_flush = 0;
+        bytes_since_flush = 0;
         // We ignore the return value of flush_buffer(). Closed connections
         // must be handled elsewhere.
-        this->conn->flush_buffer();
-    }, 1),
+        conn->flush_buffer();
+    }, 1)
+{
+    if (rethread) {
+        reregister_conn.init(new rethread_tcp_conn_stream_t(conn, get_thread_id()));
+    }
+    guarantee(conn->home_thread() == get_thread_id());
+}
+
+connectivity_cluster_t::connection_t::lane_t::~lane_t() {
+    /* The connection's drainers have been destroyed, so nothing can be holding the
+    `send_mutex`. */
+    guarantee(!send_mutex.is_locked());
+}
+
+connectivity_cluster_t::connection_t::connection_t(
+        run_t *p,
+        peer_id_t id,
+        const std::vector<keepalive_tcp_conn_stream_t *> &conns,
+        const peer_address_t &a,
+        bool compress) THROWS_NOTHING :
+    conn(conns.empty() ? NULL : conns[0]),
+    peer_address(a),
+    compress_messages(compress),
+    flush_delay_ms(p->connection_config.flush_delay_ms),
+    lanes(conns.size()),
     pm_collection(),
     pm_bytes_sent(secs_to_ticks(1), true),
+    pm_wire_bytes_sent(secs_to_ticks(1), true),
+    pm_messages_per_flush(secs_to_ticks(1), false),
     pm_collection_membership(&p->parent->connectivity_collection, &pm_collection,
         uuid_to_str(id.get_uuid())),
     pm_bytes_sent_membership(&pm_collection, &pm_bytes_sent, "bytes_sent"),
+    pm_wire_bytes_sent_membership(&pm_collection, &pm_wire_bytes_sent,
+        "wire_bytes_sent"),
+    pm_messages_per_flush_membership(&pm_collection, &pm_messages_per_flush,
+        "messages_per_flush"),
     parent(p), peer_id(id),
     drainers()
 {
+    const threadnum_t first_thread = get_thread_id();
+    pmap(conns.size(), [&](size_t i) {
+        on_thread_t thread_switcher(threadnum_t(
+            (first_thread.threadnum + i) % get_num_threads()));
+        lanes[i].init(new lane_t(this, conns[i], i != 0));
+    });
+
     pmap(get_num_threads(), [this](int thread_id) {
         on_thread_t thread_switcher((threadnum_t(thread_id)));
         parent->parent->connections.get()->set_key_no_equals(
@@ -167,8 +236,10 @@ connectivity_cluster_t::connection_t::~connection_t() THROWS_NOTHING {
         drainers.get()->drain();
     });
 
-    /* The drainers have been destroyed, so nothing can be holding the `send_mutex`. */
-    guarantee(!send_mutex.is_locked());
+    pmap(lanes.size(), [this](size_t i) {
+        on_thread_t thread_switcher(lanes[i]->conn->home_thread());
+        lanes[i].reset();
+    });
 }
 
 // Helper function for the `run_t` constructor's initialization list
@@ -210,9 +281,11 @@ connectivity_cluster_t::run_t::run_t(
         int port,
         int client_port,
         boost::shared_ptr<semilattice_read_view_t<heartbeat_semilattice_metadata_t> >
-            _heartbeat_sl_view)
+            _heartbeat_sl_view,
+        const cluster_connection_config_t &_connection_config)
         THROWS_ONLY(address_in_use_exc_t, tcp_socket_exc_t) :
     parent(p),
+    connection_config(_connection_config),
 
     /* Create the socket to use when listening for connections from peers */
     cluster_listener_socket(new tcp_bound_socket_t(local_addresses, port)),
@@ -244,7 +317,8 @@ connectivity_cluster_t::run_t::run_t(
     `connection_map` on each thread and notifying any listeners that we're now
     connected to ourself. The destructor will remove us from the
     `connection_map` and again notify any listeners. */
-    connection_to_ourself(this, parent->me, NULL, routing_table[parent->me]),
+    connection_to_ourself(this, parent->me, std::vector<keepalive_tcp_conn_stream_t *>(),
+                          routing_table[parent->me], false),
 
     heartbeat_sl_view(_heartbeat_sl_view),
 
@@ -399,10 +473,11 @@ private:
     DISABLE_COPYING(cluster_conn_closing_subscription_t);
 };
 
-/* `heartbeat_manager_t` is responsible for sending heartbeats over a single connection
-and making sure that heartbeats have arrived on time.
-`connectivity_cluster_t::run_t::handle()` constructs one after constructing the
-`connection_t`. */
+/* `heartbeat_manager_t` is responsible for sending heartbeats over one lane of a
+connection and making sure that heartbeats have arrived on it on time. If they don't,
+it closes the lane, which closes the whole connection.
+`connectivity_cluster_t::run_t::handle()` constructs one for each lane after
+constructing the `connection_t`, on the thread of the lane. */
 class connectivity_cluster_t::heartbeat_manager_t :
     public keepalive_tcp_conn_stream_t::keepalive_callback_t,
     private repeating_timer_callback_t,
@@ -413,11 +488,14 @@ public:
 
     heartbeat_manager_t(
             connectivity_cluster_t::connection_t *connection_,
+            size_t lane_index_,
             auto_drainer_t::lock_t connection_keepalive_,
             const std::string &peer_str_,
             clone_ptr_t<watchable_t<heartbeat_semilattice_metadata_t> >
                 heartbeat_sl_view_) :
         connection(connection_),
+        lane_index(lane_index_),
+        lane_conn(connection->lanes[lane_index]->conn),
         connection_keepalive(connection_keepalive_),
         read_done(false),
         write_done(false),
@@ -427,7 +505,8 @@ public:
         heartbeat_sl_view(std::move(heartbeat_sl_view_)),
         heartbeat_sl_view_sub(std::bind(&heartbeat_manager_t::on_heartbeat_change, this))
     {
-        connection->conn->set_keepalive_callback(this);
+        rassert(lane_conn->home_thread() == get_thread_id());
+        lane_conn->set_keepalive_callback(this);
 
         // This will trigger the initialization of the timeout, and timer
         watchable_t<heartbeat_semilattice_metadata_t>::freeze_t
@@ -436,7 +515,7 @@ public:
     }
 
     ~heartbeat_manager_t() {
-        connection->conn->set_keepalive_callback(nullptr);
+        lane_conn->set_keepalive_callback(nullptr);
     }
 
     /* These are called by the `keepalive_tcp_conn_stream_t`. */
@@ -454,10 +533,8 @@ public:
         if (intervals_since_last_read_done > HEARTBEAT_TIMEOUT_INTERVALS) {
             logERR("Heartbeat timeout, killing connection to peer %s", peer_str.c_str());
 
-            /* This won't block if we call it from the same thread. This is an
-            implementation detail that outside code shouldn't rely on, but since
-            `heartbeat_manager_t` is part of `connectivity_cluster_t` it's OK. */
-            connection->kill_connection();
+            /* This doesn't block because we're on the lane's thread. */
+            connection->kill_lane(lane_index);
             return;
         }
         if (write_done) {
@@ -468,10 +545,11 @@ public:
             auto_drainer_t::lock_t this_keepalive(&drainer);
             coro_t::spawn_later_ordered(
                 [this, this_keepalive /* important to capture */] {
-                    /* This might block, so we have to run it in a sub-coroutine. */
+                    /* This might block, so we have to run it in a sub-coroutine. The
+                    lane key of a lane is its index (see `send_message()`). */
                     connection->parent->parent->send_message(
                         connection, connection_keepalive,
-                        connectivity_cluster_t::heartbeat_tag, this);
+                        connectivity_cluster_t::heartbeat_tag, this, lane_index);
                 });
         }
         if (read_done) {
@@ -522,6 +600,8 @@ public:
 
 private:
     connectivity_cluster_t::connection_t *connection;
+    size_t lane_index;
+    keepalive_tcp_conn_stream_t *lane_conn;
     auto_drainer_t::lock_t connection_keepalive;
     bool read_done, write_done;
     int64_t intervals_since_last_read_done;
@@ -678,11 +758,53 @@ enum class handshake_result_code_t {
     UNKNOWN_ERROR = 4
 };
 
+// A successful `handshake_result_t` lists the optional features of the cluster
+// protocol that the sending server supports in its `additional_info`, separated by
+// spaces. Older servers send an empty string there and ignore what they receive.
+// Some features have a value, which follows their name after a `=`.
+
+// The server can decompress messages that are sent with `compressed_tag`.
+static const char *const handshake_feature_compressed_messages = "zlib-messages";
+// The server accepts additional lanes for the connections that get opened to it.
+static const char *const handshake_feature_connection_lanes = "connection-lanes";
+// Sent by the server that opened the connection if it's going to open additional
+// lanes for it. The value is the total number of lanes.
+static const char *const handshake_feature_lanes = "lanes";
+// The name of the group of lanes that the connection belongs to.
+static const char *const handshake_feature_lane_group = "lane-group";
+// Sent instead of `lanes` on an additional lane. The value is its index.
+static const char *const handshake_feature_lane_index = "lane";
+
+// Returns the value of the feature `name` in `features`, which is an empty string for
+// features without a value, or `boost::none` if the feature isn't there.
+static boost::optional<std::string> get_handshake_feature(const std::string &features,
+                                                          const std::string &name) {
+    for (const std::string &feature : split_string(features, ' ')) {
+        if (feature == name) {
+            return std::string();
+        }
+        if (feature.compare(0, name.size() + 1, name + "=") == 0) {
+            return feature.substr(name.size() + 1);
+        }
+    }
+    return boost::none;
+}
+
+// Like `get_handshake_feature()`, for features whose value is a number.
+static bool get_handshake_feature_uint64(const std::string &features,
+                                         const std::string &name,
+                                         uint64_t *value_out) {
+    boost::optional<std::string> value = get_handshake_feature(features, name);
+    return value && strtou64_strict(*value, 10, value_out);
+}
+
 class handshake_result_t {
 public:
     handshake_result_t() { }
-    static handshake_result_t success() {
-        return handshake_result_t(handshake_result_code_t::SUCCESS);
+    static handshake_result_t success(const std::string &features) {
+        handshake_result_t result(handshake_result_code_t::SUCCESS);
+        result.additional_info = features;
+        return result;
     }
     static handshake_result_t error(handshake_result_code_t error_code,
                                     const std::string &additional_info) {
@@ -693,6 +815,11 @@ public:
         return code;
     }
 
+    const std::string &get_features() const {
+        guarantee(code == handshake_result_code_t::SUCCESS);
+        return additional_info;
+    }
+
     std::string get_error_reason() const {
         if (code == handshake_result_code_t::UNKNOWN_ERROR) {
             return error_code_string + " (" + additional_info + ")";
@@ -775,6 +902,66 @@ archive_result_t deserialize_universal(read_stream_t *s, handshake_result_t *out
     return res;
 }
 
+/* Reads the rest of a message that was sent with `compressed_tag`. Sets `*tag_out` to
+the actual tag of the message and returns a stream of the decompressed message. Throws
+`fake_archive_exc_t` if the message is invalid or larger than
+`CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE`, which makes us close the connection. */
+scoped_ptr_t<vector_read_stream_t> read_compressed_message(
+        keepalive_tcp_conn_stream_t *conn,
+        connectivity_cluster_t::message_tag_t *tag_out) {
+    uint64_t size, compressed_size;
+    if (bad(deserialize_universal(conn, tag_out))
+            || bad(deserialize_universal(conn, &size))
+            || bad(deserialize_universal(conn, &compressed_size))) {
+        throw fake_archive_exc_t();
+    }
+    // We never compress a message unless that makes it smaller.
+    if (*tag_out == connectivity_cluster_t::compressed_tag || compressed_size >= size) {
+        throw fake_archive_exc_t();
+    }
+    // The buffers for the message get allocated before we read any of it.
+    if (size > static_cast<uint64_t>(CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE)
+            || compressed_size > static_cast<uint64_t>(
+                CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE)) {
+        throw fake_archive_exc_t();
+    }
+
+    std::vector<char> compressed(compressed_size);
+    if (force_read(conn, compressed.data(), compressed_size)
+            != static_cast<int64_t>(compressed_size)) {
+        throw fake_archive_exc_t();
+    }
+    std::vector<char> data(size);
+    uLongf decompressed_size = size;
+    const int res = uncompress(reinterpret_cast<Bytef *>(data.data()),
+                               &decompressed_size,
+                               reinterpret_cast<const Bytef *>(compressed.data()),
+                               compressed_size);
+    if (res != Z_OK || decompressed_size != size) {
+        throw fake_archive_exc_t();
+    }
+    return make_scoped<vector_read_stream_t>(std::move(data));
+}
+
+/* Compresses a message for sending it with `compressed_tag`. Returns an empty vector if
+that wouldn't make it smaller. */
+std::vector<char> compress_message(const std::vector<char> &data) {
+    std::vector<char> compressed(data.size() - 1);
+    uLongf compressed_size = compressed.size();
+    const int res = compress2(reinterpret_cast<Bytef *>(compressed.data()),
+                              &compressed_size,
+                              reinterpret_cast<const Bytef *>(data.data()),
+                              data.size(),
+                              CLUSTER_COMPRESSION_ZLIB_LEVEL);
+    if (res == Z_BUF_ERROR) {
+        // It didn't fit.
+        return std::vector<char>();
+    }
+    guarantee(res == Z_OK, "compress2 failed with error %d", res);
+    compressed.resize(compressed_size);
+    return compressed;
+}
+
 void fail_handshake(keepalive_tcp_conn_stream_t *conn,
                     const char *peername,
                     const handshake_result_t &reason,
@@ -798,35 +985,34 @@ void fail_handshake(keepalive_tcp_conn_stream_t *conn,
 // - warning: invalid header
 // - error: id or address don't match expected id or address; deserialization range error; unknown error
 // In all cases we close the connection and quit.
-void connectivity_cluster_t::run_t::handle(
-        /* `conn` should remain valid until `handle()` returns.
-         * `handle()` does not take ownership of `conn`. */
+/* The additional lanes of a connection that was opened to us, which the other server
+opens once we have exchanged the routing tables on the first lane. `handle()` for the
+first lane waits until they have all arrived. `handle()` for each of the additional
+lanes puts it into `conns` and then waits until the `lane_group_t` gets destroyed, so
+that the lane stays open for as long as the connection exists. */
+class connectivity_cluster_t::run_t::lane_group_t {
+public:
+    lane_group_t(const peer_id_t &_peer_id, size_t num_lanes) :
+        peer_id(_peer_id), conns(num_lanes - 1, NULL), num_missing(num_lanes - 1) { }
+
+    const peer_id_t peer_id;
+    /* `conns[i]` is lane `i + 1`, or `NULL` if it hasn't arrived yet. */
+    std::vector<keepalive_tcp_conn_stream_t *> conns;
+    size_t num_missing;
+    cond_t all_arrived;
+    auto_drainer_t drainer;
+};
+
+bool connectivity_cluster_t::run_t::exchange_handshake(
         keepalive_tcp_conn_stream_t *conn,
-        boost::optional<peer_id_t> expected_id,
-        boost::optional<peer_address_t> expected_address,
-        auto_drainer_t::lock_t drainer_lock,
-        bool *successful_join) THROWS_NOTHING
-{
+        const char *peername,
+        const std::string &features,
+        cluster_version_t *resolved_version_out,
+        peer_id_t *other_id_out,
+        std::set<host_and_port_t> *other_peer_addr_hosts_out,
+        std::string *other_features_out) THROWS_NOTHING {
     parent->assert_thread();
 
-    /* TODO: If the other peer mysteriously stops talking to us, but doesn't close the
-    connection, during the initialization process but before we construct the
-    `heartbeat_manager_t`, then we might get stuck. Maybe we should add a timeout? It
-    could just be a `signal_timer_t` that is wired into `conn_closer_1` but not
-    `conn_closer_2`. */
-
-    // Get the name of our peer, for error reporting.
-    ip_and_port_t peer_addr;
-    std::string peerstr = "(unknown)";
-    if (conn->get_underlying_conn()->getpeername(&peer_addr))
-        peerstr = peer_addr.to_string();
-    const char *peername = peerstr.c_str();
-
-    // Make sure that if we're ordered to shut down, any pending read
-    // or write gets interrupted.
-    cluster_conn_closing_subscription_t conn_closer_1(conn);
-    conn_closer_1.reset(drainer_lock.get_drain_signal());
-
     // Each side sends a header followed by its own ID and address, then receives and checks the
     // other side's.
     {
@@ -847,7 +1033,7 @@ void connectivity_cluster_t::run_t::handle(
         serialize_universal(&wm, parent->me);
         serialize_universal(&wm, routing_table[parent->me].hosts());
         if (send_write_message(conn, &wm)) {
-            return; // network error.
+            return false; // network error.
         }
     }
 
@@ -859,27 +1045,26 @@ void connectivity_cluster_t::run_t::handle(
         for (uint64_t i = 0; i < cluster_proto_header.length(); i += r) {
             r = conn->read(buffer, std::min(buffer_size, int64_t(cluster_proto_header.length() - i)));
             if (-1 == r) {
-                return; // network error.
+                return false; // network error.
             }
             rassert(r >= 0);
             // If EOF or remote_header does not match header, terminate connection.
             if (0 == r || memcmp(cluster_proto_header.c_str() + i, buffer, r) != 0) {
                 logWRN("Received invalid clustering header from %s, closing connection -- something might be connecting to the wrong port.", peername);
-                return;
+                return false;
             }
         }
     }
 
     // Check version number (e.g. 1.9.0-466-gadea67)
-    cluster_version_t resolved_version;
     {
         std::string remote_version_string;
 
         if (!deserialize_compatible_string(conn, &remote_version_string, peername)) {
-            return;
+            return false;
         }
 
-        if (!resolve_protocol_version(remote_version_string, &resolved_version)) {
+        if (!resolve_protocol_version(remote_version_string, resolved_version_out)) {
             auto reason = handshake_result_t::error(
                 handshake_result_code_t::UNRECOGNIZED_VERSION,
                 strprintf("local: %s, remote: %s",
@@ -895,11 +1080,11 @@ void connectivity_cluster_t::run_t::handle(
                 }
             }
             fail_handshake(conn, peername, reason, handshake_error_supported);
-            return;
+            return false;
         }
 
         // In the future we'll need to support multiple cluster versions.
-        guarantee(resolved_version == cluster_version_t::CLUSTER);
+        guarantee(*resolved_version_out == cluster_version_t::CLUSTER);
     }
 
     // Check bitsize (e.g. 32bit or 64bit)
@@ -907,7 +1092,7 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_arch_bitsize;
 
         if (!deserialize_compatible_string(conn, &remote_arch_bitsize, peername)) {
-            return;
+            return false;
         }
 
         if (remote_arch_bitsize != cluster_arch_bitsize) {
@@ -916,7 +1101,7 @@ void connectivity_cluster_t::run_t::handle(
                 strprintf("local: %s, remote: %s",
                           cluster_arch_bitsize.c_str(), remote_arch_bitsize.c_str()));
             fail_handshake(conn, peername, reason);
-            return;
+            return false;
         }
 
     }
@@ -926,7 +1111,7 @@ void connectivity_cluster_t::run_t::handle(
         std::string remote_build_mode;
 
         if (!deserialize_compatible_string(conn, &remote_build_mode, peername)) {
-            return;
+            return false;
         }
 
         if (remote_build_mode != cluster_build_mode) {
@@ -935,37 +1120,252 @@ void connectivity_cluster_t::run_t::handle(
                 strprintf("local: %s, remote: %s",
                           cluster_build_mode.c_str(), remote_build_mode.c_str()));
             fail_handshake(conn, peername, reason);
-            return;
+            return false;
         }
     }
 
     // Receive id, host/ports.
-    peer_id_t other_id;
-    std::set<host_and_port_t> other_peer_addr_hosts;
-    if (deserialize_universal_and_check(conn, &other_id, peername) ||
-        deserialize_universal_and_check(conn, &other_peer_addr_hosts, peername)) {
-        return;
+    if (deserialize_universal_and_check(conn, other_id_out, peername) ||
+        deserialize_universal_and_check(conn, other_peer_addr_hosts_out, peername)) {
+        return false;
     }
 
     {
         // Tell the other node that we are happy to connect with it
         write_message_t wm;
-        serialize_universal(&wm, handshake_result_t::success());
+        serialize_universal(&wm, handshake_result_t::success(features));
         if (send_write_message(conn, &wm)) {
-            return; // network error.
+            return false; // network error.
         }
 
         // Check if there was an issue with the connection initiation
         handshake_result_t handshake_result;
         if (deserialize_universal_and_check(conn, &handshake_result, peername)) {
-            return;
+            return false;
         }
         if (handshake_result.get_code() != handshake_result_code_t::SUCCESS) {
             logWRN("Remote node refused to connect with us, peer: %s, reason: \"%s\"",
                    peername,
                    sanitize_for_logger(handshake_result.get_error_reason()).c_str());
+            return false;
+        }
+        *other_features_out = handshake_result.get_features();
+    }
+
+    return true;
+}
+
+bool connectivity_cluster_t::run_t::open_lanes(
+        const ip_and_port_t &peer_addr,
+        const peer_id_t &other_id,
+        const std::string &lane_group,
+        size_t num_lanes,
+        signal_t *interruptor,
+        std::vector<scoped_ptr_t<keepalive_tcp_conn_stream_t> > *out) THROWS_NOTHING {
+    parent->assert_thread();
+    const std::string peerstr = peer_addr.to_string();
+    out->resize(num_lanes - 1);
+    bool success = true;
+    pmap(num_lanes - 1, [&](size_t i) {
+        const std::string features = strprintf("%s=%s %s=%zu",
+            handshake_feature_lane_group, lane_group.c_str(),
+            handshake_feature_lane_index, i + 1);
+        try {
+            // The lanes can't all use `cluster_client_port`, so they don't use it.
+            scoped_ptr_t<keepalive_tcp_conn_stream_t> lane(
+                new keepalive_tcp_conn_stream_t(peer_addr.ip(),
+                                                peer_addr.port().value(),
+                                                interruptor, 0));
+            cluster_conn_closing_subscription_t lane_closer(lane.get());
+            lane_closer.reset(interruptor);
+
+            cluster_version_t resolved_version;
+            peer_id_t lane_peer_id;
+            std::set<host_and_port_t> lane_peer_addr_hosts;
+            std::string lane_peer_features;
+            if (!exchange_handshake(lane.get(), peerstr.c_str(), features,
+                                    &resolved_version, &lane_peer_id,
+                                    &lane_peer_addr_hosts, &lane_peer_features)
+                    || lane_peer_id != other_id) {
+                success = false;
+                return;
+            }
+            (*out)[i] = std::move(lane);
+        } catch (const tcp_conn_t::connect_failed_exc_t &) {
+            success = false;
+        } catch (const interrupted_exc_t &) {
+            success = false;
+        }
+    });
+    return success;
+}
+
+void connectivity_cluster_t::run_t::receive_messages(
+        connection_t *connection,
+        keepalive_tcp_conn_stream_t *conn,
+        cluster_version_t resolved_version) THROWS_NOTHING {
+    /* Read messages off the connection until it's closed, which may be due to network
+    events, or the other end shutting down, or us shutting down. */
+    try {
+        int messages_handled_since_yield = 0;
+        while (true) {
+            message_tag_t tag;
+            archive_result_t res = deserialize_universal(conn, &tag);
+            if (bad(res)) { throw fake_archive_exc_t(); }
+
+            /* A compressed message gets handled as if it had arrived like it was
+            before it got compressed. */
+            read_stream_t *message_stream = conn;
+            scoped_ptr_t<vector_read_stream_t> decompressed;
+            if (tag == compressed_tag) {
+                decompressed = read_compressed_message(conn, &tag);
+                message_stream = decompressed.get();
+            }
+
+            /* Ignore messages tagged with the heartbeat tag. The
+            `keepalive_tcp_conn_stream_t` will have already notified the
+            `heartbeat_manager_t` as soon as the heartbeat arrived. */
+            if (tag != heartbeat_tag) {
+                cluster_message_handler_t *handler = parent->message_handlers[tag];
+                guarantee(handler != NULL, "Got a message for an unfamiliar tag. "
+                    "Apparently we aren't compatible with the cluster on the other "
+                    "end.");
+
+                /* If you really want to support old cluster versions, the
+                resolved_version should be passed into the on_message() handler. */
+                guarantee(resolved_version == cluster_version_t::CLUSTER);
+                handler->on_message(
+                    connection,
+                    auto_drainer_t::lock_t(connection->drainers.get()),
+                    message_stream); // might raise fake_archive_exc_t
+            }
+
+            ++messages_handled_since_yield;
+            if (messages_handled_since_yield >= MESSAGE_HANDLER_MAX_BATCH_SIZE) {
+                coro_t::yield();
+                messages_handled_since_yield = 0;
+            }
+        }
+    } catch (const fake_archive_exc_t &) {
+        /* The exception broke us out of the loop, and that's what we
+        wanted. This could either be because we lost contact with the peer
+        or because the cluster is shutting down and `close_conn()` got
+        called. */
+    }
+
+    if (conn->is_read_open()) {
+        logWRN("Received invalid data on a cluster connection. Disconnecting.");
+    }
+}
+
+void connectivity_cluster_t::run_t::handle(
+        /* `conn` should remain valid until `handle()` returns.
+         * `handle()` does not take ownership of `conn`. */
+        keepalive_tcp_conn_stream_t *conn,
+        boost::optional<peer_id_t> expected_id,
+        boost::optional<peer_address_t> expected_address,
+        auto_drainer_t::lock_t drainer_lock,
+        bool *successful_join) THROWS_NOTHING
+{
+    parent->assert_thread();
+
+    /* TODO: If the other peer mysteriously stops talking to us, but doesn't close the
+    connection, during the initialization process but before we construct the
+    `heartbeat_manager_t`, then we might get stuck. Maybe we should add a timeout? It
+    could just be a `signal_timer_t` that is wired into `conn_closer_1` but not
+    `conn_closer_2`. */
+
+    // Get the name of our peer, for error reporting.
+    ip_and_port_t peer_addr;
+    std::string peerstr = "(unknown)";
+    const bool have_peer_addr = conn->get_underlying_conn()->getpeername(&peer_addr);
+    if (have_peer_addr)
+        peerstr = peer_addr.to_string();
+    const char *peername = peerstr.c_str();
+
+    // Make sure that if we're ordered to shut down, any pending read
+    // or write gets interrupted.
+    cluster_conn_closing_subscription_t conn_closer_1(conn);
+    conn_closer_1.reset(drainer_lock.get_drain_signal());
+
+    /* If we're opening the connection, we ask the other server to accept additional
+    lanes for it, which we open once we know that it supports them. */
+    std::string features = strprintf("%s %s",
+        handshake_feature_compressed_messages, handshake_feature_connection_lanes);
+    std::string our_lane_group;
+    if (successful_join != NULL && connection_config.lanes > 1) {
+        our_lane_group = uuid_to_str(generate_uuid());
+        features += strprintf(" %s=%zu %s=%s",
+            handshake_feature_lanes, connection_config.lanes,
+            handshake_feature_lane_group, our_lane_group.c_str());
+    }
+
+    cluster_version_t resolved_version;
+    peer_id_t other_id;
+    std::set<host_and_port_t> other_peer_addr_hosts;
+    std::string other_features;
+    if (!exchange_handshake(conn, peername, features, &resolved_version, &other_id,
+                            &other_peer_addr_hosts, &other_features)) {
+        return;
+    }
+    const bool peer_decompresses_messages = static_cast<bool>(
+        get_handshake_feature(other_features, handshake_feature_compressed_messages));
+
+    /* If this is an additional lane of a connection that was opened to us, we hand it
+    over to the `handle()` call of the connection's first lane and keep it open for as
+    long as that wants to use it. */
+    uint64_t lane_index;
+    if (get_handshake_feature_uint64(other_features, handshake_feature_lane_index,
+                                     &lane_index)) {
+        boost::optional<std::string> group_name =
+            get_handshake_feature(other_features, handshake_feature_lane_group);
+        auto group_it = group_name
+            ? lane_groups.find(*group_name)
+            : lane_groups.end();
+        if (group_it == lane_groups.end()
+                || group_it->second->peer_id != other_id
+                || lane_index == 0
+                || lane_index > group_it->second->conns.size()
+                || group_it->second->conns[lane_index - 1] != NULL) {
+            logWRN("Received an unexpected connection lane from %s, closing it.",
+                   peername);
             return;
         }
+        lane_group_t *group = group_it->second;
+        auto_drainer_t::lock_t lane_lock(&group->drainer);
+        group->conns[lane_index - 1] = conn;
+        --group->num_missing;
+        if (group->num_missing == 0) {
+            group->all_arrived.pulse();
+        }
+        /* From now on, it's up to the first lane to close this one. */
+        conn_closer_1.reset();
+        lane_lock.get_drain_signal()->wait_lazily_unordered();
+        return;
+    }
+
+    /* If the other server is going to open additional lanes to us, we wait for them
+    before we set up the connection. */
+    object_buffer_t<lane_group_t> their_lane_group;
+    object_buffer_t<map_insertion_sentry_t<std::string, lane_group_t *> >
+        their_lane_group_sentry;
+    {
+        uint64_t num_lanes;
+        boost::optional<std::string> group_name =
+            get_handshake_feature(other_features, handshake_feature_lane_group);
+        if (get_handshake_feature_uint64(other_features, handshake_feature_lanes,
+                                         &num_lanes)
+                && num_lanes > 1 && group_name) {
+            if (num_lanes > CLUSTER_MAX_CONNECTION_LANES
+                    || lane_groups.count(*group_name) != 0) {
+                logWRN("Received an invalid request for connection lanes from %s, "
+                       "closing connection.", peername);
+                return;
+            }
+            their_lane_group.create(other_id, num_lanes);
+            their_lane_group_sentry.create(
+                &lane_groups, *group_name, their_lane_group.get());
+        }
     }
 
     // Look up the ip addresses for the other host
@@ -1109,6 +1509,40 @@ void connectivity_cluster_t::run_t::handle(
         *successful_join = true;
     }
 
+    /* Collect the additional lanes, if there are any. `our_lanes` and
+    `their_lane_group` outlive the `rethread_tcp_conn_stream_t`s below, so the lanes
+    are back on this thread by the time they get closed. */
+    std::vector<keepalive_tcp_conn_stream_t *> conns(1, conn);
+    std::vector<scoped_ptr_t<keepalive_tcp_conn_stream_t> > our_lanes;
+    if (their_lane_group.has()) {
+        signal_timer_t timeout;
+        timeout.start(CLUSTER_LANE_CONNECT_TIMEOUT_MS);
+        wait_any_t waiter(&their_lane_group->all_arrived, &timeout,
+                          drainer_lock.get_drain_signal());
+        waiter.wait_lazily_unordered();
+        if (!their_lane_group->all_arrived.is_pulsed()) {
+            if (timeout.is_pulsed()) {
+                logWRN("Not all connection lanes from %s arrived in time, closing "
+                       "connection.", peername);
+            }
+            return;
+        }
+        conns.insert(conns.end(), their_lane_group->conns.begin(),
+                     their_lane_group->conns.end());
+    } else if (!our_lane_group.empty() && have_peer_addr
+            && get_handshake_feature(other_features,
+                                     handshake_feature_connection_lanes)) {
+        if (!open_lanes(peer_addr, other_id, our_lane_group, connection_config.lanes,
+                        drainer_lock.get_drain_signal(), &our_lanes)) {
+            logWRN("Failed to open the connection lanes to %s, closing connection.",
+                   peername);
+            return;
+        }
+        for (const auto &lane : our_lanes) {
+            conns.push_back(lane.get());
+        }
+    }
+
     /* For each peer that our new friend told us about that we don't already
     know about, start a new connection. If the cluster is shutting down, skip
     this step. */
@@ -1136,12 +1570,29 @@ void connectivity_cluster_t::run_t::handle(
     threadnum_t chosen_thread = threadnum_t(rng.randint(get_num_threads()));
 
     cross_thread_signal_t connection_thread_drain_signal(drainer_lock.get_drain_signal(), chosen_thread);
-    cross_thread_watchable_variable_t<heartbeat_semilattice_metadata_t>
-        cross_thread_heartbeat_sl_view(
-            clone_ptr_t<semilattice_watchable_t<heartbeat_semilattice_metadata_t> >(
-                new semilattice_watchable_t<heartbeat_semilattice_metadata_t>(
-                    heartbeat_sl_view)), chosen_thread);
 
+    /* The heartbeat timeout for the `heartbeat_manager_t` of each lane, on the thread
+    that the `connection_t` is going to put the lane on. */
+    clone_ptr_t<semilattice_watchable_t<heartbeat_semilattice_metadata_t> >
+        heartbeat_watchable(
+            new semilattice_watchable_t<heartbeat_semilattice_metadata_t>(
+                heartbeat_sl_view));
+    std::vector<scoped_ptr_t<cross_thread_watchable_variable_t<
+        heartbeat_semilattice_metadata_t> > > cross_thread_heartbeat_sl_views;
+    for (size_t i = 0; i < conns.size(); ++i) {
+        cross_thread_heartbeat_sl_views.push_back(make_scoped<
+            cross_thread_watchable_variable_t<heartbeat_semilattice_metadata_t> >(
+                heartbeat_watchable,
+                threadnum_t((chosen_thread.threadnum + i) % get_num_threads())));
+    }
+
+    /* The additional lanes get moved to the threads after `chosen_thread` by the
+    `connection_t`. */
+    std::vector<scoped_ptr_t<rethread_tcp_conn_stream_t> > unregister_lanes;
+    for (size_t i = 1; i < conns.size(); ++i) {
+        unregister_lanes.push_back(
+            make_scoped<rethread_tcp_conn_stream_t>(conns[i], INVALID_THREAD));
+    }
     rethread_tcp_conn_stream_t unregister_conn(conn, INVALID_THREAD);
     on_thread_t conn_threader(chosen_thread);
     rethread_tcp_conn_stream_t reregister_conn(conn, get_thread_id());
@@ -1155,61 +1606,32 @@ void connectivity_cluster_t::run_t::handle(
         /* `connection_t` is the public interface of this coroutine. Its
         constructor registers it in the `connectivity_cluster_t`'s connection
         map. */
-        connection_t conn_structure(this, other_id, conn, *other_peer_addr.get());
-
-        /* `heartbeat_manager` will periodically send a heartbeat message to
-        other servers, and it will also close the connection if we don't
-        receive anything for a while. */
-        heartbeat_manager_t heartbeat_manager(
-            &conn_structure,
-            auto_drainer_t::lock_t(conn_structure.drainers.get()),
-            peerstr,
-            cross_thread_heartbeat_sl_view.get_watchable());
-
-        /* Main message-handling loop: read messages off the connection until
-        it's closed, which may be due to network events, or the other end
-        shutting down, or us shutting down. */
-        try {
-            int messages_handled_since_yield = 0;
-            while (true) {
-                message_tag_t tag;
-                archive_result_t res = deserialize_universal(conn, &tag);
-                if (bad(res)) { throw fake_archive_exc_t(); }
-
-                /* Ignore messages tagged with the heartbeat tag. The
-                `keepalive_tcp_conn_stream_t` will have already notified the
-                `heartbeat_manager_t` as soon as the heartbeat arrived. */
-                if (tag != heartbeat_tag) {
-                    cluster_message_handler_t *handler = parent->message_handlers[tag];
-                    guarantee(handler != NULL, "Got a message for an unfamiliar tag. "
-                        "Apparently we aren't compatible with the cluster on the other "
-                        "end.");
-
-                    /* If you really want to support old cluster versions, the
-                    resolved_version should be passed into the on_message() handler. */
-                    guarantee(resolved_version == cluster_version_t::CLUSTER);
-                    handler->on_message(
-                        &conn_structure,
-                        auto_drainer_t::lock_t(conn_structure.drainers.get()),
-                        conn); // might raise fake_archive_exc_t
-                }
+        connection_t conn_structure(this, other_id, conns, *other_peer_addr.get(),
+            connection_config.compress_messages && peer_decompresses_messages);
 
-                ++messages_handled_since_yield;
-                if (messages_handled_since_yield >= MESSAGE_HANDLER_MAX_BATCH_SIZE) {
-                    coro_t::yield();
-                    messages_handled_since_yield = 0;
-                }
+        /* Main message-handling loops, one per lane. When one of the lanes gets
+        closed, we close the other ones too. */
+        pmap(conns.size(), [&](size_t i) {
+            {
+                on_thread_t lane_threader(conns[i]->home_thread());
+                guarantee(cross_thread_heartbeat_sl_views[i]->home_thread()
+                          == get_thread_id());
+
+                /* `heartbeat_manager` will periodically send a heartbeat message
+                over the lane, and it will also close the lane if we don't receive
+                anything on it for a while. A lane that stops working therefore
+                takes the connection down even if the other lanes are fine. */
+                heartbeat_manager_t heartbeat_manager(
+                    &conn_structure,
+                    i,
+                    auto_drainer_t::lock_t(conn_structure.drainers.get()),
+                    peerstr,
+                    cross_thread_heartbeat_sl_views[i]->get_watchable());
+
+                receive_messages(&conn_structure, conns[i], resolved_version);
             }
-        } catch (const fake_archive_exc_t &) {
-            /* The exception broke us out of the loop, and that's what we
-            wanted. This could either be because we lost contact with the peer
-            or because the cluster is shutting down and `close_conn()` got
-            called. */
-        }
-
-        if (conn->is_read_open()) {
-            logWRN("Received invalid data on a cluster connection. Disconnecting.");
-        }
+            conn_structure.kill_lanes();
+        });
 
         /* The `conn_structure` destructor removes us from the connection map. It also
         blocks until all references to `conn_structure` have been released (using its
@@ -1284,7 +1706,8 @@ connectivity_cluster_t::connection_t *connectivity_cluster_t::get_connection(
 void connectivity_cluster_t::send_message(connection_t *connection,
                                      auto_drainer_t::lock_t connection_keepalive,
                                      message_tag_t tag,
-                                     cluster_send_message_write_callback_t *callback) {
+                                     cluster_send_message_write_callback_t *callback,
+                                     uint64_t lane_key) {
     // We could be on _any_ thread.
 
     /* We currently write the message to a vector_stream_t, then
@@ -1322,6 +1745,7 @@ void connectivity_cluster_t::send_message(connection_t *connection,
 #endif
 
     size_t bytes_sent = buffer.vector().size();
+    size_t wire_bytes_sent = 0;
 
 #ifdef ENABLE_MESSAGE_PROFILER
     std::pair<uint64_t, uint64_t> *stats =
@@ -1338,14 +1762,31 @@ void connectivity_cluster_t::send_message(connection_t *connection,
         message_handlers[tag]->on_local_message(connection, connection_keepalive,
             std::move(buffer_data));
     } else {
-        on_thread_t threader(connection->conn->home_thread());
+        /* Compress the message before switching to the connection's thread, so that
+        the compression work gets spread over the threads that send messages. */
+        std::vector<char> compressed;
+        if (connection->compress_messages
+                && bytes_sent >= CLUSTER_COMPRESSION_MIN_MESSAGE_SIZE) {
+            compressed = compress_message(buffer.vector());
+        }
+        const std::vector<char> &data =
+            compressed.empty() ? buffer.vector() : compressed;
+
+        const size_t num_lanes = connection->lanes.size();
+        connection_t::lane_t *lane = connection->lanes[
+            lane_key == 0 || num_lanes == 1
+                ? 0
+                : 1 + (lane_key - 1) % (num_lanes - 1)].get();
+        keepalive_tcp_conn_stream_t *conn = lane->conn;
+
+        on_thread_t threader(conn->home_thread());
 
         /* Acquire the send-mutex so we don't collide with other things trying
         to send on the same connection. */
         {
             /* The `true` is for eager waiting, which is a significant performance
             optimization in this case. */
-            mutex_t::acq_t acq(&connection->send_mutex, true);
+            mutex_t::acq_t acq(&lane->send_mutex, true);
 
             /* Write the tag to the network */
             {
@@ -1356,15 +1797,23 @@ void connectivity_cluster_t::send_message(connection_t *connection,
                               "changed, the cluster communication format has changed and "
                               "you need to ask yourself whether live cluster upgrades work."
                               );
-                serialize_universal(&wm, tag);
-                make_buffered_tcp_conn_stream_wrapper_t buffered_conn(connection->conn);
+                if (compressed.empty()) {
+                    serialize_universal(&wm, tag);
+                } else {
+                    serialize_universal(&wm, compressed_tag);
+                    serialize_universal(&wm, tag);
+                    serialize_universal(&wm, static_cast<uint64_t>(bytes_sent));
+                    serialize_universal(&wm, static_cast<uint64_t>(data.size()));
+                }
+                wire_bytes_sent += wm.size();
+                make_buffered_tcp_conn_stream_wrapper_t buffered_conn(conn);
                 int res = send_write_message(&buffered_conn, &wm);
                 if (res == -1) {
                     /* Close the other half of the connection to make sure that
                        `connectivity_cluster_t::run_t::handle()` notices that something is
                        up */
-                    if (connection->conn->is_read_open()) {
-                        connection->conn->shutdown_read();
+                    if (conn->is_read_open()) {
+                        conn->shutdown_read();
                     }
                     return;
                 }
@@ -1372,28 +1821,32 @@ void connectivity_cluster_t::send_message(connection_t *connection,
 
             /* Write the message itself to the network */
             {
-                int64_t res = connection->conn->write_buffered(buffer.vector().data(),
-                                                               buffer.vector().size());
+                int64_t res = conn->write_buffered(data.data(), data.size());
                 if (res == -1) {
-                    if (connection->conn->is_read_open()) {
-                        connection->conn->shutdown_read();
+                    if (conn->is_read_open()) {
+                        conn->shutdown_read();
                     }
                     return;
                 } else {
-                    guarantee(res == static_cast<int64_t>(buffer.vector().size()));
+                    guarantee(res == static_cast<int64_t>(data.size()));
                 }
+                wire_bytes_sent += data.size();
             }
+
+            ++lane->messages_since_flush;
+            lane->bytes_since_flush += wire_bytes_sent;
         } /* Releases the send_mutex */
 
-        connection->flusher.notify();
+        lane->flusher.notify();
         cond_t dummy_interruptor;
-        connection->flusher.flush(&dummy_interruptor);
-        if (!connection->conn->is_write_open()) {
-            if (connection->conn->is_read_open()) {
-                connection->conn->shutdown_read();
+        lane->flusher.flush(&dummy_interruptor);
+        if (!conn->is_write_open()) {
+            if (conn->is_read_open()) {
+                conn->shutdown_read();
             }
             return;
         }
+        connection->pm_wire_bytes_sent.record(wire_bytes_sent);
     }
 
     connection->pm_bytes_sent.record(bytes_sent);
@@ -1408,6 +1861,9 @@ cluster_message_handler_t::cluster_message_handler_t(
     rassert(tag != connectivity_cluster_t::heartbeat_tag,
         "Tag %" PRIu8 " is reserved for heartbeat messages.",
         connectivity_cluster_t::heartbeat_tag);
+    rassert(tag != connectivity_cluster_t::compressed_tag,
+        "Tag %" PRIu8 " is reserved for compressed messages.",
+        connectivity_cluster_t::compressed_tag);
     rassert(connectivity_cluster->message_handlers[tag] == NULL);
     connectivity_cluster->message_handlers[tag] = this;
 }
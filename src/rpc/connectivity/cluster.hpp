@@ -54,6 +54,28 @@ public:
 #endif
 };
 
+/* How `connectivity_cluster_t` writes messages to its connections to other servers. */
+class cluster_connection_config_t {
+public:
+    cluster_connection_config_t()
+        : compress_messages(false), flush_delay_ms(0), lanes(1) { }
+
+    /* Whether to compress large messages to peers that can decompress them (see
+    `connectivity_cluster_t::compressed_tag`). */
+    bool compress_messages;
+
+    /* How long to hold back small messages before flushing them to the network, so
+    that messages that get sent around the same time go out in a single write. */
+    int64_t flush_delay_ms;
+
+    /* How many TCP connections ("lanes") to open to each server that we connect to,
+    if it supports that. The first lane carries all messages but mailbox messages, and
+    the mailbox messages get spread over the other lanes by their destination mailbox
+    (see `connectivity_cluster_t::send_message()`). Each lane is handled by a different
+    thread. */
+    size_t lanes;
+};
+
 /* `connectivity_cluster_t` is responsible for establishing connections with other
 servers and communicating with them. It's the foundation of the entire clustering
 system. However, it's very low-level; most code will instead use the directory or mailbox
@@ -92,6 +114,12 @@ public:
     /* This tag is reserved exclusively for heartbeat messages. */
     static const message_tag_t heartbeat_tag = 'H';
 
+    /* This tag is reserved for messages that have been compressed with zlib. It's only
+    sent to peers that said during the handshake that they can decompress messages. It
+    is followed by the actual tag of the message, the uncompressed and the compressed
+    size of the message, and then the compressed message. */
+    static const message_tag_t compressed_tag = 'Z';
+
     class run_t;
 
     /* `connection_t` represents an open connection to another server. If we lose
@@ -103,6 +131,10 @@ public:
     `get_drain_signal()`. There will never be two `connection_t` objects that refer to
     the same peer.
 
+    A `connection_t` can consist of several TCP connections, which we call "lanes"
+    (see `cluster_connection_config_t::lanes`). Heartbeats go over every lane, and if
+    any lane gets closed or stops receiving them, the whole connection gets closed.
+
     `connection_t` is completely thread-safe. You can pass connections from thread to
     thread and call the methods on any thread. */
     class connection_t : public home_thread_mixin_debug_only_t {
@@ -129,13 +161,52 @@ public:
     private:
         friend class connectivity_cluster_t;
 
+        /* One of the TCP connections that make up the connection. It lives on the
+        home thread of its `conn`. */
+        class lane_t : public home_thread_mixin_debug_only_t {
+        public:
+            /* If `rethread` is true, `conn` doesn't have a home thread yet and gets
+            moved to the current thread for as long as the `lane_t` exists. */
+            lane_t(connection_t *parent, keepalive_tcp_conn_stream_t *conn,
+                   bool rethread);
+            ~lane_t();
+
+            keepalive_tcp_conn_stream_t *const conn;
+
+            scoped_ptr_t<rethread_tcp_conn_stream_t> reregister_conn;
+
+            mutex_t send_mutex;
+
+            /* The number of messages and bytes that have been written to `conn` since
+            `flusher` last flushed it. Protected by `send_mutex`. */
+            int64_t messages_since_flush;
+            int64_t bytes_since_flush;
+
+            /* Calls `conn->flush_buffer()`. Can be used for making sure that a
+            buffered write makes it to the TCP stack. */
+            pump_coro_t flusher;
+        };
+
         /* The constructor registers us in every thread's `connections` map, thereby
-        notifying event subscribers. */
-        connection_t(run_t *, peer_id_t, keepalive_tcp_conn_stream_t *,
-                const peer_address_t &peer) THROWS_NOTHING;
+        notifying event subscribers. `conns` is empty for the loopback connection.
+        Otherwise the first lane must already be on the current thread, and the
+        others must not have a home thread; they get spread over the threads after
+        the current one. */
+        connection_t(run_t *, peer_id_t,
+                const std::vector<keepalive_tcp_conn_stream_t *> &conns,
+                const peer_address_t &peer, bool compress_messages) THROWS_NOTHING;
         ~connection_t() THROWS_NOTHING;
 
-        /* NULL for the loopback connection (i.e. our "connection" to ourself) */
+        /* Closes all lanes. Unlike `kill_connection()`, this blocks until it has
+        visited the threads of all lanes. */
+        void kill_lanes();
+
+        /* Closes lane `i`, which must be on the current thread, without blocking.
+        `handle()` then closes the other lanes. */
+        void kill_lane(size_t i);
+
+        /* NULL for the loopback connection (i.e. our "connection" to ourself).
+        Otherwise this is the first lane. */
         keepalive_tcp_conn_stream_t *conn;
 
         /* `connection_t` contains the addresses so that we can call
@@ -143,16 +214,23 @@ public:
         cross-thread to access the routing table. */
         peer_address_t peer_address;
 
-        /* Unused for our connection to ourself */
-        mutex_t send_mutex;
+        /* Whether large messages get compressed before they're sent. This is only
+        the case if our `cluster_connection_config_t` says so and the other server
+        can decompress them. */
+        const bool compress_messages;
 
-        /* Calls `conn->flush_buffer()`. Can be used for making sure that a
-        buffered write makes it to the TCP stack. */
-        pump_coro_t flusher;
+        /* See `cluster_connection_config_t::flush_delay_ms`. */
+        const int64_t flush_delay_ms;
 
+        /* Empty for our connection to ourself */
+        std::vector<scoped_ptr_t<lane_t> > lanes;
+
+        /* `bytes_sent` is the size of the messages before compression and
+        `wire_bytes_sent` what actually got written for them. */
         perfmon_collection_t pm_collection;
-        perfmon_sampler_t pm_bytes_sent;
-        perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership;
+        perfmon_sampler_t pm_bytes_sent, pm_wire_bytes_sent, pm_messages_per_flush;
+        perfmon_membership_t pm_collection_membership, pm_bytes_sent_membership,
+            pm_wire_bytes_sent_membership, pm_messages_per_flush_membership;
 
         /* We only hold this information so we can deregister ourself */
         run_t *parent;
@@ -175,7 +253,9 @@ public:
               int port,
               int client_port,
               boost::shared_ptr<semilattice_read_view_t<
-                  heartbeat_semilattice_metadata_t> > heartbeat_sl_view)
+                  heartbeat_semilattice_metadata_t> > heartbeat_sl_view,
+              const cluster_connection_config_t &connection_config =
+                  cluster_connection_config_t())
             THROWS_ONLY(address_in_use_exc_t, tcp_socket_exc_t);
 
         ~run_t();
@@ -249,8 +329,38 @@ public:
             auto_drainer_t::lock_t,
             bool *successful_join) THROWS_NOTHING;
 
+        /* Exchanges the header, the ID and the addresses with the other server and
+        tells it that we're happy to connect, announcing the protocol features in
+        `features`. Returns `false` if the connection should be closed. */
+        bool exchange_handshake(keepalive_tcp_conn_stream_t *conn,
+                                const char *peername,
+                                const std::string &features,
+                                cluster_version_t *resolved_version_out,
+                                peer_id_t *other_id_out,
+                                std::set<host_and_port_t> *other_peer_addr_hosts_out,
+                                std::string *other_features_out) THROWS_NOTHING;
+
+        /* Opens the additional lanes of a connection that we opened to `peer_addr`.
+        `num_lanes` includes the lane that we already have. Returns `false` if that
+        didn't work out. */
+        bool open_lanes(const ip_and_port_t &peer_addr,
+                        const peer_id_t &other_id,
+                        const std::string &lane_group,
+                        size_t num_lanes,
+                        signal_t *interruptor,
+                        std::vector<scoped_ptr_t<keepalive_tcp_conn_stream_t> > *out)
+            THROWS_NOTHING;
+
+        /* Reads messages off of one of the lanes of `connection` and hands them to
+        the message handlers, until the lane gets closed. */
+        void receive_messages(connection_t *connection,
+                              keepalive_tcp_conn_stream_t *conn,
+                              cluster_version_t resolved_version) THROWS_NOTHING;
+
         connectivity_cluster_t *parent;
 
+        const cluster_connection_config_t connection_config;
+
         /* `attempt_table` is a table of all the host:port pairs we're currently
         trying to connect to or have connected to. If we are told to connect to
         an address already in this table, we'll just ignore it. That's important
@@ -270,6 +380,11 @@ public:
         redundant connections to the same peer. */
         mutex_t new_connection_mutex;
 
+        /* The connections whose initiator is going to open additional lanes to us,
+        by the name that it gave to the group of lanes. */
+        class lane_group_t;
+        std::map<std::string, lane_group_t *> lane_groups;
+
         scoped_ptr_t<tcp_bound_socket_t> cluster_listener_socket;
         int cluster_listener_port;
         int cluster_client_port;
@@ -309,11 +424,15 @@ public:
 
     /* Sends a message to the other server. The message is associated with a "tag",
     which determines which message handler on the other server will receive the message.
-    */
+    If there are several lanes to the other server, `lane_key` determines which of them
+    the message goes over. Messages with a `lane_key` of 0 always use the first lane,
+    and messages with the same `lane_key` always use the same lane. Messages that go
+    over different lanes can overtake each other. */
     void send_message(connection_t *connection,
                       auto_drainer_t::lock_t connection_keepalive,
                       message_tag_t tag,
-                      cluster_send_message_write_callback_t *callback);
+                      cluster_send_message_write_callback_t *callback,
+                      uint64_t lane_key = 0);
 
 private:
     friend class cluster_message_handler_t;
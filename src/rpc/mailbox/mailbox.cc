@@ -125,8 +125,12 @@ void send(mailbox_manager_t *src, raw_mailbox_t::address_t dest,
         return;
     }
     raw_mailbox_writer_t writer(dest.thread, dest.mailbox_id, callback);
+    /* Messages to the same mailbox go over the same lane, so they stay in order. The
+    messages to different mailboxes get spread over the lanes. */
+    const uint64_t lane_key =
+        1 + dest.mailbox_id * 31 + static_cast<uint32_t>(dest.thread);
     src->get_connectivity_cluster()->send_message(connection, connection_keepalive,
-        src->get_message_tag(), &writer);
+        src->get_message_tag(), &writer, lane_key);
 }
 
 static const int MAX_OUTSTANDING_MAILBOX_WRITES_PER_THREAD = 4;
@@ -9,12 +9,19 @@
 #include "serializer/types.hpp"
 #include "rpc/serialize_macros.hpp"
 
+/* How data blocks get compressed before they are written to disk. Whether a block
+is compressed is recorded in the LBA entry of every block, so this can be changed from
+run to run. */
+enum class block_compression_t { none, zlib };
+
 /* Configuration for the serializer that can change from run to run */
 
 struct log_serializer_dynamic_config_t {
     log_serializer_dynamic_config_t() {
         read_ahead = true;
         io_batch_factor = DEFAULT_IO_BATCH_FACTOR;
+        block_compression = block_compression_t::none;
+        lba_snapshot = false;
     }
 
     /* The (minimal) batch size of i/o requests being taken from a single i/o account.
@@ -24,6 +31,14 @@ struct log_serializer_dynamic_config_t {
 
     /* Enable reading more data than requested to let the cache warmup more quickly esp. on rotational drives */
     bool read_ahead;
+
+    /* Compress data blocks that are written from now on. Blocks that don't get
+    smaller on disk are stored uncompressed regardless. */
+    block_compression_t block_compression;
+
+    /* Save the in-memory LBA index to a separate file on clean shutdown, and load it
+    from there on the next startup instead of reading the whole LBA. */
+    bool lba_snapshot;
 };
 
 /* This is equivalent to log_serializer_static_config_t below, but is an on-disk
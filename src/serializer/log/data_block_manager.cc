@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <sys/uio.h>
+#include <zlib.h>
 
 #include <functional>
 
@@ -15,6 +16,7 @@
 #include "serializer/buf_ptr.hpp"
 #include "serializer/log/log_serializer.hpp"
 #include "stl_utils.hpp"
+#include "time.hpp"
 
 // Max amount of bytes which can be read ahead in one i/o transaction (if enabled)
 const int64_t APPROXIMATE_READ_AHEAD_SIZE = 32 * DEFAULT_BTREE_BLOCK_SIZE;
@@ -59,6 +61,9 @@ class gc_entry_t : public intrusive_list_node_t<gc_entry_t> {
 private:
     struct block_info_t {
         uint32_t relative_offset;
+        // The size the block takes up in the extent.
+        block_size_t stored_block_size;
+        // The size of the block once it's decompressed.
         block_size_t block_size;
         bool token_referenced;
         bool index_referenced;
@@ -125,11 +130,18 @@ public:
         return block_infos.empty()
             ? 0
             : block_infos.back().relative_offset
-            + aligned_value(block_infos.back().block_size);
+            + aligned_value(block_infos.back().stored_block_size);
     }
 
-    // Returns the ostensible size of the block_index'th block.  Note that
-    // block_boundaries[i] + block_size(i) <= block_boundaries[i + 1].
+    // Returns the ostensible on-disk size of the block_index'th block.  Note that
+    // block_boundaries[i] + stored_block_size(i) <= block_boundaries[i + 1].
+    block_size_t stored_block_size(unsigned int block_index) const {
+        guarantee(state != state_reconstructing);
+        guarantee(block_index < block_infos.size());
+        return block_infos[block_index].stored_block_size;
+    }
+
+    // Returns the size of the block_index'th block once it's decompressed.
     block_size_t block_size(unsigned int block_index) const {
         guarantee(state != state_reconstructing);
         guarantee(block_index < block_infos.size());
@@ -154,23 +166,25 @@ public:
         return it - block_infos.begin();
     }
 
-    bool new_offset(block_size_t block_size,
+    bool new_offset(block_size_t stored_block_size,
+                    block_size_t block_size,
                     uint32_t *relative_offset_out,
                     unsigned int *block_index_out) {
         // Returns true if there's enough room at the end of the extent for the new
         // block.
         guarantee(state == state_active);
-        guarantee(block_size.ser_value() <= parent->static_config->extent_size());
+        guarantee(stored_block_size.ser_value() <= parent->static_config->extent_size());
 
         uint32_t offset = back_relative_offset();
         guarantee(offset <= parent->static_config->extent_size());
 
-        if (offset > parent->static_config->extent_size() - block_size.ser_value()) {
+        if (offset > parent->static_config->extent_size() - stored_block_size.ser_value()) {
             return false;
         } else {
             *relative_offset_out = offset;
             *block_index_out = block_infos.size();
-            block_infos.push_back(block_info_t{offset, block_size, false, false});
+            block_infos.push_back(block_info_t{offset, stored_block_size, block_size,
+                                               false, false});
             update_stats(NULL, &block_infos.back());
             return true;
         }
@@ -221,7 +235,7 @@ public:
         uint32_t b = 0;
         for (auto it = block_infos.begin(); it < block_infos.end(); ++it) {
             if (it->token_referenced) {
-                b += aligned_value(it->block_size);
+                b += aligned_value(it->stored_block_size);
             }
         }
         return b;
@@ -235,21 +249,28 @@ public:
         return std::lower_bound(block_infos.begin(), block_infos.end(), relative_offset, &gc_entry_t::info_less);
     }
 
-    void mark_live_indexwise_with_offset(int64_t offset, block_size_t block_size) {
+    void mark_live_indexwise_with_offset(int64_t offset, block_size_t block_size,
+                                         block_size_t stored_block_size) {
         guarantee(offset >= extent_ref.offset() && offset < extent_ref.offset() + UINT32_MAX);
 
         uint32_t relative_offset = offset - extent_ref.offset();
 
         auto it = find_lower_bound_iter(relative_offset);
         if (it == block_infos.end()) {
-            block_infos.push_back(block_info_t{relative_offset, block_size, false, true});
+            block_infos.push_back(block_info_t{relative_offset, stored_block_size,
+                                               block_size, false, true});
             update_stats(NULL, &block_infos.back());
         } else if (it->relative_offset > relative_offset) {
-            guarantee(it->relative_offset >= relative_offset + aligned_value(block_size));
-            auto new_block = block_infos.insert(it, block_info_t{relative_offset, block_size, false, true});
+            guarantee(it->relative_offset
+                      >= relative_offset + aligned_value(stored_block_size));
+            auto new_block = block_infos.insert(it, block_info_t{relative_offset,
+                                                                 stored_block_size,
+                                                                 block_size,
+                                                                 false, true});
             update_stats(NULL, &*new_block);
         } else {
             guarantee(it->relative_offset == relative_offset);
+            guarantee(it->stored_block_size == stored_block_size);
             guarantee(it->block_size == block_size);
             const block_info_t old_info = *it;
             it->index_referenced = true;
@@ -274,7 +295,7 @@ public:
         uint32_t b = 0;
         for (auto it = block_infos.begin(); it < block_infos.end(); ++it) {
             if (it->index_referenced) {
-                b += aligned_value(it->block_size);
+                b += aligned_value(it->stored_block_size);
             }
         }
         return b;
@@ -291,7 +312,7 @@ public:
         for (auto it = block_infos.begin(); it != block_infos.end(); ++it) {
             ret += strprintf("%s[%" PRIi64 "..+%" PRIu32 ") %c%c",
                              it == block_infos.begin() ? "" : separator,
-                             offset + it->relative_offset, it->block_size.ser_value(),
+                             offset + it->relative_offset, it->stored_block_size.ser_value(),
                              it->token_referenced ? 'T' : ' ',
                              it->index_referenced ? 'I' : ' ');
         }
@@ -313,14 +334,14 @@ private:
             if (old_block->token_referenced || old_block->index_referenced) {
                 // Block is live
                 num_live_blocks_stat -= 1;
-                garbage_bytes_stat += aligned_value(old_block->block_size);
+                garbage_bytes_stat += aligned_value(old_block->stored_block_size);
             }
         }
         // Apply new_block
         if (new_block->token_referenced || new_block->index_referenced) {
             // Block is live
             num_live_blocks_stat += 1;
-            garbage_bytes_stat -= aligned_value(new_block->block_size);
+            garbage_bytes_stat -= aligned_value(new_block->stored_block_size);
         }
     }
 
@@ -406,7 +427,8 @@ void data_block_manager_t::start_reconstruct() {
 // gc_entry_t in the entries table.  (This is used when we start up, when
 // everything is presumed to be garbage, until we mark it as
 // non-garbage.)
-void data_block_manager_t::mark_live(int64_t offset, block_size_t ser_block_size) {
+void data_block_manager_t::mark_live(int64_t offset, block_size_t block_size,
+                                     block_size_t stored_block_size) {
     uint64_t extent_id = static_config->extent_index(offset);
 
     if (entries.get(extent_id) == NULL) {
@@ -417,7 +439,7 @@ void data_block_manager_t::mark_live(int64_t offset, block_size_t ser_block_size
     }
 
     gc_entry_t *entry = entries.get(extent_id);
-    entry->mark_live_indexwise_with_offset(offset, ser_block_size);
+    entry->mark_live_indexwise_with_offset(offset, block_size, stored_block_size);
 }
 
 void data_block_manager_t::end_reconstruct() {
@@ -560,6 +582,79 @@ void read_ahead_offset_and_size(int64_t off_in,
     *size_out = end_offset - offset;
 }
 
+// Compressed blocks keep their `ls_buf_data_t` header uncompressed (so that the GC
+// and read-ahead can tell which block they're looking at) followed by the zlib
+// stream of the cache portion of the block.
+
+// Compresses the block in `buf` into a newly allocated buffer that is padded with
+// zeros to the next DEVICE_BLOCK_SIZE boundary.  Returns an empty buffer if the
+// compressed block wouldn't take up less space on disk.
+scoped_malloc_t<char> compress_block(const ser_buffer_t *buf,
+                                     block_size_t block_size,
+                                     block_size_t *stored_block_size_out,
+                                     log_serializer_stats_t *stats) {
+    const uint32_t aligned_size = ceil_aligned(block_size.ser_value(), DEVICE_BLOCK_SIZE);
+    if (aligned_size <= DEVICE_BLOCK_SIZE) {
+        return scoped_malloc_t<char>();
+    }
+    // Anything larger than this wouldn't save a device block.
+    const uint32_t max_stored_size = aligned_size - DEVICE_BLOCK_SIZE;
+
+    const ticks_t start_ticks = get_ticks();
+    scoped_malloc_t<char> ret(malloc_aligned(max_stored_size, DEVICE_BLOCK_SIZE));
+    ser_buffer_t *const ret_buf = reinterpret_cast<ser_buffer_t *>(ret.get());
+    ret_buf->ser_header = buf->ser_header;
+    uLongf compressed_size = max_stored_size - sizeof(ls_buf_data_t);
+    const int res = compress2(reinterpret_cast<Bytef *>(ret_buf->cache_data),
+                              &compressed_size,
+                              reinterpret_cast<const Bytef *>(buf->cache_data),
+                              block_size.value(),
+                              BLOCK_COMPRESSION_ZLIB_LEVEL);
+    stats->pm_serializer_compression_ticks += get_ticks() - start_ticks;
+    if (res == Z_BUF_ERROR) {
+        // It didn't fit.
+        return scoped_malloc_t<char>();
+    }
+    guarantee(res == Z_OK, "compress2 failed with error %d", res);
+
+    const uint32_t stored_size = sizeof(ls_buf_data_t) + compressed_size;
+    memset(ret.get() + stored_size, 0,
+           ceil_aligned(stored_size, DEVICE_BLOCK_SIZE) - stored_size);
+
+    ++stats->pm_serializer_compressed_blocks;
+    stats->pm_serializer_compression_input_bytes += block_size.ser_value();
+    stats->pm_serializer_compression_output_bytes += stored_size;
+
+    *stored_block_size_out = block_size_t::unsafe_make(stored_size);
+    return ret;
+}
+
+// Decompresses a block that was compressed by `compress_block()`.
+buf_ptr_t decompress_block(const ser_buffer_t *stored,
+                           block_size_t stored_block_size,
+                           block_size_t block_size,
+                           log_serializer_stats_t *stats) {
+    guarantee(stored_block_size.ser_value() < block_size.ser_value());
+
+    const ticks_t start_ticks = get_ticks();
+    buf_ptr_t ret = buf_ptr_t::alloc_uninitialized(block_size);
+    ret.ser_buffer()->ser_header = stored->ser_header;
+    uLongf decompressed_size = block_size.value();
+    const int res = uncompress(reinterpret_cast<Bytef *>(ret.ser_buffer()->cache_data),
+                               &decompressed_size,
+                               reinterpret_cast<const Bytef *>(stored->cache_data),
+                               stored_block_size.value());
+    guarantee(res == Z_OK && decompressed_size == block_size.value(),
+              "Compressed block %" PR_BLOCK_ID " is corrupted (zlib error %d, "
+              "%lu of %" PRIu32 " bytes).",
+              stored->ser_header.block_id, res,
+              static_cast<unsigned long>(decompressed_size),  // NOLINT(runtime/int)
+              block_size.value());
+    ret.fill_padding_zero();
+    stats->pm_serializer_decompression_ticks += get_ticks() - start_ticks;
+    return ret;
+}
+
 class dbm_read_ahead_t {
 public:
     static std::vector<uint32_t> get_boundaries(data_block_manager_t *parent,
@@ -638,15 +733,24 @@ public:
                     continue;
                 }
 
-                const block_size_t block_size = block_size_t::unsafe_make(info.ser_block_size);
-                buf_ptr_t buf = buf_ptr_t::alloc_uninitialized(block_size);
-                memcpy(buf.ser_buffer(), current_buf, info.ser_block_size);
-                buf.fill_padding_zero();
+                const block_size_t block_size = info.block_size();
+                const block_size_t stored_block_size = info.stored_block_size();
                 guarantee(info.ser_block_size <= *(lower_it + 1) - *lower_it);
+                buf_ptr_t buf;
+                if (stored_block_size != block_size) {
+                    buf = decompress_block(
+                        reinterpret_cast<const ser_buffer_t *>(current_buf),
+                        stored_block_size, block_size, stats);
+                } else {
+                    buf = buf_ptr_t::alloc_uninitialized(block_size);
+                    memcpy(buf.ser_buffer(), current_buf, info.ser_block_size);
+                    buf.fill_padding_zero();
+                }
 
                 counted_t<ls_block_token_pointee_t> ls_token
                     = parent->serializer->generate_block_token(current_offset,
-                                                               block_size);
+                                                               block_size,
+                                                               stored_block_size);
 
                 counted_t<standard_block_token_t> token
                     = to_standard_block_token(block_id, std::move(ls_token));
@@ -674,8 +778,19 @@ bool data_block_manager_t::should_perform_read_ahead(int64_t offset) {
 }
 
 buf_ptr_t data_block_manager_t::read(int64_t off_in, block_size_t block_size,
-                                   file_account_t *io_account) {
+                                     block_size_t stored_block_size,
+                                     file_account_t *io_account) {
     guarantee(state == state_ready);
+    buf_ptr_t ret = read_stored_block(off_in, stored_block_size, io_account);
+    if (stored_block_size != block_size) {
+        ret = decompress_block(ret.ser_buffer(), stored_block_size, block_size, stats);
+    }
+    return ret;
+}
+
+buf_ptr_t data_block_manager_t::read_stored_block(int64_t off_in,
+                                                  block_size_t block_size,
+                                                  file_account_t *io_account) {
     if (should_perform_read_ahead(off_in)) {
         buf_ptr_t ret = buf_ptr_t::alloc_uninitialized(block_size);
         dbm_read_ahead_t::perform_read_ahead(this, off_in, block_size.ser_value(),
@@ -718,15 +833,45 @@ std::vector<counted_t<ls_block_token_pointee_t> >
 data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
                                   file_account_t *io_account,
                                   iocallback_t *cb) {
-    // These tokens are grouped by extent.  You can do a contiguous write in each
-    // extent.
-    std::vector<std::vector<counted_t<ls_block_token_pointee_t> > > token_groups
-        = gimme_some_new_offsets(writes);
+    const bool compress = serializer->block_compression() != block_compression_t::none;
 
+    std::vector<stored_write_t> stored_writes;
+    stored_writes.reserve(writes.size());
+    std::vector<scoped_malloc_t<char> > compressed_bufs;
     for (auto it = writes.begin(); it != writes.end(); ++it) {
         it->buf->ser_header.block_id = it->block_id;
+
+        if (compress) {
+            block_size_t stored_block_size = block_size_t::undefined();
+            scoped_malloc_t<char> compressed
+                = compress_block(it->buf, it->block_size, &stored_block_size, stats);
+            if (compressed.has()) {
+                stored_writes.push_back(
+                    stored_write_t{reinterpret_cast<ser_buffer_t *>(compressed.get()),
+                                   it->block_size,
+                                   stored_block_size});
+                compressed_bufs.push_back(std::move(compressed));
+                continue;
+            }
+        }
+        stored_writes.push_back(stored_write_t{it->buf, it->block_size, it->block_size});
     }
 
+    return write_stored_blocks(stored_writes, std::move(compressed_bufs), io_account,
+                               cb);
+}
+
+std::vector<counted_t<ls_block_token_pointee_t> >
+data_block_manager_t::write_stored_blocks(
+        const std::vector<stored_write_t> &writes,
+        std::vector<scoped_malloc_t<char> > &&owned_bufs,
+        file_account_t *io_account,
+        iocallback_t *cb) {
+    // These tokens are grouped by extent.  You can do a contiguous write in each
+    // extent.
+    std::vector<std::vector<counted_t<ls_block_token_pointee_t> > > token_groups
+        = gimme_some_new_offsets(writes);
+
     struct intermediate_cb_t : public iocallback_t {
         virtual void on_io_complete() {
             --ops_remaining;
@@ -739,6 +884,7 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         size_t ops_remaining;
         iocallback_t *cb;
+        std::vector<scoped_malloc_t<char> > owned_bufs;
     };
 
     intermediate_cb_t *const intermediate_cb = new intermediate_cb_t;
@@ -746,13 +892,14 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
     // intermediate_cb->on_io_complete later.
     intermediate_cb->ops_remaining = token_groups.size() + 1;
     intermediate_cb->cb = cb;
+    intermediate_cb->owned_bufs = std::move(owned_bufs);
 
     size_t write_number = 0;
     for (size_t i = 0; i < token_groups.size(); ++i) {
 
         const int64_t front_offset = token_groups[i].front()->offset();
         const int64_t back_offset = token_groups[i].back()->offset()
-            + gc_entry_t::aligned_value(token_groups[i].back()->block_size());
+            + gc_entry_t::aligned_value(token_groups[i].back()->stored_block_size());
 
         guarantee(divides(DEVICE_BLOCK_SIZE, front_offset));
 
@@ -765,14 +912,14 @@ data_block_manager_t::many_writes(const std::vector<buf_write_info_t> &writes,
 
         for (size_t j = 0; j < token_groups[i].size(); ++j) {
             const int64_t j_offset = token_groups[i][j]->offset();
-            const block_size_t j_block_size = token_groups[i][j]->block_size();
+            const block_size_t j_block_size = token_groups[i][j]->stored_block_size();
             guarantee(j_offset == last_written_offset);
             const size_t j_aligned_size = gc_entry_t::aligned_value(j_block_size);
             total_aligned_size += j_aligned_size;
 
             // The behavior of gimme_some_new_offsets is supposed to retain order, so
             // we expect writes[write_number] to have the currently-relevant write.
-            guarantee(writes[write_number].block_size == j_block_size);
+            guarantee(writes[write_number].stored_block_size == j_block_size);
 
             iovecs[j].iov_base = writes[write_number].buf;
             iovecs[j].iov_len = j_aligned_size;
@@ -933,7 +1080,7 @@ void data_block_manager_t::mark_garbage(int64_t offset, extent_transaction_t *tx
     // Add to old garbage count if necessary (works because of the
     // !entry->block_is_garbage(block_index) assertion above).
     if (entry->state == gc_entry_t::state_old && entry->block_is_garbage(block_index)) {
-        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->block_size(block_index));
+        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->stored_block_size(block_index));
     }
 
     check_and_handle_empty_extent(extent_id);
@@ -963,7 +1110,7 @@ void data_block_manager_t::mark_garbage_tokenwise_with_offset(int64_t offset) {
     // Add to old garbage count if necessary (works because of the
     // !entry->block_is_garbage(block_index) assertion above).
     if (entry->state == gc_entry_t::state_old && entry->block_is_garbage(block_index)) {
-        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->block_size(block_index));
+        gc_stats.old_garbage_block_bytes += gc_entry_t::aligned_value(entry->stored_block_size(block_index));
     }
 
     check_and_handle_empty_extent(extent_id);
@@ -1079,7 +1226,8 @@ void data_block_manager_t::gc_one_extent(gc_state_t *gc_state) {
 
                 const uint32_t end
                     = gc_state->current_entry->relative_offset(i)
-                    + gc_entry_t::aligned_value(gc_state->current_entry->block_size(i));
+                    + gc_entry_t::aligned_value(
+                        gc_state->current_entry->stored_block_size(i));
 
                 if (beg <= current_interval_end) {
                     current_interval_end = end;
@@ -1151,7 +1299,8 @@ void data_block_manager_t::gc_one_extent(gc_state_t *gc_state) {
                 + gc_state->current_entry->relative_offset(i);
 
             gc_writes.push_back(gc_write_t(block, block_offset,
-                                           gc_state->current_entry->block_size(i)));
+                                           gc_state->current_entry->block_size(i),
+                                           gc_state->current_entry->stored_block_size(i)));
         }
         guarantee(gc_writes.size() == num_writes);
     }
@@ -1199,19 +1348,23 @@ void data_block_manager_t::write_gcs(const std::vector<gc_write_t> &writes,
         // Step 1: Write buffers to disk and assemble index operations
         ASSERT_NO_CORO_WAITING;
 
-        std::vector<buf_write_info_t> the_writes;
+        // The blocks are moved as they are, so compressed blocks stay compressed.
+        std::vector<stored_write_t> the_writes;
         the_writes.reserve(writes.size());
         for (size_t i = 0; i < writes.size(); ++i) {
             old_block_tokens.push_back(serializer->generate_block_token(writes[i].old_offset,
-                                                                        writes[i].block_size));
+                                                                        writes[i].block_size,
+                                                                        writes[i].stored_block_size));
 
-            the_writes.push_back(buf_write_info_t(writes[i].buf,
-                                                  writes[i].block_size,
-                                                  writes[i].buf->ser_header.block_id));
+            the_writes.push_back(stored_write_t{writes[i].buf,
+                                                writes[i].block_size,
+                                                writes[i].stored_block_size});
         }
 
-        new_block_tokens = many_writes(the_writes, choose_gc_io_account(),
-                                       &block_write_cond);
+        new_block_tokens = write_stored_blocks(the_writes,
+                                               std::vector<scoped_malloc_t<char> >(),
+                                               choose_gc_io_account(),
+                                               &block_write_cond);
 
         guarantee(new_block_tokens.size() == writes.size());
     }
@@ -1336,7 +1489,7 @@ void data_block_manager_t::actually_shutdown() {
 }
 
 std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
-data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes) {
+data_block_manager_t::gimme_some_new_offsets(const std::vector<stored_write_t> &writes) {
     ASSERT_NO_CORO_WAITING;
 
     // Start a new extent if necessary.
@@ -1354,7 +1507,7 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
     for (auto it = writes.begin(); it != writes.end(); ++it) {
         uint32_t relative_offset = valgrind_undefined<uint32_t>(UINT32_MAX);
         unsigned int block_index = valgrind_undefined<unsigned int>(UINT_MAX);
-        if (!active_extent->new_offset(it->block_size,
+        if (!active_extent->new_offset(it->stored_block_size, it->block_size,
                                        &relative_offset, &block_index)) {
             // Move the active_extent gc_entry_t to the young extent queue (if it's
             // not already empty), and make a new gc_entry_t.
@@ -1370,7 +1523,8 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
             }
 
             ++stats->pm_serializer_data_extents_allocated;
-            const bool succeeded = active_extent->new_offset(it->block_size,
+            const bool succeeded = active_extent->new_offset(it->stored_block_size,
+                                                             it->block_size,
                                                              &relative_offset,
                                                              &block_index);
             guarantee(succeeded);
@@ -1386,7 +1540,8 @@ data_block_manager_t::gimme_some_new_offsets(const std::vector<buf_write_info_t>
         active_extent->was_written = true;
         active_extent->mark_live_tokenwise(block_index);
 
-        tokens.push_back(serializer->generate_block_token(offset, it->block_size));
+        tokens.push_back(serializer->generate_block_token(offset, it->block_size,
+                                                          it->stored_block_size));
     }
 
     if (!tokens.empty()) {
@@ -45,8 +45,10 @@ public:
     static void prepare_initial_metablock(data_block_manager::metablock_mixin_t *mb);
     void start_existing(file_t *dbfile, data_block_manager::metablock_mixin_t *last_metablock);
 
+    /* Reads the block at `off_in`, which takes up `stored_block_size` bytes on disk,
+    and decompresses it to `block_size` if the two differ. */
     buf_ptr_t read(int64_t off_in, block_size_t block_size,
-                 file_account_t *io_account);
+                   block_size_t stored_block_size, file_account_t *io_account);
 
     /* exposed gc api */
     /* mark a buffer as garbage */
@@ -54,7 +56,8 @@ public:
 
     /* r{start,end}_reconstruct functions for safety */
     void start_reconstruct();
-    void mark_live(int64_t offset, block_size_t block_size);
+    void mark_live(int64_t offset, block_size_t block_size,
+                   block_size_t stored_block_size);
     void end_reconstruct();
 
     /* We must make sure that blocks which have tokens pointing to them don't
@@ -79,17 +82,39 @@ public:
     // ratio of garbage to blocks in the system
     double garbage_ratio() const;
 
+    /* Writes the blocks, compressing them first if the serializer is configured
+    to do so. */
     std::vector<counted_t<ls_block_token_pointee_t> >
     many_writes(const std::vector<buf_write_info_t> &writes,
                 file_account_t *io_account,
                 iocallback_t *cb);
 
-    std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
-    gimme_some_new_offsets(const std::vector<buf_write_info_t> &writes);
-
     bool is_gc_active() const;
 
 private:
+    // A block in the form it takes on disk.  `buf` holds `stored_block_size` bytes
+    // (padded with zeros to the next DEVICE_BLOCK_SIZE boundary), which are
+    // compressed if `stored_block_size` is smaller than `block_size`.
+    struct stored_write_t {
+        ser_buffer_t *buf;
+        block_size_t block_size;
+        block_size_t stored_block_size;
+    };
+
+    // Writes blocks to disk as they are.  `owned_bufs` are buffers that have to stay
+    // alive until the writes are complete; they get freed after that.
+    std::vector<counted_t<ls_block_token_pointee_t> >
+    write_stored_blocks(const std::vector<stored_write_t> &writes,
+                        std::vector<scoped_malloc_t<char> > &&owned_bufs,
+                        file_account_t *io_account,
+                        iocallback_t *cb);
+
+    std::vector<std::vector<counted_t<ls_block_token_pointee_t> > >
+    gimme_some_new_offsets(const std::vector<stored_write_t> &writes);
+
+    buf_ptr_t read_stored_block(int64_t off_in, block_size_t stored_block_size,
+                                file_account_t *io_account);
+
     void actually_shutdown();
 
     struct gc_state_t : public intrusive_list_node_t<gc_state_t>{
@@ -108,10 +133,11 @@ private:
         ser_buffer_t *buf;
         int64_t old_offset;
         block_size_t block_size;
+        block_size_t stored_block_size;
         gc_write_t(ser_buffer_t *b, int64_t _old_offset,
-                   block_size_t _block_size)
+                   block_size_t _block_size, block_size_t _stored_block_size)
             : buf(b), old_offset(_old_offset),
-              block_size(_block_size) { }
+              block_size(_block_size), stored_block_size(_stored_block_size) { }
     };
 
     /* Runs in a coroutine and keeps calling `gc_one_extent()` for as long as
@@ -35,7 +35,8 @@ public:
     /* To read from an LBA on disk, first call read_step_1(), passing it the address of a
     new read_info_t structure. When it calls the callback you provide, then call
     read_step_2() with the same read_info_t as before and with a pointer to the
-    in_memory_index_t to be filled with data. */
+    in_memory_index_t to be filled with data. Unlike everything else here,
+    read_step_2() may be called on any thread. */
 
     struct read_info_t {
         void *buffer;
@@ -64,12 +64,14 @@ struct lba_entry_t {
     // (It probably assumes that sizeof(lba_entry_t) evenly divides
     // DEVICE_BLOCK_SIZE).
 
-    // Put the zero-padding at the beginning of the LBA entry.  We could use this, or
-    // the first 16 bits, perhaps, as a version flag.
-    uint32_t zero_reserved;
-
-    // This could be a uint16_t if you wanted it to be, as long as block sizes are
-    // all less than or equal to 4K (which is less than 64K).
+    // The ser block size the block had before it was compressed, or 0 if the block
+    // is stored uncompressed.  (This used to be zero padding, so LBA entries
+    // written by older versions read as uncompressed blocks.)
+    uint32_t uncompressed_ser_block_size;
+
+    // The size the block takes up on disk.  This could be a uint16_t if you wanted
+    // it to be, as long as block sizes are all less than or equal to 4K (which is
+    // less than 64K).
     uint32_t ser_block_size;
 
     block_id_t block_id;
@@ -80,10 +82,13 @@ struct lba_entry_t {
     flagged_off64_t offset;
 
     static lba_entry_t make(block_id_t block_id, repli_timestamp_t recency,
-                            flagged_off64_t offset, uint32_t ser_block_size) {
+                            flagged_off64_t offset, uint32_t ser_block_size,
+                            uint32_t uncompressed_ser_block_size) {
         guarantee(ser_block_size != 0 || !offset.has_value());
+        guarantee(uncompressed_ser_block_size == 0
+                  || uncompressed_ser_block_size > ser_block_size);
         lba_entry_t entry;
-        entry.zero_reserved = 0;
+        entry.uncompressed_ser_block_size = uncompressed_ser_block_size;
         entry.ser_block_size = ser_block_size;
         entry.block_id = block_id;
         entry.recency = recency;
@@ -96,7 +101,7 @@ struct lba_entry_t {
     }
 
     static lba_entry_t make_padding_entry() {
-        return make(PADDING_BLOCK_ID, repli_timestamp_t::invalid, flagged_off64_t::padding(), 0);
+        return make(PADDING_BLOCK_ID, repli_timestamp_t::invalid, flagged_off64_t::padding(), 0, 0);
     }
 } __attribute__((__packed__));
 
@@ -188,5 +193,26 @@ struct lba_superblock_t {
 
 
 
+/* A snapshot of the in-memory index, which is written to a separate file on clean
+ * shutdown so that the next startup doesn't have to read the whole LBA. The file
+ * starts with this header (in its own DEVICE_BLOCK_SIZE block), followed by
+ * `entries_count` LBA entries, padded with padding entries to a multiple of
+ * DEVICE_BLOCK_SIZE. A snapshot is only used if its metablock version and LBA
+ * shard references match the metablock that the serializer starts up from. */
+
+#define LBA_SNAPSHOT_MAGIC_SIZE 8
+static const char lba_snapshot_magic[LBA_SNAPSHOT_MAGIC_SIZE] = {'l', 'b', 'a', 's', 'n', 'a', 'p', '1'};
+
+struct lba_snapshot_header_t {
+    char magic[LBA_SNAPSHOT_MAGIC_SIZE];
+    int64_t metablock_version;
+    lba_shard_metablock_t shards[LBA_SHARD_FACTOR];
+    int32_t inline_lba_entries_count;
+    int32_t padding;
+    int64_t entries_count;
+};
+
+
+
 #endif  // SERIALIZER_LOG_LBA_DISK_FORMAT_HPP_
 
@@ -1,6 +1,9 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "serializer/log/lba/disk_structure.hpp"
 
+#include <functional>
+
+#include "arch/runtime/coroutines.hpp"
 #include "containers/scoped.hpp"
 #include "math.hpp"
 
@@ -66,6 +69,7 @@ void lba_disk_structure_t::on_extent_read() {
 
 void lba_disk_structure_t::add_entry(block_id_t block_id, repli_timestamp_t recency,
                                      flagged_off64_t offset, uint32_t ser_block_size,
+                                     uint32_t uncompressed_ser_block_size,
                                      file_account_t *io_account, extent_transaction_t *txn) {
     if (last_extent && last_extent->full()) {
         /* We have filled up an extent. Transfer it to the superblock. */
@@ -84,7 +88,9 @@ void lba_disk_structure_t::add_entry(block_id_t block_id, repli_timestamp_t rece
 
     rassert(!last_extent->full());
 
-    last_extent->add_entry(lba_entry_t::make(block_id, recency, offset, ser_block_size), io_account);
+    last_extent->add_entry(lba_entry_t::make(block_id, recency, offset, ser_block_size,
+                                             uncompressed_ser_block_size),
+                           io_account);
 }
 
 std::set<lba_disk_extent_t *> lba_disk_structure_t::get_inactive_extents() const {
@@ -195,6 +201,7 @@ struct reader_t
 {
     lba_disk_structure_t *ds;   // The disk structure we are reading from
     in_memory_index_t *index;   // The in-memory-index we are reading into
+    threadnum_t apply_thread;   // The thread that we put the entries into the index on
     lba_disk_structure_t::read_callback_t *rcb;   // Who to call back when we finish
 
     /* extent_reader_t takes care of reading a single extent. */
@@ -240,8 +247,26 @@ struct reader_t
             prev_done = true;
             if (have_read) done();
         }
+        /* The next extent only gets applied once we call `finish()`, so the entries of
+        a shard still go into the index in order even if we apply them on another
+        thread. Meanwhile the reads of the following extents keep going. */
         void done() {
-            extent->read_step_2(&read_info, parent->index);
+            if (parent->apply_thread == get_thread_id()) {
+                extent->read_step_2(&read_info, parent->index);
+                finish();
+            } else {
+                coro_t::spawn_sometime(std::bind(&extent_reader_t::apply_on_thread,
+                                                 this));
+            }
+        }
+        void apply_on_thread() {
+            {
+                on_thread_t th(parent->apply_thread);
+                extent->read_step_2(&read_info, parent->index);
+            }
+            finish();
+        }
+        void finish() {
             parent->active_readers--;
             parent->start_more_readers();
             if (index == static_cast<int>(parent->readers.size()) - 1) {
@@ -260,8 +285,9 @@ struct reader_t
     // reading process so that we stay under LBA_READ_BUFFER_SIZE.
     int active_readers;
 
-    reader_t(lba_disk_structure_t *_ds, in_memory_index_t *_index, lba_disk_structure_t::read_callback_t *cb)
-        : ds(_ds), index(_index), rcb(cb)
+    reader_t(lba_disk_structure_t *_ds, in_memory_index_t *_index,
+             threadnum_t _apply_thread, lba_disk_structure_t::read_callback_t *cb)
+        : ds(_ds), index(_index), apply_thread(_apply_thread), rcb(cb)
     {
         for (lba_disk_extent_t *e = ds->extents_in_superblock.head();
              e != NULL; e = ds->extents_in_superblock.next(e)) {
@@ -295,8 +321,9 @@ struct reader_t
     }
 };
 
-void lba_disk_structure_t::read(in_memory_index_t *index, read_callback_t *cb) {
-    new reader_t(this, index, cb);
+void lba_disk_structure_t::read(in_memory_index_t *index, threadnum_t apply_thread,
+                                read_callback_t *cb) {
+    new reader_t(this, index, apply_thread, cb);
 }
 
 void lba_disk_structure_t::prepare_metablock(lba_shard_metablock_t *mb_out) {
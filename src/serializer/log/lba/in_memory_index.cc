@@ -3,25 +3,191 @@
 
 #include <inttypes.h>
 
+#include <algorithm>
+#include <utility>
+
 #include "serializer/log/lba/disk_format.hpp"
 
-in_memory_index_t::in_memory_index_t() : end_block_id_(0) { }
+in_memory_index_t::chunk_t::chunk_t()
+    : count(0), has_recency_base(false),
+      recency_base(repli_timestamp_t::distant_past),
+      compact_infos(CHUNK_SIZE) { }
+
+in_memory_index_t::in_memory_index_t() { }
+
+in_memory_index_t::~in_memory_index_t() {
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        for (chunk_t *chunk : shards_[i].chunks) {
+            delete chunk;
+        }
+    }
+}
 
 block_id_t in_memory_index_t::end_block_id() {
-    return end_block_id_;
+    block_id_t end_block_id = 0;
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        end_block_id = std::max(end_block_id, shards_[i].end_block_id);
+    }
+    return end_block_id;
 }
 
 index_block_info_t in_memory_index_t::get_block_info(block_id_t id) {
-    return infos_.get(id);
+    const shard_t *shard = &shards_[id % LBA_SHARD_FACTOR];
+    const size_t key = id / LBA_SHARD_FACTOR;
+    const size_t chunk_id = key / CHUNK_SIZE;
+    if (chunk_id < shard->chunks.size() && shard->chunks[chunk_id] != NULL) {
+        return get_from_chunk(shard->chunks[chunk_id], key % CHUNK_SIZE);
+    } else {
+        return index_block_info_t();
+    }
 }
 
 void in_memory_index_t::set_block_info(block_id_t id, repli_timestamp_t recency,
-                                       flagged_off64_t offset, uint32_t ser_block_size) {
-    if (id >= end_block_id_) {
-        end_block_id_ = id + 1;
+                                       flagged_off64_t offset, uint32_t ser_block_size,
+                                       uint32_t uncompressed_ser_block_size) {
+    shard_t *shard = &shards_[id % LBA_SHARD_FACTOR];
+    if (id >= shard->end_block_id) {
+        shard->end_block_id = id + 1;
+    }
+
+    const index_block_info_t info(offset, recency, ser_block_size,
+                                  uncompressed_ser_block_size);
+    const bool is_default = info == index_block_info_t();
+
+    const size_t key = id / LBA_SHARD_FACTOR;
+    const size_t chunk_id = key / CHUNK_SIZE;
+    const size_t index = key % CHUNK_SIZE;
+    if (chunk_id >= shard->chunks.size() || shard->chunks[chunk_id] == NULL) {
+        if (is_default) {
+            return;
+        }
+        if (chunk_id >= shard->chunks.size()) {
+            shard->chunks.resize(chunk_id + 1, NULL);
+        }
+        shard->chunks[chunk_id] = new chunk_t;
+        shard->chunks_memory_usage +=
+            sizeof(chunk_t) + CHUNK_SIZE * sizeof(compact_info_t);
+    }
+
+    chunk_t *chunk = shard->chunks[chunk_id];
+    if (!(get_from_chunk(chunk, index) == index_block_info_t())) {
+        --chunk->count;
+    }
+    if (!is_default) {
+        ++chunk->count;
+    }
+
+    if (chunk->count == 0) {
+        shard->chunks_memory_usage -= sizeof(chunk_t)
+            + CHUNK_SIZE * (chunk->wide_infos.has()
+                            ? sizeof(index_block_info_t)
+                            : sizeof(compact_info_t));
+        delete chunk;
+        shard->chunks[chunk_id] = NULL;
+    } else {
+        set_in_chunk(shard, chunk, index, info);
+    }
+}
+
+size_t in_memory_index_t::memory_usage() const {
+    size_t total = sizeof(*this);
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        total += shards_[i].chunks.capacity() * sizeof(chunk_t *)
+            + shards_[i].chunks_memory_usage;
     }
+    return total;
+}
+
+index_block_info_t in_memory_index_t::get_from_chunk(const chunk_t *chunk,
+                                                     size_t index) {
+    if (chunk->wide_infos.has()) {
+        return chunk->wide_infos[index];
+    }
+
+    const compact_info_t &c = chunk->compact_infos[index];
+    repli_timestamp_t recency = repli_timestamp_t::invalid;
+    if (c.recency_delta != NO_RECENCY) {
+        recency.longtime = chunk->recency_base.longtime
+            + static_cast<int64_t>(c.recency_delta);
+    }
+    return index_block_info_t(
+        c.offset_units == 0
+            ? flagged_off64_t::unused()
+            : flagged_off64_t::make(
+                static_cast<int64_t>(c.offset_units - 1) * DEVICE_BLOCK_SIZE),
+        recency,
+        c.ser_block_size,
+        c.uncompressed_ser_block_size);
+}
+
+void in_memory_index_t::set_in_chunk(shard_t *shard, chunk_t *chunk, size_t index,
+                                     const index_block_info_t &info) {
+    if (!chunk->wide_infos.has()) {
+        if (!chunk->has_recency_base
+            && !(info.recency == repli_timestamp_t::invalid)) {
+            chunk->has_recency_base = true;
+            chunk->recency_base = info.recency;
+        }
+        if (compact(chunk, info, &chunk->compact_infos[index])) {
+            return;
+        }
+        widen(shard, chunk);
+    }
+    chunk->wide_infos[index] = info;
+}
 
-    index_block_info_t info(offset, recency, ser_block_size);
-    infos_.set(id, info);
+bool in_memory_index_t::compact(const chunk_t *chunk, const index_block_info_t &info,
+                                compact_info_t *out) {
+    compact_info_t c;
+
+    if (info.offset.has_value()) {
+        const int64_t offset = info.offset.get_value();
+        if (offset % DEVICE_BLOCK_SIZE != 0
+            || offset / DEVICE_BLOCK_SIZE >= static_cast<int64_t>(UINT32_MAX)) {
+            return false;
+        }
+        c.offset_units = offset / DEVICE_BLOCK_SIZE + 1;
+    } else if (!(info.offset == flagged_off64_t::unused())) {
+        return false;
+    }
+
+    if (!(info.recency == repli_timestamp_t::invalid)) {
+        rassert(chunk->has_recency_base);
+        const uint64_t base = chunk->recency_base.longtime;
+        const uint64_t recency = info.recency.longtime;
+        if (recency >= base) {
+            if (recency - base > static_cast<uint64_t>(INT32_MAX)) {
+                return false;
+            }
+            c.recency_delta = static_cast<int32_t>(recency - base);
+        } else {
+            // `-INT32_MAX` is the smallest delta, because INT32_MIN is NO_RECENCY.
+            if (base - recency > static_cast<uint64_t>(INT32_MAX)) {
+                return false;
+            }
+            c.recency_delta = -static_cast<int32_t>(base - recency);
+        }
+    }
+
+    if (info.ser_block_size > UINT16_MAX
+        || info.uncompressed_ser_block_size > UINT16_MAX) {
+        return false;
+    }
+    c.ser_block_size = info.ser_block_size;
+    c.uncompressed_ser_block_size = info.uncompressed_ser_block_size;
+
+    *out = c;
+    return true;
 }
 
+void in_memory_index_t::widen(shard_t *shard, chunk_t *chunk) {
+    rassert(!chunk->wide_infos.has());
+    scoped_array_t<index_block_info_t> wide_infos(CHUNK_SIZE);
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+        wide_infos[i] = get_from_chunk(chunk, i);
+    }
+    chunk->wide_infos = std::move(wide_infos);
+    chunk->compact_infos.reset();
+    shard->chunks_memory_usage -= CHUNK_SIZE * sizeof(compact_info_t);
+    shard->chunks_memory_usage += CHUNK_SIZE * sizeof(index_block_info_t);
+}
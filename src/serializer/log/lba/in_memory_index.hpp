@@ -2,8 +2,12 @@
 #ifndef SERIALIZER_LOG_LBA_IN_MEMORY_INDEX_HPP_
 #define SERIALIZER_LOG_LBA_IN_MEMORY_INDEX_HPP_
 
-#include "containers/two_level_array.hpp"
+#include <stdint.h>
+
+#include <vector>
+
 #include "config/args.hpp"
+#include "containers/scoped.hpp"
 #include "serializer/serializer.hpp"
 #include "serializer/log/lba/disk_format.hpp"
 
@@ -11,43 +15,124 @@ struct index_block_info_t {
     index_block_info_t()
         : offset(flagged_off64_t::unused()),
           recency(repli_timestamp_t::invalid),
-          ser_block_size(0) { }
+          ser_block_size(0),
+          uncompressed_ser_block_size(0) { }
 
     index_block_info_t(flagged_off64_t _offset,
                        repli_timestamp_t _recency,
-                       uint32_t _ser_block_size)
+                       uint32_t _ser_block_size,
+                       uint32_t _uncompressed_ser_block_size)
         : offset(_offset),
           recency(_recency),
-          ser_block_size(_ser_block_size) { }
+          ser_block_size(_ser_block_size),
+          uncompressed_ser_block_size(_uncompressed_ser_block_size) { }
 
-    // For two_level_array_t.
     bool operator==(const index_block_info_t &other) const {
         return offset == other.offset &&
             recency == other.recency &&
-            ser_block_size == other.ser_block_size;
+            ser_block_size == other.ser_block_size &&
+            uncompressed_ser_block_size == other.uncompressed_ser_block_size;
+    }
+
+    // The size of the block as seen by the cache (see `lba_entry_t`).
+    block_size_t block_size() const {
+        return block_size_t::unsafe_make(uncompressed_ser_block_size != 0
+                                         ? uncompressed_ser_block_size
+                                         : ser_block_size);
+    }
+
+    // The size the block takes up on disk.
+    block_size_t stored_block_size() const {
+        return block_size_t::unsafe_make(ser_block_size);
     }
 
     flagged_off64_t offset;
     repli_timestamp_t recency;
     uint32_t ser_block_size;
+    uint32_t uncompressed_ser_block_size;
 } __attribute__((__packed__));
 
 
 
+// The index is split into LBA_SHARD_FACTOR parts, in the same way as the LBA itself
+// (block `id` belongs to shard `id % LBA_SHARD_FACTOR`).  Calls to `set_block_info`
+// for block ids of different shards may run concurrently on different threads, which
+// is what lets us rebuild the shards in parallel at startup.
+//
+// Each shard is a two-level array of chunks, like `two_level_array_t`.  To save
+// memory, a chunk normally stores its entries as 12 byte `compact_info_t`s: offsets
+// in units of DEVICE_BLOCK_SIZE, recencies relative to a per-chunk base, and 16 bit
+// block sizes.  If an entry doesn't fit into that format, its chunk gets converted
+// to full `index_block_info_t`s.  Either way, lookups are a plain array access.
 class in_memory_index_t {
-    two_level_array_t<index_block_info_t> infos_;
-    block_id_t end_block_id_;
-
 public:
     in_memory_index_t();
+    ~in_memory_index_t();
 
     // end_block_id is one greater than the max block id.
     block_id_t end_block_id();
 
     index_block_info_t get_block_info(block_id_t id);
     void set_block_info(block_id_t id, repli_timestamp_t recency,
-                        flagged_off64_t offset, uint32_t ser_block_size);
+                        flagged_off64_t offset, uint32_t ser_block_size,
+                        uint32_t uncompressed_ser_block_size);
+
+    // The number of bytes that the index currently takes up in memory.  Must not be
+    // called while `set_block_info` runs on a different thread.
+    size_t memory_usage() const;
+
+    static const size_t CHUNK_SIZE = 1 << 14;
+
+private:
+    struct compact_info_t {
+        compact_info_t()
+            : offset_units(0), recency_delta(NO_RECENCY),
+              ser_block_size(0), uncompressed_ser_block_size(0) { }
+
+        // 0 if the offset is `flagged_off64_t::unused()`, otherwise the offset in
+        // units of DEVICE_BLOCK_SIZE, plus 1.
+        uint32_t offset_units;
+        // The recency relative to the chunk's `recency_base`, or NO_RECENCY if the
+        // recency is `repli_timestamp_t::invalid`.
+        int32_t recency_delta;
+        uint16_t ser_block_size;
+        uint16_t uncompressed_ser_block_size;
+    };
+    static const int32_t NO_RECENCY = INT32_MIN;
+
+    struct chunk_t {
+        chunk_t();
+
+        // The number of entries that are not `index_block_info_t()`.
+        size_t count;
+        // Set by the first entry with a valid recency.
+        bool has_recency_base;
+        repli_timestamp_t recency_base;
+        // Exactly one of these is allocated.
+        scoped_array_t<compact_info_t> compact_infos;
+        scoped_array_t<index_block_info_t> wide_infos;
+
+        DISABLE_COPYING(chunk_t);
+    };
+
+    struct shard_t {
+        shard_t() : end_block_id(0), chunks_memory_usage(0) { }
+
+        std::vector<chunk_t *> chunks;
+        block_id_t end_block_id;
+        size_t chunks_memory_usage;
+    };
+
+    static index_block_info_t get_from_chunk(const chunk_t *chunk, size_t index);
+    static void set_in_chunk(shard_t *shard, chunk_t *chunk, size_t index,
+                             const index_block_info_t &info);
+    static bool compact(const chunk_t *chunk, const index_block_info_t &info,
+                        compact_info_t *out);
+    static void widen(shard_t *shard, chunk_t *chunk);
+
+    shard_t shards_[LBA_SHARD_FACTOR];
 
+    DISABLE_COPYING(in_memory_index_t);
 };
 
 #endif  // SERIALIZER_LOG_LBA_IN_MEMORY_INDEX_HPP_
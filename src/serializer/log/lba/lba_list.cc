@@ -1,9 +1,13 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
 #include "serializer/log/lba/lba_list.hpp"
 
+#include <algorithm>
+
 #include "utils.hpp"
 #include "serializer/log/lba/disk_format.hpp"
 #include "arch/arch.hpp"
+#include "concurrency/cond_var.hpp"
+#include "math.hpp"
 #include "perfmon/perfmon.hpp"
 #include "serializer/log/stats.hpp"
 #include "arch/runtime/coroutines.hpp"
@@ -13,7 +17,8 @@
 lba_list_t::lba_list_t(extent_manager_t *em,
         const lba_list_t::write_metablock_fun_t &_write_metablock_fun)
     : gc_drainer(new auto_drainer_t), write_metablock_fun(_write_metablock_fun),
-      extent_manager(em), state(state_unstarted), inline_lba_entries_count(0)
+      extent_manager(em), state(state_unstarted), reported_index_memory_usage(0),
+      inline_lba_entries_count(0)
 {
     for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
         gc_active[i] = false;
@@ -59,8 +64,12 @@ public:
     lba_list_t *owner;
     lba_list_t::ready_callback_t *callback;
 
-    lba_start_fsm_t(lba_list_t *l, lba_list_t::metablock_mixin_t *last_metablock)
-        : owner(l), callback(NULL)
+    // True if the in-memory index has been loaded from a snapshot already.
+    bool index_loaded;
+
+    lba_start_fsm_t(lba_list_t *l, lba_list_t::metablock_mixin_t *last_metablock,
+                    bool _index_loaded)
+        : owner(l), callback(NULL), index_loaded(_index_loaded)
     {
         rassert(owner->state == lba_list_t::state_unstarted);
         owner->state = lba_list_t::state_starting_up;
@@ -85,9 +94,23 @@ public:
         rassert(cbs_out > 0);
         cbs_out--;
         if (cbs_out == 0) {
+            if (index_loaded) {
+                // The snapshot already includes the inline entries.
+                done();
+                return;
+            }
+
+            // The shards are independent of each other, so we apply them to the
+            // in-memory index on different threads.
+            const int num_threads = std::max(get_num_db_threads(), 1);
+            const int thread_offset = get_thread_id().threadnum;
             cbs_out = LBA_SHARD_FACTOR;
             for (int i = 0; i < LBA_SHARD_FACTOR; i++) {
-                owner->disk_structures[i]->read(&owner->in_memory_index, this);
+                const threadnum_t apply_thread = num_threads > 1
+                    ? threadnum_t((thread_offset + i) % num_threads)
+                    : get_thread_id();
+                owner->disk_structures[i]->read(&owner->in_memory_index, apply_thread,
+                                                this);
             }
         }
     }
@@ -105,24 +128,30 @@ public:
                         e->block_id,
                         e->recency,
                         e->offset,
-                        e->ser_block_size);
+                        e->ser_block_size,
+                        e->uncompressed_ser_block_size);
             }
 
-            owner->state = lba_list_t::state_ready;
-            if (callback) callback->on_lba_ready();
-            delete this;
+            done();
         }
     }
+
+    void done() {
+        owner->update_index_memory_stat();
+        owner->state = lba_list_t::state_ready;
+        if (callback) callback->on_lba_ready();
+        delete this;
+    }
 };
 
 bool lba_list_t::start_existing(file_t *file, metablock_mixin_t *last_metablock,
-        ready_callback_t *cb) {
+        bool index_loaded, ready_callback_t *cb) {
     rassert(state == state_unstarted);
 
     dbfile = file;
     gc_io_account.init(new file_account_t(dbfile, LBA_GC_IO_PRIORITY));
 
-    lba_start_fsm_t *starter = new lba_start_fsm_t(this, last_metablock);
+    lba_start_fsm_t *starter = new lba_start_fsm_t(this, last_metablock, index_loaded);
     if (state == state_ready) {
         return true;
     } else {
@@ -131,6 +160,166 @@ bool lba_list_t::start_existing(file_t *file, metablock_mixin_t *last_metablock,
     }
 }
 
+// Returns true if the snapshot header belongs to the given metablock.
+bool snapshot_matches(const lba_snapshot_header_t *header, int64_t metablock_version,
+                      const lba_list_t::metablock_mixin_t *last_metablock) {
+    if (memcmp(header->magic, lba_snapshot_magic, LBA_SNAPSHOT_MAGIC_SIZE) != 0
+        || header->metablock_version != metablock_version
+        || header->inline_lba_entries_count != last_metablock->inline_lba_entries_count
+        || header->entries_count < 0) {
+        return false;
+    }
+    for (int i = 0; i < LBA_SHARD_FACTOR; ++i) {
+        const lba_shard_metablock_t &a = header->shards[i];
+        const lba_shard_metablock_t &b = last_metablock->shards[i];
+        if (a.last_lba_extent_offset != b.last_lba_extent_offset
+            || a.last_lba_extent_entries_count != b.last_lba_extent_entries_count
+            || a.lba_superblock_offset != b.lba_superblock_offset
+            || a.lba_superblock_entries_count != b.lba_superblock_entries_count) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct snapshot_chunk_read_t : public linux_iocallback_t, public cond_t {
+    void on_io_complete() {
+        pulse();
+    }
+};
+
+bool lba_list_t::load_snapshot(file_t *snapshot_file, int64_t metablock_version,
+                               const metablock_mixin_t *last_metablock) {
+    rassert(state == state_unstarted);
+    rassert(coro_t::self());
+
+    const int64_t file_size = snapshot_file->get_file_size();
+    if (file_size < DEVICE_BLOCK_SIZE) {
+        return false;
+    }
+
+    int64_t entries_size;
+    {
+        scoped_malloc_t<lba_snapshot_header_t> header(
+            malloc_aligned(DEVICE_BLOCK_SIZE, DEVICE_BLOCK_SIZE));
+        co_read(snapshot_file, 0, DEVICE_BLOCK_SIZE, header.get(), DEFAULT_DISK_ACCOUNT);
+        if (!snapshot_matches(header.get(), metablock_version, last_metablock)) {
+            return false;
+        }
+        entries_size = ceil_aligned(header->entries_count * sizeof(lba_entry_t),
+                                    DEVICE_BLOCK_SIZE);
+        if (file_size < DEVICE_BLOCK_SIZE + entries_size) {
+            return false;
+        }
+    }
+
+    // We read the next chunk while we are putting the entries of the current one
+    // into the index.
+    const int64_t chunk_size = LBA_SNAPSHOT_CHUNK_SIZE;
+    scoped_malloc_t<lba_entry_t> chunks[2] = {
+        scoped_malloc_t<lba_entry_t>(malloc_aligned(chunk_size, DEVICE_BLOCK_SIZE)),
+        scoped_malloc_t<lba_entry_t>(malloc_aligned(chunk_size, DEVICE_BLOCK_SIZE))
+    };
+    scoped_ptr_t<snapshot_chunk_read_t> reads[2];
+    int64_t read_pos = 0;
+    int64_t lengths[2];
+    auto start_read = [&](int i) {
+        lengths[i] = std::min(chunk_size, entries_size - read_pos);
+        reads[i].init(new snapshot_chunk_read_t);
+        snapshot_file->read_async(DEVICE_BLOCK_SIZE + read_pos, lengths[i],
+                                  chunks[i].get(), DEFAULT_DISK_ACCOUNT, reads[i].get());
+        read_pos += lengths[i];
+    };
+
+    if (entries_size > 0) {
+        start_read(0);
+    }
+    for (int current = 0; reads[current].has(); current = 1 - current) {
+        reads[current]->wait();
+        if (read_pos < entries_size) {
+            start_read(1 - current);
+        }
+
+        const lba_entry_t *entries = chunks[current].get();
+        for (int64_t i = 0; i < lengths[current] / static_cast<int64_t>(sizeof(lba_entry_t)); ++i) {
+            const lba_entry_t *e = &entries[i];
+            if (!lba_entry_t::is_padding(e)) {
+                in_memory_index.set_block_info(e->block_id, e->recency, e->offset,
+                                               e->ser_block_size,
+                                               e->uncompressed_ser_block_size);
+            }
+        }
+        reads[current].reset();
+    }
+
+    return true;
+}
+
+void lba_list_t::write_snapshot(file_t *snapshot_file, int64_t metablock_version) {
+    rassert(state == state_ready || state == state_gc_shutting_down);
+    rassert(coro_t::self());
+
+    const block_id_t end_id = end_block_id();
+    int64_t entries_count = 0;
+    for (block_id_t id = 0; id < end_id; ++id) {
+        if (!(in_memory_index.get_block_info(id) == index_block_info_t())) {
+            ++entries_count;
+        }
+    }
+    const int64_t entries_size = ceil_aligned(entries_count * sizeof(lba_entry_t),
+                                              DEVICE_BLOCK_SIZE);
+    snapshot_file->set_file_size(DEVICE_BLOCK_SIZE + entries_size);
+
+    // We clear the old header first and write the new one last, so that a snapshot
+    // that didn't get written completely never matches a metablock.
+    scoped_malloc_t<lba_snapshot_header_t> header(
+        malloc_aligned(DEVICE_BLOCK_SIZE, DEVICE_BLOCK_SIZE));
+    memset(header.get(), 0, DEVICE_BLOCK_SIZE);
+    co_write(snapshot_file, 0, DEVICE_BLOCK_SIZE, header.get(), DEFAULT_DISK_ACCOUNT,
+             file_t::WRAP_IN_DATASYNCS);
+
+    const int64_t chunk_size = LBA_SNAPSHOT_CHUNK_SIZE;
+    const int64_t entries_per_chunk = chunk_size / sizeof(lba_entry_t);
+    scoped_malloc_t<lba_entry_t> chunk(malloc_aligned(chunk_size, DEVICE_BLOCK_SIZE));
+    int64_t write_pos = 0;
+    int64_t num_in_chunk = 0;
+    auto flush_chunk = [&]() {
+        while ((num_in_chunk * sizeof(lba_entry_t)) % DEVICE_BLOCK_SIZE != 0) {
+            chunk.get()[num_in_chunk++] = lba_entry_t::make_padding_entry();
+        }
+        const int64_t length = num_in_chunk * sizeof(lba_entry_t);
+        co_write(snapshot_file, DEVICE_BLOCK_SIZE + write_pos, length, chunk.get(),
+                 DEFAULT_DISK_ACCOUNT, file_t::NO_DATASYNCS);
+        write_pos += length;
+        num_in_chunk = 0;
+    };
+    for (block_id_t id = 0; id < end_id; ++id) {
+        const index_block_info_t info = in_memory_index.get_block_info(id);
+        if (!(info == index_block_info_t())) {
+            chunk.get()[num_in_chunk++] = lba_entry_t::make(
+                id, info.recency, info.offset, info.ser_block_size,
+                info.uncompressed_ser_block_size);
+            if (num_in_chunk == entries_per_chunk) {
+                flush_chunk();
+            }
+        }
+    }
+    if (num_in_chunk > 0) {
+        flush_chunk();
+    }
+    guarantee(write_pos == entries_size);
+
+    metablock_mixin_t metablock;
+    prepare_metablock(&metablock);
+    memcpy(header->magic, lba_snapshot_magic, LBA_SNAPSHOT_MAGIC_SIZE);
+    header->metablock_version = metablock_version;
+    memcpy(header->shards, metablock.shards, sizeof(header->shards));
+    header->inline_lba_entries_count = metablock.inline_lba_entries_count;
+    header->entries_count = entries_count;
+    co_write(snapshot_file, 0, DEVICE_BLOCK_SIZE, header.get(), DEFAULT_DISK_ACCOUNT,
+             file_t::WRAP_IN_DATASYNCS);
+}
+
 block_id_t lba_list_t::end_block_id() {
     rassert(state == state_ready || state == state_gc_shutting_down);
 
@@ -151,7 +340,11 @@ uint32_t lba_list_t::get_ser_block_size(block_id_t block) {
 }
 
 block_size_t lba_list_t::get_block_size(block_id_t block) {
-    return block_size_t::unsafe_make(get_block_info(block).ser_block_size);
+    return get_block_info(block).block_size();
+}
+
+block_size_t lba_list_t::get_stored_block_size(block_id_t block) {
+    return get_block_info(block).stored_block_size();
 }
 
 repli_timestamp_t lba_list_t::get_block_recency(block_id_t block) {
@@ -180,10 +373,13 @@ segmented_vector_t<repli_timestamp_t> lba_list_t::get_block_recencies(block_id_t
 
 void lba_list_t::set_block_info(block_id_t block, repli_timestamp_t recency,
                                 flagged_off64_t offset, uint32_t ser_block_size,
+                                uint32_t uncompressed_ser_block_size,
                                 file_account_t *io_account, extent_transaction_t *txn) {
     rassert(state == state_ready || state == state_gc_shutting_down);
 
-    in_memory_index.set_block_info(block, recency, offset, ser_block_size);
+    in_memory_index.set_block_info(block, recency, offset, ser_block_size,
+                                   uncompressed_ser_block_size);
+    update_index_memory_stat();
 
     // If the inline LBA is full, free it up first by moving its entries to
     // the LBA extents
@@ -192,7 +388,8 @@ void lba_list_t::set_block_info(block_id_t block, repli_timestamp_t recency,
         rassert(!check_inline_lba_full());
     }
     // Then store the entry inline
-    add_inline_entry(block, recency, offset, ser_block_size);
+    add_inline_entry(block, recency, offset, ser_block_size,
+                     uncompressed_ser_block_size);
 }
 
 bool lba_list_t::check_inline_lba_full() const {
@@ -230,6 +427,7 @@ void lba_list_t::move_inline_entries_to_extents(file_account_t *io_account, exte
                 e.recency,
                 e.offset,
                 e.ser_block_size,
+                e.uncompressed_ser_block_size,
                 io_account,
                 txn);
     }
@@ -238,11 +436,13 @@ void lba_list_t::move_inline_entries_to_extents(file_account_t *io_account, exte
 }
 
 void lba_list_t::add_inline_entry(block_id_t block, repli_timestamp_t recency,
-                                flagged_off64_t offset, uint32_t ser_block_size) {
+                                flagged_off64_t offset, uint32_t ser_block_size,
+                                uint32_t uncompressed_ser_block_size) {
 
     rassert(!check_inline_lba_full());
     inline_lba_entries[inline_lba_entries_count++] =
-            lba_entry_t::make(block, recency, offset, ser_block_size);
+            lba_entry_t::make(block, recency, offset, ser_block_size,
+                              uncompressed_ser_block_size);
 }
 
 class lba_syncer_t :
@@ -318,11 +518,12 @@ void lba_list_t::gc(int lba_shard, auto_drainer_t::lock_t) {
     for (block_id_t id = lba_shard; id < end_id; id += LBA_SHARD_FACTOR) {
         flagged_off64_t off = get_block_offset(id);
         if (off.has_value()) {
-            uint32_t ser_block_size = get_ser_block_size(id);
+            const index_block_info_t info = get_block_info(id);
             disk_structures[lba_shard]->add_entry(id,
-                                                  get_block_recency(id),
+                                                  info.recency,
                                                   off,
-                                                  ser_block_size,
+                                                  info.ser_block_size,
+                                                  info.uncompressed_ser_block_size,
                                                   gc_io_account.get(),
                                                   txns.back().get());
         }
@@ -462,4 +663,12 @@ void lba_list_t::shutdown() {
 lba_list_t::~lba_list_t() {
     rassert(state == state_unstarted || state == state_shut_down);
     for (int i = 0; i < LBA_SHARD_FACTOR; i++) rassert(disk_structures[i] == NULL);
+    extent_manager->stats->pm_serializer_lba_index_bytes -= reported_index_memory_usage;
+}
+
+void lba_list_t::update_index_memory_stat() {
+    const int64_t usage = in_memory_index.memory_usage();
+    extent_manager->stats->pm_serializer_lba_index_bytes +=
+        usage - reported_index_memory_usage;
+    reported_index_memory_usage = usage;
 }
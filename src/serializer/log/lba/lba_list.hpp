@@ -37,15 +37,31 @@ public:
         virtual void on_lba_ready() = 0;
         virtual ~ready_callback_t() {}
     };
+    // If `index_loaded` is true, the in-memory index has already been filled in by
+    // `load_snapshot()`, and only the on-disk structures get loaded.
     bool start_existing(file_t *dbfile, metablock_mixin_t *last_metablock,
-                        ready_callback_t *cb);
+                        bool index_loaded, ready_callback_t *cb);
+
+    // Fills in the in-memory index from a snapshot file that was written by
+    // `write_snapshot()`, if the snapshot matches `metablock_version` and
+    // `last_metablock`.  Returns false (and leaves the index empty) otherwise.  Must
+    // be called before `start_existing()`, in a coroutine.
+    bool load_snapshot(file_t *snapshot_file, int64_t metablock_version,
+                       const metablock_mixin_t *last_metablock);
+    // Writes the in-memory index to `snapshot_file`.  No index writes may happen
+    // while this runs, and `metablock_version` must be the version of the last
+    // metablock that was written.
+    void write_snapshot(file_t *snapshot_file, int64_t metablock_version);
 
     index_block_info_t get_block_info(block_id_t block);
 
     // These return individual fields of get_block_info.
     flagged_off64_t get_block_offset(block_id_t block);
     uint32_t get_ser_block_size(block_id_t block);
+    // The size of the block as seen by the cache, and the (possibly compressed)
+    // size it takes up on disk.
     block_size_t get_block_size(block_id_t block);
+    block_size_t get_stored_block_size(block_id_t block);
     repli_timestamp_t get_block_recency(block_id_t block);
     segmented_vector_t<repli_timestamp_t> get_block_recencies(block_id_t first,
                                                               block_id_t step);
@@ -62,6 +78,7 @@ public:
 
     void set_block_info(block_id_t block, repli_timestamp_t recency,
                         flagged_off64_t offset, uint32_t ser_block_size,
+                        uint32_t uncompressed_ser_block_size,
                         file_account_t *io_account,
                         extent_transaction_t *txn);
 
@@ -106,6 +123,10 @@ private:
     scoped_ptr_t<file_account_t> gc_io_account;
 
     in_memory_index_t in_memory_index;
+    // How much of `in_memory_index.memory_usage()` we have added to the
+    // `pm_serializer_lba_index_bytes` stat.
+    int64_t reported_index_memory_usage;
+    void update_index_memory_stat();
 
     // This is a set of inlined LBA entries which are written directly into the
     // metablock. When the array gets full, all inlined LBA entries are moved
@@ -116,7 +137,8 @@ private:
     bool check_inline_lba_full() const;
     void move_inline_entries_to_extents(file_account_t *io_account, extent_transaction_t *txn);
     void add_inline_entry(block_id_t block, repli_timestamp_t recency,
-                                flagged_off64_t offset, uint32_t ser_block_size);
+                                flagged_off64_t offset, uint32_t ser_block_size,
+                                uint32_t uncompressed_ser_block_size);
 
     lba_disk_structure_t *disk_structures[LBA_SHARD_FACTOR];
 
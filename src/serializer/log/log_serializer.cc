@@ -7,6 +7,7 @@
 #include <unistd.h>
 
 #include <functional>
+#include <string>
 
 #include "arch/io/disk.hpp"
 #include "arch/runtime/runtime.hpp"
@@ -17,6 +18,7 @@
 #include "perfmon/perfmon.hpp"
 #include "serializer/buf_ptr.hpp"
 #include "serializer/log/data_block_manager.hpp"
+#include "time.hpp"
 
 filepath_file_opener_t::filepath_file_opener_t(const serializer_filepath_t &filepath,
                                                io_backender_t *backender)
@@ -87,6 +89,12 @@ void filepath_file_opener_t::open_serializer_file_existing(scoped_ptr_t<file_t>
     open_serializer_file(current_file_name(), 0, file_out);
 }
 
+void filepath_file_opener_t::open_lba_snapshot_file(scoped_ptr_t<file_t> *file_out) {
+    mutex_assertion_t::acq_t acq(&reentrance_mutex_);
+    open_serializer_file(lba_snapshot_file_name(filepath_), linux_file_t::mode_create,
+                         file_out);
+}
+
 void filepath_file_opener_t::unlink_serializer_file() {
     // TODO: Make caller not require that this not block, run ::unlink in a blocker pool.
     ASSERT_NO_CORO_WAITING;
@@ -97,6 +105,10 @@ void filepath_file_opener_t::unlink_serializer_file() {
     guarantee_err(res == 0, "unlink() failed");
 }
 
+std::string lba_snapshot_file_name(const serializer_filepath_t &filepath) {
+    return filepath.permanent_path() + "_lba_snapshot";
+}
+
 #ifdef SEMANTIC_SERIALIZER_CHECK
 void filepath_file_opener_t::open_semantic_checking_file(scoped_ptr_t<semantic_checking_file_t> *file_out) {
     const std::string semantic_filepath = filepath_.permanent_path() + "_semantic";
@@ -135,7 +147,13 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
       pm_serializer_data_extents_gced(),
       pm_serializer_old_garbage_block_bytes(),
       pm_serializer_old_total_block_bytes(),
+      pm_serializer_compressed_blocks(),
+      pm_serializer_compression_input_bytes(),
+      pm_serializer_compression_output_bytes(),
+      pm_serializer_compression_ticks(),
+      pm_serializer_decompression_ticks(),
       pm_serializer_lba_gcs(),
+      pm_serializer_lba_index_bytes(),
       parent_collection_membership(parent, &serializer_collection, "serializer"),
       stats_membership(&serializer_collection,
           &pm_serializer_block_reads, "serializer_block_reads",
@@ -155,7 +173,13 @@ log_serializer_stats_t::log_serializer_stats_t(perfmon_collection_t *parent)
           &pm_serializer_data_extents_gced, "serializer_data_extents_gced",
           &pm_serializer_old_garbage_block_bytes, "serializer_old_garbage_block_bytes",
           &pm_serializer_old_total_block_bytes, "serializer_old_total_block_bytes",
-          &pm_serializer_lba_gcs, "serializer_lba_gcs")
+          &pm_serializer_compressed_blocks, "serializer_compressed_blocks",
+          &pm_serializer_compression_input_bytes, "serializer_compression_input_bytes",
+          &pm_serializer_compression_output_bytes, "serializer_compression_output_bytes",
+          &pm_serializer_compression_ticks, "serializer_compression_ticks",
+          &pm_serializer_decompression_ticks, "serializer_decompression_ticks",
+          &pm_serializer_lba_gcs, "serializer_lba_gcs",
+          &pm_serializer_lba_index_bytes, "serializer_lba_index_bytes")
 { }
 
 void log_serializer_stats_t::bytes_read(size_t count) {
@@ -199,7 +223,8 @@ struct ls_start_existing_fsm_t :
     public thread_message_t
 {
     explicit ls_start_existing_fsm_t(log_serializer_t *serializer)
-        : ser(serializer), start_existing_state(state_start) {
+        : ser(serializer), start_existing_state(state_start),
+          lba_index_loaded_from_snapshot(false) {
     }
 
     ~ls_start_existing_fsm_t() {
@@ -211,9 +236,15 @@ struct ls_start_existing_fsm_t :
         rassert(ser->state == log_serializer_t::state_unstarted);
         ser->state = log_serializer_t::state_starting_up;
 
+        start_ticks = get_ticks();
+        file_name = file_opener->file_name();
+
         scoped_ptr_t<file_t> dbfile;
         file_opener->open_serializer_file_existing(&dbfile);
         ser->dbfile = dbfile.release();
+        if (ser->dynamic_config.lba_snapshot) {
+            file_opener->open_lba_snapshot_file(&ser->lba_snapshot_file);
+        }
         ser->index_writes_io_account.init(
             new file_account_t(ser->dbfile, INDEX_WRITE_IO_PRIORITY));
 
@@ -281,9 +312,21 @@ struct ls_start_existing_fsm_t :
         if (start_existing_state == state_start_lba) {
             // STATE G
             guarantee(metablock_found, "Could not find any valid metablock.");
+            metablock_ticks = get_ticks();
 
+            if (ser->lba_snapshot_file.has()) {
+                start_existing_state = state_waiting_for_lba_snapshot;
+                coro_t::spawn_sometime(
+                    std::bind(&ls_start_existing_fsm_t::load_lba_snapshot, this));
+                return false;
+            }
+            start_existing_state = state_start_lba_index;
+        }
+
+        if (start_existing_state == state_start_lba_index) {
             // STATE H
-            if (ser->lba_index->start_existing(ser->dbfile, &metablock_buffer.lba_index_part, this)) {
+            if (ser->lba_index->start_existing(ser->dbfile, &metablock_buffer.lba_index_part,
+                                               lba_index_loaded_from_snapshot, this)) {
                 start_existing_state = state_reconstruct;
                 // STATE J
             } else {
@@ -295,6 +338,7 @@ struct ls_start_existing_fsm_t :
         }
 
         if (start_existing_state == state_reconstruct) {
+            lba_ticks = get_ticks();
             ser->data_block_manager->start_reconstruct();
             start_existing_state = state_reconstruct_ongoing;
             num_blocks_reconstructed = 0;
@@ -307,7 +351,8 @@ struct ls_start_existing_fsm_t :
                 flagged_off64_t offset = ser->lba_index->get_block_offset(num_blocks_reconstructed);
                 if (offset.has_value()) {
                     ser->data_block_manager->mark_live(offset.get_value(),
-                        ser->lba_index->get_block_size(num_blocks_reconstructed));
+                        ser->lba_index->get_block_size(num_blocks_reconstructed),
+                        ser->lba_index->get_stored_block_size(num_blocks_reconstructed));
                 }
                 ++batch;
                 if (batch >= LBA_RECONSTRUCTION_BATCH_SIZE) {
@@ -320,6 +365,16 @@ struct ls_start_existing_fsm_t :
 
             ser->extent_manager->start_existing(&metablock_buffer.extent_manager_part);
 
+            const ticks_t end_ticks = get_ticks();
+            logINF("Loaded the index of %s in %.3fs (metablock %.3fs, LBA %.3fs%s, "
+                   "reconstruction %.3fs).",
+                   file_name.c_str(),
+                   ticks_to_secs(end_ticks - start_ticks),
+                   ticks_to_secs(metablock_ticks - start_ticks),
+                   ticks_to_secs(lba_ticks - metablock_ticks),
+                   lba_index_loaded_from_snapshot ? " from snapshot" : "",
+                   ticks_to_secs(end_ticks - lba_ticks));
+
             start_existing_state = state_finish;
         }
 
@@ -353,6 +408,16 @@ struct ls_start_existing_fsm_t :
         next_starting_up_step();
     }
 
+    void load_lba_snapshot() {
+        rassert(start_existing_state == state_waiting_for_lba_snapshot);
+        lba_index_loaded_from_snapshot = ser->lba_index->load_snapshot(
+            ser->lba_snapshot_file.get(),
+            ser->metablock_manager->current_version(),
+            &metablock_buffer.lba_index_part);
+        start_existing_state = state_start_lba_index;
+        next_starting_up_step();
+    }
+
     void on_lba_ready() {
         rassert(start_existing_state == state_waiting_for_lba);
         start_existing_state = state_reconstruct;
@@ -375,6 +440,8 @@ struct ls_start_existing_fsm_t :
         state_find_metablock,
         state_waiting_for_metablock,
         state_start_lba,
+        state_waiting_for_lba_snapshot,
+        state_start_lba_index,
         state_waiting_for_lba,
         state_reconstruct,
         state_reconstruct_ongoing,
@@ -389,6 +456,15 @@ struct ls_start_existing_fsm_t :
     bool metablock_found;
     log_serializer_t::metablock_t metablock_buffer;
 
+    // True if the in-memory LBA index came from the snapshot file.
+    bool lba_index_loaded_from_snapshot;
+
+    // For the startup timings that we log once we are done.
+    std::string file_name;
+    ticks_t start_ticks;
+    ticks_t metablock_ticks;
+    ticks_t lba_ticks;
+
 private:
     DISABLE_COPYING(ls_start_existing_fsm_t);
 };
@@ -445,7 +521,7 @@ buf_ptr_t log_serializer_t::block_read(const counted_t<ls_block_token_pointee_t>
     stats->pm_serializer_block_reads.begin(&pm_time);
 
     buf_ptr_t ret = data_block_manager->read(token->offset_, token->block_size(),
-                                           io_account);
+                                             token->stored_block_size(), io_account);
 
     stats->pm_serializer_block_reads.end(&pm_time);
     return ret;
@@ -490,8 +566,10 @@ void log_serializer_t::index_write(new_mutex_in_line_t *mutex_acq,
              write_op_it != write_ops.end();
              ++write_op_it) {
             const index_write_op_t &op = *write_op_it;
-            flagged_off64_t offset = lba_index->get_block_offset(op.block_id);
-            uint32_t ser_block_size = lba_index->get_ser_block_size(op.block_id);
+            const index_block_info_t old_info = lba_index->get_block_info(op.block_id);
+            flagged_off64_t offset = old_info.offset;
+            uint32_t ser_block_size = old_info.ser_block_size;
+            uint32_t uncompressed_ser_block_size = old_info.uncompressed_ser_block_size;
 
             if (op.token) {
                 // Update the offset pointed to, and mark garbage/liveness as necessary.
@@ -506,13 +584,19 @@ void log_serializer_t::index_write(new_mutex_in_line_t *mutex_acq,
                 // Write new token to index, or remove from index as appropriate.
                 if (token.has()) {
                     offset = flagged_off64_t::make(token->offset_);
-                    ser_block_size = token->block_size().ser_value();
+                    ser_block_size = token->stored_block_size().ser_value();
+                    uncompressed_ser_block_size
+                        = token->stored_block_size() != token->block_size()
+                        ? token->block_size().ser_value()
+                        : 0;
 
                     /* mark the life */
-                    data_block_manager->mark_live(offset.get_value(), token->block_size());
+                    data_block_manager->mark_live(offset.get_value(), token->block_size(),
+                                                  token->stored_block_size());
                 } else {
                     offset = flagged_off64_t::unused();
                     ser_block_size = 0;
+                    uncompressed_ser_block_size = 0;
                 }
             }
 
@@ -521,6 +605,7 @@ void log_serializer_t::index_write(new_mutex_in_line_t *mutex_acq,
 
             lba_index->set_block_info(op.block_id, recency,
                                       offset, ser_block_size,
+                                      uncompressed_ser_block_size,
                                       index_writes_io_account.get(), &txn);
         }
     }
@@ -631,9 +716,11 @@ void log_serializer_t::write_metablock_sans_pipelining(const signal_t *safe_to_w
 }
 
 counted_t<ls_block_token_pointee_t>
-log_serializer_t::generate_block_token(int64_t offset, block_size_t block_size) {
+log_serializer_t::generate_block_token(int64_t offset, block_size_t block_size,
+                                       block_size_t stored_block_size) {
     assert_thread();
-    counted_t<ls_block_token_pointee_t> ret(new ls_block_token_pointee_t(this, offset, block_size));
+    counted_t<ls_block_token_pointee_t> ret(
+        new ls_block_token_pointee_t(this, offset, block_size, stored_block_size));
     return ret;
 }
 
@@ -770,7 +857,8 @@ counted_t<ls_block_token_pointee_t> log_serializer_t::index_read(block_id_t bloc
 
     index_block_info_t info = lba_index->get_block_info(block_id);
     if (info.offset.has_value()) {
-        return generate_block_token(info.offset.get_value(), block_size_t::unsafe_make(info.ser_block_size));
+        return generate_block_token(info.offset.get_value(), info.block_size(),
+                                    info.stored_block_size());
     } else {
         return counted_t<ls_block_token_pointee_t>();
     }
@@ -852,6 +940,16 @@ void log_serializer_t::next_shutdown_step() {
     rassert(expecting_no_more_tokens);
 
     if (shutdown_state == shutdown_waiting_on_block_tokens) {
+        shutdown_state = shutdown_waiting_on_lba_snapshot;
+        if (lba_snapshot_file.has()) {
+            coro_t::spawn_sometime(
+                std::bind(&log_serializer_t::write_lba_snapshot_and_continue_shutdown,
+                          this));
+            return;
+        }
+    }
+
+    if (shutdown_state == shutdown_waiting_on_lba_snapshot) {
         lba_index->shutdown();
         metablock_manager->shutdown();
         extent_manager->shutdown();
@@ -888,6 +986,15 @@ void log_serializer_t::next_shutdown_step() {
     unreachable("Invalid state.");
 }
 
+void log_serializer_t::write_lba_snapshot_and_continue_shutdown() {
+    // Nothing writes to the serializer anymore, so the index matches the last
+    // metablock.
+    lba_index->write_snapshot(lba_snapshot_file.get(),
+                              metablock_manager->current_version());
+    lba_snapshot_file.reset();
+    next_shutdown_step();
+}
+
 void log_serializer_t::delete_dbfile_and_continue_shutdown() {
     index_writes_io_account.reset();
     rassert(dbfile != NULL);
@@ -953,11 +1060,19 @@ bool log_serializer_t::should_perform_read_ahead() {
     return dynamic_config.read_ahead && !read_ahead_callbacks.empty();
 }
 
+block_compression_t log_serializer_t::block_compression() const {
+    return dynamic_config.block_compression;
+}
+
 ls_block_token_pointee_t::ls_block_token_pointee_t(log_serializer_t *serializer,
                                                    int64_t initial_offset,
-                                                   block_size_t initial_block_size)
+                                                   block_size_t initial_block_size,
+                                                   block_size_t initial_stored_block_size)
     : serializer_(serializer), ref_count_(0),
-      block_size_(initial_block_size), offset_(initial_offset) {
+      block_size_(initial_block_size),
+      stored_block_size_(initial_stored_block_size),
+      offset_(initial_offset) {
+    rassert(stored_block_size_.ser_value() <= block_size_.ser_value());
     serializer_->assert_thread();
     serializer_->register_block_token(this, initial_offset);
 }
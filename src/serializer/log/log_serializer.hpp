@@ -69,6 +69,7 @@ public:
     void open_serializer_file_create_temporary(scoped_ptr_t<file_t> *file_out);
     void move_serializer_file_to_permanent_location();
     void open_serializer_file_existing(scoped_ptr_t<file_t> *file_out);
+    void open_lba_snapshot_file(scoped_ptr_t<file_t> *file_out);
     void unlink_serializer_file();
 #ifdef SEMANTIC_SERIALIZER_CHECK
     void open_semantic_checking_file(scoped_ptr_t<semantic_checking_file_t> *file_out);
@@ -101,6 +102,10 @@ private:
     DISABLE_COPYING(filepath_file_opener_t);
 };
 
+// The file that `filepath_file_opener_t::open_lba_snapshot_file()` opens.  It needs
+// to be removed together with the serializer file.
+std::string lba_snapshot_file_name(const serializer_filepath_t &filepath);
+
 
 // Used internally
 struct ls_start_existing_fsm_t;
@@ -171,7 +176,9 @@ private:
     void unregister_block_token(ls_block_token_pointee_t *token);
     void remap_block_to_new_offset(int64_t current_offset, int64_t new_offset);
     counted_t<ls_block_token_pointee_t> generate_block_token(int64_t offset,
-                                                             block_size_t block_size);
+                                                             block_size_t block_size,
+                                                             block_size_t stored_block_size);
+    block_compression_t block_compression() const;
 
     void offer_buf_to_read_ahead_callbacks(
             block_id_t block_id,
@@ -191,6 +198,7 @@ private:
     void shutdown(cond_t *cb);
     void next_shutdown_step();
 
+    void write_lba_snapshot_and_continue_shutdown();
     void delete_dbfile_and_continue_shutdown();
 
     virtual void on_datablock_manager_shutdown();
@@ -241,6 +249,7 @@ private:
         shutdown_waiting_on_serializer,
         shutdown_waiting_on_datablock_manager,
         shutdown_waiting_on_block_tokens,
+        shutdown_waiting_on_lba_snapshot,
         shutdown_waiting_on_dbfile_destruction,
     } shutdown_state;
 
@@ -255,6 +264,9 @@ private:
     file_t *dbfile;
     scoped_ptr_t<file_account_t> index_writes_io_account;
 
+    // Only open if `dynamic_config.lba_snapshot` is set.
+    scoped_ptr_t<file_t> lba_snapshot_file;
+
     extent_manager_t *extent_manager;
     mb_manager_t *metablock_manager;
     lba_list_t *lba_index;
@@ -104,6 +104,10 @@ public:
 
     void read_next_metablock();
 
+    /* The version of the metablock that was found by `start_existing()`, or of the
+    last one that has been written since. */
+    metablock_version_t current_version() const { return next_version_number - 1; }
+
 private:
     struct head_t {
     private:
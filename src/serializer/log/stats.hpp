@@ -35,9 +35,15 @@ struct log_serializer_stats_t {
     perfmon_counter_t pm_serializer_data_extents_gced;
     perfmon_counter_t pm_serializer_old_garbage_block_bytes;
     perfmon_counter_t pm_serializer_old_total_block_bytes;
+    perfmon_counter_t pm_serializer_compressed_blocks;
+    perfmon_counter_t pm_serializer_compression_input_bytes;
+    perfmon_counter_t pm_serializer_compression_output_bytes;
+    perfmon_counter_t pm_serializer_compression_ticks;
+    perfmon_counter_t pm_serializer_decompression_ticks;
 
     /* used in serializer/log/lba/lba_list.cc */
     perfmon_counter_t pm_serializer_lba_gcs;
+    perfmon_counter_t pm_serializer_lba_index_bytes;
 
     perfmon_membership_t parent_collection_membership;
     perfmon_multi_membership_t stats_membership;
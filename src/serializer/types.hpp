@@ -121,6 +121,7 @@ class ls_block_token_pointee_t {
 public:
     int64_t offset() const { return offset_; }
     block_size_t block_size() const { return block_size_; }
+    block_size_t stored_block_size() const { return stored_block_size_; }
 
 private:
     friend class log_serializer_t;
@@ -131,7 +132,8 @@ private:
 
     ls_block_token_pointee_t(log_serializer_t *serializer,
                              int64_t initial_offset,
-                             block_size_t initial_ser_block_size);
+                             block_size_t initial_ser_block_size,
+                             block_size_t initial_stored_block_size);
 
     log_serializer_t *serializer_;
     intptr_t ref_count_;
@@ -139,6 +141,10 @@ private:
     // The block's size.
     block_size_t block_size_;
 
+    // The size the block takes up on disk.  This is smaller than `block_size_` iff
+    // the block is stored compressed.
+    block_size_t stored_block_size_;
+
     // The block's offset on disk.
     int64_t offset_;
 
@@ -172,6 +178,9 @@ public:
     virtual void open_serializer_file_create_temporary(scoped_ptr_t<file_t> *file_out) = 0;
     virtual void move_serializer_file_to_permanent_location() = 0;
     virtual void open_serializer_file_existing(scoped_ptr_t<file_t> *file_out) = 0;
+    // Opens (creating it if necessary) the file that holds the snapshot of the LBA
+    // index, next to the serializer file.
+    virtual void open_lba_snapshot_file(scoped_ptr_t<file_t> *file_out) = 0;
     virtual void unlink_serializer_file() = 0;
 #ifdef SEMANTIC_SERIALIZER_CHECK
     virtual void open_semantic_checking_file(scoped_ptr_t<semantic_checking_file_t> *file_out) = 0;
@@ -0,0 +1,108 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "containers/archive/string_stream.hpp"
+#include "containers/archive/varint.hpp"
+#include "protob/binary_shim.hpp"
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/error.hpp"
+#include "rdb_protocol/ql2.pb.h"
+#include "rdb_protocol/serialize_datum.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+std::string encode_response(const Response &response) {
+    write_message_t wm;
+    binary_shim::write_binary_pb(response, &wm);
+    string_stream_t stream;
+    int res = send_write_message(&stream, &wm);
+    guarantee(res == 0);
+    return std::move(stream.str());
+}
+
+void expect_header(read_stream_t *s, int32_t type, int32_t error_type) {
+    int32_t type_out, error_type_out;
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_universal(s, &type_out));
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_universal(s, &error_type_out));
+    EXPECT_EQ(type, type_out);
+    EXPECT_EQ(error_type, error_type_out);
+}
+
+ql::datum_t read_datum(read_stream_t *s) {
+    ql::datum_t d;
+    archive_result_t res = ql::datum_deserialize(s, &d);
+    guarantee(res == archive_result_t::SUCCESS);
+    return d;
+}
+
+TEST(BinaryShimTest, SuccessSequence) {
+    ql::datum_object_builder_t builder;
+    builder.overwrite("id", ql::datum_t(1.0));
+    builder.overwrite("name", ql::datum_t("a name"));
+    const ql::datum_t object = std::move(builder).to_datum();
+    const ql::datum_t number(-12.5);
+
+    Response response;
+    response.set_token(7);
+    response.set_type(Response::SUCCESS_PARTIAL);
+    response.add_notes(Response::SEQUENCE_FEED);
+    object.write_to_protobuf(response.add_response(), ql::use_json_t::BINARY);
+    number.write_to_protobuf(response.add_response(), ql::use_json_t::BINARY);
+    ASSERT_EQ(Datum::R_DATUM, response.response(0).type());
+
+    const std::string encoded = encode_response(response);
+    string_read_stream_t s(std::string(encoded), 0);
+    expect_header(&s, Response::SUCCESS_PARTIAL, 0);
+
+    uint64_t count;
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_varint_uint64(&s, &count));
+    ASSERT_EQ(2u, count);
+    EXPECT_EQ(object, read_datum(&s));
+    EXPECT_EQ(number, read_datum(&s));
+
+    uint64_t note;
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_varint_uint64(&s, &count));
+    ASSERT_EQ(1u, count);
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_varint_uint64(&s, &note));
+    EXPECT_EQ(static_cast<uint64_t>(Response::SEQUENCE_FEED), note);
+
+    EXPECT_EQ(ql::datum_t::null(), read_datum(&s));
+    EXPECT_EQ(ql::datum_t::null(), read_datum(&s));
+    char c;
+    EXPECT_EQ(0, s.read(&c, 1));
+}
+
+TEST(BinaryShimTest, RuntimeError) {
+    Response response;
+    response.set_token(1);
+    response.set_type(Response::RUNTIME_ERROR);
+    response.set_error_type(Response::NON_EXISTENCE);
+    Datum *message = response.add_response();
+    message->set_type(Datum::R_STR);
+    message->set_r_str("No such table.");
+    Frame *frame = response.mutable_backtrace()->add_frames();
+    frame->set_type(Frame::POS);
+    frame->set_pos(0);
+    frame = response.mutable_backtrace()->add_frames();
+    frame->set_type(Frame::OPT);
+    frame->set_opt("index");
+
+    const std::string encoded = encode_response(response);
+    string_read_stream_t s(std::string(encoded), 0);
+    expect_header(&s, Response::RUNTIME_ERROR, Response::NON_EXISTENCE);
+
+    uint64_t count;
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_varint_uint64(&s, &count));
+    ASSERT_EQ(1u, count);
+    EXPECT_EQ(ql::datum_t("No such table."), read_datum(&s));
+    ASSERT_EQ(archive_result_t::SUCCESS, deserialize_varint_uint64(&s, &count));
+    EXPECT_EQ(0u, count);
+
+    const ql::datum_t backtrace = read_datum(&s);
+    ASSERT_EQ(ql::datum_t::R_ARRAY, backtrace.get_type());
+    ASSERT_EQ(2u, backtrace.arr_size());
+    EXPECT_EQ(ql::datum_t(0.0), backtrace.get(0));
+    EXPECT_EQ(ql::datum_t("index"), backtrace.get(1));
+    EXPECT_EQ(ql::datum_t::null(), read_datum(&s));
+}
+
+}  // namespace unittest
@@ -4,6 +4,7 @@
 #include "rdb_protocol/datum.hpp"
 #include "rdb_protocol/datum_string.hpp"
 #include "rdb_protocol/env.hpp"
+#include "rdb_protocol/pseudo_time.hpp"
 #include "unittest/gtest.hpp"
 
 
@@ -205,4 +206,37 @@ TEST(DatumTest, OffsetScaling) {
     }
 }
 
+ql::datum_t serialization_round_trip(const ql::datum_t &datum) {
+    string_stream_t write_stream;
+    write_message_t wm;
+    serialize<cluster_version_t::LATEST_OVERALL>(&wm, datum);
+    guarantee(send_write_message(&write_stream, &wm) == 0);
+    string_read_stream_t read_stream(std::move(write_stream.str()), 0);
+    ql::datum_t res;
+    guarantee(deserialize<cluster_version_t::LATEST_OVERALL>(&read_stream, &res)
+              == archive_result_t::SUCCESS);
+    return res;
+}
+
+// Data that compare equal have to hash the same, no matter how they are represented.
+TEST(DatumTest, Hash) {
+    EXPECT_EQ(ql::datum_t(0.0).hash(), ql::datum_t(-0.0).hash());
+    EXPECT_NE(ql::datum_t(1.0).hash(), ql::datum_t(2.0).hash());
+    EXPECT_NE(ql::datum_t(1.0).hash(), ql::datum_t(datum_string_t("1")).hash());
+
+    ql::datum_t object(std::map<datum_string_t, ql::datum_t>
+        {std::make_pair(datum_string_t("a"), ql::datum_t(1.0)),
+         std::make_pair(datum_string_t("b"), ql::datum_t(
+             std::vector<ql::datum_t>{ql::datum_t::null(), ql::datum_t(-0.0)},
+             ql::configured_limits_t::unlimited))});
+    ql::datum_t deserialized_object = serialization_round_trip(object);
+    ASSERT_EQ(object, deserialized_object);
+    EXPECT_EQ(object.hash(), deserialized_object.hash());
+
+    ql::datum_t utc_time = ql::pseudo::make_time(1234567890, "+00:00");
+    ql::datum_t other_time = ql::pseudo::make_time(1234567890, "-07:00");
+    ASSERT_EQ(utc_time, other_time);
+    EXPECT_EQ(utc_time.hash(), other_time.hash());
+}
+
 }  // namespace unittest
@@ -0,0 +1,53 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "containers/disk_backed_sorter.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+void run_sorter_test(size_t memory_limit, size_t num_values) {
+    temp_directory_t temp_dir;
+    recreate_temporary_directory(temp_dir.path());
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+
+    disk_backed_sorter_t<std::string> sorter(
+        &io_backender, temp_dir.path(), "sorter_test",
+        &get_global_perfmon_collection(), memory_limit);
+
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < num_values; ++i) {
+        std::string value = strprintf("%d", randint(1000000));
+        expected.push_back(value);
+        sorter.push(std::move(value), expected.back().size());
+    }
+    sorter.finish_pushing();
+    std::sort(expected.begin(), expected.end());
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+        std::string value;
+        ASSERT_TRUE(sorter.pop(&value));
+        ASSERT_EQ(expected[i], value);
+    }
+    std::string value;
+    EXPECT_FALSE(sorter.pop(&value));
+}
+
+TPTEST(DiskBackedSorter, InMemory) {
+    run_sorter_test(MEGABYTE, 1000);
+}
+
+TPTEST(DiskBackedSorter, ManyRuns) {
+    // About 10 runs.
+    run_sorter_test(KILOBYTE * 6, 10000);
+}
+
+TPTEST(DiskBackedSorter, Empty) {
+    run_sorter_test(KILOBYTE, 0);
+}
+
+}  // namespace unittest
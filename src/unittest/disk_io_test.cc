@@ -0,0 +1,174 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "arch/arch.hpp"
+#include "arch/io/disk.hpp"
+#include "arch/io/disk/uring.hpp"
+#include "arch/runtime/thread_pool.hpp"
+#include "arch/timing.hpp"
+#include "concurrency/cond_var.hpp"
+#include "concurrency/queue/unlimited_fifo.hpp"
+#include "concurrency/wait_any.hpp"
+#include "config/args.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* Writes a file through every kind of request the disk manager knows about and reads
+it back. If the kernel doesn't support io_uring, the io_uring variants quietly run on
+the thread pool backend instead. */
+void run_read_write_test(io_backend_t io_backend) {
+    const size_t block_size = 4 * KILOBYTE;
+    const size_t num_blocks = 64;
+    const size_t file_size = block_size * num_blocks;
+
+    temp_file_t temp_file;
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired,
+                                DEFAULT_MAX_CONCURRENT_IO_REQUESTS,
+                                io_backend);
+    scoped_ptr_t<file_t> file;
+    file_open_result_t open_res = open_file(
+        temp_file.name().permanent_path().c_str(),
+        linux_file_t::mode_read | linux_file_t::mode_write | linux_file_t::mode_create,
+        &io_backender, &file);
+    ASSERT_NE(file_open_result_t::ERROR, open_res.outcome);
+    file->set_file_size(file_size);
+
+    scoped_malloc_t<char> data(malloc_aligned(file_size, DEVICE_BLOCK_SIZE));
+    for (size_t i = 0; i < file_size; ++i) {
+        data.get()[i] = static_cast<char>(i * 7 + i / block_size);
+    }
+
+    // The first block goes through a datasync-wrapped write, the rest of the first
+    // half one block at a time.
+    co_write(file.get(), 0, block_size, data.get(), DEFAULT_DISK_ACCOUNT,
+             file_t::WRAP_IN_DATASYNCS);
+    for (size_t i = 1; i < num_blocks / 2; ++i) {
+        co_write(file.get(), i * block_size, block_size, data.get() + i * block_size,
+                 DEFAULT_DISK_ACCOUNT, file_t::NO_DATASYNCS);
+    }
+
+    // The second half goes through a single vectored write.
+    {
+        scoped_array_t<iovec> bufs(num_blocks / 2);
+        for (size_t i = 0; i < bufs.size(); ++i) {
+            bufs[i].iov_base = data.get() + (num_blocks / 2 + i) * block_size;
+            bufs[i].iov_len = block_size;
+        }
+        struct : public iocallback_t, public cond_t {
+            void on_io_complete() {
+                pulse();
+            }
+        } cb;
+        file->writev_async(file_size / 2, file_size / 2, std::move(bufs),
+                           DEFAULT_DISK_ACCOUNT, &cb);
+        cb.wait();
+    }
+
+    // Read everything back, once as a whole and once block by block.
+    scoped_malloc_t<char> readback(malloc_aligned(file_size, DEVICE_BLOCK_SIZE));
+    memset(readback.get(), 0, file_size);
+    co_read(file.get(), 0, file_size, readback.get(), DEFAULT_DISK_ACCOUNT);
+    ASSERT_EQ(0, memcmp(data.get(), readback.get(), file_size));
+
+    memset(readback.get(), 0, file_size);
+    for (size_t i = 0; i < num_blocks; ++i) {
+        co_read(file.get(), i * block_size, block_size, readback.get() + i * block_size,
+                DEFAULT_DISK_ACCOUNT);
+    }
+    ASSERT_EQ(0, memcmp(data.get(), readback.get(), file_size));
+}
+
+TPTEST(DiskIoTest, PoolReadWrite) {
+    run_read_write_test(io_backend_t::pool);
+}
+
+TPTEST(DiskIoTest, UringReadWrite) {
+    run_read_write_test(io_backend_t::uring);
+}
+
+TPTEST(DiskIoTest, UringRegisteredReadWrite) {
+    run_read_write_test(io_backend_t::uring_registered);
+}
+
+#if USE_IO_URING
+
+int uring_refused_submissions = 0;
+int uring_enter_calls = 0;
+
+int refusing_io_uring_enter(fd_t ring_fd, unsigned to_submit, unsigned min_complete,
+                            unsigned flags) {
+    ++uring_enter_calls;
+    if (uring_refused_submissions > 0) {
+        --uring_refused_submissions;
+        errno = EAGAIN;
+        return -1;
+    }
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+/* If the kernel refuses a submission while nothing else is in flight, no completion
+comes in to retry it, so the disk manager has to retry from a timer. */
+void run_uring_submit_retry_test() {
+    if (!uring_diskmgr_t::is_supported()) {
+        return;
+    }
+
+    const size_t size = 4 * KILOBYTE;
+    temp_file_t temp_file;
+    scoped_fd_t fd(open(temp_file.name().permanent_path().c_str(),
+                        O_RDWR | O_CREAT, 0644));
+    ASSERT_NE(INVALID_FD, fd.get());
+    std::vector<char> data(size);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>(i * 7);
+    }
+    ASSERT_EQ(static_cast<ssize_t>(size), pwrite(fd.get(), data.data(), size, 0));
+
+    unlimited_fifo_queue_t<pool_diskmgr_t::action_t *> source;
+    uring_diskmgr_t diskmgr(&linux_thread_pool_t::get_thread()->queue, &source,
+                            DEFAULT_MAX_CONCURRENT_IO_REQUESTS, false);
+    cond_t done;
+    diskmgr.done_fun = [&](pool_diskmgr_t::action_t *) { done.pulse(); };
+    uring_enter_calls = 0;
+    uring_refused_submissions = 2;
+    diskmgr.enter_fun = &refusing_io_uring_enter;
+
+    std::vector<char> readback(size, 0);
+    pool_diskmgr_t::action_t action;
+    action.make_read(fd.get(), readback.data(), size, 0);
+    source.push(&action);
+
+    // The submission got refused with nothing in flight, so only the timer can
+    // retry it.
+    EXPECT_EQ(1, uring_enter_calls);
+    EXPECT_TRUE(diskmgr.submit_retry_timer != NULL);
+
+    signal_timer_t timeout(10000);
+    wait_any_t done_or_timeout(&done, &timeout);
+    done_or_timeout.wait_lazily_unordered();
+    ASSERT_TRUE(done.is_pulsed());
+
+    // Refused once more from the timer, then accepted.
+    EXPECT_EQ(3, uring_enter_calls);
+    EXPECT_TRUE(diskmgr.submit_retry_timer == NULL);
+    EXPECT_TRUE(action.get_succeeded());
+    EXPECT_EQ(data, readback);
+}
+
+TPTEST(DiskIoTest, UringSubmitRetry) {
+    run_uring_submit_retry_test();
+}
+
+#endif  // USE_IO_URING
+
+}  // namespace unittest
@@ -0,0 +1,179 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/minidriver.hpp"
+#include "rdb_protocol/query_cache.hpp"
+#include "rdb_protocol/term_walker.hpp"
+#include "rdb_protocol/terms/terms.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/query_utils.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+bool is_hash_join(Term::TermType type, ql::r::reql_t &&func) {
+    ql::protob_t<Term> term =
+        ql::r::array().call(type, ql::r::array(), std::move(func)).release_counted();
+    ql::propagate_backtrace(term.get(), ql::backtrace_id_t::empty());
+    ql::compile_env_t compile_env((ql::var_visibility_t()));
+    counted_t<ql::term_t> hash_join = type == Term::INNER_JOIN
+        ? ql::maybe_make_inner_hash_join_term(&compile_env, term)
+        : ql::maybe_make_outer_hash_join_term(&compile_env, term);
+    return hash_join.has();
+}
+
+TEST(HashJoin, Matcher) {
+    const ql::pb::dummy_var_t l = ql::pb::dummy_var_t::INNERJOIN_N;
+    const ql::pb::dummy_var_t r = ql::pb::dummy_var_t::INNERJOIN_M;
+    auto field = [](ql::pb::dummy_var_t var, const char *name) {
+        return ql::r::var(var)[std::string(name)];
+    };
+
+    EXPECT_TRUE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(l, "k") == field(r, "k"))));
+    EXPECT_TRUE(is_hash_join(Term::OUTER_JOIN,
+        ql::r::fun(l, r, field(l, "k") == field(r, "k"))));
+    // The sides of the comparison can be swapped, and be any deterministic term.
+    EXPECT_TRUE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(r, "k") + 1.0 == field(l, "k"))));
+
+    // Not an equality.
+    EXPECT_FALSE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(l, "k") < field(r, "k"))));
+    // Equalities between more than two values.
+    EXPECT_FALSE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(l, "k").call(Term::EQ, field(r, "k"), 1.0))));
+    // A side that depends on both rows, or on neither.
+    EXPECT_FALSE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(l, "k") == field(r, "k") + field(l, "i"))));
+    EXPECT_FALSE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(l, "k") == ql::r::expr(1.0))));
+    // A non-deterministic key.
+    EXPECT_FALSE(is_hash_join(Term::INNER_JOIN,
+        ql::r::fun(l, r, field(l, "k")
+                   == field(r, "k") + ql::r::reql_t(Term::RANDOM, 0.0, 10.0))));
+}
+
+ql::datum_t make_join_row(int i, int mod) {
+    std::map<datum_string_t, ql::datum_t> row;
+    row[datum_string_t("k")] = ql::datum_t(static_cast<double>(i % mod));
+    row[datum_string_t("i")] = ql::datum_t(static_cast<double>(i));
+    return ql::datum_t(std::move(row));
+}
+
+/* `r.range(num_rows).map(x => {k: x % mod, i: x})` */
+std::string join_rows_json(int num_rows, int mod) {
+    return strprintf("[38,[[173,[%d]],[69,[[2,[3]],{\"k\":[28,[[10,[3]],%d]],"
+                     "\"i\":[10,[3]]}]]]]", num_rows, mod);
+}
+
+/* The result of joining the rows of `join_rows_json()` on `k`, in the order of a nested
+loop. */
+std::vector<ql::datum_t> nested_loop_join(int num_lefts, int left_mod,
+                                          int num_rights, int right_mod,
+                                          bool outer) {
+    std::vector<ql::datum_t> out;
+    for (int i = 0; i < num_lefts; ++i) {
+        bool matched = false;
+        for (int j = 0; j < num_rights; ++j) {
+            if (i % left_mod == j % right_mod) {
+                std::map<datum_string_t, ql::datum_t> pair;
+                pair[datum_string_t("left")] = make_join_row(i, left_mod);
+                pair[datum_string_t("right")] = make_join_row(j, right_mod);
+                out.push_back(ql::datum_t(std::move(pair)));
+                matched = true;
+            }
+        }
+        if (!matched && outer) {
+            std::map<datum_string_t, ql::datum_t> pair;
+            pair[datum_string_t("left")] = make_join_row(i, left_mod);
+            out.push_back(ql::datum_t(std::move(pair)));
+        }
+    }
+    return out;
+}
+
+/* Runs the join of `join_rows_json()`s with the predicate `func_json` and returns the
+rows it produced. */
+std::vector<ql::datum_t> run_join(ql::query_cache_t *query_cache,
+                                  int64_t token,
+                                  const char *global_optargs_json,
+                                  bool outer,
+                                  int num_lefts, int left_mod,
+                                  int num_rights, int right_mod,
+                                  const char *func_json) {
+    Response res = run_json_query(query_cache, token, strprintf(
+        "[1,[51,[[%d,[%s,%s,%s]],\"array\"]],%s]",
+        static_cast<int>(outer ? Term::OUTER_JOIN : Term::INNER_JOIN),
+        join_rows_json(num_lefts, left_mod).c_str(),
+        join_rows_json(num_rights, right_mod).c_str(),
+        func_json,
+        global_optargs_json));
+    guarantee(res.type() == Response::SUCCESS_ATOM);
+    ql::datum_t array = response_datum(res);
+    std::vector<ql::datum_t> rows;
+    for (size_t i = 0; i < array.arr_size(); ++i) {
+        rows.push_back(array.get(i));
+    }
+    return rows;
+}
+
+// r.func(l, r) { l('k') == r('k') }
+const char *const hash_join_func_json =
+    "[69,[[2,[1,2]],[17,[[170,[[10,[1]],\"k\"]],[170,[[10,[2]],\"k\"]]]]]]";
+// r.func(l, r) { r.eq(l('k'), r('k'), r('k')) }, which gets evaluated as a nested loop.
+const char *const nested_loop_func_json =
+    "[69,[[2,[1,2]],[17,[[170,[[10,[1]],\"k\"]],[170,[[10,[2]],\"k\"]],"
+    "[170,[[10,[2]],\"k\"]]]]]]";
+
+TPTEST(HashJoin, InMemory) {
+    rdb_context_t ctx;
+    ql::query_cache_t query_cache(&ctx, ip_and_port_t(),
+                                  ql::return_empty_normal_batches_t::NO);
+    int64_t token = 1;
+    for (bool outer : {false, true}) {
+        // Left rows with `k` 5 and 6 don't match anything.
+        const std::vector<ql::datum_t> expected = nested_loop_join(50, 7, 40, 5, outer);
+        ASSERT_EQ(expected, run_join(&query_cache, token++, "{}", outer,
+                                     50, 7, 40, 5, hash_join_func_json));
+        ASSERT_EQ(expected, run_join(&query_cache, token++, "{}", outer,
+                                     50, 7, 40, 5, nested_loop_func_json));
+    }
+    // Nothing to join with.
+    EXPECT_TRUE(run_join(&query_cache, token++, "{}", false,
+                         20, 7, 0, 5, hash_join_func_json).empty());
+    EXPECT_EQ(20u, run_join(&query_cache, token++, "{}", true,
+                            20, 7, 0, 5, hash_join_func_json).size());
+}
+
+TPTEST(HashJoin, Spill) {
+    temp_directory_t temp_dir;
+    recreate_temporary_directory(temp_dir.path());
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    rdb_context_t ctx(nullptr, nullptr, nullptr,
+                      boost::shared_ptr<semilattice_readwrite_view_t<
+                          auth_semilattice_metadata_t> >(),
+                      &get_global_perfmon_collection(), std::string(),
+                      &io_backender, temp_dir.path());
+    ql::query_cache_t query_cache(&ctx, ip_and_port_t(),
+                                  ql::return_empty_normal_batches_t::NO);
+    int64_t token = 1;
+    for (bool outer : {false, true}) {
+        // With a memory limit of one byte, the join spills as soon as it has read
+        // the first right row.  The results then come partition by partition.
+        std::vector<ql::datum_t> expected = nested_loop_join(200, 13, 300, 10, outer);
+        std::vector<ql::datum_t> rows = run_join(
+            &query_cache, token++, "{\"memory_limit\":1}", outer,
+            200, 13, 300, 10, hash_join_func_json);
+        std::sort(expected.begin(), expected.end());
+        std::sort(rows.begin(), rows.end());
+        ASSERT_EQ(expected, rows);
+    }
+}
+
+}  // namespace unittest
@@ -0,0 +1,86 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "unittest/gtest.hpp"
+
+#include "serializer/log/lba/in_memory_index.hpp"
+
+namespace unittest {
+
+void set_info(in_memory_index_t *index, block_id_t id,
+              const index_block_info_t &info) {
+    index->set_block_info(id, info.recency, info.offset, info.ser_block_size,
+                          info.uncompressed_ser_block_size);
+}
+
+index_block_info_t typical_info(block_id_t id) {
+    repli_timestamp_t recency;
+    recency.longtime = 1000000 + id % 7;
+    return index_block_info_t(flagged_off64_t::make(id * 4 * KILOBYTE), recency,
+                              4 * KILOBYTE, id % 3 == 0 ? 0 : 8 * KILOBYTE);
+}
+
+TEST(InMemoryIndexTest, RoundTrip) {
+    in_memory_index_t index;
+    const block_id_t count = 3 * LBA_SHARD_FACTOR * in_memory_index_t::CHUNK_SIZE;
+    for (block_id_t id = 0; id < count; ++id) {
+        set_info(&index, id, typical_info(id));
+    }
+    EXPECT_EQ(count, index.end_block_id());
+    for (block_id_t id = 0; id < count; ++id) {
+        ASSERT_TRUE(index.get_block_info(id) == typical_info(id));
+    }
+    EXPECT_TRUE(index.get_block_info(count) == index_block_info_t());
+
+    // Typical entries use the compact representation, which takes up half as much
+    // memory as plain `index_block_info_t`s.
+    EXPECT_LT(index.memory_usage(), count * sizeof(index_block_info_t) * 6 / 10);
+}
+
+TEST(InMemoryIndexTest, UnusualEntries) {
+    in_memory_index_t index;
+    for (block_id_t id = 0; id < 100; ++id) {
+        set_info(&index, id, typical_info(id));
+    }
+    const size_t compact_usage = index.memory_usage();
+
+    // Entries that don't fit into the compact representation.
+    repli_timestamp_t far_recency;
+    far_recency.longtime = 1000000 + (1ULL << 40);
+    const index_block_info_t unusual[] = {
+        index_block_info_t(flagged_off64_t::make(123), repli_timestamp_t::distant_past,
+                           100, 0),
+        index_block_info_t(flagged_off64_t::make(DEVICE_BLOCK_SIZE), far_recency,
+                           100, 0),
+        index_block_info_t(flagged_off64_t::make(DEVICE_BLOCK_SIZE),
+                           repli_timestamp_t::distant_past, 100000, 200000),
+        index_block_info_t(flagged_off64_t::make(1LL << 45),
+                           repli_timestamp_t::distant_past, 100, 0),
+    };
+    for (size_t i = 0; i < sizeof(unusual) / sizeof(unusual[0]); ++i) {
+        set_info(&index, 200 + i, unusual[i]);
+    }
+    // A deleted block keeps its recency.
+    set_info(&index, 5, index_block_info_t(flagged_off64_t::unused(),
+                                           typical_info(5).recency, 0, 0));
+
+    EXPECT_GT(index.memory_usage(), compact_usage);
+    for (block_id_t id = 0; id < 100; ++id) {
+        if (id == 5) {
+            EXPECT_FALSE(index.get_block_info(id).offset.has_value());
+            EXPECT_TRUE(index.get_block_info(id).recency == typical_info(5).recency);
+        } else {
+            ASSERT_TRUE(index.get_block_info(id) == typical_info(id));
+        }
+    }
+    for (size_t i = 0; i < sizeof(unusual) / sizeof(unusual[0]); ++i) {
+        EXPECT_TRUE(index.get_block_info(200 + i) == unusual[i]);
+    }
+
+    // Chunks get freed once all their entries are back to the default.
+    for (block_id_t id = 0; id < 300; ++id) {
+        set_info(&index, id, index_block_info_t());
+    }
+    EXPECT_LT(index.memory_usage(), compact_usage);
+    EXPECT_TRUE(index.get_block_info(200) == index_block_info_t());
+}
+
+}  // namespace unittest
@@ -1,11 +1,13 @@
 // Copyright 2010-2013 RethinkDB, all rights reserved.
 #include <algorithm>
+#include <string>
 #include <vector>
 
 #include "unittest/gtest.hpp"
 
 #include "btree/internal_node.hpp"
 #include "btree/node.hpp"
+#include "containers/scoped.hpp"
 
 namespace unittest {
 
@@ -61,6 +63,108 @@ TEST(InternalNodeTest, Offsets) {
     EXPECT_EQ(9u, sizeof(btree_internal_pair));
 }
 
+TEST(InternalNodeTest, SplitOffLastChild) {
+    block_size_t bs = block_size_t::unsafe_make(4096);
+    scoped_malloc_t<internal_node_t> node(bs.value());
+    scoped_malloc_t<internal_node_t> rnode(bs.value());
+    internal_node::init(bs, node.get());
+
+    // Appends children 0, 1, 2, ... the way the bulk loader does.
+    block_id_t num_children = 1;
+    while (!internal_node::is_full(node.get())) {
+        store_key_t key(strprintf("%08d", static_cast<int>(num_children - 1)));
+        ASSERT_TRUE(internal_node::insert(node.get(), key.btree_key(),
+                                          num_children - 1, num_children));
+        ++num_children;
+    }
+    verify(bs, node.get());
+
+    store_key_t median;
+    internal_node::split_off_last_child(bs, node.get(), rnode.get(), median.btree_key());
+    verify(bs, node.get());
+    EXPECT_EQ(store_key_t(strprintf("%08d", static_cast<int>(num_children - 2))), median);
+    ASSERT_EQ(num_children - 1, node->npairs);
+    EXPECT_EQ(num_children - 2,
+              internal_node::get_pair_by_index(node.get(), node->npairs - 1)->lnode);
+
+    // `rnode` now only holds the last child, and can take the next one.
+    ASSERT_EQ(1, rnode->npairs);
+    EXPECT_EQ(num_children - 1, internal_node::get_pair_by_index(rnode.get(), 0)->lnode);
+    store_key_t key(strprintf("%08d", static_cast<int>(num_children - 1)));
+    ASSERT_TRUE(internal_node::insert(rnode.get(), key.btree_key(),
+                                      num_children - 1, num_children));
+    verify(bs, rnode.get());
+    EXPECT_EQ(num_children - 1, internal_node::lookup(rnode.get(), key.btree_key()));
+}
+
+// The index of the first separator key that `key` isn't greater than, found without
+// any prefix skipping.
+int linear_offset_index(const internal_node_t *node, const btree_key_t *key) {
+    int index = 0;
+    while (index < node->npairs - 1) {
+        const btree_internal_pair *pair = internal_node::get_pair_by_index(node, index);
+        if (btree_key_cmp(key, &pair->key) <= 0) {
+            break;
+        }
+        ++index;
+    }
+    return index;
+}
+
+TEST(InternalNodeTest, OffsetIndexWithSharedPrefixes) {
+    block_size_t bs = block_size_t::unsafe_make(4096);
+    scoped_malloc_t<internal_node_t> node(bs.value());
+    internal_node::init(bs, node.get());
+
+    // Every separator key starts with "prefix/", and they go up in steps of two, so
+    // that there are keys in between them.
+    int num_separators = 0;
+    while (!internal_node::is_full(node.get())) {
+        store_key_t key(strprintf("prefix/%04d", num_separators * 2));
+        ASSERT_TRUE(internal_node::insert(node.get(), key.btree_key(),
+                                          num_separators, num_separators + 1));
+        ++num_separators;
+    }
+    verify(bs, node.get());
+    ASSERT_LT(16, num_separators);
+
+    std::vector<std::string> keys;
+    for (int i = -1; i <= num_separators * 2; ++i) {
+        keys.push_back(strprintf("prefix/%04d", i));
+        keys.push_back(strprintf("prefix/%04d", i) + std::string(1, '\0'));
+        keys.push_back(strprintf("prefix/%04d~", i));
+    }
+    // Keys that sort just before every key with the prefix...
+    keys.push_back("");
+    keys.push_back("prefix");
+    keys.push_back("prefix/");
+    keys.push_back("prefix.");
+    keys.push_back("prefix.\xff");
+    keys.push_back("prefiw");
+    // ... and just after.
+    keys.push_back("prefix0");
+    keys.push_back("prefix/\xff");
+    keys.push_back("prefix/9999~");
+    keys.push_back("prefiy");
+    keys.push_back("\xff");
+
+    for (const std::string &k : keys) {
+        store_key_t key(k);
+        const int expected = linear_offset_index(node.get(), key.btree_key());
+        EXPECT_EQ(expected, internal_node::get_offset_index(node.get(), key.btree_key()))
+            << "key: " << key_to_debug_str(key);
+        EXPECT_EQ(static_cast<block_id_t>(expected),
+                  internal_node::lookup(node.get(), key.btree_key()));
+    }
+
+    // The keys around the prefix land on the first and the last child.
+    EXPECT_EQ(0, internal_node::get_offset_index(node.get(),
+                                                 store_key_t("prefix.").btree_key()));
+    EXPECT_EQ(num_separators,
+              internal_node::get_offset_index(node.get(),
+                                              store_key_t("prefix0").btree_key()));
+}
+
 
 }  // namespace unittest
 
@@ -193,6 +193,114 @@ SPAWNER_TEST(JSProc, InfiniteRecursionFunction) {
     ASSERT_EQ(*err_msg, std::string("RangeError: Maximum call stack size exceeded"));
 }
 
+SPAWNER_TEST(JSProc, CallBatch) {
+    extproc_pool_t extproc_pool(1);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, NULL, limits);
+
+    const std::string source_code =
+        "(function(x) { if (x == 7) { throw 'seven'; } return x * 2; })";
+
+    // More calls than fit into a single batch, one of which fails.
+    std::vector<std::vector<ql::datum_t> > args;
+    for (int i = 0; i < 250; ++i) {
+        args.push_back(std::vector<ql::datum_t>(1, ql::datum_t(static_cast<double>(i))));
+    }
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+    std::vector<js_result_t> results = js_runner.call_batch(source_code, args, config);
+    ASSERT_TRUE(js_runner.connected());
+    ASSERT_EQ(args.size(), results.size());
+
+    for (int i = 0; i < 250; ++i) {
+        if (i == 7) {
+            std::string *err_msg = boost::get<std::string>(&results[i]);
+            ASSERT_TRUE(err_msg != NULL);
+            ASSERT_EQ(std::string("seven"), *err_msg);
+        } else {
+            ql::datum_t *res_datum = boost::get<ql::datum_t>(&results[i]);
+            ASSERT_TRUE(res_datum != NULL);
+            ASSERT_EQ(i * 2, res_datum->as_int());
+        }
+    }
+}
+
+SPAWNER_TEST(JSProc, CallBatchTimeout) {
+    extproc_pool_t extproc_pool(1);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, NULL, limits);
+
+    const std::string source_code =
+        "(function(x) { if (x == 3) { for (var y = 0; y < 4e10; y++) {} } return x; })";
+
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+    js_result_t result = js_runner.eval(source_code, config);
+    ASSERT_TRUE(boost::get<js_id_t>(&result) != NULL);
+
+    std::vector<std::vector<ql::datum_t> > args;
+    for (int i = 0; i < 10; ++i) {
+        args.push_back(std::vector<ql::datum_t>(1, ql::datum_t(static_cast<double>(i))));
+    }
+
+    // The calls before the one that loops still get their results, and the batch ends
+    // with the one that times out.
+    config.timeout_ms = 100;
+    std::vector<js_result_t> results = js_runner.call_batch(source_code, args, config);
+    ASSERT_FALSE(js_runner.connected());
+    ASSERT_EQ(args.size(), results.size());
+    for (int i = 0; i < 10; ++i) {
+        if (i < 3) {
+            ql::datum_t *res_datum = boost::get<ql::datum_t>(&results[i]);
+            ASSERT_TRUE(res_datum != NULL);
+            ASSERT_EQ(i, res_datum->as_int());
+        } else {
+            std::string *err_msg = boost::get<std::string>(&results[i]);
+            ASSERT_TRUE(err_msg != NULL);
+            ASSERT_EQ(strprintf("JavaScript query `%s` timed out after 0.100 seconds.",
+                                source_code.c_str()), *err_msg);
+        }
+    }
+}
+
+SPAWNER_TEST(JSProc, CallBatchReturnsFunctions) {
+    extproc_pool_t extproc_pool(1);
+    js_runner_t js_runner;
+    ql::configured_limits_t limits;
+
+    js_runner.begin(&extproc_pool, NULL, limits);
+
+    const std::string source_code = "(function(x) { return function() { return x; }; })";
+
+    std::vector<std::vector<ql::datum_t> > args;
+    for (int i = 0; i < 10; ++i) {
+        args.push_back(std::vector<ql::datum_t>(1, ql::datum_t(static_cast<double>(i))));
+    }
+
+    // The ids of the returned functions get released, and the worker stays usable.
+    js_runner_t::req_config_t config;
+    config.timeout_ms = 10000;
+    std::vector<js_result_t> results = js_runner.call_batch(source_code, args, config);
+    ASSERT_TRUE(js_runner.connected());
+    ASSERT_EQ(args.size(), results.size());
+    for (const js_result_t &result : results) {
+        ASSERT_TRUE(boost::get<js_id_t>(&result) != NULL);
+    }
+
+    js_result_t result = js_runner.call(
+        "(function(x) { return x + 1; })",
+        std::vector<ql::datum_t>(1, ql::datum_t(1.0)),
+        config);
+    ql::datum_t *res_datum = boost::get<ql::datum_t>(&result);
+    ASSERT_TRUE(res_datum != NULL);
+    ASSERT_EQ(2, res_datum->as_int());
+}
+
 void run_overalloc_function_test() {
     extproc_pool_t extproc_pool(1);
     js_runner_t js_runner;
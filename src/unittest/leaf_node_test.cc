@@ -1,10 +1,13 @@
 // Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <algorithm>
 #include <map>
+#include <vector>
 
 #include "btree/leaf_node.hpp"
 #include "btree/node.hpp"
 #include "containers/scoped.hpp"
 #include "repli_timestamp.hpp"
+#include "time.hpp"
 #include "unittest/gtest.hpp"
 #include "utils.hpp"
 
@@ -13,7 +16,8 @@ struct short_value_t;
 
 class short_value_sizer_t : public value_sizer_t {
 public:
-    explicit short_value_sizer_t(max_block_size_t bs) : block_size_(bs) { }
+    short_value_sizer_t(max_block_size_t bs, bool key_prefixes)
+        : block_size_(bs), key_prefixes_(key_prefixes) { }
 
     int size(const void *value) const {
         int x = *reinterpret_cast<const uint8_t *>(value);
@@ -35,8 +39,11 @@ public:
 
     max_block_size_t block_size() const { return block_size_; }
 
+    bool btree_leaf_key_prefixes() const { return key_prefixes_; }
+
 private:
     max_block_size_t block_size_;
+    bool key_prefixes_;
 
     DISABLE_COPYING(short_value_sizer_t);
 };
@@ -69,9 +76,9 @@ private:
 
 class LeafNodeTracker {
 public:
-    LeafNodeTracker()
+    explicit LeafNodeTracker(bool key_prefixes = false)
         : bs_(max_block_size_t::unsafe_make(4096)),
-          sizer_(bs_),
+          sizer_(bs_, key_prefixes),
           node_(bs_.value()),
           tstamp_counter_(0),
           maximum_existing_tstamp_(repli_timestamp_t::distant_past) {
@@ -240,6 +247,16 @@ public:
         ASSERT_EQ(key_to_unescaped_str(p->first), key_to_unescaped_str(median));
     }
 
+    void GrowKeyPrefix(const store_key_t &left_excl, const store_key_t &right_incl) {
+        leaf::grow_key_prefix(&sizer_, node(), left_excl.btree_key(), right_incl.btree_key());
+        Verify();
+    }
+
+    std::string KeyPrefix() {
+        const btree_key_t *prefix = leaf::key_prefix(node());
+        return prefix == NULL ? std::string() : key_to_unescaped_str(store_key_t(prefix));
+    }
+
     bool IsFull(const store_key_t& key, const std::string& value) {
         short_value_buffer_t value_buf(value);
         return leaf::is_full(&sizer_, node(), key.btree_key(), value_buf.data());
@@ -294,6 +311,14 @@ public:
             printf("\n");
         }
         ASSERT_TRUE(leaf_guts == kv_);
+
+        auto kv_it = kv_.begin();
+        for (auto it = leaf::begin(*node()); it != leaf::end(*node()); ++it, ++kv_it) {
+            ASSERT_TRUE(kv_it != kv_.end());
+            ASSERT_EQ(key_to_unescaped_str(kv_it->first),
+                      key_to_unescaped_str(store_key_t((*it).first)));
+        }
+        ASSERT_TRUE(kv_it == kv_.end());
     }
 
 private:
@@ -674,4 +699,203 @@ TEST(LeafNodeTest, Fullness) {
     ASSERT_TRUE(node.IsFull(store_key_t(strprintf("a%d", i)), strprintf("A%d", i)));
 }
 
+// Keys that share long prefixes, some of which are prefixes of each other.
+store_key_t prefixed_test_key(int i) {
+    return store_key_t(strprintf("user_%08d%s", i * 3, i % 3 == 0 ? "" : "_x"));
+}
+
+void fill_with_prefixed_keys(LeafNodeTracker *tracker, std::vector<store_key_t> *keys_out) {
+    for (int i = 0; tracker->Insert(prefixed_test_key(i), "v"); ++i) {
+        keys_out->push_back(prefixed_test_key(i));
+    }
+    std::sort(keys_out->begin(), keys_out->end());
+}
+
+TEST(LeafNodeTest, FindKeyWithSharedPrefixes) {
+    LeafNodeTracker tracker;
+    std::vector<store_key_t> keys;
+    fill_with_prefixed_keys(&tracker, &keys);
+    ASSERT_GT(keys.size(), 50u);
+
+    std::vector<store_key_t> probes = keys;
+    for (int i = 0; i < static_cast<int>(keys.size()) * 3 + 3; ++i) {
+        probes.push_back(store_key_t(strprintf("user_%08d", i)));
+        probes.push_back(store_key_t(strprintf("user_%08d_", i)));
+        probes.push_back(store_key_t(strprintf("user_%08d_y", i)));
+    }
+    probes.push_back(store_key_t(""));
+    probes.push_back(store_key_t("user_"));
+    probes.push_back(store_key_t("zzz"));
+
+    for (const store_key_t &probe : probes) {
+        const auto it = std::lower_bound(keys.begin(), keys.end(), probe);
+        int index;
+        const bool found = leaf::find_key(tracker.node(), probe.btree_key(), &index);
+        EXPECT_EQ(it - keys.begin(), index);
+        EXPECT_EQ(it != keys.end() && *it == probe, found);
+    }
+}
+
+store_key_t customer_key(int i) {
+    return store_key_t(strprintf("customers/by_id/%08d", i));
+}
+
+// A node with a key prefix only stores the remaining bytes of each key.
+TEST(LeafNodeTest, KeyPrefixFitsMoreEntries) {
+    LeafNodeTracker plain(false);
+    LeafNodeTracker prefixed(true);
+
+    int num_plain = 0;
+    while (plain.Insert(customer_key(num_plain), "v")) {
+        ++num_plain;
+    }
+
+    ASSERT_TRUE(prefixed.Insert(customer_key(0), "v"));
+    ASSERT_TRUE(prefixed.Insert(customer_key(1), "v"));
+    prefixed.GrowKeyPrefix(store_key_t("customers/by_id/"), store_key_t("customers/by_id/~"));
+    ASSERT_EQ("customers/by_id/", prefixed.KeyPrefix());
+    int num_prefixed = 2;
+    while (prefixed.Insert(customer_key(num_prefixed), "v")) {
+        ++num_prefixed;
+    }
+    EXPECT_GT(num_prefixed, num_plain * 3 / 2);
+
+    // Lookups with keys that don't start with the prefix.
+    int index;
+    EXPECT_FALSE(leaf::find_key(prefixed.node(), store_key_t("a").btree_key(), &index));
+    EXPECT_EQ(0, index);
+    EXPECT_FALSE(leaf::find_key(prefixed.node(), store_key_t("customers").btree_key(), &index));
+    EXPECT_EQ(0, index);
+    EXPECT_FALSE(leaf::find_key(prefixed.node(), store_key_t("z").btree_key(), &index));
+    EXPECT_EQ(prefixed.node()->num_pairs, index);
+    EXPECT_TRUE(leaf::find_key(prefixed.node(), customer_key(7).btree_key(), &index));
+    EXPECT_EQ(7, index);
+
+    for (int i = 0; i < num_prefixed; i += 3) {
+        prefixed.Remove(customer_key(i));
+    }
+    for (int i = 0; i < num_prefixed; i += 6) {
+        ASSERT_TRUE(prefixed.Insert(customer_key(i), "w"));
+    }
+
+    // The prefix doesn't grow if the bounds don't share more than it.
+    prefixed.GrowKeyPrefix(store_key_t("customers/by_id/0"), store_key_t("customers/by_id/9"));
+    EXPECT_EQ("customers/by_id/", prefixed.KeyPrefix());
+
+    // Nor does it for sizers that don't allow key prefixes.
+    plain.GrowKeyPrefix(store_key_t("customers/by_id/"), store_key_t("customers/by_id/~"));
+    EXPECT_EQ("", plain.KeyPrefix());
+}
+
+// Splits a full node with the key prefix "customers/by_id/" into `left` and
+// `right`, and gives `right` a longer key prefix.  The keys are
+// `customer_key(0)` to `customer_key(*num_keys_out - 1)`.
+void split_customer_nodes(LeafNodeTracker *left, LeafNodeTracker *right, int *num_keys_out) {
+    ASSERT_TRUE(left->Insert(customer_key(0), "v"));
+    ASSERT_TRUE(left->Insert(customer_key(1), "v"));
+    left->GrowKeyPrefix(store_key_t("customers/by_id/"), store_key_t("customers/by_id/~"));
+    *num_keys_out = 2;
+    while (left->Insert(customer_key(*num_keys_out), "v")) {
+        ++*num_keys_out;
+    }
+
+    left->Split(right);
+    ASSERT_EQ("customers/by_id/", right->KeyPrefix());
+    left->Verify();
+    right->Verify();
+
+    // After the split, `right`'s key range is narrower.
+    store_key_t median((*leaf::rbegin(*left->node())).first);
+    right->GrowKeyPrefix(median, customer_key(9999));
+    ASSERT_EQ("customers/by_id/0000", right->KeyPrefix());
+}
+
+TEST(LeafNodeTest, KeyPrefixMerging) {
+    LeafNodeTracker left(true);
+    LeafNodeTracker right(true);
+    int num_keys;
+    split_customer_nodes(&left, &right, &num_keys);
+
+    for (int i = 0; i < num_keys; ++i) {
+        if (i % 10 != 0) {
+            if (left.ShouldHave(customer_key(i))) {
+                left.Remove(customer_key(i));
+            } else if (right.ShouldHave(customer_key(i))) {
+                right.Remove(customer_key(i));
+            }
+        }
+    }
+    ASSERT_TRUE(leaf::is_mergable(right.sizer(), left.node(), right.node()));
+
+    right.Merge(&left);
+    EXPECT_EQ("customers/by_id/", right.KeyPrefix());
+}
+
+TEST(LeafNodeTest, KeyPrefixLeveling) {
+    LeafNodeTracker left(true);
+    LeafNodeTracker right(true);
+    int num_keys;
+    split_customer_nodes(&left, &right, &num_keys);
+
+    for (int i = 0; i < num_keys; ++i) {
+        if (i % 10 != 0 && left.ShouldHave(customer_key(i))) {
+            left.Remove(customer_key(i));
+        }
+    }
+    while (right.Insert(customer_key(num_keys), "v")) {
+        ++num_keys;
+    }
+
+    bool could_level;
+    left.Level(-1, &right, &could_level);
+    ASSERT_TRUE(could_level);
+    // Only the node that receives entries has to switch to the shorter prefix.
+    EXPECT_EQ("customers/by_id/", left.KeyPrefix());
+    EXPECT_EQ("customers/by_id/0000", right.KeyPrefix());
+}
+
+#ifdef NDEBUG
+TEST(LeafNodeTest, FindKeyBenchmark) {
+    LeafNodeTracker tracker;
+    std::vector<store_key_t> keys;
+    fill_with_prefixed_keys(&tracker, &keys);
+
+    // The plain binary search that `find_key` used to do, for comparison.
+    std::vector<const btree_key_t *> node_keys;
+    for (auto it = leaf::begin(*tracker.node()); it != leaf::end(*tracker.node()); ++it) {
+        node_keys.push_back((*it).first);
+    }
+
+    const int NUM_REPETITIONS = 1000;
+    int sum = 0;
+    ticks_t start_ticks = get_ticks();
+    for (int r = 0; r < NUM_REPETITIONS; ++r) {
+        for (const store_key_t &key : keys) {
+            sum += std::lower_bound(node_keys.begin(), node_keys.end(), key.btree_key(),
+                                    [](const btree_key_t *a, const btree_key_t *b) {
+                                        return btree_key_cmp(a, b) < 0;
+                                    }) - node_keys.begin();
+        }
+    }
+    const double dur_plain = ticks_to_secs(get_ticks() - start_ticks);
+
+    int find_key_sum = 0;
+    start_ticks = get_ticks();
+    for (int r = 0; r < NUM_REPETITIONS; ++r) {
+        for (const store_key_t &key : keys) {
+            int index;
+            leaf::find_key(tracker.node(), key.btree_key(), &index);
+            find_key_sum += index;
+        }
+    }
+    const double dur_find_key = ticks_to_secs(get_ticks() - start_ticks);
+    EXPECT_EQ(sum, find_key_sum);
+
+    const double num_lookups = static_cast<double>(NUM_REPETITIONS) * keys.size();
+    printf("%zu keys per node.\n", keys.size());
+    printf("Plain binary search: %f lookups/s\n", num_lookups / dur_plain);
+    printf("find_key: %f lookups/s\n", num_lookups / dur_find_key);
+}
+#endif  // NDEBUG
+
 }  // namespace unittest
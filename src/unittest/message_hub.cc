@@ -0,0 +1,108 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <vector>
+
+#include "arch/runtime/runtime.hpp"
+#include "arch/runtime/runtime_utils.hpp"
+#include "concurrency/cond_var.hpp"
+#include "concurrency/pmap.hpp"
+#include "time.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+/* A message that gets sent from one of several threads to thread 0, where it checks
+that it arrives after all of the messages that the same thread sent before it. */
+class sequenced_message_t : public linux_thread_message_t {
+public:
+    sequenced_message_t()
+        : sender(0), seq(0), last_seqs(NULL), remaining(NULL), done(NULL) { }
+
+    void on_thread_switch() {
+        EXPECT_EQ(threadnum_t(0), get_thread_id());
+        int *last_seq = &(*last_seqs)[sender];
+        EXPECT_EQ(*last_seq + 1, seq);
+        *last_seq = seq;
+        if (--*remaining == 0) {
+            done->pulse();
+        }
+    }
+
+    int sender;
+    int seq;
+    // These are only accessed on thread 0.
+    std::vector<int> *last_seqs;
+    int *remaining;
+    cond_t *done;
+};
+
+/* Sends `per_sender` messages from each thread but thread 0 to thread 0, yielding
+every `batch_size` messages so that they get handed over in batches.  Returns how long
+it took until all of them arrived. */
+double send_to_thread_zero(int per_sender, int batch_size) {
+    on_thread_t thread_switcher((threadnum_t(0)));
+    const int senders = get_num_threads() - 1;
+    std::vector<int> last_seqs(senders + 1, 0);
+    int remaining = senders * per_sender;
+    cond_t done;
+    std::vector<sequenced_message_t> messages(remaining);
+
+    ticks_t start = get_ticks();
+    pmap(senders, [&](int64_t i) {
+        const int sender = i + 1;
+        on_thread_t sender_switcher((threadnum_t(sender)));
+        for (int i = 0; i < per_sender; ++i) {
+            sequenced_message_t *msg = &messages[(sender - 1) * per_sender + i];
+            msg->sender = sender;
+            msg->seq = i + 1;
+            msg->last_seqs = &last_seqs;
+            msg->remaining = &remaining;
+            msg->done = &done;
+            bool on_same_thread = continue_on_thread(threadnum_t(0), msg);
+            guarantee(!on_same_thread);
+            if ((i + 1) % batch_size == 0) {
+                coro_t::yield();
+            }
+        }
+    });
+    done.wait();
+    double duration = ticks_to_secs(get_ticks() - start);
+
+    for (int sender = 1; sender <= senders; ++sender) {
+        EXPECT_EQ(per_sender, last_seqs[sender]);
+    }
+    return duration;
+}
+
+TPTEST(MessageHub, OrderedFromManyThreads, 4) {
+    send_to_thread_zero(1000, 1);
+    send_to_thread_zero(1000, 64);
+    send_to_thread_zero(1000, 1000);
+}
+
+// These are not really unit tests, but micro benchmarks of the latency and
+// throughput of messages between threads. No need to run them in debug mode.
+#ifdef NDEBUG
+TPTEST(MessageHub, PingPongBenchmark, 2) {
+    const int NUM_ROUND_TRIPS = 100000;
+    on_thread_t thread_switcher((threadnum_t(0)));
+    ticks_t start_ticks = get_ticks();
+    for (int i = 0; i < NUM_ROUND_TRIPS; ++i) {
+        on_thread_t other_thread((threadnum_t(1)));
+    }
+    double dur = ticks_to_secs(get_ticks() - start_ticks);
+    printf("Cross-thread round trip: %f us\n", dur / NUM_ROUND_TRIPS * 1000000);
+}
+
+TPTEST(MessageHub, ThroughputBenchmark, 8) {
+    const int NUM_MESSAGES_PER_SENDER = 100000;
+    const int senders = get_num_threads() - 1;
+    for (int batch_size : {1, 64}) {
+        double dur = send_to_thread_zero(NUM_MESSAGES_PER_SENDER, batch_size);
+        printf("%d senders, batches of %d: %f messages/s\n",
+               senders, batch_size, senders * NUM_MESSAGES_PER_SENDER / dur);
+    }
+}
+#endif  // NDEBUG
+
+}  // namespace unittest
@@ -113,6 +113,10 @@ void mock_file_opener_t::open_serializer_file_existing(scoped_ptr_t<file_t> *fil
     file_out->init(new mock_file_t(mock_file_t::mode_rw, &file_));
 }
 
+void mock_file_opener_t::open_lba_snapshot_file(scoped_ptr_t<file_t> *file_out) {
+    file_out->init(new mock_file_t(mock_file_t::mode_rw, &lba_snapshot_file_));
+}
+
 void mock_file_opener_t::unlink_serializer_file() {
     ASSERT_TRUE(file_existence_state_ == temporary_file || file_existence_state_ == permanent_file);
     file_existence_state_ = unlinked_file;
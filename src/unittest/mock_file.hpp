@@ -75,6 +75,7 @@ public:
     void open_serializer_file_create_temporary(scoped_ptr_t<file_t> *file_out);
     void move_serializer_file_to_permanent_location();
     void open_serializer_file_existing(scoped_ptr_t<file_t> *file_out);
+    void open_lba_snapshot_file(scoped_ptr_t<file_t> *file_out);
     void unlink_serializer_file();
 #ifdef SEMANTIC_SERIALIZER_CHECK
     void open_semantic_checking_file(scoped_ptr_t<semantic_checking_file_t> *file_out);
@@ -84,6 +85,7 @@ private:
     enum existence_state_t { no_file, temporary_file, permanent_file, unlinked_file };
     existence_state_t file_existence_state_;
     std::vector<char> file_;
+    std::vector<char> lba_snapshot_file_;
 #ifdef SEMANTIC_SERIALIZER_CHECK
     std::vector<char> semantic_checking_file_;
 #endif
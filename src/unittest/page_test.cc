@@ -1,4 +1,6 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <vector>
+
 #include "arch/runtime/coroutines.hpp"
 #include "arch/timing.hpp"
 #include "buffer_cache/page_cache.hpp"
@@ -6,8 +8,10 @@
 #include "buffer_cache/cache_balancer.hpp"
 #include "concurrency/auto_drainer.hpp"
 #include "concurrency/pmap.hpp"
+#include "config/args.hpp"
 #include "containers/scoped.hpp"
 #include "serializer/config.hpp"
+#include "time.hpp"
 #include "unittest/gtest.hpp"
 #include "unittest/mock_file.hpp"
 #include "unittest/unittest_utils.hpp"
@@ -1179,4 +1183,88 @@ TPTEST(PageTest, BiggerTestNoMemory, 4) {
     test.run();
 }
 
+// Creates `num_blocks` blocks that each hold their own block id.
+std::vector<block_id_t> create_numbered_blocks(mock_ser_t *mock, size_t num_blocks) {
+    std::vector<block_id_t> block_ids;
+    dummy_cache_balancer_t balancer(GIGABYTE);
+    test_cache_t page_cache(mock->ser.get(), &balancer, mock->throttler.get());
+    auto txn = make_scoped<test_txn_t>(&page_cache);
+    for (size_t i = 0; i < num_blocks; ++i) {
+        current_test_acq_t acq(txn.get(), alt_create_t::create);
+        test_acq_t page_acq;
+        page_acq.init(acq.current_page_for_write(), &page_cache);
+        block_id_t *buf = static_cast<block_id_t *>(page_acq.get_buf_write());
+        *buf = acq.block_id();
+        block_ids.push_back(acq.block_id());
+    }
+    page_cache.flush(std::move(txn));
+    return block_ids;
+}
+
+// Reads a block created by `create_numbered_blocks`.  Returns true if the read was
+// served from the cache.
+bool read_numbered_block(test_cache_t *page_cache, block_id_t block_id) {
+    const uint64_t block_reads_before = page_cache->evicter().block_reads();
+    current_test_acq_t acq(page_cache, block_id, read_access_t::read);
+    test_acq_t page_acq;
+    page_acq.init(acq.current_page_for_read(), page_cache);
+    const block_id_t *buf = static_cast<const block_id_t *>(page_acq.get_buf_read());
+    EXPECT_EQ(block_id, *buf);
+    return page_cache->evicter().block_reads() == block_reads_before;
+}
+
+// Point reads on a small set of hot blocks, interleaved with full scans over a much
+// larger number of blocks that don't fit into the cache.  Returns the ratio of
+// point reads that were served from the cache, not counting the first round (which
+// warms up the cache).
+double scan_mix_hit_ratio(size_t memory_blocks, size_t hot_blocks,
+                          size_t scan_blocks, int rounds) {
+    mock_ser_t mock;
+    std::vector<block_id_t> block_ids
+        = create_numbered_blocks(&mock, hot_blocks + scan_blocks);
+
+    dummy_cache_balancer_t balancer(memory_blocks * DEFAULT_BTREE_BLOCK_SIZE);
+    test_cache_t page_cache(mock.ser.get(), &balancer, mock.throttler.get());
+    uint64_t hits = 0;
+    uint64_t point_reads = 0;
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < scan_blocks; ++i) {
+            read_numbered_block(&page_cache, block_ids[hot_blocks + i]);
+            const bool hit
+                = read_numbered_block(&page_cache, block_ids[randsize(hot_blocks)]);
+            if (round > 0) {
+                hits += hit ? 1 : 0;
+                ++point_reads;
+            }
+        }
+    }
+    return static_cast<double>(hits) / point_reads;
+}
+
+TPTEST(PageTest, ScanResistantEviction, 4) {
+    // Between two reads of the same hot block, about twice as many other blocks get
+    // read as fit into the cache, so without some scan resistance most point reads
+    // would go to disk.
+    const double hit_ratio = scan_mix_hit_ratio(64, 32, 512, 3);
+    EXPECT_GT(hit_ratio, 0.85);
+}
+
+#ifdef NDEBUG
+TPTEST(PageTest, ScanMixBenchmark, 4) {
+    const size_t memory_blocks = 256;
+    const size_t scan_blocks = 2048;
+    const int rounds = 4;
+    for (size_t hot_blocks = 32; hot_blocks <= 224; hot_blocks += 64) {
+        ticks_t start_ticks = get_ticks();
+        const double hit_ratio
+            = scan_mix_hit_ratio(memory_blocks, hot_blocks, scan_blocks, rounds);
+        double duration = ticks_to_secs(get_ticks() - start_ticks);
+        printf("%zu of %zu blocks in memory, %zu hot blocks, %zu scanned blocks: "
+               "%.1f%% of point reads hit the cache (%f s)\n",
+               memory_blocks, hot_blocks + scan_blocks, hot_blocks, scan_blocks,
+               hit_ratio * 100, duration);
+    }
+}
+#endif  // NDEBUG
+
 }  // namespace unittest
@@ -48,4 +48,35 @@ TEST(PrintSecondary, Mangle) {
                 "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb");
 }
 
+TEST(PrintSecondary, ExtractValue) {
+    const store_key_t primary(ql::datum_t(datum_string_t("pkey")).print_primary());
+    std::vector<ql::datum_t> values = {
+        ql::datum_t(-1.5), ql::datum_t(3.0), ql::datum_t(1e300),
+        ql::datum_t(datum_string_t("foo")), ql::datum_t(datum_string_t("")),
+        ql::datum_t::boolean(true), ql::datum_t::boolean(false) };
+    for (const ql::datum_t &value : values) {
+        ASSERT_EQ(value, ql::datum_t::from_primary_key(value.print_primary()));
+        for (boost::optional<uint64_t> tag : { boost::optional<uint64_t>(),
+                                               boost::optional<uint64_t>(7) }) {
+            store_key_t key(value.print_secondary(
+                ql::skey_version_t::post_1_16, primary, tag));
+            ASSERT_EQ(value, ql::datum_t::extract_secondary_value(key));
+            // Keys of the old skey version don't say where the value ends.
+            store_key_t old_key(value.print_secondary(
+                ql::skey_version_t::pre_1_16, primary, tag));
+            ASSERT_FALSE(ql::datum_t::extract_secondary_value(old_key).has());
+        }
+    }
+
+    // Truncated keys and values of other types can't be extracted.
+    store_key_t long_key(ql::datum_t(datum_string_t(std::string(300, 'a')))
+        .print_secondary(ql::skey_version_t::post_1_16, primary, boost::none));
+    ASSERT_FALSE(ql::datum_t::extract_secondary_value(long_key).has());
+    ql::datum_t array(std::vector<ql::datum_t>{ql::datum_t(1.0)},
+                      ql::configured_limits_t::unlimited);
+    store_key_t array_key(array.print_secondary(
+        ql::skey_version_t::post_1_16, primary, boost::none));
+    ASSERT_FALSE(ql::datum_t::extract_secondary_value(array_key).has());
+}
+
 }  // namespace unittest
@@ -0,0 +1,61 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/query_cache.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/query_utils.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+TPTEST(QueryCacheTest, PrepareAndExecute) {
+    rdb_context_t ctx;
+    ql::query_cache_t query_cache(&ctx, ip_and_port_t(),
+                                  ql::return_empty_normal_batches_t::NO);
+
+    // r.func(x, y) { x * 10 + y['a'].count() }
+    Response res = run_json_query(&query_cache, 1, strprintf(
+        "[%d,[69,[[2,[1,2]],[24,[[26,[[10,[1]],10]],[43,[[170,[[10,[2]],\"a\"]]]]]]]]]",
+        static_cast<int>(Query::PREPARE)));
+    ASSERT_EQ(Response::SUCCESS_ATOM, res.type());
+    const ql::datum_t id = response_datum(res);
+    ASSERT_EQ(ql::datum_t::R_NUM, id.get_type());
+
+    for (int i = 0; i < 3; ++i) {
+        res = run_json_query(&query_cache, 2 + i, strprintf(
+            "[%d,[2,[%s,%d,{\"a\":[2,[1,2,3]]}]]]",
+            static_cast<int>(Query::EXECUTE), id.print().c_str(), i));
+        ASSERT_EQ(Response::SUCCESS_ATOM, res.type());
+        EXPECT_EQ(ql::datum_t(static_cast<double>(i * 10 + 3)), response_datum(res));
+    }
+
+    // Runtime errors have backtraces relative to the prepared function.
+    res = run_json_query(&query_cache, 10, strprintf(
+        "[%d,[2,[%s,1,{}]]]",
+        static_cast<int>(Query::EXECUTE), id.print().c_str()));
+    EXPECT_EQ(Response::RUNTIME_ERROR, res.type());
+    ASSERT_LT(0, res.backtrace().frames_size());
+    EXPECT_EQ(1, res.backtrace().frames(0).pos());
+
+    // Arguments must be literals.
+    res = run_json_query(&query_cache, 11, strprintf(
+        "[%d,[2,[%s,[24,[1,2]],{}]]]",
+        static_cast<int>(Query::EXECUTE), id.print().c_str()));
+    EXPECT_EQ(Response::COMPILE_ERROR, res.type());
+
+    res = run_json_query(&query_cache, 12, strprintf(
+        "[%d,[2,[1234,1,{}]]]", static_cast<int>(Query::EXECUTE)));
+    EXPECT_EQ(Response::CLIENT_ERROR, res.type());
+
+    res = run_json_query(&query_cache, 13, strprintf(
+        "[%d,[24,[1,2]]]", static_cast<int>(Query::PREPARE)));
+    EXPECT_EQ(Response::CLIENT_ERROR, res.type());
+
+    // `r.now()` would be the time of the PREPARE, so it isn't allowed.
+    // r.func(x) { x + r.now() }
+    res = run_json_query(&query_cache, 14, strprintf(
+        "[%d,[69,[[2,[1]],[24,[[10,[1]],[103,[]]]]]]]",
+        static_cast<int>(Query::PREPARE)));
+    EXPECT_EQ(Response::COMPILE_ERROR, res.type());
+}
+
+}  // namespace unittest
@@ -0,0 +1,63 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "unittest/query_utils.hpp"
+
+#include "concurrency/cond_var.hpp"
+#include "concurrency/new_semaphore.hpp"
+#include "protob/json_shim.hpp"
+#include "rdb_protocol/counted_term.hpp"
+#include "rdb_protocol/query_cache.hpp"
+
+// Predeclaration for run, like in `query_server.cc`
+namespace ql {
+    void run(ql::query_id_t &&query_id,
+             protob_t<Query> q,
+             Response *response_out,
+             ql::query_cache_t *query_cache,
+             new_semaphore_acq_t *throttler,
+             signal_t *interruptor);
+}
+
+namespace unittest {
+
+Response run_json_query(ql::query_cache_t *query_cache,
+                        int64_t token,
+                        const std::string &json) {
+    ql::protob_t<Query> query = ql::make_counted_query();
+    std::string buf = json;
+    guarantee(json_shim::parse_json_pb(query.get(), token, &buf[0]));
+
+    Response res;
+    new_semaphore_acq_t throttler;
+    cond_t interruptor;
+    ql::run(ql::query_id_t(query_cache), query, &res, query_cache, &throttler,
+            &interruptor);
+    return res;
+}
+
+std::vector<ql::datum_t> run_json_stream_query(ql::query_cache_t *query_cache,
+                                               int64_t token,
+                                               const std::string &json) {
+    std::vector<ql::datum_t> rows;
+    Response res = run_json_query(query_cache, token, json);
+    for (;;) {
+        guarantee(res.type() == Response::SUCCESS_PARTIAL
+                  || res.type() == Response::SUCCESS_SEQUENCE);
+        for (int i = 0; i < res.response_size(); ++i) {
+            rows.push_back(ql::to_datum(&res.response(i),
+                                        ql::configured_limits_t::unlimited,
+                                        reql_version_t::LATEST));
+        }
+        if (res.type() == Response::SUCCESS_SEQUENCE) {
+            return rows;
+        }
+        res = run_json_query(query_cache, token, "[2]");
+    }
+}
+
+ql::datum_t response_datum(const Response &res) {
+    guarantee(res.response_size() == 1);
+    return ql::to_datum(&res.response(0), ql::configured_limits_t::unlimited,
+                        reql_version_t::LATEST);
+}
+
+}  // namespace unittest
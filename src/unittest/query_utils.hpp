@@ -0,0 +1,32 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#ifndef UNITTEST_QUERY_UTILS_HPP_
+#define UNITTEST_QUERY_UTILS_HPP_
+
+#include <string>
+#include <vector>
+
+#include "rdb_protocol/datum.hpp"
+#include "rdb_protocol/ql2.pb.h"
+
+namespace ql { class query_cache_t; }
+
+namespace unittest {
+
+/* Runs a query given in the JSON wire format, like `[1,<term>,<global optargs>]`, the
+way a client connection would, and returns the response. */
+Response run_json_query(ql::query_cache_t *query_cache,
+                        int64_t token,
+                        const std::string &json);
+
+/* Runs a query like `run_json_query`, which must return a stream rather than an atom,
+and then keeps continuing it until the stream is over.  Returns all the rows. */
+std::vector<ql::datum_t> run_json_stream_query(ql::query_cache_t *query_cache,
+                                               int64_t token,
+                                               const std::string &json);
+
+/* The single datum that `res` carries. */
+ql::datum_t response_datum(const Response &res);
+
+}  // namespace unittest
+
+#endif  // UNITTEST_QUERY_UTILS_HPP_
@@ -7,16 +7,19 @@
 #include "btree/operations.hpp"
 #include "btree/reql_specific.hpp"
 #include "buffer_cache/cache_balancer.hpp"
+#include "config/args.hpp"
 #include "containers/archive/boost_types.hpp"
 #include "containers/archive/vector_stream.hpp"
 #include "containers/uuid.hpp"
 #include "rapidjson/document.h"
 #include "rdb_protocol/btree.hpp"
+#include "rdb_protocol/context.hpp"
 #include "rdb_protocol/env.hpp"
 #include "rdb_protocol/erase_range.hpp"
 #include "rdb_protocol/minidriver.hpp"
 #include "rdb_protocol/pb_utils.hpp"
 #include "rdb_protocol/protocol.hpp"
+#include "rdb_protocol/shards.hpp"
 #include "rdb_protocol/store.hpp"
 #include "rdb_protocol/sym.hpp"
 #include "stl_utils.hpp"
@@ -161,6 +164,7 @@ ql::grouped_t<ql::stream_t> read_row_via_sindex(
         key_range_t::universe(),
         sorting_t::ASCENDING,
         sindex_info,
+        "",
         &res,
         release_superblock_t::RELEASE);
 
@@ -433,4 +437,329 @@ TPTEST(RDBBtree, SindexInterruptionViaStoreDelete) {
     store.reset();
 }
 
+TPTEST(RDBBtree, GetBatch) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."),
+            generate_uuid());
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+
+    // Unsorted, with a duplicate and with keys that don't exist.
+    std::vector<store_key_t> keys;
+    for (int i = TOTAL_KEYS_TO_INSERT + 20; i >= -20; i -= 7) {
+        keys.push_back(
+            store_key_t(ql::datum_t(static_cast<double>(i)).print_primary()));
+    }
+    keys.push_back(keys[3]);
+
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store.new_read_token(&token);
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store.acquire_superblock_for_read(
+            &token, &txn, &superblock, &dummy_interruptor, false);
+
+    batched_point_read_response_t response;
+    rdb_get_batch(keys, store.btree.get(), superblock.get(), &response, NULL);
+
+    int expected_found = 0;
+    for (int i = TOTAL_KEYS_TO_INSERT + 20; i >= -20; i -= 7) {
+        store_key_t key(ql::datum_t(static_cast<double>(i)).print_primary());
+        auto it = response.data.find(key);
+        if (i < 0 || i >= TOTAL_KEYS_TO_INSERT) {
+            EXPECT_TRUE(it == response.data.end());
+        } else {
+            ASSERT_TRUE(it != response.data.end());
+            EXPECT_EQ(ql::datum_t(static_cast<double>(i)),
+                      it->second.get_field("id"));
+            ++expected_found;
+        }
+    }
+    EXPECT_EQ(static_cast<size_t>(expected_found), response.data.size());
+}
+
+uint64_t count_rows(store_t *store, const key_range_t &range, read_mode_t read_mode) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store->acquire_superblock_for_read(
+            &token, &txn, &superblock, &dummy_interruptor, true);
+
+    ql::env_t dummy_env(&dummy_interruptor,
+                        ql::return_empty_normal_batches_t::NO,
+                        reql_version_t::LATEST);
+    rget_read_response_t res;
+    rdb_rget_slice(
+        store->btree.get(),
+        range,
+        superblock.get(),
+        &dummy_env,
+        ql::batchspec_t::default_for(ql::batch_type_t::TERMINAL),
+        std::vector<ql::transform_variant_t>(),
+        boost::optional<ql::terminal_variant_t>(ql::count_wire_func_t()),
+        sorting_t::UNORDERED,
+        &res,
+        release_superblock_t::RELEASE,
+        read_mode);
+
+    ql::grouped_t<uint64_t> *counts = boost::get<ql::grouped_t<uint64_t> >(&res.result);
+    guarantee(counts != NULL);
+    return counts->size() == 0 ? 0 : counts->begin()->second;
+}
+
+TPTEST(RDBBtree, Count) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."),
+            generate_uuid());
+
+    EXPECT_EQ(0u, count_rows(&store, key_range_t::universe(), read_mode_t::OUTDATED));
+
+    insert_rows(0, TOTAL_KEYS_TO_INSERT, &store);
+
+    // This one comes from the stat block...
+    EXPECT_EQ(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT),
+              count_rows(&store, key_range_t::universe(), read_mode_t::OUTDATED));
+    // ... and these ones get counted, because they aren't outdated reads or have
+    // rows outside of their range.
+    EXPECT_EQ(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT),
+              count_rows(&store, key_range_t::universe(), read_mode_t::SINGLE));
+    const store_key_t key_100(ql::datum_t(100.0).print_primary());
+    const store_key_t key_200(ql::datum_t(200.0).print_primary());
+    EXPECT_EQ(100u, count_rows(&store,
+                               key_range_t(key_range_t::closed, key_100,
+                                           key_range_t::open, key_200),
+                               read_mode_t::OUTDATED));
+    EXPECT_EQ(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT - 100),
+              count_rows(&store,
+                         key_range_t(key_range_t::closed, key_100,
+                                     key_range_t::none, store_key_t()),
+                         read_mode_t::OUTDATED));
+}
+
+TPTEST(RDBBtree, CountDuringWrites) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."),
+            generate_uuid());
+
+    const int initial_rows = TOTAL_KEYS_TO_INSERT / 2;
+    insert_rows(0, initial_rows, &store);
+
+    // Every count has to see a state of the table that the writes went through, so
+    // with only inserts running they can never go down.
+    cond_t background_inserts_done;
+    coro_t::spawn_sometime(std::bind(&insert_rows_and_pulse_when_done,
+                                     initial_rows, TOTAL_KEYS_TO_INSERT,
+                                     &store, &background_inserts_done));
+    uint64_t last_count = initial_rows;
+    while (!background_inserts_done.is_pulsed()) {
+        const uint64_t count =
+            count_rows(&store, key_range_t::universe(), read_mode_t::SINGLE);
+        EXPECT_LE(last_count, count);
+        EXPECT_GE(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT), count);
+        last_count = count;
+
+        const uint64_t outdated_count =
+            count_rows(&store, key_range_t::universe(), read_mode_t::OUTDATED);
+        EXPECT_LE(static_cast<uint64_t>(initial_rows), outdated_count);
+        EXPECT_GE(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT), outdated_count);
+        coro_t::yield();
+    }
+
+    EXPECT_EQ(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT),
+              count_rows(&store, key_range_t::universe(), read_mode_t::SINGLE));
+    EXPECT_EQ(static_cast<uint64_t>(TOTAL_KEYS_TO_INSERT),
+              count_rows(&store, key_range_t::universe(), read_mode_t::OUTDATED));
+}
+
+size_t count_rget_parts(store_t *store, const key_range_t &range) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store->acquire_superblock_for_read(
+            &token, &txn, &superblock, &dummy_interruptor, true);
+    return split_rget_range(superblock.get(), range).size();
+}
+
+ql::datum_t rget_terminal(store_t *store,
+                          const key_range_t &range,
+                          const ql::terminal_variant_t &terminal) {
+    cond_t dummy_interruptor;
+    read_token_t token;
+    store->new_read_token(&token);
+    scoped_ptr_t<txn_t> txn;
+    scoped_ptr_t<real_superblock_t> superblock;
+    store->acquire_superblock_for_read(
+            &token, &txn, &superblock, &dummy_interruptor, true);
+
+    // The parts only get evaluated concurrently if there is a context.
+    rdb_context_t ctx;
+    ql::env_t env(&ctx, ql::return_empty_normal_batches_t::NO, &dummy_interruptor,
+                  std::map<std::string, ql::wire_func_t>(), nullptr);
+    rget_read_response_t res;
+    rdb_rget_slice(
+        store->btree.get(),
+        range,
+        superblock.get(),
+        &env,
+        ql::batchspec_t::default_for(ql::batch_type_t::TERMINAL),
+        std::vector<ql::transform_variant_t>(),
+        boost::optional<ql::terminal_variant_t>(terminal),
+        sorting_t::UNORDERED,
+        &res,
+        release_superblock_t::RELEASE,
+        read_mode_t::SINGLE);
+    guarantee(boost::get<ql::exc_t>(&res.result) == NULL);
+
+    scoped_ptr_t<ql::eager_acc_t> acc = ql::make_eager_terminal(terminal);
+    acc->add_res(&env, &res.result);
+    return acc->finish_eager(ql::backtrace_id_t::empty(), false,
+                             ql::configured_limits_t::unlimited)->as_datum();
+}
+
+TPTEST_MULTITHREAD(RDBBtree, ParallelRget, 4) {
+    recreate_temporary_directory(base_path_t("."));
+    temp_file_t temp_file;
+
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    dummy_cache_balancer_t balancer(GIGABYTE);
+
+    filepath_file_opener_t file_opener(temp_file.name(), &io_backender);
+    standard_serializer_t::create(
+        &file_opener,
+        standard_serializer_t::static_config_t());
+
+    standard_serializer_t serializer(
+        standard_serializer_t::dynamic_config_t(),
+        &file_opener,
+        &get_global_perfmon_collection());
+
+    store_t store(
+            region_t::universe(),
+            &serializer,
+            &balancer,
+            "unit_test_store",
+            true,
+            &get_global_perfmon_collection(),
+            NULL,
+            &io_backender,
+            base_path_t("."),
+            generate_uuid());
+
+    const int num_rows = 2 * RGET_PARALLEL_MIN_ROWS;
+    insert_rows(0, num_rows, &store);
+
+    // Only the whole table is large enough to be split, and only if there are threads
+    // to evaluate the parts on.
+    const store_key_t key_100(ql::datum_t(100.0).print_primary());
+    const store_key_t key_200(ql::datum_t(200.0).print_primary());
+    const key_range_t small_range(key_range_t::closed, key_100,
+                                  key_range_t::open, key_200);
+    if (get_num_db_threads() > 1) {
+        EXPECT_LT(1u, count_rget_parts(&store, key_range_t::universe()));
+    } else {
+        EXPECT_EQ(1u, count_rget_parts(&store, key_range_t::universe()));
+    }
+    EXPECT_EQ(1u, count_rget_parts(&store, small_range));
+
+    ql::sym_t x(1);
+    ql::sum_wire_func_t sum(ql::backtrace_id_t::empty(),
+                            ql::r::var(x)["id"].release_counted(),
+                            make_vector(x), ql::backtrace_id_t::empty());
+    EXPECT_EQ(ql::datum_t(static_cast<double>(num_rows) * (num_rows - 1) / 2),
+              rget_terminal(&store, key_range_t::universe(), sum));
+    EXPECT_EQ(ql::datum_t(14950.0), rget_terminal(&store, small_range, sum));
+
+    // The rows with the smallest `id % 10` are tied, and come out in key order no
+    // matter which parts they were read in.
+    ql::top_k_wire_func_t top_k;
+    top_k.n = 25;
+    top_k.directions.push_back(sorting_t::ASCENDING);
+    top_k.funcs.push_back(ql::wire_func_t(
+        ql::r::var(x)["id"].call(Term::MOD, 10.0).release_counted(),
+        make_vector(x), ql::backtrace_id_t::empty()));
+    ql::datum_t rows = rget_terminal(&store, key_range_t::universe(), top_k);
+    ASSERT_EQ(25u, rows.arr_size());
+    for (size_t i = 0; i < rows.arr_size(); ++i) {
+        EXPECT_EQ(ql::datum_t(static_cast<double>(10 * i)),
+                  rows.get(i).get_field("id"));
+    }
+}
+
 } //namespace unittest
@@ -71,6 +71,20 @@ void mock_namespace_interface_t::read_visitor_t::operator()(const point_read_t &
     }
 }
 
+void mock_namespace_interface_t::read_visitor_t::operator()(
+        const batched_point_read_t &get) {
+    response->response = batched_point_read_response_t();
+    batched_point_read_response_t &res =
+        boost::get<batched_point_read_response_t>(response->response);
+
+    for (const store_key_t &key : get.keys) {
+        auto it = parent->data.find(key);
+        if (it != parent->data.end()) {
+            res.data[key] = it->second;
+        }
+    }
+}
+
 void mock_namespace_interface_t::read_visitor_t::operator()(const dummy_read_t &) {
     response->response = dummy_read_response_t();
 }
@@ -640,4 +654,15 @@ bool test_rdb_env_t::instance_t::sindex_list(
     return false;
 }
 
+bool test_rdb_env_t::instance_t::sindex_list_cached(
+        counted_t<const ql::db_t> db,
+        const name_string_t &table,
+        signal_t *local_interruptor,
+        admin_err_t *error_out,
+        std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+            *configs_and_statuses_out) {
+    return sindex_list(
+        db, table, local_interruptor, error_out, configs_and_statuses_out);
+}
+
 }  // namespace unittest
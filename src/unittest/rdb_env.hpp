@@ -66,6 +66,7 @@ private:
 
     struct read_visitor_t : public boost::static_visitor<void> {
         void operator()(const point_read_t &get);
+        void operator()(const batched_point_read_t &get);
         void operator()(const dummy_read_t &d);
         void NORETURN operator()(const changefeed_subscribe_t &);
         void NORETURN operator()(const changefeed_limit_subscribe_t &);
@@ -279,6 +280,13 @@ public:
                 admin_err_t *error_out,
                 std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
                     *configs_and_statuses_out);
+        bool sindex_list_cached(
+                counted_t<const ql::db_t> db,
+                const name_string_t &table,
+                signal_t *interruptor,
+                admin_err_t *error_out,
+                std::map<std::string, std::pair<sindex_config_t, sindex_status_t> >
+                    *configs_and_statuses_out);
 
     private:
         extproc_pool_t extproc_pool;
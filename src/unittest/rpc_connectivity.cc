@@ -1,10 +1,14 @@
 // Copyright 2010-2014 RethinkDB, all rights reserved.
+#include <zlib.h>
+
 #include <functional>
 
 #include "arch/runtime/thread_pool.hpp"
 #include "arch/timing.hpp"
+#include "config/args.hpp"
 #include "containers/scoped.hpp"
 #include "containers/archive/socket_stream.hpp"
+#include "containers/archive/vector_stream.hpp"
 #include "unittest/clustering_utils.hpp"
 #include "unittest/unittest_utils.hpp"
 #include "rpc/connectivity/cluster.hpp"
@@ -506,6 +510,292 @@ TPTEST_MULTITHREAD(RPCConnectivityTest, BinaryData, 3) {
     EXPECT_TRUE(a2.got_spectrum);
 }
 
+/* `CompressedMessages` sends large and small messages from a server that compresses
+them and holds them back for a moment, and checks that they arrive intact and in
+order. */
+
+class string_test_application_t :
+    public home_thread_mixin_t,
+    public cluster_message_handler_t
+{
+public:
+    explicit string_test_application_t(connectivity_cluster_t *cm) :
+        cluster_message_handler_t(cm, 'S')
+        { }
+    void send(const std::string &message, peer_id_t peer, uint64_t lane_key = 0) {
+        class writer_t : public cluster_send_message_write_callback_t {
+        public:
+            explicit writer_t(const std::string &_data) : data(_data) { }
+            virtual ~writer_t() { }
+            void write(write_stream_t *stream) {
+                write_message_t wm;
+                serialize<cluster_version_t::CLUSTER>(&wm, data);
+                int res = send_write_message(stream, &wm);
+                if (res) { throw fake_archive_exc_t(); }
+            }
+#ifdef ENABLE_MESSAGE_PROFILER
+            const char *message_profiler_tag() const {
+                return "unittest";
+            }
+#endif
+            const std::string &data;
+        } writer(message);
+        auto_drainer_t::lock_t connection_keepalive;
+        connectivity_cluster_t::connection_t *connection =
+            get_connectivity_cluster()->get_connection(peer, &connection_keepalive);
+        ASSERT_TRUE(connection != NULL);
+        get_connectivity_cluster()->send_message(connection, connection_keepalive,
+                                                 get_message_tag(), &writer, lane_key);
+    }
+    void on_message(connectivity_cluster_t::connection_t *,
+                    auto_drainer_t::lock_t,
+                    read_stream_t *stream) {
+        std::string message;
+        archive_result_t res
+            = deserialize<cluster_version_t::CLUSTER>(stream, &message);
+        if (bad(res)) { throw fake_archive_exc_t(); }
+        on_thread_t th(home_thread());
+        inbox.push_back(message);
+    }
+    std::vector<std::string> inbox;
+};
+
+TPTEST_MULTITHREAD(RPCConnectivityTest, CompressedMessages, 3) {
+    heartbeat_semilattice_metadata_t heartbeat_semilattice_metadata;
+    dummy_semilattice_controller_t<heartbeat_semilattice_metadata_t>
+        heartbeat_manager(heartbeat_semilattice_metadata);
+
+    cluster_connection_config_t config;
+    config.compress_messages = true;
+    config.flush_delay_ms = 5;
+
+    connectivity_cluster_t c1, c2;
+    string_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, heartbeat_manager.get_view(), config);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, heartbeat_manager.get_view());
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    // Every other message is large enough to get compressed. The random one at the end
+    // doesn't get any smaller, so it gets sent as it is.
+    std::vector<std::string> messages;
+    for (int i = 0; i < 10; ++i) {
+        messages.push_back(strprintf("small %d", i));
+        messages.push_back(std::string(10 * KILOBYTE, 'a' + i));
+    }
+    messages.push_back(rand_string(10 * KILOBYTE));
+    for (const std::string &message : messages) {
+        a1.send(message, c2.get_me());
+        a2.send(message, c1.get_me());
+    }
+
+    let_stuff_happen();
+
+    EXPECT_EQ(messages, a2.inbox);
+    // `c2` doesn't compress its messages, but `c1` reads them all the same.
+    EXPECT_EQ(messages, a1.inbox);
+}
+
+/* `ConnectionLanes` opens several lanes from one server to another, and checks that
+messages in both directions arrive, and in order if they use the same lane key. Then it
+checks that the heartbeats keep the idle lanes open. */
+TPTEST_MULTITHREAD(RPCConnectivityTest, ConnectionLanes, 3) {
+    heartbeat_semilattice_metadata_t heartbeat_semilattice_metadata;
+    heartbeat_semilattice_metadata.heartbeat_timeout = versioned_t<uint64_t>(500);
+    dummy_semilattice_controller_t<heartbeat_semilattice_metadata_t>
+        heartbeat_manager(heartbeat_semilattice_metadata);
+
+    cluster_connection_config_t config;
+    config.lanes = 3;
+
+    connectivity_cluster_t c1, c2;
+    string_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, heartbeat_manager.get_view(), config);
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, heartbeat_manager.get_view());
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    const uint64_t num_keys = 5;
+    const int messages_per_key = 50;
+    for (int i = 0; i < messages_per_key; ++i) {
+        for (uint64_t key = 0; key < num_keys; ++key) {
+            const std::string message = strprintf("%" PRIu64 " %d", key, i);
+            a1.send(message, c2.get_me(), key);
+            a2.send(message, c1.get_me(), key);
+        }
+    }
+
+    let_stuff_happen();
+
+    for (string_test_application_t *a : {&a1, &a2}) {
+        ASSERT_EQ(num_keys * messages_per_key, a->inbox.size());
+        std::vector<int> next_per_key(num_keys, 0);
+        for (const std::string &message : a->inbox) {
+            uint64_t key;
+            int i;
+            ASSERT_EQ(2, sscanf(message.c_str(), "%" SCNu64 " %d", &key, &i));
+            ASSERT_LT(key, num_keys);
+            EXPECT_EQ(next_per_key[key], i);
+            next_per_key[key] = i + 1;
+        }
+    }
+
+    /* Nothing but heartbeats goes over the lanes for several heartbeat timeouts. If
+    any lane didn't get its own heartbeats, it would close the connection. */
+    nap(2000);
+    EXPECT_EQ(2u, c1.get_connections()->get_all().size());
+    EXPECT_EQ(2u, c2.get_connections()->get_all().size());
+}
+
+/* `BadCompressedMessages` sends compressed messages with bad headers or contents, and
+checks that the receiving server closes the connection instead of allocating whatever
+the header claims or crashing. */
+
+class raw_test_application_t :
+    public home_thread_mixin_t,
+    public cluster_message_handler_t
+{
+public:
+    explicit raw_test_application_t(connectivity_cluster_t *cm) :
+        cluster_message_handler_t(cm, 'R'), received(0)
+        { }
+    /* Sends an empty message, followed by `raw`. Since the receiving end doesn't read
+    anything for the empty message, it reads `raw` as the next message. */
+    void send_raw(const std::vector<char> &raw, peer_id_t peer) {
+        class writer_t : public cluster_send_message_write_callback_t {
+        public:
+            explicit writer_t(const std::vector<char> &_data) : data(_data) { }
+            virtual ~writer_t() { }
+            void write(write_stream_t *stream) {
+                int64_t res = stream->write(data.data(), data.size());
+                if (res != static_cast<int64_t>(data.size())) {
+                    throw fake_archive_exc_t();
+                }
+            }
+#ifdef ENABLE_MESSAGE_PROFILER
+            const char *message_profiler_tag() const {
+                return "unittest";
+            }
+#endif
+            const std::vector<char> &data;
+        } writer(raw);
+        auto_drainer_t::lock_t connection_keepalive;
+        connectivity_cluster_t::connection_t *connection =
+            get_connectivity_cluster()->get_connection(peer, &connection_keepalive);
+        ASSERT_TRUE(connection != NULL);
+        get_connectivity_cluster()->send_message(connection, connection_keepalive,
+                                                 get_message_tag(), &writer);
+    }
+    void on_message(connectivity_cluster_t::connection_t *,
+                    auto_drainer_t::lock_t,
+                    read_stream_t *) {
+        on_thread_t th(home_thread());
+        ++received;
+    }
+    int received;
+};
+
+/* Returns a compressed message with the given header fields, followed by `contents`. */
+std::vector<char> make_compressed_message(uint64_t size,
+                                          uint64_t compressed_size,
+                                          const std::vector<char> &contents) {
+    write_message_t wm;
+    serialize_universal(&wm, connectivity_cluster_t::compressed_tag);
+    serialize_universal(&wm, static_cast<connectivity_cluster_t::message_tag_t>('R'));
+    serialize_universal(&wm, size);
+    serialize_universal(&wm, compressed_size);
+    vector_stream_t stream;
+    int res = send_write_message(&stream, &wm);
+    guarantee(res == 0);
+    std::vector<char> message;
+    stream.swap(&message);
+    message.insert(message.end(), contents.begin(), contents.end());
+    return message;
+}
+
+void run_bad_compressed_message_test(const std::vector<char> &message,
+                                     bool expect_closed) {
+    heartbeat_semilattice_metadata_t heartbeat_semilattice_metadata;
+    dummy_semilattice_controller_t<heartbeat_semilattice_metadata_t>
+        heartbeat_manager(heartbeat_semilattice_metadata);
+
+    connectivity_cluster_t c1, c2;
+    raw_test_application_t a1(&c1), a2(&c2);
+    connectivity_cluster_t::run_t cr1(&c1, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, heartbeat_manager.get_view());
+    connectivity_cluster_t::run_t cr2(&c2, get_unittest_addresses(), peer_address_t(),
+        ANY_PORT, 0, heartbeat_manager.get_view());
+    cr1.join(get_cluster_local_address(&c2));
+
+    let_stuff_happen();
+
+    auto_drainer_t::lock_t connection_keepalive;
+    connectivity_cluster_t::connection_t *connection =
+        c1.get_connection(c2.get_me(), &connection_keepalive);
+    ASSERT_TRUE(connection != NULL);
+
+    a1.send_raw(message, c2.get_me());
+
+    let_stuff_happen();
+
+    if (expect_closed) {
+        // Only the empty message that carried the bad one got through.
+        EXPECT_EQ(1, a2.received);
+        EXPECT_TRUE(connection_keepalive.get_drain_signal()->is_pulsed());
+    } else {
+        EXPECT_EQ(2, a2.received);
+        EXPECT_FALSE(connection_keepalive.get_drain_signal()->is_pulsed());
+    }
+}
+
+std::vector<char> compress_for_test(const std::vector<char> &data) {
+    std::vector<char> compressed(compressBound(data.size()));
+    uLongf compressed_size = compressed.size();
+    int res = compress2(reinterpret_cast<Bytef *>(compressed.data()), &compressed_size,
+                        reinterpret_cast<const Bytef *>(data.data()), data.size(),
+                        CLUSTER_COMPRESSION_ZLIB_LEVEL);
+    guarantee(res == Z_OK);
+    compressed.resize(compressed_size);
+    return compressed;
+}
+
+TPTEST_MULTITHREAD(RPCConnectivityTest, BadCompressedMessages, 3) {
+    const std::vector<char> data(10 * KILOBYTE, 'a');
+    const std::vector<char> compressed = compress_for_test(data);
+
+    // A good message, to make sure the bad ones below fail for the right reason.
+    run_bad_compressed_message_test(
+        make_compressed_message(data.size(), compressed.size(), compressed), false);
+
+    // A message that claims to be much larger than we'd ever accept.
+    run_bad_compressed_message_test(
+        make_compressed_message(uint64_t(1) << 50, uint64_t(1) << 40, compressed),
+        true);
+    run_bad_compressed_message_test(
+        make_compressed_message(
+            static_cast<uint64_t>(CLUSTER_COMPRESSION_MAX_MESSAGE_SIZE) + 1,
+            compressed.size(), compressed),
+        true);
+
+    // Messages that inflate to more or less than their header says.
+    run_bad_compressed_message_test(
+        make_compressed_message(data.size() + 1, compressed.size(), compressed), true);
+    run_bad_compressed_message_test(
+        make_compressed_message(data.size() - 1, compressed.size(), compressed), true);
+
+    // A message that ends in the middle of the zlib stream.
+    std::vector<char> truncated(compressed.begin(),
+                                compressed.begin() + compressed.size() / 2);
+    run_bad_compressed_message_test(
+        make_compressed_message(data.size(), truncated.size(), truncated), true);
+}
+
 /* `PeerIDSemantics` makes sure that `peer_id_t::is_nil()` works as expected. */
 TPTEST_MULTITHREAD(RPCConnectivityTest, PeerIDSemantics, 3) {
     peer_id_t nil_peer;
@@ -1,3 +1,6 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <functional>
 
 #include "arch/runtime/starter.hpp"
@@ -90,5 +93,184 @@ TEST(SerializerTest, AddDeleteRepeatedlyWithIndex) {
     run_in_thread_pool(std::bind(run_AddDeleteRepeatedly, true), 4);
 }
 
+void check_block_contents(standard_serializer_t *ser, file_account_t *account,
+                          block_id_t block_id, const buf_ptr_t &expected) {
+    counted_t<standard_block_token_t> token = ser->index_read(block_id);
+    ASSERT_TRUE(token.has());
+    ASSERT_EQ(expected.block_size().ser_value(), token->block_size().ser_value());
+    buf_ptr_t buf = ser->block_read(token, account);
+    ASSERT_EQ(expected.block_size().ser_value(), buf.block_size().ser_value());
+    ASSERT_EQ(0, memcmp(expected.cache_data(), buf.cache_data(),
+                        expected.block_size().value()));
+}
+
+TPTEST(SerializerTest, CompressedBlocks, 4) {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+
+    // One block that compresses well and one that doesn't compress at all, so we
+    // get both kinds of blocks on disk.
+    const int num_blocks = 2;
+    std::vector<buf_ptr_t> bufs;
+    {
+        standard_serializer_t::dynamic_config_t dynamic_config;
+        dynamic_config.block_compression = block_compression_t::zlib;
+        standard_serializer_t ser(dynamic_config,
+                                  &file_opener,
+                                  &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+
+        for (int i = 0; i < num_blocks; ++i) {
+            buf_ptr_t buf = buf_ptr_t::alloc_zeroed(ser.max_block_size());
+            char *data = static_cast<char *>(buf.cache_data());
+            for (uint32_t j = 0; j < buf.block_size().value(); ++j) {
+                data[j] = i == 0 ? static_cast<char>(j % 7) : static_cast<char>(random());
+            }
+            bufs.push_back(std::move(buf));
+        }
+
+        std::vector<buf_write_info_t> infos;
+        for (int i = 0; i < num_blocks; ++i) {
+            infos.push_back(buf_write_info_t(bufs[i].ser_buffer(), bufs[i].block_size(),
+                                             i));
+        }
+        struct : public iocallback_t, public cond_t {
+            void on_io_complete() {
+                pulse();
+            }
+        } cb;
+        std::vector<counted_t<standard_block_token_t> > tokens
+            = ser.block_writes(infos, account.get(), &cb);
+        cb.wait();
+
+        std::vector<index_write_op_t> write_ops;
+        for (int i = 0; i < num_blocks; ++i) {
+            ASSERT_EQ(bufs[i].block_size().ser_value(), tokens[i]->block_size().ser_value());
+            write_ops.push_back(index_write_op_t(i, tokens[i],
+                                                 repli_timestamp_t::distant_past));
+        }
+        new_mutex_in_line_t dummy_acq;
+        ser.index_write(&dummy_acq, []{ }, write_ops);
+
+        for (int i = 0; i < num_blocks; ++i) {
+            check_block_contents(&ser, account.get(), i, bufs[i]);
+        }
+    }
+
+    // The blocks must still be readable after a restart, even with compression
+    // turned off.
+    {
+        standard_serializer_t ser(standard_serializer_t::dynamic_config_t(),
+                                  &file_opener,
+                                  &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+        for (int i = 0; i < num_blocks; ++i) {
+            check_block_contents(&ser, account.get(), i, bufs[i]);
+        }
+    }
+}
+
+
+// Writes `bufs` to the blocks `first_block_id`, `first_block_id + 1`, and so on.
+void write_test_blocks(standard_serializer_t *ser, file_account_t *account,
+                       const std::vector<buf_ptr_t> &bufs, block_id_t first_block_id) {
+    std::vector<buf_write_info_t> infos;
+    for (size_t i = 0; i < bufs.size(); ++i) {
+        infos.push_back(buf_write_info_t(bufs[i].ser_buffer(), bufs[i].block_size(),
+                                         first_block_id + i));
+    }
+    struct : public iocallback_t, public cond_t {
+        void on_io_complete() {
+            pulse();
+        }
+    } cb;
+    std::vector<counted_t<standard_block_token_t> > tokens
+        = ser->block_writes(infos, account, &cb);
+    cb.wait();
+
+    std::vector<index_write_op_t> write_ops;
+    for (size_t i = 0; i < bufs.size(); ++i) {
+        write_ops.push_back(index_write_op_t(first_block_id + i, tokens[i],
+                                             repli_timestamp_t::distant_past));
+    }
+    new_mutex_in_line_t dummy_acq;
+    ser->index_write(&dummy_acq, []{ }, write_ops);
+}
+
+std::vector<buf_ptr_t> make_test_bufs(standard_serializer_t *ser, size_t count,
+                                      char fill) {
+    std::vector<buf_ptr_t> bufs;
+    for (size_t i = 0; i < count; ++i) {
+        buf_ptr_t buf = buf_ptr_t::alloc_zeroed(ser->max_block_size());
+        memset(buf.cache_data(), fill + static_cast<char>(i), buf.block_size().value());
+        bufs.push_back(std::move(buf));
+    }
+    return bufs;
+}
+
+TPTEST(SerializerTest, LbaSnapshot, 4) {
+    mock_file_opener_t file_opener;
+    standard_serializer_t::create(&file_opener, standard_serializer_t::static_config_t());
+    standard_serializer_t::dynamic_config_t snapshot_config;
+    snapshot_config.lba_snapshot = true;
+
+    const block_id_t num_blocks = 100;
+    std::vector<buf_ptr_t> expected;
+    {
+        standard_serializer_t ser(snapshot_config, &file_opener,
+                                  &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+        expected = make_test_bufs(&ser, num_blocks, 'a');
+        write_test_blocks(&ser, account.get(), expected, 0);
+    }
+
+    // This startup loads the index from the snapshot.  We change some blocks and
+    // delete the last one, and shut down again, which writes a new snapshot.
+    {
+        standard_serializer_t ser(snapshot_config, &file_opener,
+                                  &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+        for (block_id_t i = 0; i < num_blocks; ++i) {
+            check_block_contents(&ser, account.get(), i, expected[i]);
+        }
+
+        std::vector<buf_ptr_t> changed = make_test_bufs(&ser, num_blocks / 2, 'A');
+        write_test_blocks(&ser, account.get(), changed, 0);
+        for (block_id_t i = 0; i < changed.size(); ++i) {
+            expected[i] = std::move(changed[i]);
+        }
+
+        std::vector<index_write_op_t> write_ops;
+        write_ops.push_back(index_write_op_t(num_blocks - 1,
+                                             counted_t<standard_block_token_t>()));
+        new_mutex_in_line_t dummy_acq;
+        ser.index_write(&dummy_acq, []{ }, write_ops);
+    }
+
+    // Without snapshots, the snapshot file doesn't get updated and becomes stale.
+    {
+        standard_serializer_t ser(standard_serializer_t::dynamic_config_t(),
+                                  &file_opener,
+                                  &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+        std::vector<buf_ptr_t> changed = make_test_bufs(&ser, 10, '0');
+        write_test_blocks(&ser, account.get(), changed, num_blocks / 2);
+        for (block_id_t i = 0; i < changed.size(); ++i) {
+            expected[num_blocks / 2 + i] = std::move(changed[i]);
+        }
+    }
+
+    // The stale snapshot must not be used.
+    {
+        standard_serializer_t ser(snapshot_config, &file_opener,
+                                  &get_global_perfmon_collection());
+        scoped_ptr_t<file_account_t> account(ser.make_io_account(1));
+        for (block_id_t i = 0; i < num_blocks - 1; ++i) {
+            check_block_contents(&ser, account.get(), i, expected[i]);
+        }
+        ASSERT_FALSE(ser.index_read(num_blocks - 1).has());
+    }
+}
+
 
 }  // namespace unittest
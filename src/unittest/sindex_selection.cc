@@ -0,0 +1,65 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include "rdb_protocol/func.hpp"
+#include "rdb_protocol/minidriver.hpp"
+#include "rdb_protocol/sindex_selection.hpp"
+#include "rdb_protocol/term_walker.hpp"
+#include "unittest/gtest.hpp"
+
+namespace unittest {
+
+counted_t<const ql::func_t> compile_func(ql::r::reql_t &&func) {
+    ql::protob_t<Term> term = func.release_counted();
+    ql::propagate_backtrace(term.get(), ql::backtrace_id_t::empty());
+    ql::compile_env_t compile_env((ql::var_visibility_t()));
+    return make_counted<ql::func_term_t>(&compile_env, term)->eval_to_func(
+        ql::var_scope_t());
+}
+
+TEST(SindexSelection, FieldFunc) {
+    const ql::pb::dummy_var_t x = ql::pb::dummy_var_t::SINDEXCREATE_X;
+    EXPECT_EQ(boost::optional<std::string>("f"), ql::get_field_func_name(
+        compile_func(ql::r::fun(x, ql::r::var(x)[std::string("f")]))));
+    EXPECT_FALSE(ql::get_field_func_name(compile_func(
+        ql::r::fun(x, ql::r::var(x)[std::string("f")][std::string("g")]))));
+    EXPECT_FALSE(ql::get_field_func_name(compile_func(
+        ql::r::fun(x, ql::r::var(x)[std::string("f")] + 1.0))));
+}
+
+TEST(SindexSelection, FilterRanges) {
+    const ql::pb::dummy_var_t x = ql::pb::dummy_var_t::SINDEXCREATE_X;
+    auto field = [&](const char *name) {
+        return ql::r::var(x)[std::string(name)];
+    };
+
+    std::map<std::string, ql::field_range_t> ranges =
+        ql::get_filter_field_ranges(compile_func(ql::r::fun(x,
+            (field("a") == 5.0)
+            && (ql::r::expr(10.0) > field("b"))
+            && (field("b") >= 3.0)
+            && (field("b") > 1.0)
+            && (field("c") < 4.0)
+            && (field("d") == ql::r::null())
+            && (field("e") >= 1.0)
+            && (field("e") <= std::string("z")))));
+
+    ASSERT_EQ(2u, ranges.size());
+    ASSERT_EQ(1u, ranges.count("a"));
+    EXPECT_TRUE(ranges["a"].single_value);
+    EXPECT_TRUE(ranges["a"].range.contains(ql::datum_t(5.0)));
+    EXPECT_FALSE(ranges["a"].range.contains(ql::datum_t(6.0)));
+
+    // `b` is in `[3, 10)`.  `c` and `e` could also be `null` or an object, and `d` is
+    // `null`, so an index read wouldn't find all of the rows for any of them.
+    ASSERT_EQ(1u, ranges.count("b"));
+    EXPECT_FALSE(ranges["b"].single_value);
+    EXPECT_FALSE(ranges["b"].range.contains(ql::datum_t(2.0)));
+    EXPECT_TRUE(ranges["b"].range.contains(ql::datum_t(3.0)));
+    EXPECT_TRUE(ranges["b"].range.contains(ql::datum_t(9.5)));
+    EXPECT_FALSE(ranges["b"].range.contains(ql::datum_t(10.0)));
+
+    // Comparisons below anything but `and` don't constrain the row.
+    EXPECT_TRUE(ql::get_filter_field_ranges(compile_func(ql::r::fun(x,
+        !(field("a") == 5.0)))).empty());
+}
+
+}  // namespace unittest
@@ -0,0 +1,188 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arch/io/disk.hpp"
+#include "rdb_protocol/context.hpp"
+#include "rdb_protocol/env.hpp"
+#include "rdb_protocol/minidriver.hpp"
+#include "rdb_protocol/query_cache.hpp"
+#include "rdb_protocol/shards.hpp"
+#include "stl_utils.hpp"
+#include "unittest/gtest.hpp"
+#include "unittest/query_utils.hpp"
+#include "unittest/unittest_utils.hpp"
+
+namespace unittest {
+
+ql::datum_t make_sort_row(int i, int mod) {
+    std::map<datum_string_t, ql::datum_t> row;
+    row[datum_string_t("k")] = ql::datum_t(static_cast<double>(i % mod));
+    row[datum_string_t("i")] = ql::datum_t(static_cast<double>(i));
+    return ql::datum_t(std::move(row));
+}
+
+/* `r.range(num_rows).map(x => {k: x % mod, i: x}).order_by(r.asc('k'))`, or with
+`r.desc('k')`.  With `as_array` the rows are coerced to an array before sorting. */
+std::string order_by_json(int num_rows, int mod, bool desc, bool as_array) {
+    std::string rows = strprintf(
+        "[38,[[173,[%d]],[69,[[2,[3]],{\"k\":[28,[[10,[3]],%d]],\"i\":[10,[3]]}]]]]",
+        num_rows, mod);
+    if (as_array) {
+        rows = "[51,[" + rows + ",\"array\"]]";
+    }
+    return strprintf("[41,[%s,[%d,[\"k\"]]]]",
+                     rows.c_str(), static_cast<int>(desc ? Term::DESC : Term::ASC));
+}
+
+/* The rows of `order_by_json()`, sorted the way `order_by` is supposed to: rows with
+the same `k` stay in the order they came in. */
+std::vector<ql::datum_t> stable_sorted_rows(int num_rows, int mod, bool desc) {
+    std::vector<ql::datum_t> rows;
+    for (int i = 0; i < num_rows; ++i) {
+        rows.push_back(make_sort_row(i, mod));
+    }
+    std::stable_sort(rows.begin(), rows.end(),
+                     [desc](const ql::datum_t &l, const ql::datum_t &r) {
+                         const int cmp = l.get_field("k").cmp(r.get_field("k"));
+                         return desc ? cmp > 0 : cmp < 0;
+                     });
+    return rows;
+}
+
+TPTEST(SortDatumStream, Spill) {
+    temp_directory_t temp_dir;
+    recreate_temporary_directory(temp_dir.path());
+    io_backender_t io_backender(file_direct_io_mode_t::buffered_desired);
+    rdb_context_t ctx(nullptr, nullptr, nullptr,
+                      boost::shared_ptr<semilattice_readwrite_view_t<
+                          auth_semilattice_metadata_t> >(),
+                      &get_global_perfmon_collection(), std::string(),
+                      &io_backender, temp_dir.path());
+    ql::query_cache_t query_cache(&ctx, ip_and_port_t(),
+                                  ql::return_empty_normal_batches_t::NO);
+    int64_t token = 1;
+    for (bool desc : {false, true}) {
+        // With an array limit of ten rows the sort goes to disk after the eleventh
+        // row, and with a memory limit of one byte every row is a run of its own.
+        // The result is a stream, even though it starts out in memory.
+        std::vector<ql::datum_t> rows = run_json_stream_query(
+            &query_cache, token++,
+            "[1," + order_by_json(500, 7, desc, false)
+            + ",{\"array_limit\":10,\"memory_limit\":1}]");
+        ASSERT_EQ(stable_sorted_rows(500, 7, desc), rows);
+
+        // Fewer rows than the array limit are sorted in memory, but still come back
+        // as a stream.
+        rows = run_json_stream_query(
+            &query_cache, token++,
+            "[1," + order_by_json(50, 7, desc, false) + ",{}]");
+        ASSERT_EQ(stable_sorted_rows(50, 7, desc), rows);
+    }
+
+    // Sorting an array never goes to disk, and gives an array.
+    Response res = run_json_query(
+        &query_cache, token++, "[1," + order_by_json(10, 3, false, true) + ",{}]");
+    ASSERT_EQ(Response::SUCCESS_ATOM, res.type());
+    ql::datum_t array = response_datum(res);
+    const std::vector<ql::datum_t> expected = stable_sorted_rows(10, 3, false);
+    ASSERT_EQ(expected.size(), array.arr_size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], array.get(i));
+    }
+}
+
+TPTEST(SortDatumStream, NoSpill) {
+    // Without a data directory, sorting a stream gives an array, which has to fit into
+    // the array limit.
+    rdb_context_t ctx;
+    ql::query_cache_t query_cache(&ctx, ip_and_port_t(),
+                                  ql::return_empty_normal_batches_t::NO);
+    Response res = run_json_query(
+        &query_cache, 1, "[1," + order_by_json(50, 7, true, false) + ",{}]");
+    ASSERT_EQ(Response::SUCCESS_ATOM, res.type());
+    ql::datum_t array = response_datum(res);
+    const std::vector<ql::datum_t> expected = stable_sorted_rows(50, 7, true);
+    ASSERT_EQ(expected.size(), array.arr_size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], array.get(i));
+    }
+
+    res = run_json_query(&query_cache, 2,
+        "[1," + order_by_json(50, 7, true, false) + ",{\"array_limit\":10}]");
+    EXPECT_EQ(Response::RUNTIME_ERROR, res.type());
+}
+
+// The rows of a table shard with their keys, in the order they are read in.
+typedef std::vector<std::pair<store_key_t, ql::datum_t> > shard_rows_t;
+
+/* Runs the `top_k_wire_func_t` terminal on each of `shards` and unshards the results in
+the order of `shards`. */
+ql::datum_t run_top_k(ql::env_t *env,
+                      const ql::top_k_wire_func_t &tk,
+                      const std::vector<shard_rows_t> &shards) {
+    std::vector<ql::result_t> results(shards.size());
+    for (size_t i = 0; i < shards.size(); ++i) {
+        scoped_ptr_t<ql::accumulator_t> acc = ql::make_terminal(tk);
+        for (auto it = shards[i].begin(); it != shards[i].end(); ++it) {
+            ql::groups_t groups;
+            groups[ql::datum_t()] = ql::datums_t{it->second};
+            acc->operator()(env, &groups, it->first, ql::datum_t());
+        }
+        acc->finish(&results[i]);
+    }
+    std::vector<ql::result_t *> result_ptrs;
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        result_ptrs.push_back(&*it);
+    }
+    scoped_ptr_t<ql::accumulator_t> unsharder = ql::make_terminal(tk);
+    unsharder->unshard(env, store_key_t::max(), result_ptrs);
+    ql::result_t unsharded;
+    unsharder->finish(&unsharded);
+
+    scoped_ptr_t<ql::eager_acc_t> eager = ql::make_eager_terminal(tk);
+    eager->add_res(env, &unsharded);
+    return eager->finish_eager(ql::backtrace_id_t::empty(), false,
+                               ql::configured_limits_t::unlimited)->as_datum();
+}
+
+TPTEST(SortDatumStream, TopKShards) {
+    cond_t interruptor;
+    ql::env_t env(&interruptor, ql::return_empty_normal_batches_t::NO,
+                  reql_version_t::LATEST);
+    ql::sym_t x(1);
+    ql::top_k_wire_func_t tk;
+    tk.n = 5;
+    tk.directions.push_back(sorting_t::ASCENDING);
+    tk.funcs.push_back(ql::wire_func_t(ql::r::var(x)["k"].release_counted(),
+                                       make_vector(x), ql::backtrace_id_t::empty()));
+
+    // Rows 0 to 19 with `k` 0 for the first ten and 1 for the rest, split between two
+    // shards by parity and read in descending key order, so that the positions on
+    // each shard disagree with the keys.
+    std::vector<shard_rows_t> shards(2);
+    std::vector<ql::datum_t> expected;
+    for (int i = 19; i >= 0; --i) {
+        std::map<datum_string_t, ql::datum_t> row;
+        row[datum_string_t("k")] = ql::datum_t(static_cast<double>(i / 10));
+        row[datum_string_t("i")] = ql::datum_t(static_cast<double>(i));
+        shards[i % 2].push_back(std::make_pair(store_key_t(strprintf("%02d", i)),
+                                               ql::datum_t(std::move(row))));
+        if (i < 5) {
+            expected.insert(expected.begin(), shards[i % 2].back().second);
+        }
+    }
+
+    // Ties are broken by the key, whichever order the shards answer in.
+    ql::datum_t rows = run_top_k(&env, tk, shards);
+    ASSERT_EQ(expected.size(), rows.arr_size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], rows.get(i));
+    }
+    std::swap(shards[0], shards[1]);
+    EXPECT_EQ(rows, run_top_k(&env, tk, shards));
+}
+
+}  // namespace unittest
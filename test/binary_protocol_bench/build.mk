@@ -0,0 +1,18 @@
+# Copyright 2010-2015 RethinkDB, all rights reserved.
+
+BINARY_PROTOCOL_BENCH_SRC_DIR = $(TOP)/test/binary_protocol_bench
+BINARY_PROTOCOL_BENCH_BUILD_DIR = $(BUILD_DIR)/tests/binary_protocol_bench
+BINARY_PROTOCOL_BENCH = $(BINARY_PROTOCOL_BENCH_BUILD_DIR)/binary_protocol_bench
+
+$(BINARY_PROTOCOL_BENCH): $(BINARY_PROTOCOL_BENCH_SRC_DIR)/main.cc
+	$P CC
+	mkdir -p $(dir $@)
+	$(CXX) $(CXXFLAGS) $(LDFLAGS) -std=gnu++0x -O2 -o $@ $<
+
+.PHONY: binary-protocol-bench-make
+binary-protocol-bench-make: $(BINARY_PROTOCOL_BENCH)
+
+.PHONY: binary-protocol-bench-clean
+binary-protocol-bench-clean:
+	$P RM $(BINARY_PROTOCOL_BENCH_BUILD_DIR)
+	rm -rf $(BINARY_PROTOCOL_BENCH_BUILD_DIR)
@@ -0,0 +1,391 @@
+// Copyright 2010-2015 RethinkDB, all rights reserved.
+
+// A small client for the BINARY protocol (see `ql2.proto`) that measures how many
+// point gets per second a server can answer.  It only depends on POSIX sockets, so
+// it also serves as a reference for decoding BINARY responses.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint32_t V0_4 = 0x400c2d20;
+const uint32_t PROTOCOL_JSON = 0x7e6970c7;
+const uint32_t PROTOCOL_BINARY = 0x2b7e94d1;
+
+const int32_t SUCCESS_ATOM = 1;
+const int32_t SUCCESS_SEQUENCE = 2;
+const int32_t SUCCESS_PARTIAL = 3;
+
+/* The decoded form of a datum. */
+struct datum_t {
+    enum type_t { NUL, BOOL, NUM, STR, BINARY, ARRAY, OBJECT, MINVAL, MAXVAL };
+    datum_t() : type(NUL), b(false), num(0) { }
+    type_t type;
+    bool b;
+    double num;
+    std::string str;  // For STR and BINARY
+    std::vector<datum_t> array;
+    std::map<std::string, datum_t> object;
+};
+
+/* Decodes the format of `src/rdb_protocol/serialize_datum.cc`. */
+class decoder_t {
+public:
+    decoder_t(const char *data, size_t size) : p_(data), end_(data + size) { }
+
+    bool done() const { return p_ == end_; }
+
+    uint8_t read_u8() {
+        need(1);
+        return static_cast<uint8_t>(*p_++);
+    }
+
+    int32_t read_i32() {
+        need(4);
+        int32_t res;
+        memcpy(&res, p_, 4);
+        p_ += 4;
+        return res;
+    }
+
+    uint64_t read_varint() {
+        uint64_t res = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = read_u8();
+            res |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return res;
+            }
+        }
+        throw std::runtime_error("varint too long");
+    }
+
+    std::string read_string() {
+        const uint64_t size = read_varint();
+        need(size);
+        std::string res(p_, size);
+        p_ += size;
+        return res;
+    }
+
+    datum_t read_datum() {
+        datum_t res;
+        const uint8_t type = read_u8();
+        switch (type) {
+        case 1:  // R_ARRAY
+            res.type = datum_t::ARRAY;
+            for (uint64_t n = read_varint(); n > 0; --n) {
+                res.array.push_back(read_datum());
+            }
+            break;
+        case 2:  // R_BOOL
+            res.type = datum_t::BOOL;
+            res.b = read_u8() != 0;
+            break;
+        case 3:  // R_NULL
+            break;
+        case 4:  // DOUBLE
+            res.type = datum_t::NUM;
+            need(8);
+            memcpy(&res.num, p_, 8);
+            p_ += 8;
+            break;
+        case 5:  // R_OBJECT
+            res.type = datum_t::OBJECT;
+            for (uint64_t n = read_varint(); n > 0; --n) {
+                std::string key = read_string();
+                res.object[key] = read_datum();
+            }
+            break;
+        case 6:  // R_STR
+            res.type = datum_t::STR;
+            res.str = read_string();
+            break;
+        case 7:  // INT_NEGATIVE
+            res.type = datum_t::NUM;
+            res.num = -static_cast<double>(read_varint());
+            break;
+        case 8:  // INT_POSITIVE
+            res.type = datum_t::NUM;
+            res.num = static_cast<double>(read_varint());
+            break;
+        case 9:  // R_BINARY
+            res.type = datum_t::BINARY;
+            res.str = read_string();
+            break;
+        case 10:  // BUF_R_ARRAY
+        case 11:  // BUF_R_OBJECT
+            read_buffer_backed(type == 11, &res);
+            break;
+        case 13:
+            res.type = datum_t::MINVAL;
+            break;
+        case 14:
+            res.type = datum_t::MAXVAL;
+            break;
+        default:
+            throw std::runtime_error("unknown datum type");
+        }
+        return res;
+    }
+
+private:
+    void need(uint64_t n) const {
+        if (static_cast<uint64_t>(end_ - p_) < n) {
+            throw std::runtime_error("truncated response");
+        }
+    }
+
+    // Buffer-backed arrays and objects have an offset table that allows random
+    // access to their elements.  We read the elements in order, so we skip it.
+    void read_buffer_backed(bool is_object, datum_t *out) {
+        const uint64_t inner_size = read_varint();
+        need(inner_size);
+        const char *const end = p_ + inner_size;
+        const uint64_t num_elements = read_varint();
+        size_t offset_size = 8;
+        if (inner_size <= 0xff) {
+            offset_size = 1;
+        } else if (inner_size <= 0xffff) {
+            offset_size = 2;
+        } else if (inner_size <= 0xffffffffULL) {
+            offset_size = 4;
+        }
+        if (num_elements > 0) {
+            need((num_elements - 1) * offset_size);
+            p_ += (num_elements - 1) * offset_size;
+        }
+        out->type = is_object ? datum_t::OBJECT : datum_t::ARRAY;
+        for (uint64_t i = 0; i < num_elements; ++i) {
+            if (is_object) {
+                std::string key = read_string();
+                out->object[key] = read_datum();
+            } else {
+                out->array.push_back(read_datum());
+            }
+        }
+        if (p_ != end) {
+            throw std::runtime_error("inconsistent buffer-backed datum size");
+        }
+    }
+
+    const char *p_;
+    const char *const end_;
+};
+
+void write_all(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t res = write(fd, p, size);
+        if (res <= 0) {
+            throw std::runtime_error("write failed");
+        }
+        p += res;
+        size -= res;
+    }
+}
+
+void read_all(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t res = read(fd, p, size);
+        if (res <= 0) {
+            throw std::runtime_error("connection closed");
+        }
+        p += res;
+        size -= res;
+    }
+}
+
+int connect_to(const char *host, int port, const std::string &auth_key,
+               uint32_t protocol) {
+    struct addrinfo hints, *addrs;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    const std::string port_str = std::to_string(port);
+    if (getaddrinfo(host, port_str.c_str(), &hints, &addrs) != 0) {
+        throw std::runtime_error("could not resolve host");
+    }
+    int fd = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+    if (fd < 0 || connect(fd, addrs->ai_addr, addrs->ai_addrlen) != 0) {
+        freeaddrinfo(addrs);
+        throw std::runtime_error("could not connect");
+    }
+    freeaddrinfo(addrs);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // All integers are little-endian on the wire, like on the hosts we run on.
+    const uint32_t key_size = auth_key.size();
+    write_all(fd, &V0_4, sizeof(V0_4));
+    write_all(fd, &key_size, sizeof(key_size));
+    write_all(fd, auth_key.data(), auth_key.size());
+    write_all(fd, &protocol, sizeof(protocol));
+
+    std::string reply;
+    char c;
+    do {
+        read_all(fd, &c, 1);
+        if (c != '\0') {
+            reply.push_back(c);
+        }
+    } while (c != '\0');
+    if (reply != "SUCCESS") {
+        throw std::runtime_error("handshake failed: " + reply);
+    }
+    return fd;
+}
+
+void send_query(int fd, int64_t token, const std::string &query) {
+    std::string msg;
+    const uint32_t size = query.size();
+    msg.append(reinterpret_cast<const char *>(&token), sizeof(token));
+    msg.append(reinterpret_cast<const char *>(&size), sizeof(size));
+    msg.append(query);
+    write_all(fd, msg.data(), msg.size());
+}
+
+void read_response(int fd, int64_t *token_out, std::string *body_out) {
+    uint32_t size;
+    read_all(fd, token_out, sizeof(*token_out));
+    read_all(fd, &size, sizeof(size));
+    body_out->resize(size);
+    if (size > 0) {
+        read_all(fd, &(*body_out)[0], size);
+    }
+}
+
+/* Decodes a BINARY response and checks that it isn't an error. */
+void check_binary_response(const std::string &body) {
+    decoder_t d(body.data(), body.size());
+    const int32_t type = d.read_i32();
+    d.read_i32();  // error type
+    std::vector<datum_t> results;
+    for (uint64_t n = d.read_varint(); n > 0; --n) {
+        results.push_back(d.read_datum());
+    }
+    for (uint64_t n = d.read_varint(); n > 0; --n) {
+        d.read_varint();
+    }
+    d.read_datum();  // backtrace
+    d.read_datum();  // profile
+    if (!d.done()) {
+        throw std::runtime_error("trailing data in response");
+    }
+    if (type != SUCCESS_ATOM && type != SUCCESS_SEQUENCE && type != SUCCESS_PARTIAL) {
+        const std::string message =
+            !results.empty() && results[0].type == datum_t::STR
+            ? results[0].str : "unknown error";
+        throw std::runtime_error("query failed: " + message);
+    }
+}
+
+double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [--host HOST] [--port PORT] [--auth KEY] [--db DB] --table TABLE\n"
+            "       [--keys N] [--queries N] [--pipeline N] [--json]\n"
+            "\n"
+            "Runs `r.db(DB).table(TABLE).get(k)` for integer keys `k` in `[0, N)`.\n"
+            "`--pipeline` sets how many queries are in flight at a time, and `--json`\n"
+            "uses the JSON protocol (without parsing the responses) for comparison.\n",
+            name);
+    exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string host = "localhost", auth_key, db = "test", table;
+    int port = 28015;
+    int64_t num_keys = 1000, num_queries = 100000, pipeline = 16;
+    bool use_json = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--json") {
+            use_json = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        const char *value = argv[++i];
+        if (arg == "--host") {
+            host = value;
+        } else if (arg == "--port") {
+            port = atoi(value);
+        } else if (arg == "--auth") {
+            auth_key = value;
+        } else if (arg == "--db") {
+            db = value;
+        } else if (arg == "--table") {
+            table = value;
+        } else if (arg == "--keys") {
+            num_keys = atoll(value);
+        } else if (arg == "--queries") {
+            num_queries = atoll(value);
+        } else if (arg == "--pipeline") {
+            pipeline = atoll(value);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (table.empty() || num_keys <= 0 || num_queries <= 0 || pipeline <= 0) {
+        usage(argv[0]);
+    }
+
+    try {
+        const int fd = connect_to(host.c_str(), port, auth_key,
+                                  use_json ? PROTOCOL_JSON : PROTOCOL_BINARY);
+        // [START, [GET, [[TABLE, [[DB, [db]], table]], key]], {}]
+        const std::string prefix =
+            "[1,[16,[[15,[[14,[\"" + db + "\"]],\"" + table + "\"]],";
+        const std::string suffix = "]],{}]";
+
+        int64_t sent = 0, received = 0;
+        std::string body;
+        const double start = now();
+        while (received < num_queries) {
+            while (sent < num_queries && sent - received < pipeline) {
+                send_query(fd, sent,
+                           prefix + std::to_string(sent % num_keys) + suffix);
+                ++sent;
+            }
+            int64_t token;
+            read_response(fd, &token, &body);
+            if (!use_json) {
+                check_binary_response(body);
+            }
+            ++received;
+        }
+        const double elapsed = now() - start;
+        printf("%lld queries in %.3f s: %.0f queries/s\n",
+               static_cast<long long>(received), elapsed, received / elapsed);
+        close(fd);
+    } catch (const std::exception &e) {
+        fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
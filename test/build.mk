@@ -1,5 +1,6 @@
 
 include $(TOP)/test/protobuf_test/build.mk
+include $(TOP)/test/binary_protocol_bench/build.mk
 
 .PHONY: test-deps
 test-deps: $(BUILD_DIR)/rethinkdb $(BUILD_DIR)/rethinkdb-unittest web-assets rb-driver py-driver